@@ -82,6 +82,9 @@ namespace DBP_Option
 		cycles_scale,
 		cycle_limit,
 		perfstats,
+		frame_pipeline,
+		render_thread,
+		skip_unchanged,
 		// Video
 		machine,
 		cga,
@@ -108,6 +111,12 @@ namespace DBP_Option
 		modem,
 		cpu_type,
 		cpu_core,
+		#if defined(C_DYNREC)
+		dynrec_cache,
+		dynrec_profile,
+		dynrec_fpu,
+		#endif
+		zip_cache,
 		bootos_ramdisk,
 		bootos_dfreespace,
 		bootos_forcenormal,
@@ -263,11 +272,13 @@ static retro_core_option_v2_definition option_defs[DBP_Option::_OPTIONS_TOTAL] =
 		"Save States Support", NULL,
 		"Make sure to test it in each game before using it. Complex late era DOS games might have problems." "\n"
 		"Be aware that states saved with different video, CPU or memory settings are not loadable." "\n"
-		"Rewind support comes at a high performance cost and needs at least 40MB of rewind buffer.", NULL,
+		"Rewind support comes at a high performance cost and needs at least 40MB of rewind buffer." "\n"
+		"Fast rewind keeps the memory history inside the core, states made with it can only be loaded until the core is closed.", NULL,
 		DBP_OptionCat::General,
 		{
 			{ "on",       "Enable save states" },
 			{ "rewind",   "Enable save states with rewind" },
+			{ "fastrewind", "Enable save states with fast rewind" },
 			{ "disabled", "Disabled" },
 		},
 		"on"
@@ -601,6 +612,42 @@ static retro_core_option_v2_definition option_defs[DBP_Option::_OPTIONS_TOTAL] =
 		},
 		"none"
 	},
+	{
+		"dosbox_pure_frame_pipeline",
+		"Advanced > Pipelined Emulation Thread", NULL,
+		"Let the emulation thread run one frame ahead while the frontend presents the previous frame." "\n"
+		"This gives demanding games more headroom on devices with few CPU cores at the cost of one frame of input latency.", NULL,
+		DBP_OptionCat::Performance,
+		{
+			{ "false", "Off" },
+			{ "true", "On" },
+		},
+		"false"
+	},
+	{
+		"dosbox_pure_render_thread",
+		"Advanced > Threaded Video Conversion", NULL,
+		"Convert the emulated screen into the output image on a separate thread while the emulation continues with the next scanlines." "\n"
+		"Only used for 8, 15 and 16-bit color modes of 640x480 and above, it can help such SVGA games on devices with spare CPU cores.", NULL,
+		DBP_OptionCat::Performance,
+		{
+			{ "false", "Off" },
+			{ "true", "On" },
+		},
+		"false"
+	},
+	{
+		"dosbox_pure_skip_unchanged",
+		"Advanced > Skip Unchanged Scanlines", NULL,
+		"Track writes to video memory and only redraw scanlines of VGA and SVGA graphics modes that changed since the previous frame." "\n"
+		"Frames without any change are reported to the frontend as duplicates. This makes mostly static screens very cheap to emulate.", NULL,
+		DBP_OptionCat::Performance,
+		{
+			{ "false", "Off" },
+			{ "true", "On" },
+		},
+		"false"
+	},
 
 	// Video
 	{
@@ -948,6 +995,44 @@ static retro_core_option_v2_definition option_defs[DBP_Option::_OPTIONS_TOTAL] =
 		"normal"
 		#endif
 	},
+	#if defined(C_DYNREC)
+	{
+		"dosbox_pure_dynrec_cache",
+		"Advanced > Dynamic Core Cache Size", NULL,
+		"Amount of memory for translated code of the dynamic CPU core." "\n"
+		"When it is full, code that has not been running recently gets replaced first. Large games that run lots of different code can stutter less with a bigger cache. Changes apply when the dynamic core is started the next time.", NULL,
+		DBP_OptionCat::System,
+		{ { "4", "4MB" }, { "8", "8MB (default)" }, { "16", "16MB" }, { "32", "32MB" } },
+		"8"
+	},
+	{
+		"dosbox_pure_dynrec_profile",
+		"Advanced > Remember Translated Code", NULL,
+		"Store which code the dynamic CPU core translated in a file next to the save game when closing the content." "\n"
+		"On the next start, known code gets translated as a whole when it first runs which reduces stutter while a game warms up. Only used while the game does not use paging.", NULL,
+		DBP_OptionCat::System,
+		{ { "false", "Off (default)" }, { "true", "On" } },
+		"false"
+	},
+	{
+		"dosbox_pure_dynrec_fpu",
+		"Advanced > Dynamic Core FPU", NULL,
+		"How the dynamic CPU core runs floating point instructions." "\n"
+		"Host FPU keeps values in registers of the host CPU from one instruction to the next, helper functions handle every instruction on its own. Both calculate with the same precision, so the helper functions are only a fallback for games that have problems. Host FPU is available on ARM64 and x86-64.", NULL,
+		DBP_OptionCat::System,
+		{ { "true", "Host FPU (default)" }, { "false", "Helper functions" } },
+		"true"
+	},
+	#endif
+	{
+		"dosbox_pure_zip_cache",
+		"Advanced > ZIP Decompression Cache", NULL,
+		"Amount of memory used per mounted ZIP file to keep recently decompressed data." "\n"
+		"This speeds up loading when games read the same files repeatedly or seek around in large files. While a file is read sequentially, the following data gets decompressed ahead of time on another thread.", NULL,
+		DBP_OptionCat::System,
+		{ { "0", "Off" }, { "4", "4MB" }, { "8", "8MB (default)" }, { "16", "16MB" }, { "32", "32MB" }, { "64", "64MB" } },
+		"8"
+	},
 	{
 		"dosbox_pure_bootos_ramdisk",
 		"Advanced > OS Disk Modifications (restart required)", NULL,
@@ -42,6 +42,8 @@
 #include <string>
 #include <sstream>
 
+#include "include/dbp_simd.h"
+
 // RETROARCH AUDIO/VIDEO
 #if defined(GEKKO) || defined(MIYOO) // From RetroArch/config.def.h
 #define DBP_DEFAULT_SAMPLERATE 32000.0
@@ -58,9 +60,13 @@ static retro_system_av_info av_info;
 
 // DOSBOX STATE
 static enum DBP_State : Bit8u { DBPSTATE_BOOT, DBPSTATE_EXITED, DBPSTATE_SHUTDOWN, DBPSTATE_REBOOT, DBPSTATE_FIRST_FRAME, DBPSTATE_RUNNING } dbp_state;
-static enum DBP_SerializeMode : Bit8u { DBPSERIALIZE_STATES, DBPSERIALIZE_REWIND, DBPSERIALIZE_DISABLED } dbp_serializemode;
+static enum DBP_SerializeMode : Bit8u { DBPSERIALIZE_STATES, DBPSERIALIZE_DISABLED, DBPSERIALIZE_REWIND, DBPSERIALIZE_FASTREWIND } dbp_serializemode; // rewind modes must be last
 static bool dbp_game_running, dbp_pause_events, dbp_paused_midframe, dbp_frame_pending, dbp_biosreboot, dbp_system_cached, dbp_system_scannable, dbp_refresh_memmaps;
 static bool dbp_optionsupdatecallback, dbp_reboot_set64mem, dbp_use_network, dbp_had_game_running, dbp_strict_mode, dbp_legacy_save, dbp_wasloaded, dbp_skip_c_mount;
+static bool dbp_pipeline, dbp_frame_ahead, dbp_emu_ahead; // emulation thread may run one frame ahead, frame_ahead is the main thread view, emu_ahead the emulation thread view
+static bool dbp_pause_ahead; // a pause answered a frame the emulation thread ran ahead of, the next retro_run still submits its audio and image
+static Bit8u dbp_pause_ahead_buffer;
+static Bit32u dbp_pause_ahead_serial;
 static signed char dbp_menu_time, dbp_conf_loading, dbp_reboot_machine;
 static Bit8u dbp_alphablend_base;
 static float dbp_auto_target, dbp_last_fastforward;
@@ -70,17 +76,23 @@ static retro_throttle_state dbp_throttle;
 static std::string dbp_crash_message;
 static std::string dbp_content_path;
 static std::string dbp_content_name;
+static std::string dbp_dynrec_profile; // path of the translation profile file of the dynamic core, empty if disabled
 static retro_time_t dbp_boot_time;
 static size_t dbp_serializesize;
 static Bit16s dbp_content_year, dbp_forcefps;
 
 // DOSBOX AUDIO/VIDEO
-static Bit8u buffer_active, dbp_overscan;
+static Bit8u buffer_active, buffer_finished, buffer_clean, dbp_overscan, dbp_fpsboost = 1; // buffer_clean is buffer index + 1 of a frame without anything drawn over it
+static Bit32u buffer_serial, buffer_finished_serial, buffer_submitted_serial = (Bit32u)-1; // counts finished frames to report unchanged frames to the frontend
 static bool dbp_doublescan, dbp_padding;
 static struct DBP_Buffer { Bit32u *video, width, height, cap, pad_x, pad_y, border_color; float ratio; } dbp_buffers[3];
 #ifndef DBP_STANDALONE
 static struct DBP_Audio { int16_t* audio; Bit32u length; } dbp_audio[2];
 static Bit8u dbp_audio_active;
+static Bit32u dbp_audio_ahead; // samples mixed by an emulation thread that ran ahead
+static Bit32u dbp_audio_pause_ahead; // samples of the frame answered by a pause (see dbp_pause_ahead)
+static Bit8u dbp_audio_pause_ahead_active;
+static struct DBP_AudioFrame { double samples, boost; } dbp_audio_frame; // set by retro_run before each frame, the emulation thread mixing ahead must not read av_info or dbp_throttle
 #endif
 static double dbp_audio_remain;
 static struct retro_hw_render_callback dbp_hw_render;
@@ -243,7 +255,9 @@ static retro_input_state_t        input_state_cb;
 
 // PERF OVERLAY
 static enum DBP_Perf : Bit8u { DBP_PERF_NONE, DBP_PERF_SIMPLE, DBP_PERF_DETAILED } dbp_perf;
-static Bit32u dbp_perf_uniquedraw, dbp_perf_count, dbp_perf_totaltime;
+static Bit32u dbp_perf_uniquedraw, dbp_perf_count, dbp_perf_totaltime, dbp_perf_latency, dbp_perf_latencycount;
+static Bit32u dbp_input_seq, dbp_input_seq_frame, dbp_input_seq_finished, dbp_latency_seq; // input latency is measured from polling until the frame that processed it gets presented
+static retro_time_t dbp_latency_start;
 //#define DBP_ENABLE_WAITSTATS
 #ifdef DBP_ENABLE_WAITSTATS
 static Bit32u dbp_wait_pause, dbp_wait_finish, dbp_wait_paused, dbp_wait_continue;
@@ -527,7 +541,36 @@ static void DBP_ReportCoreMemoryMaps()
 	dbp_refresh_memmaps = false;
 }
 
-enum DBP_ThreadCtlMode { TCM_PAUSE_FRAME, TCM_ON_PAUSE_FRAME, TCM_RESUME_FRAME, TCM_FINISH_FRAME, TCM_ON_FINISH_FRAME, TCM_NEXT_FRAME, TCM_SHUTDOWN, TCM_ON_SHUTDOWN };
+#ifndef DBP_STANDALONE
+static void DBP_SetFrameAudio()
+{
+	if (dbp_throttle.mode == RETRO_THROTTLE_FAST_FORWARD && dbp_throttle.rate < 1)
+		dbp_audio_frame.samples = -1; // mix all available
+	else if (dbp_throttle.mode == RETRO_THROTTLE_FAST_FORWARD || dbp_throttle.mode == RETRO_THROTTLE_SLOW_MOTION || dbp_throttle.rate < 1)
+		dbp_audio_frame.samples = (av_info.timing.sample_rate / av_info.timing.fps);
+	else
+		dbp_audio_frame.samples = (av_info.timing.sample_rate / dbp_throttle.rate);
+	dbp_audio_frame.boost = dbp_fpsboost;
+}
+
+static Bit32u DBP_MixFrameAudio()
+{
+	Bit32u haveSamples = DBP_MIXER_DoneSamplesCount(), mixSamples = 0;
+	double numSamples = (dbp_audio_frame.samples < 0 ? haveSamples : dbp_audio_frame.samples + dbp_audio_remain);
+	if (dbp_audio_frame.boost > 1) numSamples /= (dbp_audio_frame.boost*.9); // Without *.9 audio can end up skipping
+	if (numSamples && haveSamples && dbp_audio_remain != -1) // stretch on underrun (allows frontend to catch up with the emulation)
+	{
+		mixSamples = (numSamples > haveSamples ? haveSamples : (Bit32u)numSamples);
+		dbp_audio_remain = ((numSamples <= mixSamples || numSamples > haveSamples) ? 0.0 : (numSamples - mixSamples));
+		DBP_Audio& aud = dbp_audio[dbp_audio_active ^= 1];
+		if (mixSamples > aud.length) { aud.audio = (int16_t*)realloc(aud.audio, mixSamples * 4); aud.length = mixSamples; }
+		MIXER_CallBack(0, (Bit8u*)aud.audio, mixSamples * 4);
+	}
+	return mixSamples;
+}
+#endif
+
+enum DBP_ThreadCtlMode { TCM_PAUSE_FRAME, TCM_ON_PAUSE_FRAME, TCM_WAIT_PAUSE, TCM_RESUME_FRAME, TCM_FINISH_FRAME, TCM_ON_FINISH_FRAME, TCM_ON_WAIT_AHEAD, TCM_NEXT_FRAME, TCM_SHUTDOWN, TCM_ON_SHUTDOWN };
 static void DBP_ThreadControl(DBP_ThreadCtlMode m)
 {
 	static retro_time_t pausedTimeStart; retro_time_t emuWaitTimeStart;
@@ -536,17 +579,42 @@ static void DBP_ThreadControl(DBP_ThreadCtlMode m)
 	switch (m)
 	{
 		case TCM_PAUSE_FRAME:
-			if (!dbp_frame_pending || dbp_pause_events) goto case_TCM_EMULATION_PAUSED;
+			if (dbp_frame_ahead)
+			{
+				// The emulation thread is running ahead, answer its last finished frame and let it pause at the next opportunity
+				dbp_pause_events = dbp_frame_pending = true;
+				dbp_frame_ahead = false;
+				semDoContinue.Post();
+			}
+			else if (!dbp_frame_pending || dbp_pause_events) goto case_TCM_EMULATION_PAUSED;
 			dbp_pause_events = true;
 			#ifdef DBP_ENABLE_WAITSTATS
-			{ retro_time_t t = time_cb(); semDidPause.Wait(); dbp_wait_pause += (Bit32u)(time_cb() - t); }
+			{ retro_time_t t = time_cb(); DBP_ThreadControl(TCM_WAIT_PAUSE); dbp_wait_pause += (Bit32u)(time_cb() - t); }
 			#else
-			semDidPause.Wait();
+			DBP_ThreadControl(TCM_WAIT_PAUSE);
 			#endif
 			dbp_pause_events = dbp_frame_pending = dbp_paused_midframe;
 			goto case_TCM_EMULATION_PAUSED;
+		case TCM_WAIT_PAUSE:
+			// If the emulation thread decided to run ahead right before dbp_pause_events was set, answer it and wait again
+			// The answered frame is finished and its audio is mixed, keep both for the next retro_run
+			for (semDidPause.Wait(); dbp_emu_ahead; semDidPause.Wait())
+			{
+				DBP_ASSERT(!dbp_pause_ahead);
+				dbp_pause_ahead = true;
+				dbp_pause_ahead_buffer = buffer_finished;
+				dbp_pause_ahead_serial = buffer_finished_serial;
+				#ifndef DBP_STANDALONE
+				dbp_audio_pause_ahead = dbp_audio_ahead;
+				dbp_audio_pause_ahead_active = dbp_audio_active;
+				#endif
+				semDoContinue.Post();
+			}
+			return;
 		case TCM_ON_PAUSE_FRAME:
 			DBP_ASSERT(dbp_pause_events && !dbp_paused_midframe);
+			RENDER_FinishWorker(); // the main thread may access the video buffers and render state while paused
+			if (dbp_emu_ahead) DBP_ThreadControl(TCM_ON_WAIT_AHEAD);
 			dbp_paused_midframe = true;
 			semDidPause.Post();
 			emuWaitTimeStart = time_cb();
@@ -572,8 +640,24 @@ static void DBP_ThreadControl(DBP_ThreadCtlMode m)
 			#endif
 			DBP_ASSERT(!dbp_paused_midframe);
 			dbp_frame_pending = false;
+			dbp_frame_ahead = dbp_emu_ahead;
 			goto case_TCM_EMULATION_PAUSED;
 		case TCM_ON_FINISH_FRAME:
+			RENDER_FinishWorker();
+			if (dbp_emu_ahead) DBP_ThreadControl(TCM_ON_WAIT_AHEAD);
+			buffer_finished = buffer_active;
+			buffer_finished_serial = buffer_serial;
+			dbp_input_seq_finished = dbp_input_seq_frame;
+			if (dbp_pipeline && !dbp_pause_events && !dbp_pause_ahead && dbp_state == DBPSTATE_RUNNING)
+			{
+				// Announce the finished frame and continue with the next one, the main thread answers before the next announcement
+				#ifndef DBP_STANDALONE
+				dbp_audio_ahead = DBP_MixFrameAudio();
+				#endif
+				dbp_emu_ahead = true;
+				semDidPause.Post();
+				return;
+			}
 			semDidPause.Post();
 			emuWaitTimeStart = time_cb();
 			semDoContinue.Wait();
@@ -582,17 +666,25 @@ static void DBP_ThreadControl(DBP_ThreadCtlMode m)
 			dbp_wait_continue += (Bit32u)(time_cb() - emuWaitTimeStart);
 			#endif
 			return;
+		case TCM_ON_WAIT_AHEAD:
+			emuWaitTimeStart = time_cb();
+			semDoContinue.Wait();
+			dbp_emu_waiting += (Bit32u)(time_cb() - emuWaitTimeStart);
+			dbp_emu_ahead = false;
+			return;
 		case TCM_NEXT_FRAME:
 			DBP_ASSERT(!dbp_frame_pending);
 			if (dbp_state == DBPSTATE_EXITED) return;
 			dbp_frame_pending = true;
+			dbp_frame_ahead = false;
 			goto case_TCM_EMULATION_CONTINUES;
 		case TCM_SHUTDOWN:
+			if (dbp_frame_ahead) { dbp_frame_ahead = false; dbp_frame_pending = true; dbp_pause_events = true; semDoContinue.Post(); }
 			if (dbp_frame_pending)
 			{
 				dbp_pause_events = true;
-				semDidPause.Wait();
-				dbp_pause_events = dbp_frame_pending = false;
+				DBP_ThreadControl(TCM_WAIT_PAUSE);
+				dbp_pause_events = dbp_frame_pending = dbp_pause_ahead = false;
 			}
 			if (dbp_state == DBPSTATE_EXITED) return;
 			DBP_DOSBOX_ForceShutdown();
@@ -603,17 +695,19 @@ static void DBP_ThreadControl(DBP_ThreadCtlMode m)
 			} while (dbp_state != DBPSTATE_EXITED);
 			return;
 		case TCM_ON_SHUTDOWN:
+			if (dbp_emu_ahead) DBP_ThreadControl(TCM_ON_WAIT_AHEAD);
 			dbp_state = DBPSTATE_EXITED;
 			dbp_game_running = false;
 			semDidPause.Post();
 			return;
 		case_TCM_EMULATION_PAUSED:
+			if (dbp_frame_ahead) return; // still running
 			if (!pausedTimeStart) pausedTimeStart = time_cb();
 			if (dbp_refresh_memmaps) DBP_ReportCoreMemoryMaps();
 			return;
 		case_TCM_EMULATION_CONTINUES:
 			if (pausedTimeStart) { dbp_paused_work += (Bit32u)(time_cb() - pausedTimeStart); pausedTimeStart = 0; }
-			if (dbp_serializesize && dbp_serializemode != DBPSERIALIZE_REWIND) dbp_serializesize = 0;
+			if (dbp_serializesize && dbp_serializemode < DBPSERIALIZE_REWIND) dbp_serializesize = 0;
 			semDoContinue.Post();
 			return;
 	}
@@ -800,7 +894,7 @@ void DBP_Unmount(char drive)
 			DBP_Unmount(i + 'A');
 }
 
-enum DBP_SaveFileType { SFT_GAMESAVE, SFT_SAVENAMEREDIRECT, SFT_VIRTUALDISK, SFT_DIFFDISK, _SFT_LAST_SAVE_DIRECTORY, SFT_SYSTEMDIR, SFT_NEWOSIMAGE };
+enum DBP_SaveFileType { SFT_GAMESAVE, SFT_SAVENAMEREDIRECT, SFT_VIRTUALDISK, SFT_DIFFDISK, SFT_DYNRECPROFILE, _SFT_LAST_SAVE_DIRECTORY, SFT_SYSTEMDIR, SFT_NEWOSIMAGE };
 static std::string DBP_GetSaveFile(DBP_SaveFileType type, const char** out_filename = NULL, Bit32u* out_diskhash = NULL)
 {
 	std::string res;
@@ -876,6 +970,10 @@ static std::string DBP_GetSaveFile(DBP_SaveFileType type, const char** out_filen
 		{
 			res.append("-CDRIVE.sav");
 		}
+		else if (type == SFT_DYNRECPROFILE)
+		{
+			res.append("-DYNREC.sav");
+		}
 	}
 	else if (type == SFT_NEWOSIMAGE)
 	{
@@ -1255,6 +1353,16 @@ static void DBP_Shutdown()
 	if (control)
 	{
 		DBP_ASSERT(!first_shell); //should have been properly cleaned up
+		#if defined(C_DYNREC)
+		if (!dbp_dynrec_profile.empty())
+		{
+			extern void CPU_Core_Dynrec_SaveProfile(std::vector<Bit8u>& out);
+			std::vector<Bit8u> profile;
+			CPU_Core_Dynrec_SaveProfile(profile);
+			FILE* f = (profile.size() ? fopen_wrap(dbp_dynrec_profile.c_str(), "wb") : NULL);
+			if (f) { fwrite(&profile[0], profile.size(), 1, f); fclose(f); }
+		}
+		#endif
 		CPU_Cycles = 0; // avoid crash due to PIC_TickIndex returning negative number when CPU_Cycles > CPU_CycleMax
 		delete control;
 		control = NULL;
@@ -1504,6 +1612,66 @@ bool GFX_StartUpdate(Bit8u*& pixels, Bitu& pitch)
 	return true;
 }
 
+static void DBP_DoubleWidth(Bit32u* trg, const Bit32u* src, Bit32u srcw)
+{
+	// Works from right to left so trg may be the same line as src
+	Bit32u i = srcw;
+	#if defined(__SSE2__) && __SSE2__
+	for (; i >= 4; i -= 4)
+	{
+		__m128i p = _mm_loadu_si128((const __m128i*)(src + i - 4));
+		_mm_storeu_si128((__m128i*)(trg + i * 2 - 4), _mm_unpackhi_epi32(p, p));
+		_mm_storeu_si128((__m128i*)(trg + i * 2 - 8), _mm_unpacklo_epi32(p, p));
+	}
+	#elif defined(DBP_NEON)
+	for (; i >= 4; i -= 4)
+	{
+		uint32x4_t p = vld1q_u32(src + i - 4);
+		uint32x4x2_t pp = { { p, p } };
+		vst2q_u32(trg + i * 2 - 8, pp);
+	}
+	#endif
+	while (i--) trg[i * 2] = trg[i * 2 + 1] = src[i];
+}
+
+static void DBP_HalveWidth(Bit32u* trg, const Bit32u* src, Bit32u trgw)
+{
+	Bit32u i = 0;
+	#if defined(__SSE2__) && __SSE2__
+	for (; i + 4 <= trgw; i += 4)
+	{
+		__m128 a = _mm_castsi128_ps(_mm_loadu_si128((const __m128i*)(src + i * 2))), b = _mm_castsi128_ps(_mm_loadu_si128((const __m128i*)(src + i * 2 + 4)));
+		_mm_storeu_si128((__m128i*)(trg + i), _mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2,0,2,0))));
+	}
+	#elif defined(DBP_NEON)
+	for (; i + 4 <= trgw; i += 4)
+		vst1q_u32(trg + i, vld2q_u32(src + i * 2).val[0]);
+	#endif
+	for (; i != trgw; i++) trg[i] = src[i * 2];
+}
+
+bool GFX_CanCopyPreviousLines()
+{
+	const DBP_Buffer& prev = dbp_buffers[buffer_active], &buf = dbp_buffers[(buffer_active + 1) % 3];
+	return (buffer_clean == buffer_active + 1 && prev.video && prev.width == buf.width && prev.height == buf.height && prev.pad_x == buf.pad_x && prev.pad_y == buf.pad_y);
+}
+
+void GFX_CopyPreviousLines(Bitu y, Bitu count)
+{
+	// Copy source lines from the previous frame which has already been expanded by doublescan in GFX_EndUpdate
+	const DBP_Buffer& prev = dbp_buffers[buffer_active];
+	DBP_Buffer& buf = dbp_buffers[(buffer_active + 1) % 3];
+	const Bit32u pitch = buf.width, padofs = (pitch * buf.pad_y + buf.pad_x), srcw = (Bit32u)render.src.width;
+	const Bit32u dblw = (dbp_doublescan ? (Bit32u)render.src.dblw : 0), dblh = (dbp_doublescan ? (Bit32u)render.src.dblh : 0);
+	const Bit32u *src = prev.video + padofs + ((pitch * (Bit32u)y) << dblh);
+	Bit32u *trg = buf.video + padofs + pitch * (Bit32u)y;
+	for (; count--; src += (pitch << dblh), trg += pitch)
+	{
+		if (!dblw) memcpy(trg, src, srcw * 4);
+		else DBP_HalveWidth(trg, src, srcw);
+	}
+}
+
 void GFX_EndUpdate(const Bit16u *changedLines)
 {
 	if (!changedLines) return;
@@ -1514,17 +1682,25 @@ void GFX_EndUpdate(const Bit16u *changedLines)
 	DBP_ASSERT(render.scale.outWrite >= (Bit8u*)buf.video && render.scale.outWrite <= (Bit8u*)(buf.video + buf.width * buf.height + (buf.width * buf.pad_y + buf.pad_x) * 4));
 
 	const Bit32u dblw = (Bit32u)render.src.dblw, dblh = (Bit32u)render.src.dblh, srcw = (Bit32u)render.src.width, srch = (Bit32u)render.src.height;
+	const Bit32u border_color = ((buf.pad_x | buf.pad_y) ? (Bit32u)GFX_GetRGB(vga.dac.rgb[vga.attr.overscan_color].red<<2, vga.dac.rgb[vga.attr.overscan_color].green<<2, vga.dac.rgb[vga.attr.overscan_color].blue<<2) : 0);
+	const bool draw_intercept = (dbp_intercept_next && dbp_intercept_next->usegfx());
+	if (changedLines[0] >= srch)
+	{
+		// No line changed since the previous frame, keep showing it unless something needs to be drawn over it
+		if (!draw_intercept && (!(buf.pad_x | buf.pad_y) || border_color == dbp_buffers[buffer_active].border_color)) goto frame_done;
+		GFX_CopyPreviousLines(0, srch);
+	}
 	if (render.aspect)
 	{
 		if (dbp_doublescan && (dblw | dblh))
 		{
 			const Bit32u pitch = buf.width, trgpitch = pitch<<dblh, padofs = (pitch * buf.pad_y + buf.pad_x);
-			for (Bit32u *pVid = buf.video + padofs, *pLine = pVid + (pitch * (srch - 1)), *pTrgRight = pVid + (trgpitch * (srch - 1) + ((srcw - 1) << dblw)); pLine >= pVid; pLine -= pitch, pTrgRight -= trgpitch)
+			// Go from the bottom up, only the first line gets expanded onto itself
+			for (Bit32u *pVid = buf.video + padofs, *pLine = pVid + (pitch * (srch - 1)), *pTrg = pVid + (trgpitch * (srch - 1)); pLine >= pVid; pLine -= pitch, pTrg -= trgpitch)
 			{
-				Bit32u *src = pLine + srcw, *srcEnd = pLine, *trg = pTrgRight;
-				if      (!dblw) for (; src != srcEnd; trg -= 1) trg[0] = trg[pitch] = *(--src);
-				else if (!dblh) for (; src != srcEnd; trg -= 2) trg[0] = trg[1] = *(--src);
-				else            for (; src != srcEnd; trg -= 2) trg[0] = trg[1] = trg[pitch] = trg[pitch+1] = *(--src);
+				if (dblw) DBP_DoubleWidth(pTrg, pLine, srcw);
+				else if (pTrg != pLine) memcpy(pTrg, pLine, srcw * 4);
+				if (dblh) memcpy(pTrg + pitch, pTrg, (srcw << dblw) * 4);
 			}
 		}
 		buf.ratio = (dbp_padding ? (4.0f / 3.0f) : ((srcw<<dblw) / ((srch<<dblh) * (float)render.src.ratio)));
@@ -1538,7 +1714,6 @@ void GFX_EndUpdate(const Bit16u *changedLines)
 
 	if (buf.pad_x | buf.pad_y)
 	{
-		Bit32u border_color = (Bit32u)GFX_GetRGB(vga.dac.rgb[vga.attr.overscan_color].red<<2, vga.dac.rgb[vga.attr.overscan_color].green<<2, vga.dac.rgb[vga.attr.overscan_color].blue<<2);
 		if (border_color != buf.border_color)
 		{
 			buf.border_color = border_color;
@@ -1548,7 +1723,7 @@ void GFX_EndUpdate(const Bit16u *changedLines)
 		}
 	}
 
-	if (dbp_intercept_next && dbp_intercept_next->usegfx())
+	if (draw_intercept)
 	{
 		#ifdef DBP_STANDALONE
 		DBP_Buffer& osdbf = dbp_osdbuf[(buffer_active + 1) % 3];
@@ -1572,7 +1747,10 @@ void GFX_EndUpdate(const Bit16u *changedLines)
 		if (diff) { DBP_FPSCOUNT(dbp_fpscount_gfxend) dbp_perf_uniquedraw++; }
 	}
 	buffer_active = (buffer_active + 1) % 3;
+	buffer_clean = (draw_intercept ? 0 : buffer_active + 1);
+	buffer_serial++;
 
+	frame_done:
 	// frameskip is best to be modified in this function (otherwise it can be off by one)
 	dbp_framecount += 1 + render.frameskip.max;
 	render.frameskip.max = DBP_NeedFrameSkip(true);
@@ -1788,6 +1966,8 @@ void GFX_Events()
 
 	static bool mouse_speed_up, mouse_speed_down;
 	static int mouse_joy_x, mouse_joy_y, hatbits;
+	if (dbp_pipeline && !wasFrameEnd) goto skip_events; // latch input at frame boundaries when running ahead
+	dbp_input_seq_frame = dbp_input_seq;
 	while (dbp_event_queue_read_cursor != dbp_event_queue_write_cursor)
 	{
 		// Read the "Menu Activation Inputs" option and determine which inputs (L3 / Ctrl+Home) are enabled
@@ -1903,6 +2083,7 @@ void GFX_Events()
 		#endif
 	}
 
+	skip_events:
 	GFX_EVENTS_RECURSIVE = false;
 }
 
@@ -1941,6 +2122,8 @@ void DBP_ShowSlowLoading()
 	buffer_active = (buffer_active + (3-1)) % 3; // go back
 	Bit8u* pixels; Bitu pitch; GFX_StartUpdate(pixels, pitch);
 	buffer_active = (buffer_active + 1) % 3; // advance again
+	buffer_clean = 0;
+	buffer_serial++;
 	DBP_BufferDrawing& buf = (DBP_BufferDrawing&)dbp_buffers[buffer_active];
 
 	// Show loading message
@@ -2364,15 +2547,28 @@ static bool check_variables()
 		case 'd': dbp_perf = DBP_PERF_DETAILED; break;
 		default:  dbp_perf = DBP_PERF_NONE; break;
 	}
+	dbp_pipeline = (DBP_Option::Get(DBP_Option::frame_pipeline)[0] == 't');
+	RENDER_SetWorker(DBP_Option::Get(DBP_Option::render_thread)[0] == 't');
+	VGA_SkipUnchangedLines(DBP_Option::Get(DBP_Option::skip_unchanged)[0] == 't');
+	zipDrive::SetCacheSize((Bit32u)atoi(DBP_Option::Get(DBP_Option::zip_cache)) * 1024 * 1024);
+	#if defined(C_DYNREC)
+	extern void CPU_Core_Dynrec_SetCacheSize(Bitu bytes);
+	CPU_Core_Dynrec_SetCacheSize((Bitu)atoi(DBP_Option::Get(DBP_Option::dynrec_cache)) * 1024 * 1024);
+	extern void CPU_Core_Dynrec_SetFPUMode(bool host_fpu);
+	CPU_Core_Dynrec_SetFPUMode(DBP_Option::Get(DBP_Option::dynrec_fpu)[0] == 't');
+	#endif
 	#ifndef DBP_STANDALONE
+	DBP_SerializeMode old_serializemode = dbp_serializemode;
 	switch (DBP_Option::Get(DBP_Option::savestate)[0])
 	{
 		case 'd': dbp_serializemode = DBPSERIALIZE_DISABLED; break;
 		case 'r': dbp_serializemode = DBPSERIALIZE_REWIND; break;
+		case 'f': dbp_serializemode = DBPSERIALIZE_FASTREWIND; break;
 		default: dbp_serializemode = DBPSERIALIZE_STATES; break;
 	}
+	if (dbp_serializemode != old_serializemode) dbp_serializesize = 0; // fast rewind states are much smaller
 	#endif
-	DBPArchive::accomodate_delta_encoding = (dbp_serializemode == DBPSERIALIZE_REWIND);
+	DBPArchive::accomodate_delta_encoding = (dbp_serializemode >= DBPSERIALIZE_REWIND);
 	dbp_conf_loading = DBP_Option::Get(DBP_Option::conf)[0];
 	dbp_menu_time = (char)atoi(DBP_Option::Get(DBP_Option::menu_time));
 
@@ -2724,6 +2920,28 @@ static void init_dosbox(bool forcemenu = false, bool reinit = false, const std::
 		}
 	}
 
+	#if defined(C_DYNREC)
+	// Load the translation profile of the dynamic core, it gets written back in DBP_Shutdown
+	{
+		std::vector<Bit8u> profile;
+		dbp_dynrec_profile.clear();
+		if (!dbp_skip_c_mount && DBP_Option::Get(DBP_Option::dynrec_profile)[0] == 't')
+		{
+			dbp_dynrec_profile = DBP_GetSaveFile(SFT_DYNRECPROFILE);
+			if (FILE* f = fopen_wrap(dbp_dynrec_profile.c_str(), "rb"))
+			{
+				fseek(f, 0, SEEK_END);
+				profile.resize((size_t)ftell(f));
+				fseek(f, 0, SEEK_SET);
+				if (profile.size() && !fread(&profile[0], profile.size(), 1, f)) profile.clear();
+				fclose(f);
+			}
+		}
+		extern void CPU_Core_Dynrec_LoadProfile(const Bit8u* data, Bitu size);
+		CPU_Core_Dynrec_LoadProfile((profile.size() ? &profile[0] : NULL), (Bitu)profile.size());
+	}
+	#endif
+
 	// Detect content year and auto mapping
 	if (newcontent && !reinit)
 	{
@@ -3436,6 +3654,7 @@ void retro_run(void)
 		check_variables(); // can't do this while DOS has crashed (control is NULL)
 
 	// start input update
+	const int input_cursor = dbp_event_queue_write_cursor;
 	input_poll_cb();
 	//input_state_cb(0, RETRO_DEVICE_NONE, 0, 0); // poll keys? 
 	//input_state_cb(0, RETRO_DEVICE_KEYBOARD, 0, RETROK_SPACE); // get latest keyboard callbacks?
@@ -3531,6 +3750,13 @@ void retro_run(void)
 	else
 		{ dbp_intercept->close(); dbp_intercept = dbp_intercept_next; goto recheck_intercept; }
 
+	// track new input to measure how long it takes until a frame that processed it gets presented
+	if (input_cursor != dbp_event_queue_write_cursor)
+	{
+		dbp_input_seq++;
+		if (!dbp_latency_start) { dbp_latency_seq = dbp_input_seq; dbp_latency_start = time_cb(); }
+	}
+
 	// This catches sticky keys due to various frontend/driver issues
 	// For example ALT key can easily get stuck when using ALT-TAB, menu opening or fast forwarding also can get stuck
 	if (dbp_keys_down_count)
@@ -3615,47 +3841,52 @@ void retro_run(void)
 		}
 	}
 
+	dbp_fpsboost = fpsboost;
 	bool skip_emulate = (fpsboost > 1 && (((fpsboost_count++)%fpsboost)!=0)) || DBP_NeedFrameSkip(false);
 	DBP_ThreadControl(skip_emulate ? TCM_PAUSE_FRAME : TCM_FINISH_FRAME);
 
-	Bit32u tpfActual = 0, tpfTarget = 0, tpfDraws = 0;
+	Bit32u tpfActual = 0, tpfTarget = 0, tpfDraws = 0, tpfLatency = 0;
 	#ifdef DBP_ENABLE_WAITSTATS
 	Bit32u waitPause = 0, waitFinish = 0, waitPaused = 0, waitContinue = 0;
 	#endif
+	#if defined(C_DYNREC)
+	Bit32u dynTranslated = 0, dynEvicted = 0, dynSpared = 0, dynInvalidated = 0, dynTraces = 0, dynSmcPage = 0, dynSmcPageCount = 0;
+	#endif
 	if (dbp_perf && dbp_perf_totaltime > 1000000)
 	{
 		tpfActual = dbp_perf_totaltime / dbp_perf_count;
 		tpfTarget = (Bit32u)(1000000.f / render.src.fps);
 		tpfDraws = dbp_perf_uniquedraw;
+		tpfLatency = (dbp_perf_latencycount ? dbp_perf_latency / dbp_perf_latencycount : 0);
 		#ifdef DBP_ENABLE_WAITSTATS
 		waitPause = dbp_wait_pause / dbp_perf_count, waitFinish = dbp_wait_finish / dbp_perf_count, waitPaused = dbp_wait_paused / dbp_perf_count, waitContinue = dbp_wait_continue / dbp_perf_count;
 		dbp_wait_pause = dbp_wait_finish = dbp_wait_paused = dbp_wait_continue = 0;
 		#endif
-		dbp_perf_uniquedraw = dbp_perf_count = dbp_perf_totaltime = 0;
+		#if defined(C_DYNREC)
+		extern void CPU_Core_Dynrec_GetCacheStats(Bit32u& translations, Bit32u& evictions, Bit32u& spared, Bit32u& invalidations, Bit32u& traces, Bit32u& smc_page, Bit32u& smc_page_count);
+		CPU_Core_Dynrec_GetCacheStats(dynTranslated, dynEvicted, dynSpared, dynInvalidated, dynTraces, dynSmcPage, dynSmcPageCount);
+		#endif
+		dbp_perf_uniquedraw = dbp_perf_count = dbp_perf_totaltime = dbp_perf_latency = dbp_perf_latencycount = 0;
 	}
 
 	#ifndef DBP_STANDALONE
-	// mix audio
-	Bit32u haveSamples = DBP_MIXER_DoneSamplesCount(), mixSamples = 0; double numSamples;
-	if (dbp_throttle.mode == RETRO_THROTTLE_FAST_FORWARD && dbp_throttle.rate < 1)
-		numSamples = haveSamples;
-	else if (dbp_throttle.mode == RETRO_THROTTLE_FAST_FORWARD || dbp_throttle.mode == RETRO_THROTTLE_SLOW_MOTION || dbp_throttle.rate < 1)
-		numSamples = (av_info.timing.sample_rate / av_info.timing.fps) + dbp_audio_remain;
-	else
-		numSamples = (av_info.timing.sample_rate / dbp_throttle.rate) + dbp_audio_remain;
-	if (fpsboost > 1) numSamples /= (fpsboost*.9); // Without *.9 audio can end up skipping
-	if (numSamples && haveSamples && dbp_audio_remain != -1) // stretch on underrun (allows frontend to catch up with the emulation)
-	{
-		mixSamples = (numSamples > haveSamples ? haveSamples : (Bit32u)numSamples);
-		dbp_audio_remain = ((numSamples <= mixSamples || numSamples > haveSamples) ? 0.0 : (numSamples - mixSamples));
-		DBP_Audio& aud = dbp_audio[dbp_audio_active ^= 1];
-		if (mixSamples > aud.length) { aud.audio = (int16_t*)realloc(aud.audio, mixSamples * 4); aud.length = mixSamples; }
-		MIXER_CallBack(0, (Bit8u*)aud.audio, mixSamples * 4);
-	}
+	// mix audio (already done by the emulation thread if it is running ahead)
+	// the frame audio parameters are read by the emulation thread when it mixes ahead after TCM_NEXT_FRAME below
+	DBP_SetFrameAudio();
+	const Bit32u mixSamples = (dbp_frame_ahead ? dbp_audio_ahead : DBP_MixFrameAudio());
+	const int16_t* mixAudio = dbp_audio[dbp_audio_active].audio;
+	// a frame answered by a pause was mixed before the samples above (the emulation thread doesn't run ahead while it is pending)
+	const Bit32u pauseAheadSamples = (dbp_pause_ahead ? dbp_audio_pause_ahead : 0);
+	const int16_t* pauseAheadAudio = dbp_audio[dbp_audio_pause_ahead_active].audio;
 	#endif
 
-	// Read buffer_active before waking up emulation thread
-	const DBP_Buffer& buf = dbp_buffers[buffer_active];
+	// Read buffer_active before waking up emulation thread (or the last finished frame if it is running ahead)
+	// When skipping emulation, show the frame answered by a pause if there is one, its buffer is only reused after the next finished frame
+	const bool show_pause_ahead = (skip_emulate && dbp_pause_ahead && !dbp_opengl_draw);
+	const DBP_Buffer& buf = dbp_buffers[show_pause_ahead ? dbp_pause_ahead_buffer : dbp_frame_ahead ? buffer_finished : buffer_active];
+	const Bit32u buf_serial = (show_pause_ahead ? dbp_pause_ahead_serial : dbp_frame_ahead ? buffer_finished_serial : buffer_serial);
+	dbp_pause_ahead = false;
+	const Bit32u input_seq_shown = dbp_input_seq_finished;
 	Bit32u view_width = buf.width, view_height = buf.height;
 
 	if (dbp_opengl_draw && voodoo_ogl_mainthread()) { view_width *= voodoo_ogl_scale; view_height *= voodoo_ogl_scale; }
@@ -3664,26 +3895,34 @@ void retro_run(void)
 
 	#ifndef DBP_STANDALONE
 	// submit audio
-	//log_cb(RETRO_LOG_INFO, "[retro_run] Submit %d samples (remain %f) - Had: %d - Left: %d\n", mixSamples, dbp_audio_remain, haveSamples, DBP_MIXER_DoneSamplesCount());
+	//log_cb(RETRO_LOG_INFO, "[retro_run] Submit %d samples (remain %f) - Left: %d\n", mixSamples, dbp_audio_remain, DBP_MIXER_DoneSamplesCount());
+	if (pauseAheadSamples)
+		audio_batch_cb(pauseAheadAudio, pauseAheadSamples);
 	if (mixSamples)
-		audio_batch_cb(dbp_audio[dbp_audio_active].audio, mixSamples);
+		audio_batch_cb(mixAudio, mixSamples);
 	#endif
 
 	if (tpfActual)
 	{
 		extern const char* DBP_CPU_GetDecoderName();
 		if (dbp_perf == DBP_PERF_DETAILED)
-			retro_notify(-1500, RETRO_LOG_INFO, "Speed: %4.1f%%, DOS: %dx%d@%4.2fhz, Actual: %4.2ffps, Drawn: %dfps, Cycles: %u (%s)"
+			retro_notify(-1500, RETRO_LOG_INFO, "Speed: %4.1f%%, DOS: %dx%d@%4.2fhz, Actual: %4.2ffps, Drawn: %dfps, Cycles: %u (%s), Latency: %.1fms"
 				#ifdef DBP_ENABLE_WAITSTATS
 				", Waits: p%u|f%u|z%u|c%u"
 				#endif
+				#if defined(C_DYNREC)
+				"\nDynRec Blocks: %u translated, %u evicted, %u kept hot, %u invalidated (most at %05X: %u), %u traced"
+				#endif
 				#ifdef DBP_ENABLE_FPS_COUNTERS
 				"\nRetro: %u, GfxStart: %u, GfxEnd: %u, Event: %u, SkipRun: %u, SkipRender: %u"
 				#endif
-				, ((float)tpfTarget / (float)tpfActual * 100), (int)render.src.width, (int)render.src.height, render.src.fps, (1000000.f / tpfActual), tpfDraws, CPU_CycleMax, DBP_CPU_GetDecoderName()
+				, ((float)tpfTarget / (float)tpfActual * 100), (int)render.src.width, (int)render.src.height, render.src.fps, (1000000.f / tpfActual), tpfDraws, CPU_CycleMax, DBP_CPU_GetDecoderName(), (tpfLatency / 1000.f)
 				#ifdef DBP_ENABLE_WAITSTATS
 				, waitPause, waitFinish, waitPaused, waitContinue
 				#endif
+				#if defined(C_DYNREC)
+				, dynTranslated, dynEvicted, dynSpared, dynInvalidated, (dynSmcPage << 12), dynSmcPageCount, dynTraces
+				#endif
 				#ifdef DBP_ENABLE_FPS_COUNTERS
 				, dbp_fpscount_retro, dbp_fpscount_gfxstart, dbp_fpscount_gfxend, dbp_fpscount_event, dbp_fpscount_skip_run, dbp_fpscount_skip_render
 				#endif
@@ -3722,15 +3961,33 @@ void retro_run(void)
 		}
 		environ_cb(((newfps || newmax) ? RETRO_ENVIRONMENT_SET_SYSTEM_AV_INFO : RETRO_ENVIRONMENT_SET_GEOMETRY), &av_info);
 		av_info.timing.fps = targetfps;
+		buffer_submitted_serial = (Bit32u)-1;
 	}
 
 	// submit video
-	if (skip_emulate)
+	if (skip_emulate && (!show_pause_ahead || buf_serial == buffer_submitted_serial))
 		video_cb(NULL, view_width, view_height, view_width * 4);
+	else if (show_pause_ahead)
+	{
+		video_cb(buf.video, view_width, view_height, view_width * 4);
+		buffer_submitted_serial = buf_serial;
+	}
 	else if (dbp_opengl_draw)
 		dbp_opengl_draw(buf);
+	else if (buf_serial == buffer_submitted_serial)
+		video_cb(NULL, view_width, view_height, view_width * 4); // no new frame since the last submitted one
 	else
+	{
 		video_cb(buf.video, view_width, view_height, view_width * 4);
+		buffer_submitted_serial = buf_serial;
+	}
+
+	if (dbp_latency_start && !skip_emulate && (Bit32s)(input_seq_shown - dbp_latency_seq) >= 0)
+	{
+		dbp_perf_latency += (Bit32u)(time_cb() - dbp_latency_start);
+		dbp_perf_latencycount++;
+		dbp_latency_start = 0;
+	}
 
 	#ifdef DBP_STANDALONE
 	if (dbp_intercept && dbp_osdbuf[&buf - dbp_buffers].video)
@@ -3746,6 +4003,8 @@ static bool retro_serialize_all(DBPArchive& ar, bool unlock_thread)
 	if (dbp_serializemode == DBPSERIALIZE_DISABLED) return false;
 	bool pauseThread = (dbp_state != DBPSTATE_BOOT && dbp_state != DBPSTATE_SHUTDOWN);
 	if (pauseThread) DBP_ThreadControl(TCM_PAUSE_FRAME);
+	if (dbp_serializemode != DBPSERIALIZE_FASTREWIND) { if (MemDirty) DBPRewind_Shutdown(); } // switched away from fast rewind
+	else if (ar.mode != DBPArchive::MODE_LOAD) ar.flags |= DBPArchive::FLAG_REWINDBUFFER;
 	DBPSerialize_All(ar, (dbp_state == DBPSTATE_RUNNING || dbp_state == DBPSTATE_FIRST_FRAME), dbp_game_running);
 	//log_cb(RETRO_LOG_WARN, "[SERIALIZE] [%d] [%s] %u\n", ((dbp_state == DBPSTATE_RUNNING || dbp_state == DBPSTATE_FIRST_FRAME) && dbp_game_running), (ar.mode == DBPArchive::MODE_LOAD ? "LOAD" : ar.mode == DBPArchive::MODE_SAVE ? "SAVE" : ar.mode == DBPArchive::MODE_SIZE ? "SIZE" : ar.mode == DBPArchive::MODE_MAXSIZE ? "MAXX" : ar.mode == DBPArchive::MODE_ZERO ? "ZERO" : "???????"), (Bit32u)ar.GetOffset());
 	if (dbp_game_running && ar.mode == DBPArchive::MODE_LOAD) dbp_lastmenuticks = DBP_GetTicks(); // force show menu on immediate emulation crash
@@ -3772,7 +4031,7 @@ static bool retro_serialize_all(DBPArchive& ar, bool unlock_thread)
 			case DBPArchive::ERR_GAMENOTRUNNING:
 				if (ar.mode == DBPArchive::MODE_LOAD)
 					retro_notify(0, RETRO_LOG_WARN, "Unable to load a save state while game the isn't running, start it first.");
-				else if (dbp_serializemode != DBPSERIALIZE_REWIND)
+				else if (dbp_serializemode < DBPSERIALIZE_REWIND)
 					retro_notify(0, RETRO_LOG_ERROR, "%sUnable to %s while %s %s not running."
 						#ifndef DBP_STANDALONE
 						"\nIf using rewind, make sure to modify the related core option."
@@ -3794,6 +4053,10 @@ static bool retro_serialize_all(DBPArchive& ar, bool unlock_thread)
 				retro_notify(0, RETRO_LOG_ERROR, "%sWrong SVGA mode configuration (%d KB VGA RAM instead of %D KB)", "Load State Error: ",
 					(Bit8u)(vga.vmemsize / 1024), ar.error_info * 128);
 				break;
+			case DBPArchive::ERR_REWINDBUFFER:
+				retro_notify(0, RETRO_LOG_ERROR, "%s%s", (ar.mode == DBPArchive::MODE_LOAD ? "Load State Error: " : "Save State Error: "),
+					(ar.mode == DBPArchive::MODE_LOAD ? "Rewind history of this state is no longer available" : "Unable to allocate rewind buffer"));
+				break;
 		}
 	}
 	else if (ar.warnings && ar.mode == DBPArchive::MODE_LOAD)
@@ -3808,14 +4071,14 @@ static bool retro_serialize_all(DBPArchive& ar, bool unlock_thread)
 size_t retro_serialize_size(void)
 {
 	if (dbp_serializesize) return dbp_serializesize;
-	DBPArchiveCounter ar((dbp_state != DBPSTATE_RUNNING && dbp_state != DBPSTATE_FIRST_FRAME) || dbp_serializemode == DBPSERIALIZE_REWIND);
+	DBPArchiveCounter ar((dbp_state != DBPSTATE_RUNNING && dbp_state != DBPSTATE_FIRST_FRAME) || dbp_serializemode >= DBPSERIALIZE_REWIND);
 	return dbp_serializesize = (retro_serialize_all(ar, false) ? ar.count : 0);
 }
 
 bool retro_serialize(void *data, size_t size)
 {
 	DBPArchiveWriter ar(data, size);
-	if (!retro_serialize_all(ar, true) && ((ar.had_error != DBPArchive::ERR_DOSNOTRUNNING && ar.had_error != DBPArchive::ERR_GAMENOTRUNNING) || dbp_serializemode != DBPSERIALIZE_REWIND)) return false;
+	if (!retro_serialize_all(ar, true) && ((ar.had_error != DBPArchive::ERR_DOSNOTRUNNING && ar.had_error != DBPArchive::ERR_GAMENOTRUNNING) || dbp_serializemode < DBPSERIALIZE_REWIND)) return false;
 	memset(ar.ptr, 0, ar.end - ar.ptr);
 	return true;
 }
@@ -3824,7 +4087,7 @@ bool retro_unserialize(const void *data, size_t size)
 {
 	DBPArchiveReader ar(data, size);
 	bool res = retro_serialize_all(ar, true);
-	if ((ar.had_error != DBPArchive::ERR_DOSNOTRUNNING && ar.had_error != DBPArchive::ERR_GAMENOTRUNNING) || dbp_serializemode != DBPSERIALIZE_REWIND) return res;
+	if ((ar.had_error != DBPArchive::ERR_DOSNOTRUNNING && ar.had_error != DBPArchive::ERR_GAMENOTRUNNING) || dbp_serializemode < DBPSERIALIZE_REWIND) return res;
 	if ((dbp_state != DBPSTATE_RUNNING && dbp_state != DBPSTATE_FIRST_FRAME) || dbp_game_running) retro_reset();
 	return true;
 }
@@ -62,6 +62,7 @@ struct DBPArchive
 		ERR_WRONGMACHINECONFIG,
 		ERR_WRONGMEMORYCONFIG,
 		ERR_WRONGVGAMEMCONFIG,
+		ERR_REWINDBUFFER,
 	};
 	enum EWarning : Bit8u
 	{
@@ -74,6 +75,7 @@ struct DBPArchive
 	{
 		FLAG_NONE            = 0,
 		FLAG_NORESETINPUT = 1<<0,
+		FLAG_REWINDBUFFER = 1<<1, // guest memory and video memory are stored in the in-core rewind buffer instead of the archive
 	};
 
 	Bit8u mode, version, flags, had_error, warnings, error_info;
@@ -158,4 +160,11 @@ struct DBPArchiveZeroer : DBPArchive
 
 void DBPSerialize_All(DBPArchive& ar, bool dos_running = true, bool game_running = true);
 
+// In-core rewind buffer which keeps the history of guest memory and video memory as compressed deltas of dirty pages.
+// Save states made with FLAG_REWINDBUFFER only reference a snapshot in it and are valid for the running session only.
+bool DBPRewind_Capture(Bit32u& session, Bit32u& snapshot);
+bool DBPRewind_Restore(Bit32u session, Bit32u snapshot);
+void DBPRewind_Reset();
+void DBPRewind_Shutdown();
+
 #endif
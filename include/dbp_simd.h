@@ -0,0 +1,34 @@
+/*
+ *  Copyright (C) 2020-2025 Bernhard Schelling
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef DOSBOX_DBP_SIMD_H
+#define DOSBOX_DBP_SIMD_H
+
+// SSE2 (always available on x64 and with /arch:SSE2 on MSVC which doesn't define __SSE2__) or NEON intrinsics
+// Code paths check for '#if defined(__SSE2__) && __SSE2__' and '#elif defined(DBP_NEON)' with a scalar fallback
+#if !defined(__SSE2__) && (_M_IX86_FP == 2 || (defined(_M_AMD64) || defined(_M_X64)))
+#define __SSE2__ 1
+#endif
+#if defined(__SSE2__) && __SSE2__
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define DBP_NEON 1
+#endif
+
+#endif
@@ -32,8 +32,14 @@ typedef Bit32s MemHandle;
 #define MEM_PAGESIZE 4096
 
 extern HostPt MemBase;
+extern Bit8u* MemDirty; // DBP: Per page write flags, only allocated while dirty page tracking is enabled
 HostPt GetMemBase(void);
 
+/* DBP: Dirty page tracking for the in-core rewind buffer */
+void MEM_TrackDirtyPages(bool enable);
+void MEM_ResetDirtyPages(void);
+void MEM_MarkPageDirty(Bitu phys_page);
+
 bool MEM_A20_Enabled(void);
 void MEM_A20_Enable(bool enable);
 
@@ -150,12 +156,15 @@ void mem_writew(PhysPt pt,Bit16u val);
 void mem_writed(PhysPt pt,Bit32u val);
 
 static INLINE void phys_writeb(PhysPt addr,Bit8u val) {
+	if (GCC_UNLIKELY(MemDirty!=0)) MemDirty[addr>>12]=1;
 	host_writeb(MemBase+addr,val);
 }
 static INLINE void phys_writew(PhysPt addr,Bit16u val){
+	if (GCC_UNLIKELY(MemDirty!=0)) MemDirty[addr>>12]=MemDirty[(addr+1)>>12]=1;
 	host_writew(MemBase+addr,val);
 }
 static INLINE void phys_writed(PhysPt addr,Bit32u val){
+	if (GCC_UNLIKELY(MemDirty!=0)) MemDirty[addr>>12]=MemDirty[(addr+3)>>12]=1;
 	host_writed(MemBase+addr,val);
 }
 
@@ -175,6 +184,7 @@ void MEM_BlockWrite(PhysPt pt,void const * const data,Bitu size);
 void MEM_BlockRead(PhysPt pt,void * data,Bitu size);
 void MEM_BlockCopy(PhysPt dest,PhysPt src,Bitu size);
 void MEM_StrCopy(PhysPt pt,char * data,Bitu size);
+HostPt MEM_GetBlockHostPt(PhysPt pt,Bitu size,bool write);
 
 void mem_memcpy(PhysPt dest,PhysPt src,Bitu size);
 Bitu mem_strlen(PhysPt pt);
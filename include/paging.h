@@ -162,6 +162,9 @@ struct PagingBlock {
 		PhysPt addr;
 	} base;
 #if defined(USE_FULL_TLB)
+	// entries of pages that were never linked stay all zero (a NULL handler
+	// stands for init_handler) so the untouched parts of the tables don't
+	// take up any memory
 	struct {
 		HostPt read[TLB_SIZE];
 		HostPt write[TLB_SIZE];
@@ -169,6 +172,7 @@ struct PagingBlock {
 		PageHandler * writehandler[TLB_SIZE];
 		Bit32u	phys_page[TLB_SIZE];
 	} tlb;
+	PageHandler * init_handler;
 #else
 	tlb_entry tlbh[TLB_SIZE];
 	tlb_entry *tlbh_banks[TLB_BANKS];
@@ -220,10 +224,12 @@ static INLINE HostPt get_tlb_write(PhysPt address) {
 	return paging.tlb.write[address>>12];
 }
 static INLINE PageHandler* get_tlb_readhandler(PhysPt address) {
-	return paging.tlb.readhandler[address>>12];
+	PageHandler* handler=paging.tlb.readhandler[address>>12];
+	return (handler ? handler : paging.init_handler);
 }
 static INLINE PageHandler* get_tlb_writehandler(PhysPt address) {
-	return paging.tlb.writehandler[address>>12];
+	PageHandler* handler=paging.tlb.writehandler[address>>12];
+	return (handler ? handler : paging.init_handler);
 }
 
 /* Use these helper functions to access linear addresses in readX/writeX functions */
@@ -115,6 +115,9 @@ void RENDER_SetSize(Bitu width,Bitu height,Bitu bpp,float fps,double ratio,bool
 bool RENDER_StartUpdate(void);
 void RENDER_EndUpdate(bool abort);
 void RENDER_SetPal(Bit8u entry,Bit8u red,Bit8u green,Bit8u blue);
+void RENDER_SetWorker(bool enable);
+void RENDER_FinishWorker(void);
+bool RENDER_SkipUnchangedLines(void);
 #if 0
 bool RENDER_GetForceUpdate(void);
 void RENDER_SetForceUpdate(bool);
@@ -361,6 +361,11 @@ typedef union {
 typedef struct {
 	Bit8u* linear;
 	Bit8u* linear_orgptr;
+	Bit8u* dirty;         // DBP: Per page write flags of linear followed by fastmem, only allocated while dirty page tracking is enabled
+	Bit8u* dirty_fastmem; // DBP: Points into dirty at the flags of the first fastmem page
+	Bit8u* dirty_display;         // DBP: Same layout as dirty, pages written since the display last reset them
+	Bit8u* dirty_display_fastmem; // DBP: Points into dirty_display at the flags of the first fastmem page
+	Bit8u* dirty_display_last;    // DBP: Same layout as dirty, pages written in the period before that
 } VGA_Memory;
 
 typedef struct {
@@ -455,6 +460,18 @@ void VGA_KillDrawing(void);
 
 void VGA_SetOverride(bool vga_override);
 
+/* DBP: Dirty page tracking of video memory for the in-core rewind buffer and for skipping unchanged scanlines */
+#define VGA_MARK_DIRTY(_OFS_) { if (GCC_UNLIKELY(vga.mem.dirty!=0)) vga.mem.dirty[(_OFS_)>>12]=vga.mem.dirty_display[(_OFS_)>>12]=1; }
+#define VGA_MARK_DIRTY_FASTMEM(_OFS_) { if (GCC_UNLIKELY(vga.mem.dirty!=0)) vga.mem.dirty_fastmem[(_OFS_)>>12]=vga.mem.dirty_display_fastmem[(_OFS_)>>12]=1; }
+Bit32u VGA_LinearSize(void);
+Bit32u VGA_FastmemSize(void);
+void VGA_TrackDirtyPages(bool enable);
+void VGA_ResetDirtyPages(void);
+void VGA_MarkAllPagesDirty(void);
+void VGA_TrackDisplayPages(bool enable);
+void VGA_ResetDisplayPages(void);
+void VGA_SkipUnchangedLines(bool enable);
+
 extern VGA_Type vga;
 
 /* Support for modular SVGA implementation */
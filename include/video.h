@@ -67,6 +67,8 @@ void GFX_Stop(void);
 void GFX_SwitchFullScreen(void);
 bool GFX_StartUpdate(Bit8u * & pixels,Bitu & pitch);
 void GFX_EndUpdate( const Bit16u *changedLines );
+bool GFX_CanCopyPreviousLines(void);
+void GFX_CopyPreviousLines(Bitu y,Bitu count);
 void GFX_GetSize(int &width, int &height, bool &fullscreen);
 void GFX_LosingFocus(void);
 
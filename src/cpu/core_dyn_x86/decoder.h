@@ -775,6 +775,8 @@ static void dyn_write_word(DynReg * addr,DynReg * val,bool dword,bool release=fa
 }
 
 #else // X86_64
+// writes to pages with translated code (i.e. data next to code) call CodePageHandler without the virtual dispatch
+// this only devirtualizes code page writes, it is not fastmem (pages with a host pointer are already accessed inline)
 static bool mem_readd_checked_dcx64(PhysPt address, Bit32u* dst) {
 	return get_tlb_readhandler(address)->readd_checked(address, dst);
 }
@@ -782,16 +784,22 @@ static bool mem_readw_checked_dcx64(PhysPt address, Bit16u* dst) {
 	return get_tlb_readhandler(address)->readw_checked(address, dst);
 }
 static bool mem_writed_checked_dcx64(PhysPt address, Bitu val) {
-	return get_tlb_writehandler(address)->writed_checked(address, val);
+	PageHandler * handler=get_tlb_writehandler(address);
+	if (handler->flags & PFLAG_HASCODE) return ((CodePageHandler *)handler)->CodePageHandler::writed_checked(address, val);
+	return handler->writed_checked(address, val);
 }
 static bool mem_writew_checked_dcx64(PhysPt address, Bitu val) {
-	return get_tlb_writehandler(address)->writew_checked(address, val);
+	PageHandler * handler=get_tlb_writehandler(address);
+	if (handler->flags & PFLAG_HASCODE) return ((CodePageHandler *)handler)->CodePageHandler::writew_checked(address, val);
+	return handler->writew_checked(address, val);
 }
 static bool mem_readb_checked_dcx64(PhysPt address, Bit8u* dst) {
 	return get_tlb_readhandler(address)->readb_checked(address, dst);
 }
 static bool mem_writeb_checked_dcx64(PhysPt address, Bitu val) {
-	return get_tlb_writehandler(address)->writeb_checked(address, val);
+	PageHandler * handler=get_tlb_writehandler(address);
+	if (handler->flags & PFLAG_HASCODE) return ((CodePageHandler *)handler)->CodePageHandler::writeb_checked(address, val);
+	return handler->writeb_checked(address, val);
 }
 
 static void dyn_read_word(DynReg * addr,DynReg * dst,bool dword,bool release=false) {
@@ -27,6 +27,8 @@
 #include <string.h>
 #include <stddef.h>
 #include <stdlib.h>
+#include <vector>
+#include <algorithm>
 
 #if defined (WIN32)
 #include <windows.h>
@@ -57,6 +59,11 @@
 #define CACHE_PAGES		(512)
 #define CACHE_BLOCKS	(128*1024)
 #define CACHE_ALIGN		(16)
+#define CACHE_HOT_HEAT	(16)
+#define CACHE_HOT_SKIPS	(8)
+#define DYN_TRACE_HEAT		(512)	// block entries before a block is retranslated as trace
+#define DYN_TRACE_OPCODES	(64)
+#define DYN_TRACE_GAP		(64)	// maximum distance of a forward jump followed by a trace
 #define DYN_HASH_SHIFT	(4)
 #define DYN_PAGE_HASH	(4096>>DYN_HASH_SHIFT)
 #define DYN_LINKS		(16)
@@ -115,7 +122,13 @@ enum BlockReturn {
 	BR_Iret,
 	BR_CallBack,
 	BR_SMCBlock,
-	BR_Trap
+	BR_Trap,
+	BR_FpuTop
+};
+
+// arithmetic operations of the backends that keep fpu values in host registers
+enum DynFpuOps {
+	DFO_ADD,DFO_SUB,DFO_MUL,DFO_DIV
 };
 
 // identificator to signal self-modification of the currently executed block
@@ -185,6 +198,82 @@ CacheBlockDynRec * LinkBlocks(BlockReturn ret) {
 	return block;
 }
 
+/*
+	Blocks that are entered very often get translated a second time as
+	a trace which continues through short forward jumps and through the
+	more frequently taken direction of conditional jumps (see decoder.h).
+	Candidates are picked when the cycles run out right at the entry of a
+	block, this way the translated code doesn't need any extra checks.
+*/
+static void RetranslateHotBlock(void) {
+	CacheBlockDynRec * block=cache.block.running;
+	if (!block || block->trace || block->heat<DYN_TRACE_HEAT) return;
+	PhysPt ip_point=SegPhys(cs)+reg_eip;
+	CodePageHandlerDynRec * chandler=block->page.handler;
+	// the page must still be mapped at the same place and be free of self-modifying code
+	if (!chandler || chandler->invalidation_map || (PageHandler *)chandler!=get_tlb_readhandler(ip_point)) return;
+	if (chandler->FindCacheBlock(ip_point&4095)!=block) return;
+	block->Clear();
+	CreateCacheBlock(chandler,ip_point,DYN_TRACE_OPCODES,true)->trace=true;
+	cache_stats.traces++;
+}
+
+/*
+	The translation profile remembers which blocks of which code pages had
+	been translated (and which of them became traces) when the content was
+	closed, so a later run can translate them all at once when a page is
+	first executed instead of warming up again. The generated code itself
+	can't be kept because it refers to host addresses that differ between
+	starts. Pages are identified by their physical page number and a hash
+	of their content, so pages that hold different code now are ignored.
+*/
+struct DynProfileBlock {
+	Bit32u phys_page,page_hash,heat;
+	Bit16u start;
+	Bit8u big,trace;
+};
+static std::vector<DynProfileBlock> dyn_profile;	// sorted by phys_page
+
+static bool DynProfileLess(const DynProfileBlock& a,const DynProfileBlock& b) {
+	return a.phys_page<b.phys_page;
+}
+
+static Bit32u DynProfilePageHash(CodePageHandlerDynRec * chandler) {
+	HostPt hostmem=chandler->GetHostReadPt(chandler->GetPhysPage());
+	if (!hostmem) return 0;
+	Bit32u hash=2166136261u;
+	for (Bitu i=0;i<4096;i+=4) hash=(hash^host_readd(hostmem+i))*16777619u;
+	return hash|1;	// zero is used for pages without memory
+}
+
+static bool ApplyTranslationProfile(CodePageHandlerDynRec * chandler,PhysPt ip_point) {
+	DynProfileBlock key;
+	key.phys_page=(Bit32u)chandler->GetPhysPage();
+	std::vector<DynProfileBlock>::iterator first=std::lower_bound(dyn_profile.begin(),dyn_profile.end(),key,DynProfileLess),last=first;
+	while (last!=dyn_profile.end() && last->phys_page==key.phys_page) last++;
+	if (first==last) return false;
+	// each page is only looked at once, after that the regular warm-up applies
+	std::vector<DynProfileBlock> blocks(first,last);
+	dyn_profile.erase(first,last);
+	// only without paging the speculative translation can't raise page faults
+	if (paging.enabled || chandler->invalidation_map || blocks[0].big!=(cpu.code.big ? 1 : 0)) return false;
+	if (DynProfilePageHash(chandler)!=blocks[0].page_hash) return false;
+	// plain blocks first so traces see the heat of their branch targets
+	for (Bitu pass=0;pass<2;pass++) {
+		for (size_t i=0;i<blocks.size();i++) {
+			const DynProfileBlock& b=blocks[i];
+			if (b.trace!=pass) continue;
+			// translating can release pages when the cache runs out of them
+			if ((PageHandler *)chandler!=get_tlb_readhandler(ip_point)) return true;
+			if (chandler->FindCacheBlock(b.start)) continue;
+			CacheBlockDynRec * block=CreateCacheBlock(chandler,(ip_point&~4095)|b.start,(pass ? DYN_TRACE_OPCODES : 32),pass!=0);
+			block->heat=b.heat;
+			block->trace=(pass!=0);
+		}
+	}
+	return true;
+}
+
 /*
 	The core tries to find the block that should be executed next.
 	If such a block is found, it is run, otherwise the instruction
@@ -219,11 +308,13 @@ Bits CPU_Core_Dynrec_Run(void) {
 		// find correct Dynamic Block to run
 		CacheBlockDynRec * block=chandler->FindCacheBlock(ip_point&4095);
 		if (!block) {
+			// first visit of a page known from the translation profile
+			if (GCC_UNLIKELY(!dyn_profile.empty()) && ApplyTranslationProfile(chandler,ip_point)) continue;
 			// no block found, thus translate the instruction stream
 			// unless the instruction is known to be modified
 			if (!chandler->invalidation_map || (chandler->invalidation_map[ip_point&4095]<4)) {
 				// translate up to 32 instructions
-				block=CreateCacheBlock(chandler,ip_point,32);
+				block=CreateCacheBlock(chandler,ip_point,32,false);
 			} else {
 				// let the normal core handle this instruction to avoid zero-sized blocks
 				Bitu old_cycles=CPU_Cycles;
@@ -281,6 +372,7 @@ run_block:
 			if (DEBUG_HeavyIsBreakpoint()) return debugCallback;
 #endif
 #endif
+			RetranslateHotBlock();
 			return CBRET_NONE;
 
 		case BR_CallBack:
@@ -326,6 +418,13 @@ run_block:
 			cpudecoder=CPU_Core_Dynrec_Trap_Run;
 			return CBRET_NONE;
 
+#ifdef DYN_FPU_HOST
+		case BR_FpuTop:
+			// the block was translated for another fpu stack top, drop it
+			dyn_fpu_top_mismatch(cache.block.running);
+			break;
+#endif
+
 		default:
 			E_Exit("Invalid return code %d", ret);
 		}
@@ -355,10 +454,87 @@ Bits CPU_Core_Dynrec_Trap_Run(void) {
 void CPU_Core_Dynrec_Init(void) {
 }
 
+static Bitu dynrec_cache_request=CACHE_TOTAL;
+
+void CPU_Core_Dynrec_SetCacheSize(Bitu bytes) {
+#if defined(VITA) || defined(WIIU)
+	// code memory is a fixed region on these platforms
+	bytes=CACHE_TOTAL;
+#endif
+	if (bytes<CACHE_TOTAL/2) bytes=CACHE_TOTAL/2;
+	// applied the next time the cache gets initialized
+	dynrec_cache_request=bytes&~(Bitu)(PAGESIZE_TEMP-1);
+}
+
+void CPU_Core_Dynrec_SetFPUMode(bool host_fpu) {
+#ifdef DYN_FPU_HOST
+	// applies to code translated from now on
+	dyn_fpu_host=host_fpu;
+#endif
+}
+
+void CPU_Core_Dynrec_GetCacheStats(Bit32u& translations, Bit32u& evictions, Bit32u& spared, Bit32u& invalidations, Bit32u& traces, Bit32u& smc_page, Bit32u& smc_page_count) {
+	// returns the counters since the last call
+	translations=cache_stats.translations;
+	evictions=cache_stats.evictions;
+	spared=cache_stats.spared;
+	invalidations=cache_stats.invalidations;
+	traces=cache_stats.traces;
+	smc_page=cache_stats.smc_page;
+	smc_page_count=cache_stats.smc_page_count;
+	memset(&cache_stats,0,sizeof(cache_stats));
+}
+
+void CPU_Core_Dynrec_LoadProfile(const Bit8u* data,Bitu size) {
+	dyn_profile.clear();
+	if (size<8 || memcmp(data,"DBPDYN01",8) || ((size-8)%sizeof(DynProfileBlock))) return;
+	dyn_profile.resize((size-8)/sizeof(DynProfileBlock));
+	memcpy(&dyn_profile[0],data+8,size-8);
+	std::stable_sort(dyn_profile.begin(),dyn_profile.end(),DynProfileLess);
+}
+
+void CPU_Core_Dynrec_SaveProfile(std::vector<Bit8u>& out) {
+	out.clear();
+	std::vector<DynProfileBlock> blocks;
+	if (cache_initialized) {
+		for (CodePageHandlerDynRec * cpage=cache.used_pages;cpage;cpage=cpage->next) {
+			if (cpage->invalidation_map) continue;
+			DynProfileBlock b;
+			b.phys_page=(Bit32u)cpage->GetPhysPage();
+			b.page_hash=DynProfilePageHash(cpage);
+			b.big=((cpage->flags&PFLAG_HASCODE32) ? 1 : 0);
+			if (!b.page_hash) continue;
+			for (Bitu i=1;i<=DYN_PAGE_HASH;i++) {
+				for (CacheBlockDynRec * block=cpage->GetHashChain(i);block;block=block->hash.next) {
+					b.start=block->page.start;
+					b.heat=block->heat;
+					b.trace=(block->trace ? 1 : 0);
+					blocks.push_back(b);
+				}
+			}
+		}
+	}
+	// keep entries of pages that were not visited this time
+	std::sort(blocks.begin(),blocks.end(),DynProfileLess);
+	for (size_t i=0;i<dyn_profile.size() && blocks.size()<65536;i++)
+		if (!std::binary_search(blocks.begin(),blocks.end(),dyn_profile[i],DynProfileLess))
+			blocks.push_back(dyn_profile[i]);
+	if (blocks.empty()) return;
+	out.resize(8+blocks.size()*sizeof(DynProfileBlock));
+	memcpy(&out[0],"DBPDYN01",8);
+	memcpy(&out[8],&blocks[0],blocks.size()*sizeof(DynProfileBlock));
+}
+
 void CPU_Core_Dynrec_Cache_Init(bool enable_cache) {
 	// Initialize code cache and dynamic blocks
 	//DBP: Fix turning dynamic core on and off
 	//cache_init(enable_cache);
+	if (enable_cache && cache_initialized && cache_total!=dynrec_cache_request) cache_close();
+	if (!cache_initialized) {
+		// keep the same average block size as the default setup
+		cache_total=dynrec_cache_request;
+		cache_block_count=(Bitu)((Bit64u)CACHE_BLOCKS*cache_total/CACHE_TOTAL);
+	}
 	if (enable_cache && cache_initialized) DBPSerialize_cache_reset();
 	else if (enable_cache && !cache_initialized) cache_init(true);
 	else if (!enable_cache && cache_initialized) cache_close();
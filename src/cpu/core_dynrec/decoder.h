@@ -35,8 +35,9 @@
 	instruction is encountered.
 */
 
-static CacheBlockDynRec * CreateCacheBlock(CodePageHandlerDynRec * codepage,PhysPt start,Bitu max_opcodes) {
+static CacheBlockDynRec * CreateCacheBlock(CodePageHandlerDynRec * codepage,PhysPt start,Bitu max_opcodes,bool trace) {
 	// initialize a load of variables
+	decode.trace=trace;
 	decode.code_start=start;
 	decode.code=start;
 	decode.page.code=codepage;
@@ -49,10 +50,15 @@ static CacheBlockDynRec * CreateCacheBlock(CodePageHandlerDynRec * codepage,Phys
 	codepage->AddCacheBlock(decode.block);
 
 	InitFlagsOptimization();
+#ifdef DYN_FPU_HOST
+	dyn_fpu_start_block((Bit32u)((codepage->GetPhysPage()<<12)|decode.page.index));
+#endif
 
 	// every codeblock that is run sets cache.block.running to itself
 	// so the block linking knows the last executed block
 	gen_mov_direct_ptr(&cache.block.running,(Bitu)decode.block);
+	// count how often the block gets entered for the cache eviction
+	gen_add_direct_word(&decode.block->heat,1,true);
 
 	// start with the cycles check
 	gen_mov_word_to_reg(FC_RETOP,&CPU_Cycles,true);
@@ -62,6 +68,8 @@ static CacheBlockDynRec * CreateCacheBlock(CodePageHandlerDynRec * codepage,Phys
 
 	decode.cycles=0;
 	while (max_opcodes--) {
+		// traces end early before they outgrow the space guaranteed for a block
+		if (decode.trace && ((Bitu)(cache.pos-decode.block->cache.start)>CACHE_MAXSIZE/4 || used_save_info_dynrec>=128)) break;
 		// Init prefixes
 		decode.big_addr=cpu.code.big;
 		decode.big_op=cpu.code.big;
@@ -86,6 +94,9 @@ restart_prefix:
 					(decode.page.invmap[decode.page.index-1]>=4))) goto illegalopcode;
 			}
 		}
+#ifdef DYN_FPU_HOST
+		dyn_fpu_before_opcode(opcode);
+#endif
 		switch (opcode) {
 		// instructions 'op reg8,reg8' and 'op [],reg8'
 		case 0x00:dyn_dop_ebgb(DOP_ADD);break;
@@ -197,10 +208,12 @@ restart_prefix:
 
 				// short conditional jumps
 				case 0x80:case 0x81:case 0x82:case 0x83:case 0x84:case 0x85:case 0x86:case 0x87:	
-				case 0x88:case 0x89:case 0x8a:case 0x8b:case 0x8c:case 0x8d:case 0x8e:case 0x8f:	
-					dyn_branched_exit((BranchTypes)(dual_code&0xf),
-						decode.big_op ? (Bit32s)decode_fetchd() : (Bit16s)decode_fetchw());
+				case 0x88:case 0x89:case 0x8a:case 0x8b:case 0x8c:case 0x8d:case 0x8e:case 0x8f: {
+					Bit32s eip_add=(decode.big_op ? (Bit32s)decode_fetchd() : (Bit16s)decode_fetchw());
+					if (dyn_trace_branch((BranchTypes)(dual_code&0xf),eip_add)) break;
+					dyn_branched_exit((BranchTypes)(dual_code&0xf),eip_add);
 					goto finish_block;
+				}
 
 				// conditional byte set instructions
 /*				case 0x90:case 0x91:case 0x92:case 0x93:case 0x94:case 0x95:case 0x96:case 0x97:	
@@ -304,9 +317,12 @@ restart_prefix:
 
 		// short conditional jumps
 		case 0x70:case 0x71:case 0x72:case 0x73:case 0x74:case 0x75:case 0x76:case 0x77:	
-		case 0x78:case 0x79:case 0x7a:case 0x7b:case 0x7c:case 0x7d:case 0x7e:case 0x7f:	
-			dyn_branched_exit((BranchTypes)(opcode&0xf),(Bit8s)decode_fetchb());	
+		case 0x78:case 0x79:case 0x7a:case 0x7b:case 0x7c:case 0x7d:case 0x7e:case 0x7f: {
+			Bit32s eip_add=(Bit8s)decode_fetchb();
+			if (dyn_trace_branch((BranchTypes)(opcode&0xf),eip_add)) break;
+			dyn_branched_exit((BranchTypes)(opcode&0xf),eip_add);
 			goto finish_block;
+		}
 
 		// 'op []/reg8,imm8'
 		case 0x80:
@@ -527,17 +543,23 @@ restart_prefix:
 			dyn_call_near_imm();
 			goto finish_block;
 		// 'jmp near imm16/32'
-		case 0xe9:
-			dyn_exit_link(decode.big_op ? (Bit32s)decode_fetchd() : (Bit16s)decode_fetchw());
+		case 0xe9: {
+			Bits eip_change=(decode.big_op ? (Bit32s)decode_fetchd() : (Bit16s)decode_fetchw());
+			if (dyn_trace_jump(eip_change)) break;
+			dyn_exit_link(eip_change);
 			goto finish_block;
+		}
 		// 'jmp far'
 		case 0xea:
 			dyn_jmp_far_imm();
 			goto finish_block;
 		// 'jmp short imm8'
-		case 0xeb:
-			dyn_exit_link((Bit8s)decode_fetchb());
+		case 0xeb: {
+			Bits eip_change=(Bit8s)decode_fetchb();
+			if (dyn_trace_jump(eip_change)) break;
+			dyn_exit_link(eip_change);
 			goto finish_block;
+		}
 
 
 		// repeat prefixes
@@ -602,6 +624,9 @@ restart_prefix:
 		}
 	}
 	// link to next block because the maximum number of opcodes has been reached
+#ifdef DYN_FPU_HOST
+	dyn_fpu_flush();
+#endif
 	dyn_set_eip_end();
 	dyn_reduce_cycles();
 	gen_jmp_ptr(&decode.block->link[0].to,offsetof(CacheBlockDynRec,cache.start));
@@ -614,6 +639,9 @@ core_close_block:
 	goto finish_block;
 illegalopcode:
 	// some unhandled opcode has been encountered
+#ifdef DYN_FPU_HOST
+	dyn_fpu_flush();
+#endif
 	dyn_set_eip_last();
 	dyn_reduce_cycles();
 	dyn_return(BR_Opcode);	// tell the core what happened
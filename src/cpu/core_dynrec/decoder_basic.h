@@ -103,6 +103,7 @@ static struct DynDecode {
 	Bitu cycles;			// number cycles used by currently translated code
 	bool seg_prefix_used;	// segment overridden
 	Bit8u seg_prefix;		// segment prefix (if seg_prefix_used==true)
+	bool trace;				// translating a hot trace (jumps inside the page get followed)
 
 	// block that contains the first instruction translated
 	CacheBlockDynRec * block;
@@ -610,7 +611,7 @@ static INLINE const Bit8u* gen_call_function_mm(void * func,Bitu op1,Bitu op2) {
 
 
 
-enum save_info_type {db_exception, cycle_check, string_break, trap};
+enum save_info_type {db_exception, cycle_check, string_break, trap, fpu_top};
 
 
 // function that is called on exceptions
@@ -678,6 +679,13 @@ static void dyn_fill_blocks(void) {
 				gen_add_direct_word(&reg_eip,save_info_dynrec[sct].eip_change,decode.big_op);
 				dyn_return(BR_Trap);
 				break;
+			case fpu_top:
+				// the fpu stack top differs from the one the block was translated for
+				decode.cycles=save_info_dynrec[sct].cycles;
+				dyn_reduce_cycles();
+				gen_add_direct_word(&reg_eip,save_info_dynrec[sct].eip_change,cpu.code.big);
+				dyn_return(BR_FpuTop);
+				break;
 		}
 	}
 	used_save_info_dynrec=0;
@@ -930,10 +938,18 @@ static void dyn_fill_ea(HostReg ea_reg,bool addseg=true) {
 	Bit8u seg_base=DRC_SEG_DS;
 	if (!decode.big_addr) {
 		Bits imm;
+		Bitu val;
+		void* imm_ptr=NULL;	// displacement that gets read from the code at runtime
 		switch (decode.modrm.mod) {
 		case 0:imm=0;break;
 		case 1:imm=(Bit8s)decode_fetchb();break;
-		case 2:imm=(Bit16s)decode_fetchw();break;
+		case 2:
+			// try to get a pointer to the next word code position
+			if (decode_fetchw_imm(val)) {
+				imm=0;
+				imm_ptr=(void*)val;
+			} else imm=(Bit16s)val;
+			break;
 		}
 		switch (decode.modrm.rm) {
 		case 0:// BX+SI
@@ -960,7 +976,12 @@ static void dyn_fill_ea(HostReg ea_reg,bool addseg=true) {
 			break;
 		case 6:// imm/BP
 			if (!decode.modrm.mod) {
-				imm=decode_fetchw();
+				if (decode_fetchw_imm(val)) {
+					// succeeded, use the pointer to avoid code invalidation
+					gen_mov_LE_word_to_reg(ea_reg,(void*)val,false);
+					break;	// the upper 16bit may be undefined
+				}
+				imm=(Bit16u)val;
 				gen_mov_dword_to_reg_imm(ea_reg,(Bit32u)imm);
 				goto skip_extend_word;
 			} else {
@@ -974,6 +995,11 @@ static void dyn_fill_ea(HostReg ea_reg,bool addseg=true) {
 			if (imm) gen_add_imm(ea_reg,(Bit32u)imm);
 			break;
 		}
+		if (imm_ptr) {
+			// add the displacement, the carry into the high 16bit is cut off below
+			gen_mov_LE_word_to_reg(TEMP_REG_DRC,imm_ptr,false);
+			gen_lea(ea_reg,TEMP_REG_DRC,0,0);
+		}
 		// zero out the high 16bit so ea_reg can be used as full register
 		gen_extend_word(false,ea_reg);
 skip_extend_word:
@@ -1121,8 +1147,19 @@ skip_extend_word:
 				base_reg=DRC_REG_EBP;seg_base=DRC_SEG_SS;
 			} else {
 				// no base, no scalereg
-
-				imm=(Bit32s)decode_fetchd();
+				Bitu val;
+				// try to get a pointer to the next dword code position
+				if (decode_fetchd_imm(val)) {
+					// succeeded, use the pointer to avoid code invalidation
+					if (!addseg) {
+						gen_mov_LE_word_to_reg(ea_reg,(void*)val,true);
+					} else {
+						MOV_SEG_PHYS_TO_HOST_REG(ea_reg,(decode.seg_prefix_used ? decode.seg_prefix : seg_base));
+						gen_add_LE(ea_reg,(void*)val);
+					}
+					return;
+				}
+				imm=(Bit32s)val;
 				if (!addseg) {
 					gen_mov_dword_to_reg_imm(ea_reg,(Bit32u)imm);
 				} else {
@@ -1253,6 +1290,7 @@ static void InvalidateFlags(void* current_simple_function,Bitu flags_type) {
 // this function can be replaced by a simpler one as well
 static void InvalidateFlagsPartially(void* current_simple_function,Bitu flags_type) {
 #ifdef DRC_FLAGS_INVALIDATION
+	if (GCC_UNLIKELY(mf_functions_num>=64)) return;	// long traces, keep the full flags variant
 	mf_functions[mf_functions_num].pos=cache.pos;
 	mf_functions[mf_functions_num].fct_ptr=current_simple_function;
 	mf_functions[mf_functions_num].ftype=flags_type;
@@ -1265,6 +1303,7 @@ static void InvalidateFlagsPartially(void* current_simple_function,Bitu flags_ty
 // this function can be replaced by a simpler one as well
 static void InvalidateFlagsPartially(void* current_simple_function,const Bit8u* cpos,Bitu flags_type) {
 #ifdef DRC_FLAGS_INVALIDATION
+	if (GCC_UNLIKELY(mf_functions_num>=64)) return;	// long traces, keep the full flags variant
 	mf_functions[mf_functions_num].pos=cpos;
 	mf_functions[mf_functions_num].fct_ptr=current_simple_function;
 	mf_functions[mf_functions_num].ftype=flags_type;
@@ -1121,6 +1121,62 @@ static void dyn_branched_exit(BranchTypes btype,Bit32s eip_add) {
  	dyn_closeblock();
 }
 
+// inside a hot trace decoding continues at the target of a jump instead of
+// ending the block, the skipped bytes are counted as part of the block so
+// it still covers a single range of the page and writes there invalidate it
+static void dyn_trace_continue(Bits eip_change) {
+	for (Bitu i=decode.page.index;i<decode.page.index+eip_change;i++) decode.page.wmap[i]++;
+	gen_add_direct_word(&reg_eip,(decode.code-decode.code_start)+eip_change,decode.big_op);
+	decode.code+=eip_change;
+	decode.code_start=decode.code;
+	decode.page.index+=eip_change;
+}
+
+static bool dyn_trace_can_follow(Bits eip_change) {
+	if (!decode.trace || decode.active_block!=decode.block) return false;
+	// only short forward jumps that neither leave the page nor wrap ip
+	if (eip_change<=0 || eip_change>DYN_TRACE_GAP) return false;
+	if (decode.page.index+eip_change>=4096) return false;
+	if (!decode.big_op && (decode.code-SegPhys(cs)+eip_change)>0xffff) return false;
+	return true;
+}
+
+static bool dyn_trace_jump(Bits eip_change) {
+	if (!dyn_trace_can_follow(eip_change)) return false;
+	dyn_trace_continue(eip_change);
+	return true;
+}
+
+// inside a hot trace a conditional jump continues into the direction whose
+// block was entered clearly more often so far, the other direction becomes
+// a side exit that returns to the core which then looks up the target block
+static bool dyn_trace_branch(BranchTypes btype,Bit32s eip_add) {
+	if (!decode.trace || decode.active_block!=decode.block) return false;
+	if (eip_add<=0 || decode.page.index+eip_add>=4096) return false;
+	CacheBlockDynRec * fall_block=decode.page.code->FindCacheBlock(decode.page.index);
+	CacheBlockDynRec * taken_block=decode.page.code->FindCacheBlock(decode.page.index+eip_add);
+	Bit32u fall_heat=(fall_block ? fall_block->heat : 0);
+	Bit32u taken_heat=(taken_block ? taken_block->heat : 0);
+	bool follow_taken;
+	if (fall_heat>taken_heat*2) follow_taken=false;
+	else if (taken_heat>fall_heat*2 && dyn_trace_can_follow(eip_add)) follow_taken=true;
+	else return false;
+
+	Bitu eip_base=decode.code-decode.code_start;
+	AcquireFlags(FMASK_TEST);
+	dyn_reduce_cycles();
+	decode.cycles=0;
+
+	dyn_branchflag_to_reg(btype);
+	const Bit8u* data=(follow_taken ? gen_create_branch_on_nonzero(FC_RETOP,true) : gen_create_branch_on_zero(FC_RETOP,true));
+	gen_add_direct_word(&reg_eip,eip_base+(follow_taken ? 0 : eip_add),decode.big_op);
+	dyn_return(BR_Normal);
+	gen_fill_branch(data);
+
+	if (follow_taken) dyn_trace_continue(eip_add);
+	return true;
+}
+
 /*
 static void dyn_set_byte_on_condition(BranchTypes btype) {
 	dyn_get_modrm();
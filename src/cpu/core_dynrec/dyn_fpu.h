@@ -67,6 +67,460 @@ static INLINE void dyn_fpu_top_swapped() {
 	gen_mov_word_to_reg(FC_OP2,(void*)(&TOP),true);
 }
 
+#if defined(DRC_USE_HOST_FPU) && !C_FPU_X86
+#define DYN_FPU_HOST
+#endif
+
+#ifdef DYN_FPU_HOST
+/*
+	Host fpu mode: the stack top is resolved while translating and the
+	fpu registers a block works on stay in host floating point registers
+	until an instruction that is not an fpu instruction (or a helper
+	function) needs them in memory again.
+	The first fpu instruction of a block checks that TOP still matches
+	the value the block was translated for, if not the block is dropped
+	and translated again. Blocks that keep missing use the helper functions.
+	Values are doubles just like in the helper functions.
+*/
+
+static bool dyn_fpu_host=true;		// new translations may use the host fpu mode
+
+enum {
+	DYN_FPU_HELPERS,	// every instruction calls the helper functions
+	DYN_FPU_CHECK,		// the check of the stack top is still missing
+	DYN_FPU_ACTIVE		// stack top is known, values are cached in host registers
+};
+
+// owner of a host register that holds a temporary value
+#define DYN_FPU_SCRATCH 9
+
+static struct {
+	Bitu mode;
+	Bitu top;				// value of TOP at the current instruction
+	bool top_dirty;			// top has not been written to TOP yet
+	Bitu tags_known;		// mask of the tags that are known
+	Bitu tags_dirty;		// mask of the known tags that have not been written yet
+	FPU_Tag tags[8];
+	Bits freg[9];			// host register that holds fpu.regs[i] or -1
+	Bits owner[DRC_FPU_HOST_REGS];	// fpu register in the host register or -1
+	Bitu used[DRC_FPU_HOST_REGS];	// last use, for replacing the least recently used
+	Bitu regs_dirty;		// mask of the fpu registers that were changed in host registers
+	Bitu clock;
+} dyn_fpu;
+
+// blocks that were entered with another stack top than they were translated for
+static struct {
+	Bit32u addr;			// physical address of the block plus one
+	Bit32u misses;
+} dyn_fpu_unstable[64];
+
+#define DYN_FPU_UNSTABLE_INDEX(addr) (((addr)^((addr)>>6))&63)
+
+static void dyn_fpu_start_block(Bit32u phys_addr) {
+	dyn_fpu.mode=DYN_FPU_HELPERS;
+	if (dyn_fpu_host) {
+		Bitu idx=DYN_FPU_UNSTABLE_INDEX(phys_addr);
+		if (dyn_fpu_unstable[idx].addr!=phys_addr+1 || dyn_fpu_unstable[idx].misses<2) dyn_fpu.mode=DYN_FPU_CHECK;
+	}
+	dyn_fpu.top=TOP;
+	dyn_fpu.top_dirty=false;
+	dyn_fpu.tags_known=dyn_fpu.tags_dirty=0;
+	dyn_fpu.regs_dirty=0;
+	for (Bitu i=0;i<9;i++) dyn_fpu.freg[i]=-1;
+	for (Bitu i=0;i<DRC_FPU_HOST_REGS;i++) dyn_fpu.owner[i]=-1;
+}
+
+// called by the core when a block exited because of another stack top
+static void dyn_fpu_top_mismatch(CacheBlockDynRec * block) {
+	if (!block) return;
+	Bit32u phys_addr=(Bit32u)((block->page.handler->GetPhysPage()<<12)|block->page.start);
+	Bitu idx=DYN_FPU_UNSTABLE_INDEX(phys_addr);
+	if (dyn_fpu_unstable[idx].addr!=phys_addr+1) {
+		dyn_fpu_unstable[idx].addr=phys_addr+1;
+		dyn_fpu_unstable[idx].misses=0;
+	}
+	dyn_fpu_unstable[idx].misses++;
+	block->Clear();
+}
+
+static void dyn_fpu_check_top(void) {
+	gen_mov_word_to_reg(FC_OP1,(void*)(&TOP),true);
+	gen_add_imm(FC_OP1,(Bit32u)(-(Bit32s)dyn_fpu.top));
+	save_info_dynrec[used_save_info_dynrec].branch_pos=gen_create_branch_long_nonzero(FC_OP1,true);
+	// leave before the current instruction
+	save_info_dynrec[used_save_info_dynrec].cycles=decode.cycles-1;
+	save_info_dynrec[used_save_info_dynrec].eip_change=decode.op_start-decode.code_start;
+	if (!cpu.code.big) save_info_dynrec[used_save_info_dynrec].eip_change&=0xffff;
+	save_info_dynrec[used_save_info_dynrec].type=fpu_top;
+	used_save_info_dynrec++;
+	dyn_fpu.mode=DYN_FPU_ACTIVE;
+}
+
+// get a free host register, the least recently used one is written back if needed
+static Bitu dyn_fpu_alloc(Bits owner) {
+	Bitu hr=0;
+	for (Bitu i=0;i<DRC_FPU_HOST_REGS;i++) {
+		if (dyn_fpu.owner[i]<0) {
+			hr=i;
+			break;
+		}
+		if (dyn_fpu.used[i]<dyn_fpu.used[hr]) hr=i;
+	}
+	Bits old=dyn_fpu.owner[hr];
+	if (old>=0 && old!=DYN_FPU_SCRATCH) {
+		if (dyn_fpu.regs_dirty&(1<<old)) gen_fpu_mov_dbl_from_freg(hr,&fpu.regs[old].d);
+		dyn_fpu.regs_dirty&=~(1<<old);
+		dyn_fpu.freg[old]=-1;
+	}
+	dyn_fpu.owner[hr]=owner;
+	dyn_fpu.used[hr]=++dyn_fpu.clock;
+	if (owner!=DYN_FPU_SCRATCH) dyn_fpu.freg[owner]=hr;
+	return hr;
+}
+
+static INLINE void dyn_fpu_release(Bitu hr) {
+	dyn_fpu.owner[hr]=-1;
+}
+
+// host register that holds the value of fpu register r
+static Bitu dyn_fpu_get(Bitu r) {
+	Bits hr=dyn_fpu.freg[r];
+	if (hr<0) {
+		hr=dyn_fpu_alloc(r);
+		gen_fpu_mov_dbl_to_freg(hr,&fpu.regs[r].d);
+	} else dyn_fpu.used[hr]=++dyn_fpu.clock;
+	return hr;
+}
+
+// host register that receives a new value for fpu register r
+static Bitu dyn_fpu_set(Bitu r) {
+	Bits hr=dyn_fpu.freg[r];
+	if (hr<0) hr=dyn_fpu_alloc(r);
+	else dyn_fpu.used[hr]=++dyn_fpu.clock;
+	dyn_fpu.regs_dirty|=1<<r;
+	return hr;
+}
+
+// write back changed registers, host registers don't survive function calls
+static void dyn_fpu_spill(void) {
+	for (Bitu i=0;i<DRC_FPU_HOST_REGS;i++) {
+		Bits r=dyn_fpu.owner[i];
+		if (r<0) continue;
+		if (r!=DYN_FPU_SCRATCH) {
+			if (dyn_fpu.regs_dirty&(1<<r)) gen_fpu_mov_dbl_from_freg(i,&fpu.regs[r].d);
+			dyn_fpu.freg[r]=-1;
+		}
+		dyn_fpu.owner[i]=-1;
+	}
+	dyn_fpu.regs_dirty=0;
+}
+
+static void dyn_fpu_write_top(void) {
+	if (!dyn_fpu.top_dirty) return;
+	gen_mov_direct_dword((void*)(&TOP),(Bit32u)dyn_fpu.top);
+	dyn_fpu.top_dirty=false;
+}
+
+// write back the complete fpu state
+static void dyn_fpu_flush(void) {
+	dyn_fpu_spill();
+	for (Bitu i=0;i<8;i++) {
+		if (dyn_fpu.tags_dirty&(1<<i)) gen_mov_direct_dword((void*)(&fpu.tags[i]),(Bit32u)dyn_fpu.tags[i]);
+	}
+	dyn_fpu.tags_dirty=0;
+	dyn_fpu_write_top();
+}
+
+// fpu state kept in host registers has to be written back before
+// instructions that are not fpu instructions (or prefixes of them)
+static void dyn_fpu_before_opcode(Bitu opcode) {
+	switch (opcode) {
+	case 0x26:case 0x2e:case 0x36:case 0x3e:case 0x64:case 0x65:case 0x66:case 0x67:
+	case 0x90:case 0x9b:
+	case 0xd8:case 0xd9:case 0xda:case 0xdb:case 0xdc:case 0xdd:case 0xde:case 0xdf:
+		return;
+	}
+	dyn_fpu_flush();
+}
+
+static void dyn_fpu_set_tag(Bitu r,FPU_Tag tag) {
+	dyn_fpu.tags[r]=tag;
+	dyn_fpu.tags_known|=1<<r;
+	dyn_fpu.tags_dirty|=1<<r;
+}
+
+static void dyn_fpu_copy_tag(Bitu dst,Bitu src) {
+	if (dyn_fpu.tags_known&(1<<src)) {
+		dyn_fpu_set_tag(dst,dyn_fpu.tags[src]);
+		return;
+	}
+	gen_mov_word_to_reg(FC_OP1,(void*)(&fpu.tags[src]),true);
+	gen_mov_word_from_reg(FC_OP1,(void*)(&fpu.tags[dst]),true);
+	dyn_fpu.tags_known&=~(1<<dst);
+	dyn_fpu.tags_dirty&=~(1<<dst);
+}
+
+static void dyn_fpu_swap_tags(Bitu a,Bitu b) {
+	if (dyn_fpu.tags_known&(1<<a)) {
+		FPU_Tag tag=dyn_fpu.tags[a];
+		dyn_fpu_copy_tag(a,b);
+		dyn_fpu_set_tag(b,tag);
+	} else if (dyn_fpu.tags_known&(1<<b)) {
+		FPU_Tag tag=dyn_fpu.tags[b];
+		dyn_fpu_copy_tag(b,a);
+		dyn_fpu_set_tag(a,tag);
+	} else {
+		gen_mov_word_to_reg(FC_OP1,(void*)(&fpu.tags[a]),true);
+		gen_mov_word_to_reg(FC_OP2,(void*)(&fpu.tags[b]),true);
+		gen_mov_word_from_reg(FC_OP1,(void*)(&fpu.tags[b]),true);
+		gen_mov_word_from_reg(FC_OP2,(void*)(&fpu.tags[a]),true);
+	}
+}
+
+// the exact 64bit integers of FILD/FISTP move along with the registers,
+// copied through host fpu registers which keeps all bits
+static void dyn_fpu_copy_r64(Bitu dst,Bitu src) {
+	Bitu hr=dyn_fpu_alloc(DYN_FPU_SCRATCH);
+	gen_fpu_mov_dbl_to_freg(hr,&fpu_r64s[src]);
+	gen_fpu_mov_dbl_from_freg(hr,&fpu_r64s[dst]);
+	dyn_fpu_release(hr);
+}
+
+static void dyn_fpu_swap_r64(Bitu a,Bitu b) {
+	Bitu hra=dyn_fpu_alloc(DYN_FPU_SCRATCH);
+	Bitu hrb=dyn_fpu_alloc(DYN_FPU_SCRATCH);
+	gen_fpu_mov_dbl_to_freg(hra,&fpu_r64s[a]);
+	gen_fpu_mov_dbl_to_freg(hrb,&fpu_r64s[b]);
+	gen_fpu_mov_dbl_from_freg(hra,&fpu_r64s[b]);
+	gen_fpu_mov_dbl_from_freg(hrb,&fpu_r64s[a]);
+	dyn_fpu_release(hra);
+	dyn_fpu_release(hrb);
+}
+
+static void dyn_fpu_push(FPU_Tag tag) {
+	dyn_fpu.top=(dyn_fpu.top-1)&7;
+	dyn_fpu.top_dirty=true;
+	dyn_fpu_set_tag(dyn_fpu.top,tag);
+}
+
+static void dyn_fpu_pop(void) {
+	dyn_fpu_set_tag(dyn_fpu.top,TAG_Empty);
+	dyn_fpu.top=(dyn_fpu.top+1)&7;
+	dyn_fpu.top_dirty=true;
+}
+
+// like FPU_FST
+static void dyn_fpu_copy(Bitu src,Bitu dst) {
+	if (src==dst) return;
+	Bitu hrs=dyn_fpu_get(src);
+	gen_fpu_mov_fregs(dyn_fpu_set(dst),hrs);
+	dyn_fpu_copy_tag(dst,src);
+	dyn_fpu_copy_r64(dst,src);
+}
+
+// like FPU_FXCH, the host registers just change their owners
+static void dyn_fpu_xchg(Bitu a,Bitu b) {
+	if (a==b) return;
+	Bitu hra=dyn_fpu_get(a);
+	Bitu hrb=dyn_fpu_get(b);
+	dyn_fpu.freg[a]=hrb;
+	dyn_fpu.freg[b]=hra;
+	dyn_fpu.owner[hra]=b;
+	dyn_fpu.owner[hrb]=a;
+	dyn_fpu.regs_dirty|=(1<<a)|(1<<b);
+	dyn_fpu_swap_tags(a,b);
+	dyn_fpu_swap_r64(a,b);
+}
+
+// arithmetic group of the instruction (FADD,FMUL,-,-,FSUB,FSUBR,FDIV,FDIVR)
+static void dyn_fpu_arith(Bitu group,Bitu dst,Bitu src) {
+	DynFpuOps op;
+	switch (group) {
+	case 0x00:case 0x01:op=(group==0x00) ? DFO_ADD : DFO_MUL;break;
+	case 0x04:case 0x05:op=DFO_SUB;break;
+	default:op=DFO_DIV;break;
+	}
+	Bitu hrd=dyn_fpu_get(dst);
+	Bitu hrs=dyn_fpu_get(src);
+	if (group==0x05 || group==0x07) gen_fpu_dop(op,hrd,hrs,hrd);
+	else gen_fpu_dop(op,hrd,hrd,hrs);
+	dyn_fpu.regs_dirty|=1<<dst;
+}
+
+// FLD and friends, the helper function converts the value into the new top
+static void dyn_fpu_load(void * func) {
+	dyn_fpu_spill();
+	dyn_fill_ea(FC_OP1);
+	dyn_fpu_push(TAG_Valid);
+	gen_call_function_RI(func,FC_OP1,dyn_fpu.top);
+}
+
+// FST and friends, the helper function reads the value from TOP
+static void dyn_fpu_store(void * func,bool pop) {
+	dyn_fpu_spill();
+	dyn_fpu_write_top();
+	dyn_fill_ea(FC_ADDR);
+	gen_call_function_R(func,FC_ADDR);
+	if (pop) dyn_fpu_pop();
+}
+
+// stack top change of the helper function code for the current instruction
+#define DYN_FPU_TOP_RESET 0x100		// set to zero
+#define DYN_FPU_TOP_UNKNOWN 0x200	// loaded from memory
+static Bits dyn_fpu_helpers_top_change(Bitu esc) {
+	static const Bits esc1_group6[8]={0,1,-1,1,-1,0,-1,1};		// F2XM1..FINCSTP
+	static const Bits esc1_group7[8]={0,1,0,-1,0,0,0,0};		// FPREM..FCOS
+	Bitu reg=decode.modrm.reg;
+	Bitu rm=decode.modrm.rm;
+	if (decode.modrm.mod==3) switch (esc) {
+	case 0:case 4:return (reg==3) ? 1 : 0;
+	case 1:
+		switch (reg) {
+		case 0:return -1;
+		case 3:return 1;
+		case 5:return (rm<7) ? -1 : 0;
+		case 6:return esc1_group6[rm];
+		case 7:return esc1_group7[rm];
+		}
+		return 0;
+	case 2:return (reg==5 && rm==1) ? 2 : 0;
+	case 3:return (reg==4 && rm==3) ? DYN_FPU_TOP_RESET : 0;
+	case 5:return (reg==3 || reg==5) ? 1 : 0;
+	case 6:if (reg==3) return (rm==1) ? 2 : 0;
+		return 1;
+	case 7:return (reg==0 || reg==2 || reg==3) ? 1 : 0;
+	} else switch (esc) {
+	case 0:case 2:case 4:case 6:return (reg==3) ? 1 : 0;
+	case 1:
+		if (reg==0) return -1;
+		if (reg==4) return DYN_FPU_TOP_UNKNOWN;
+		return (reg==3) ? 1 : 0;
+	case 3:
+		if (reg==0 || reg==5) return -1;
+		return (reg==3 || reg==7) ? 1 : 0;
+	case 5:
+		if (reg==0) return -1;
+		if (reg==4) return DYN_FPU_TOP_UNKNOWN;
+		if (reg==6) return DYN_FPU_TOP_RESET;
+		return (reg==3) ? 1 : 0;
+	case 7:
+		if (reg==0 || reg==4 || reg==5) return -1;
+		return (reg==3 || reg>=6) ? 1 : 0;
+	}
+	return 0;
+}
+
+static const Real64 dyn_fpu_consts[7]={1.0,L2T,L2E,PI,LG2,LN2,0.0};
+
+// translate the current instruction with host fpu registers, returns false
+// when the helper function code has to be generated after all
+static bool dyn_fpu_host_op(Bitu esc) {
+	if (dyn_fpu.mode==DYN_FPU_HELPERS) return false;
+	if (dyn_fpu.mode==DYN_FPU_CHECK) dyn_fpu_check_top();
+	Bitu reg=decode.modrm.reg;
+	Bitu st=dyn_fpu.top;
+	Bitu sti=(dyn_fpu.top+decode.modrm.rm)&7;
+	if (decode.modrm.mod==3) switch (esc) {
+	case 0:		// op ST,STi
+		if (reg==0x02 || reg==0x03) break;
+		dyn_fpu_arith(reg,st,sti);
+		return true;
+	case 1:
+		switch (reg) {
+		case 0x00:	// FLD STi
+			dyn_fpu_push(TAG_Valid);
+			dyn_fpu_copy(sti,dyn_fpu.top);
+			return true;
+		case 0x01:	// FXCH STi
+			dyn_fpu_xchg(st,sti);
+			return true;
+		case 0x02:	// FNOP
+			return true;
+		case 0x03:	// FSTP STi
+			dyn_fpu_copy(st,sti);
+			dyn_fpu_pop();
+			return true;
+		case 0x05:	// FLD1..FLDZ
+			if (decode.modrm.rm==7) break;
+			dyn_fpu_push(decode.modrm.rm==6 ? TAG_Zero : TAG_Valid);
+			gen_fpu_mov_dbl_to_freg(dyn_fpu_set(dyn_fpu.top),(void*)&dyn_fpu_consts[decode.modrm.rm]);
+			return true;
+		}
+		break;
+	case 4:		// op STi,ST (with FSUB/FSUBR and FDIV/FDIVR swapped)
+	case 6:		// same and pop
+		if (reg==0x02 || reg==0x03) break;
+		dyn_fpu_arith((reg>=0x04) ? (reg^1) : reg,sti,st);
+		if (esc==6) dyn_fpu_pop();
+		return true;
+	case 5:
+	case 7:
+		switch (reg) {
+		case 0x00:	// FFREE STi, FFREEP STi
+			dyn_fpu_set_tag(sti,TAG_Empty);
+			if (esc==7) dyn_fpu_pop();
+			return true;
+		case 0x01:	// FXCH STi
+			dyn_fpu_xchg(st,sti);
+			return true;
+		case 0x02:	// FST STi (FSTP STi)
+		case 0x03:	// FSTP STi
+			dyn_fpu_copy(st,sti);
+			if (reg==0x03 || esc==7) dyn_fpu_pop();
+			return true;
+		}
+		break;
+	} else switch (esc) {
+	case 0:case 2:case 4:case 6:	// op ST,mem
+		if (reg==0x02 || reg==0x03) break;
+		dyn_fpu_spill();
+		dyn_fill_ea(FC_ADDR);
+		switch (esc) {
+		case 0:gen_call_function_R((void*)&FPU_FLD_F32_EA,FC_ADDR);break;
+		case 2:gen_call_function_R((void*)&FPU_FLD_I32_EA,FC_ADDR);break;
+		case 4:gen_call_function_R((void*)&FPU_FLD_F64_EA,FC_ADDR);break;
+		case 6:gen_call_function_R((void*)&FPU_FLD_I16_EA,FC_ADDR);break;
+		}
+		dyn_fpu_arith(reg,st,8);
+		return true;
+	case 1:
+		if (reg==0x00) dyn_fpu_load((void*)&FPU_FLD_F32);
+		else if (reg==0x02 || reg==0x03) dyn_fpu_store((void*)&FPU_FST_F32,reg==0x03);
+		else break;
+		return true;
+	case 3:
+		if (reg==0x00) dyn_fpu_load((void*)&FPU_FLD_I32);
+		else if (reg==0x02 || reg==0x03) dyn_fpu_store((void*)&FPU_FST_I32,reg==0x03);
+		else break;
+		return true;
+	case 5:
+		if (reg==0x00) dyn_fpu_load((void*)&FPU_FLD_F64);
+		else if (reg==0x02 || reg==0x03) dyn_fpu_store((void*)&FPU_FST_F64,reg==0x03);
+		else break;
+		return true;
+	case 7:
+		switch (reg) {
+		case 0x00:dyn_fpu_load((void*)&FPU_FLD_I16);return true;
+		case 0x02:case 0x03:dyn_fpu_store((void*)&FPU_FST_I16,reg==0x03);return true;
+		case 0x04:dyn_fpu_load((void*)&FPU_FBLD);return true;
+		case 0x05:dyn_fpu_load((void*)&FPU_FLD_I64);return true;
+		case 0x06:dyn_fpu_store((void*)&FPU_FBST,true);return true;
+		case 0x07:dyn_fpu_store((void*)&FPU_FST_I64,true);return true;
+		}
+		break;
+	}
+
+	// everything else is left to the helper functions
+	dyn_fpu_flush();
+	dyn_fpu.tags_known=0;
+	Bits change=dyn_fpu_helpers_top_change(esc);
+	if (change==DYN_FPU_TOP_UNKNOWN) dyn_fpu.mode=DYN_FPU_HELPERS;
+	else if (change==DYN_FPU_TOP_RESET) dyn_fpu.top=0;
+	else dyn_fpu.top=(dyn_fpu.top+change)&7;
+	return false;
+}
+#endif
+
 static void dyn_eatree() {
 //	Bitu group = (decode.modrm.val >> 3) & 7;
 	Bitu group = decode.modrm.reg&7; //It is already that, but compilers.
@@ -103,6 +557,9 @@ static void dyn_eatree() {
 
 static void dyn_fpu_esc0(){
 	dyn_get_modrm(); 
+#ifdef DYN_FPU_HOST
+	if (dyn_fpu_host_op(0)) return;
+#endif
 //	if (decode.modrm.val >= 0xc0) {
 	if (decode.modrm.mod == 3) { 
 		dyn_fpu_top();
@@ -146,6 +603,9 @@ static void dyn_fpu_esc0(){
 
 static void dyn_fpu_esc1(){
 	dyn_get_modrm();  
+#ifdef DYN_FPU_HOST
+	if (dyn_fpu_host_op(1)) return;
+#endif
 //	if (decode.modrm.val >= 0xc0) { 
 	if (decode.modrm.mod == 3) {
 		switch (decode.modrm.reg){
@@ -334,6 +794,9 @@ static void dyn_fpu_esc1(){
 
 static void dyn_fpu_esc2(){
 	dyn_get_modrm();  
+#ifdef DYN_FPU_HOST
+	if (dyn_fpu_host_op(2)) return;
+#endif
 //	if (decode.modrm.val >= 0xc0) { 
 	if (decode.modrm.mod == 3) {
 		switch(decode.modrm.reg){
@@ -367,6 +830,9 @@ static void dyn_fpu_esc2(){
 
 static void dyn_fpu_esc3(){
 	dyn_get_modrm();  
+#ifdef DYN_FPU_HOST
+	if (dyn_fpu_host_op(3)) return;
+#endif
 //	if (decode.modrm.val >= 0xc0) { 
 	if (decode.modrm.mod == 3) {
 		switch (decode.modrm.reg) {
@@ -432,6 +898,9 @@ static void dyn_fpu_esc3(){
 
 static void dyn_fpu_esc4(){
 	dyn_get_modrm();  
+#ifdef DYN_FPU_HOST
+	if (dyn_fpu_host_op(4)) return;
+#endif
 //	if (decode.modrm.val >= 0xc0) { 
 	if (decode.modrm.mod == 3) {
 		switch(decode.modrm.reg){
@@ -481,6 +950,9 @@ static void dyn_fpu_esc4(){
 
 static void dyn_fpu_esc5(){
 	dyn_get_modrm();  
+#ifdef DYN_FPU_HOST
+	if (dyn_fpu_host_op(5)) return;
+#endif
 //	if (decode.modrm.val >= 0xc0) { 
 	if (decode.modrm.mod == 3) {
 		dyn_fpu_top();
@@ -552,6 +1024,9 @@ static void dyn_fpu_esc5(){
 
 static void dyn_fpu_esc6(){
 	dyn_get_modrm();  
+#ifdef DYN_FPU_HOST
+	if (dyn_fpu_host_op(6)) return;
+#endif
 //	if (decode.modrm.val >= 0xc0) { 
 	if (decode.modrm.mod == 3) {
 		switch(decode.modrm.reg){
@@ -609,6 +1084,9 @@ static void dyn_fpu_esc6(){
 
 static void dyn_fpu_esc7(){
 	dyn_get_modrm();  
+#ifdef DYN_FPU_HOST
+	if (dyn_fpu_host_op(7)) return;
+#endif
 //	if (decode.modrm.val >= 0xc0) { 
 	if (decode.modrm.mod == 3) {
 		switch (decode.modrm.reg){
@@ -1477,6 +1477,11 @@ static INLINE void dyn_mmx_pandn()
 static INLINE void dyn_mmx_emms()
 {
 	gen_call_function_raw((void*)setFPUTagEmpty);
+#ifdef DYN_FPU_HOST
+	// the fpu stack top is reset, later fpu instructions have to know
+	dyn_fpu.top=0;
+	dyn_fpu.tags_known=0;
+#endif
 }
 
 #define dynrec_mmx_op(code, func) case code: if (CPU_ArchitectureType<CPU_ARCHTYPE_PENTIUM_MMX) goto illegalopcode; func(); break;
@@ -40,6 +40,9 @@
 #define DRC_USE_REGS_ADDR
 // use FC_SEGS_ADDR to hold the address of "Segs" and to access it using FC_SEGS_ADDR
 #define DRC_USE_SEGS_ADDR
+// keep fpu values in the floating point registers d16-d23 (not preserved across calls)
+#define DRC_USE_HOST_FPU
+#define DRC_FPU_HOST_REGS 8
 
 // register mapping
 typedef Bit8u HostReg;
@@ -298,6 +301,19 @@ typedef Bit8u HostReg;
 #define BGT_FWD(imm) (0x5400000c + ((imm) << 3) )
 // b pc+imm		@	0 <= imm < 128M	&	imm mod 4 = 0
 #define B_FWD(imm) (0x14000000 + ((imm) >> 2) )
+
+// floating point
+// ldr freg, [addr, #imm]		@	0 <= imm < 32768	&	imm mod 8 = 0
+#define FLDR64_IMM(freg, addr, imm) (0xfd400000 + (freg) + ((addr) << 5) + ((imm) << 7) )
+// str freg, [addr, #imm]		@	0 <= imm < 32768	&	imm mod 8 = 0
+#define FSTR64_IMM(freg, addr, imm) (0xfd000000 + (freg) + ((addr) << 5) + ((imm) << 7) )
+// fmov dst, src
+#define FMOV64(dst, src) (0x1e604000 + (dst) + ((src) << 5) )
+// fadd/fsub/fmul/fdiv dst, src1, src2
+#define FADD64(dst, src1, src2) (0x1e602800 + (dst) + ((src1) << 5) + ((src2) << 16) )
+#define FSUB64(dst, src1, src2) (0x1e603800 + (dst) + ((src1) << 5) + ((src2) << 16) )
+#define FMUL64(dst, src1, src2) (0x1e600800 + (dst) + ((src1) << 5) + ((src2) << 16) )
+#define FDIV64(dst, src1, src2) (0x1e601800 + (dst) + ((src1) << 5) + ((src2) << 16) )
 // br reg
 #define BR(reg) (0xd61f0000 + ((reg) << 5) )
 // blr reg
@@ -1137,6 +1153,34 @@ static void gen_fill_function_ptr(const Bit8u * pos,void* fct_ptr,Bitu flags_typ
 #endif
 
 
+// load the double at data into host fpu register freg
+static void gen_fpu_mov_dbl_to_freg(Bitu freg,void* data) {
+	gen_mov_qword_to_reg_imm(temp1, (Bit64u)data);
+	cache_addd( FLDR64_IMM(16 + freg, temp1, 0) );      // ldr d(16+freg), [temp1]
+}
+
+// store host fpu register freg as double at dest
+static void gen_fpu_mov_dbl_from_freg(Bitu freg,void* dest) {
+	gen_mov_qword_to_reg_imm(temp1, (Bit64u)dest);
+	cache_addd( FSTR64_IMM(16 + freg, temp1, 0) );      // str d(16+freg), [temp1]
+}
+
+// copy host fpu register src to dst
+static void gen_fpu_mov_fregs(Bitu dst,Bitu src) {
+	if (dst == src) return;
+	cache_addd( FMOV64(16 + dst, 16 + src) );           // fmov d(16+dst), d(16+src)
+}
+
+// dst=src1 op src2 on host fpu registers, operands may overlap in any way
+static void gen_fpu_dop(DynFpuOps op,Bitu dst,Bitu src1,Bitu src2) {
+	switch (op) {
+		case DFO_ADD: cache_addd( FADD64(16 + dst, 16 + src1, 16 + src2) ); break;
+		case DFO_SUB: cache_addd( FSUB64(16 + dst, 16 + src1, 16 + src2) ); break;
+		case DFO_MUL: cache_addd( FMUL64(16 + dst, 16 + src1, 16 + src2) ); break;
+		case DFO_DIV: cache_addd( FDIV64(16 + dst, 16 + src1, 16 + src2) ); break;
+	}
+}
+
 #ifdef _MSC_VER
 static HANDLE hProcess = GetCurrentProcess();
 static void cache_block_closing(const Bit8u* block_start,Bitu block_size) {
@@ -33,6 +33,16 @@
 #define DRC_CALL_CONV	/* nothing */
 #define DRC_FC			/* nothing */
 
+// keep fpu values in sse registers (see gen_fpu_dop and friends)
+#define DRC_USE_HOST_FPU
+#if defined (_WIN64)
+// xmm6 and above are callee-saved, xmm5 is the scratch register for gen_fpu_dop
+#define DRC_FPU_HOST_REGS 5
+#else
+// xmm7 is the scratch register for gen_fpu_dop
+#define DRC_FPU_HOST_REGS 7
+#endif
+
 
 // register mapping
 typedef Bit8u HostReg;
@@ -692,6 +702,59 @@ static void gen_fill_function_ptr(const Bit8u * pos,void* fct_ptr,Bitu flags_typ
 }
 #endif
 
+// generate an sse2 instruction (f2 0f op) that accesses a double at a memory location
+static void gen_fpu_memaddr(Bitu freg,void* data,Bit8u op) {
+	Bit64s diff = (Bit64s)data-((Bit64s)cache.pos+8);
+	if ( (diff>>63) == (diff>>31) ) {
+		cache_addb(0xf2);
+		cache_addw(0x0f+(op<<8));
+		cache_addb(0x05+(freg<<3));		// [rip+diff]
+		cache_addd((Bit32u)(((Bit64u)diff)&0xffffffffLL));
+	} else if ((Bit64u)data<0x100000000LL) {
+		cache_addb(0xf2);
+		cache_addw(0x0f+(op<<8));
+		cache_addw(0x2504+(freg<<3));	// [data]
+		cache_addd((Bit32u)(((Bit64u)data)&0xffffffffLL));
+	} else {
+		cache_addb(0x50);				// push rax
+		gen_mov_reg_qword(HOST_EAX,(Bit64u)data);
+		cache_addb(0xf2);
+		cache_addw(0x0f+(op<<8));
+		cache_addb(0x00+(freg<<3));		// [rax]
+		cache_addb(0x58);				// pop rax
+	}
+}
+
+// load the double at data into host fpu register freg
+static void gen_fpu_mov_dbl_to_freg(Bitu freg,void* data) {
+	gen_fpu_memaddr(freg,data,0x10);	// movsd xmm,[data]
+}
+
+// store host fpu register freg as double at dest
+static void gen_fpu_mov_dbl_from_freg(Bitu freg,void* dest) {
+	gen_fpu_memaddr(freg,dest,0x11);	// movsd [dest],xmm
+}
+
+// copy host fpu register src to dst
+static void gen_fpu_mov_fregs(Bitu dst,Bitu src) {
+	if (dst==src) return;
+	cache_addb(0x66);					// movapd dst,src
+	cache_addw(0x280f);
+	cache_addb(0xc0+(dst<<3)+src);
+}
+
+// dst=src1 op src2 on host fpu registers, operands may overlap in any way
+static void gen_fpu_dop(DynFpuOps op,Bitu dst,Bitu src1,Bitu src2) {
+	static const Bit8u sse_ops[4]={0x58,0x5c,0x59,0x5e};	// addsd,subsd,mulsd,divsd
+	Bitu res=dst;
+	if (dst==src2 && dst!=src1) res=DRC_FPU_HOST_REGS;		// keep src2 intact
+	gen_fpu_mov_fregs(res,src1);
+	cache_addb(0xf2);
+	cache_addw(0x0f+(sse_ops[op]<<8));
+	cache_addb(0xc0+(res<<3)+src2);
+	gen_fpu_mov_fregs(dst,res);
+}
+
 static void cache_block_closing(const Bit8u* block_start,Bitu block_size) { }
 
 static void cache_block_before_close(void) { }
@@ -103,6 +103,8 @@ public:
 		CacheBlockDynRec * from;	// the from-block can transfer control to this block
 	} link[2];	// maximum two links (conditional jumps)
 	CacheBlockDynRec * crossblock;
+	Bit32u heat;	// times the block was entered (if counted by the core), halved whenever the allocator passes by
+	bool trace;		// block was retranslated as a hot trace (see core_dynrec)
 };
 
 static struct {
@@ -118,6 +120,21 @@ static struct {
 	CodePageHandlerDynRec * last_page;		// the last used page
 } cache;
 
+// size of the code cache and number of cache blocks, can be changed before (re-)initialization
+static Bitu cache_total=CACHE_TOTAL;
+static Bitu cache_block_count=CACHE_BLOCKS;
+
+// counters for the performance statistics display
+static struct {
+	Bit32u translations;	// blocks created
+	Bit32u evictions;		// blocks dropped to make room for new ones
+	Bit32u invalidations;	// blocks dropped due to self-modifying code
+	Bit32u spared;			// hot blocks skipped over by the allocator
+	Bit32u traces;			// hot blocks retranslated as traces
+	Bit32u smc_page;		// code page with the most invalidated blocks
+	Bit32u smc_page_count;	// number of blocks invalidated in that page
+} cache_stats;
+
 
 // cache memory pointers, to be malloc'd later
 static Bit8u * cache_code_start_ptr=NULL;
@@ -154,6 +171,7 @@ public:
 
 		active_blocks=0;
 		active_count=16;
+		invalidations=0;
 
 		// initialize the maps with zero (no cache blocks as well as code present)
 		memset(&hash_map,0,sizeof(hash_map));
@@ -184,6 +202,11 @@ public:
 				if (start<=block->page.end && end>=block->page.start) {
 					if (ip_point<=block->page.end && ip_point>=block->page.start) is_current_block=true;
 					block->Clear();		// clear the block, decrements the write_map accordingly
+					cache_stats.invalidations++;
+					if (++invalidations>cache_stats.smc_page_count) {
+						cache_stats.smc_page_count=invalidations;
+						cache_stats.smc_page=(Bit32u)phys_page;
+					}
 				}
 				block=nextblock;
 			}
@@ -201,6 +224,7 @@ public:
 		addr&=4095;
 		if (host_readb(hostmem+addr)==(Bit8u)val) return;
 		host_writeb(hostmem+addr,val);
+		MEM_MarkPageDirty(phys_page);
 		// see if there's code where we are writing to
 		if (!write_map[addr]) {
 			if (active_blocks) return;		// still some blocks in this page
@@ -222,6 +246,7 @@ public:
 		addr&=4095;
 		if (host_readw(hostmem+addr)==(Bit16u)val) return;
 		host_writew(hostmem+addr,val);
+		MEM_MarkPageDirty(phys_page);
 		// see if there's code where we are writing to
 		if (!*(Bit16u*)&write_map[addr]) {
 			if (active_blocks) return;		// still some blocks in this page
@@ -248,6 +273,7 @@ public:
 		addr&=4095;
 		if (host_readd(hostmem+addr)==(Bit32u)val) return;
 		host_writed(hostmem+addr,val);
+		MEM_MarkPageDirty(phys_page);
 		// see if there's code where we are writing to
 		if (!*(Bit32u*)&write_map[addr]) {
 			if (active_blocks) return;		// still some blocks in this page
@@ -292,6 +318,7 @@ public:
 			}
 		}
 		host_writeb(hostmem+addr,val);
+		MEM_MarkPageDirty(phys_page);
 		return false;
 	}
 	bool writew_checked(PhysPt addr,Bitu val) {
@@ -325,6 +352,7 @@ public:
 			}
 		}
 		host_writew(hostmem+addr,val);
+		MEM_MarkPageDirty(phys_page);
 		return false;
 	}
 	bool writed_checked(PhysPt addr,Bitu val) {
@@ -358,6 +386,7 @@ public:
 			}
 		}
 		host_writed(hostmem+addr,val);
+		MEM_MarkPageDirty(phys_page);
 		return false;
 	}
 
@@ -457,6 +486,9 @@ public:
 	HostPt GetHostWritePt(Bitu phys_page) { 
 		return GetHostReadPt( phys_page );
 	}
+	// access for the translation profile (see core_dynrec)
+	Bitu GetPhysPage(void) { return phys_page; }
+	CacheBlockDynRec * GetHashChain(Bitu index) { return hash_map[index]; }
 public:
 	// the write map, there are write_map[i] cache blocks that cover the byte at address i
 	Bit8u write_map[4096];
@@ -470,6 +502,7 @@ private:
 
 	Bitu active_blocks;		// the number of cache blocks in this page
 	Bitu active_count;		// delaying parameter to not immediately release a page
+	Bit32u invalidations;	// number of blocks dropped due to writes into this page
 	HostPt hostmem;	
 	Bitu phys_page;
 };
@@ -537,13 +570,45 @@ void CacheBlockDynRec::Clear(void) {
 }
 
 
+// get the block the allocator continues with after the given block
+static INLINE CacheBlockDynRec * cache_nextactive(CacheBlockDynRec * block) {
+	if (!block->cache.next || (block->cache.next->cache.start>(cache_code_start_ptr + cache_total - CACHE_MAXSIZE))) {
+//		LOG_MSG("Cache full restarting");
+		return cache.block.first;
+	}
+	return block->cache.next;
+}
+
 static CacheBlockDynRec * cache_openblock(void) {
 	CacheBlockDynRec * block=cache.block.active;
+#ifdef CACHE_HOT_HEAT
+	// the cache is used as a ring, but instead of overwriting whatever comes next
+	// skip over areas that contain blocks which were entered often since the last
+	// time around. Their heat gets halved so they only survive while still in use.
+	for (Bitu tries=0;tries<CACHE_HOT_SKIPS;tries++) {
+		Bitu region=0;
+		CacheBlockDynRec * hotblock=NULL, * regblock;
+		for (regblock=block;regblock && region<CACHE_MAXSIZE;regblock=regblock->cache.next) {
+			region+=regblock->cache.size;
+			if (regblock->page.handler && regblock->heat>=CACHE_HOT_HEAT) hotblock=regblock;
+		}
+		if (!hotblock) break;
+		for (regblock=block;;regblock=regblock->cache.next) {
+			regblock->heat>>=1;
+			if (regblock==hotblock) break;
+		}
+		cache_stats.spared++;
+		block=cache_nextactive(hotblock);
+	}
+	cache.block.active=block;
+#endif
 	// check for enough space in this block
 	Bitu size=block->cache.size;
 	CacheBlockDynRec * nextblock=block->cache.next;
-	if (block->page.handler) 
+	if (block->page.handler) {
 		block->Clear();
+		cache_stats.evictions++;
+	}
 	// block size must be at least CACHE_MAXSIZE
 	while (size<CACHE_MAXSIZE) {
 		if (!nextblock)
@@ -551,8 +616,10 @@ static CacheBlockDynRec * cache_openblock(void) {
 		// merge blocks
 		size+=nextblock->cache.size;
 		CacheBlockDynRec * tempblock=nextblock->cache.next;
-		if (nextblock->page.handler) 
+		if (nextblock->page.handler) {
 			nextblock->Clear();
+			cache_stats.evictions++;
+		}
 		// block is free now
 		cache_addunusedblock(nextblock);
 		nextblock=tempblock;
@@ -561,7 +628,10 @@ skipresize:
 	// adjust parameters and open this block
 	block->cache.size=size;
 	block->cache.next=nextblock;
+	block->heat=0;
+	block->trace=false;
 	cache.pos=block->cache.start;
+	cache_stats.translations++;
 	return block;
 }
 
@@ -596,12 +666,7 @@ static void cache_closeblock(void) {
 		}
 	}
 	// advance the active block pointer
-	if (!block->cache.next || (block->cache.next->cache.start>(cache_code_start_ptr + CACHE_TOTAL - CACHE_MAXSIZE))) {
-//		LOG_MSG("Cache full restarting");
-		cache.block.active=cache.block.first;
-	} else {
-		cache.block.active=block->cache.next;
-	}
+	cache.block.active=cache_nextactive(block);
 }
 
 
@@ -691,12 +756,12 @@ static void cache_init(bool enable) {
 		cache_initialized = true;
 		if (cache_blocks == NULL) {
 			// allocate the cache blocks memory
-			cache_blocks=(CacheBlockDynRec*)malloc(CACHE_BLOCKS*sizeof(CacheBlockDynRec));
+			cache_blocks=(CacheBlockDynRec*)malloc(cache_block_count*sizeof(CacheBlockDynRec));
 			if(!cache_blocks) E_Exit("Allocating cache_blocks has failed");
-			memset(cache_blocks,0,sizeof(CacheBlockDynRec)*CACHE_BLOCKS);
+			memset(cache_blocks,0,sizeof(CacheBlockDynRec)*cache_block_count);
 			cache.block.free=&cache_blocks[0];
 			// initialize the cache blocks
-			for (i=0;i<CACHE_BLOCKS-1;i++) {
+			for (i=0;i<(Bits)cache_block_count-1;i++) {
 				cache_blocks[i].link[0].to=(CacheBlockDynRec *)1;
 				cache_blocks[i].link[1].to=(CacheBlockDynRec *)1;
 				cache_blocks[i].cache.next=&cache_blocks[i+1];
@@ -705,12 +770,12 @@ static void cache_init(bool enable) {
 		if (cache_code_start_ptr==NULL) {
 			// allocate the code cache memory
 #if defined (WIN32)
-			cache_code_start_ptr=(Bit8u*)VirtualAlloc(0,CACHE_TOTAL+CACHE_MAXSIZE+PAGESIZE_TEMP-1+PAGESIZE_TEMP,
+			cache_code_start_ptr=(Bit8u*)VirtualAlloc(0,cache_total+CACHE_MAXSIZE+PAGESIZE_TEMP-1+PAGESIZE_TEMP,
 				MEM_COMMIT,PAGE_EXECUTE_READWRITE);
 			if (!cache_code_start_ptr)
-				cache_code_start_ptr=(Bit8u*)malloc(CACHE_TOTAL+CACHE_MAXSIZE+PAGESIZE_TEMP-1+PAGESIZE_TEMP);
+				cache_code_start_ptr=(Bit8u*)malloc(cache_total+CACHE_MAXSIZE+PAGESIZE_TEMP-1+PAGESIZE_TEMP);
 #elif defined (HAVE_LIBNX)
-			cache_code_start_ptr=(Bit8u*)nxmmap(NULL, CACHE_TOTAL+CACHE_MAXSIZE+PAGESIZE_TEMP-1+PAGESIZE_TEMP);
+			cache_code_start_ptr=(Bit8u*)nxmmap(NULL, cache_total+CACHE_MAXSIZE+PAGESIZE_TEMP-1+PAGESIZE_TEMP);
 #elif defined (VITA)
 			sceBlock = getVMBlock();
 			if (sceBlock >= 0) {
@@ -723,7 +788,7 @@ static void cache_init(bool enable) {
 			cache_code_start_ptr=(Bit8u*)WUP_RWX_MEM_BASE;
 			//memset(cache_code_start_ptr, 0, (WUP_RWX_MEM_END - WUP_RWX_MEM_BASE));
 #else
-			cache_code_start_ptr=(Bit8u*)malloc(CACHE_TOTAL+CACHE_MAXSIZE+PAGESIZE_TEMP-1+PAGESIZE_TEMP);
+			cache_code_start_ptr=(Bit8u*)malloc(cache_total+CACHE_MAXSIZE+PAGESIZE_TEMP-1+PAGESIZE_TEMP);
 #endif
 			if(!cache_code_start_ptr) E_Exit("Allocating dynamic cache failed");
 
@@ -734,14 +799,14 @@ static void cache_init(bool enable) {
 			cache_code=cache_code+PAGESIZE_TEMP;
 
 #if (C_HAVE_MPROTECT)
-			if(mprotect(cache_code_link_blocks,CACHE_TOTAL+CACHE_MAXSIZE+PAGESIZE_TEMP,PROT_WRITE|PROT_READ|PROT_EXEC))
+			if(mprotect(cache_code_link_blocks,cache_total+CACHE_MAXSIZE+PAGESIZE_TEMP,PROT_WRITE|PROT_READ|PROT_EXEC))
 				LOG_MSG("Setting execute permission on the code cache has failed");
 #endif
 			CacheBlockDynRec * block=cache_getblock();
 			cache.block.first=block;
 			cache.block.active=block;
 			block->cache.start=&cache_code[0];
-			block->cache.size=CACHE_TOTAL;
+			block->cache.size=cache_total;
 			block->cache.next=0;						// last block in the list
 		}
 		// setup the default blocks for block linkage returns
@@ -817,7 +882,7 @@ static void cache_close(void) {
 		if (!VirtualFree(cache_code_start_ptr, 0, MEM_RELEASE))
 			free(cache_code_start_ptr);
 #elif defined (HAVE_LIBNX)
-		nxmunmap(cache_code_start_ptr, CACHE_TOTAL+CACHE_MAXSIZE+PAGESIZE_TEMP-1+PAGESIZE_TEMP);
+		nxmunmap(cache_code_start_ptr, cache_total+CACHE_MAXSIZE+PAGESIZE_TEMP-1+PAGESIZE_TEMP);
 #elif defined (VITA)
 		sceKernelFreeMemBlock(sceBlock);
 		sceBlock = 0;
@@ -840,9 +905,9 @@ static void DBPSerialize_cache_reset(void) {
 		}
 
 		DBP_ASSERT(cache_blocks);
-		memset(cache_blocks,0,sizeof(CacheBlockDynRec)*CACHE_BLOCKS);
+		memset(cache_blocks,0,sizeof(CacheBlockDynRec)*cache_block_count);
 		cache.block.free=&cache_blocks[0];
-		for (Bits i=0;i<CACHE_BLOCKS-1;i++) {
+		for (Bits i=0;i<(Bits)cache_block_count-1;i++) {
 			cache_blocks[i].link[0].to=(CacheBlockDynRec *)1;
 			cache_blocks[i].link[1].to=(CacheBlockDynRec *)1;
 			cache_blocks[i].cache.next=&cache_blocks[i+1];
@@ -853,7 +918,7 @@ static void DBPSerialize_cache_reset(void) {
 		cache.block.first=block;
 		cache.block.active=block;
 		block->cache.start=&cache_code[0];
-		block->cache.size=CACHE_TOTAL;
+		block->cache.size=cache_total;
 		block->cache.next=0;
 
 		/* Setup the default blocks for block linkage returns */
@@ -1373,7 +1373,6 @@ static InitPageUserROHandler dyncore_init_page_handler_userro;
 static NewInitPageHandler normalcore_init_page_handler;
 static ExceptionPageHandler normalcore_exception_handler;
 static PageFoilHandler normalcore_foiling_handler;
-static PageHandler* init_page_handler;
 
 Bitu PAGING_GetDirBase(void) {
 	return paging.cr3;
@@ -1393,18 +1392,12 @@ bool PAGING_ForcePageInit(Bitu lin_addr) {
 }
 
 #if defined(USE_FULL_TLB)
-#include <stddef.h> //for offsetof
 
 void PAGING_InitTLB(void) {
-	//DBP: Performance improvement
-	DBP_STATIC_ASSERT(offsetof(PagingBlock, tlb.write) == offsetof(PagingBlock, tlb.read) + sizeof(paging.tlb.read));
-	memset(paging.tlb.read, 0, sizeof(paging.tlb.read) + sizeof(paging.tlb.write));
-	for (Bitu i=0;i<TLB_SIZE;i++) paging.tlb.readhandler[i]=init_page_handler;
-	for (Bitu i=0;i<TLB_SIZE;i++) paging.tlb.writehandler[i]=init_page_handler;
-	paging.ur_links.used=0;
-	paging.krw_links.used=0;
-	paging.kr_links.used=0;
-	paging.links.used=0;
+	//DBP: Only reset the entries that were linked, all others are still zero.
+	// This keeps the pages of the tables that were never used out of memory.
+	PAGING_UnlinkPages(0,LINK_START);
+	PAGING_ClearTLB();
 }
 
 void PAGING_ClearTLB(void) {
@@ -1415,8 +1408,8 @@ void PAGING_ClearTLB(void) {
 		Bitu page=*entries++;
 		paging.tlb.read[page]=0;
 		paging.tlb.write[page]=0;
-		paging.tlb.readhandler[page]=init_page_handler;
-		paging.tlb.writehandler[page]=init_page_handler;
+		paging.tlb.readhandler[page]=NULL;
+		paging.tlb.writehandler[page]=NULL;
 	}
 	paging.ur_links.used=0;
 	paging.krw_links.used=0;
@@ -1428,8 +1421,8 @@ void PAGING_UnlinkPages(Bitu lin_page,Bitu pages) {
 	for (;pages>0;pages--) {
 		paging.tlb.read[lin_page]=0;
 		paging.tlb.write[lin_page]=0;
-		paging.tlb.readhandler[lin_page]=init_page_handler;
-		paging.tlb.writehandler[lin_page]=init_page_handler;
+		paging.tlb.readhandler[lin_page]=NULL;
+		paging.tlb.writehandler[lin_page]=NULL;
 		lin_page++;
 	}
 }
@@ -1440,8 +1433,8 @@ void PAGING_MapPage(Bitu lin_page,Bitu phys_page) {
 		paging.firstmb[lin_page]=phys_page;
 		paging.tlb.read[lin_page]=0;
 		paging.tlb.write[lin_page]=0;
-		paging.tlb.readhandler[lin_page]=init_page_handler;
-		paging.tlb.writehandler[lin_page]=init_page_handler;
+		paging.tlb.readhandler[lin_page]=NULL;
+		paging.tlb.writehandler[lin_page]=NULL;
 	} else {
 		PAGING_LinkPage(lin_page,phys_page);
 	}
@@ -1716,7 +1709,7 @@ bool PAGING_Enabled(void) {
 }
 
 static void PAGING_ShutDown(Section* /*sec*/) {
-	init_page_handler = NULL;
+	paging.init_handler = NULL;
 	paging_prevent_exception_jump = false;
 }
 
@@ -1746,19 +1739,8 @@ void PAGING_Init(Section * sec) {
 void PAGING_OnChangeCore(void) {
 	// Use dynamic core compatible init page handler when core is set to 'dynamic' or 'auto'
 	const char* core = static_cast<Section_prop *>(control->GetSection("cpu"))->Get_string("core");
-	PageHandler* next_init_page_handler = ((core[0] == 'a' || core[0] == 'd') ? (PageHandler*)&dyncore_init_page_handler : (PageHandler*)&normalcore_init_page_handler);
-	PageHandler* prev_init_page_handler = init_page_handler;
-	if (prev_init_page_handler == next_init_page_handler) return;
-
-	if (prev_init_page_handler)
-	{
-		for (Bitu i=0;i<TLB_SIZE;i++)
-		{
-			if (paging.tlb.readhandler[i]==prev_init_page_handler) paging.tlb.readhandler[i]=next_init_page_handler;
-			if (paging.tlb.writehandler[i]==prev_init_page_handler) paging.tlb.writehandler[i]=next_init_page_handler;
-		}
-	}
-	init_page_handler = next_init_page_handler;
+	// the tlb entries of unlinked pages are NULL and refer to this one
+	paging.init_handler = ((core[0] == 'a' || core[0] == 'd') ? (PageHandler*)&dyncore_init_page_handler : (PageHandler*)&normalcore_init_page_handler);
 }
 
 #include <dbp_serialize.h>
@@ -1785,14 +1767,7 @@ void DBPSerialize_Paging(DBPArchive& ar)
 
 	if (ar.mode == DBPArchive::MODE_LOAD)
 	{
-		//PAGING_InitTLB();
-		memset(paging.tlb.read, 0, sizeof(paging.tlb.read));
-		memset(paging.tlb.write, 0, sizeof(paging.tlb.write));
-		for (Bitu i = 0; i != LINK_START; i++) {
-			paging.tlb.readhandler[i]=init_page_handler;
-			paging.tlb.writehandler[i]=init_page_handler;
-		}
-		PAGING_ClearTLB();
+		PAGING_InitTLB();
 	}
 	if (ar.mode == DBPArchive::MODE_ZERO)
 		pf_queue.used = 0;
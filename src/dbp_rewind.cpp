@@ -0,0 +1,404 @@
+/*
+ *  Copyright (C) 2025 Bernhard Schelling
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "dosbox.h"
+#include "mem.h"
+#include "vga.h"
+#include "dbp_serialize.h"
+#include "dbp_threads.h"
+#include <string.h> /* memset, memcpy */
+#include <time.h>
+#include <vector>
+#include <deque>
+
+// The rewind buffer keeps a shadow copy of guest memory and video memory as it was at the latest snapshot.
+// Capturing a snapshot copies only the pages written since the previous one, a worker thread then
+// XORs them against the shadow copy and LZ compresses the difference into the history.
+// Because XOR deltas are reversible, restoring walks back from the shadow copy without needing keyframes.
+struct DBP_RewindBuffer
+{
+	enum { PAGE_SIZE = MEM_PAGESIZE, MAX_HISTORY_BYTES = 64*1024*1024 };
+	enum { REGION_RAM, REGION_VGA_LINEAR, REGION_VGA_FASTMEM, REGION_COUNT };
+
+	struct Region { HostPt ptr; Bitu size, first_page; Bit8u* dirty; };
+	struct Snapshot { Bit32u id; std::vector<Bit8u> deltas; };
+	struct Job { Bit32u id; std::vector<Bit32u> pages; std::vector<Bit8u> data; };
+
+	DBP_RewindBuffer() : shadow(NULL), pages(0), session(0), last_id(0), history_bytes(0), worker_started(false), worker_idle(false), worker_busy(false), worker_quit(false), waiting(false) { memset(regions, 0, sizeof(regions)); }
+	~DBP_RewindBuffer() { Shutdown(); }
+
+	Bit8u* shadow;
+	Region regions[REGION_COUNT];
+	Bitu pages;
+	Bit32u session, last_id;
+	size_t history_bytes;
+	std::deque<Snapshot> history;
+	std::vector<Job*> queue, free_jobs;
+	bool worker_started, worker_idle, worker_busy, worker_quit, waiting;
+	Mutex lock;
+	Semaphore work, done;
+
+	void Shutdown()
+	{
+		if (worker_started)
+		{
+			lock.Lock();
+			worker_quit = true;
+			if (worker_idle) { worker_idle = false; work.Post(); }
+			lock.Unlock();
+			done.Wait(); // wait for worker thread to exit
+			worker_started = worker_quit = worker_idle = false;
+		}
+		for (Job* job : queue) delete job;
+		for (Job* job : free_jobs) delete job;
+		queue.clear();
+		free_jobs.clear();
+		history.clear();
+		history_bytes = 0;
+		delete [] shadow;
+		shadow = NULL;
+	}
+
+	void Flush()
+	{
+		lock.Lock();
+		while (!queue.empty() || worker_busy) { waiting = true; lock.Unlock(); done.Wait(); lock.Lock(); }
+		lock.Unlock();
+	}
+
+	static void GetRegions(Region* out)
+	{
+		out[REGION_RAM].ptr          = MemBase;
+		out[REGION_RAM].size         = MEM_TotalPages() * PAGE_SIZE;
+		out[REGION_RAM].dirty        = MemDirty;
+		out[REGION_VGA_LINEAR].ptr   = vga.mem.linear;
+		out[REGION_VGA_LINEAR].size  = VGA_LinearSize();
+		out[REGION_VGA_LINEAR].dirty = vga.mem.dirty;
+		out[REGION_VGA_FASTMEM].ptr  = vga.fastmem;
+		out[REGION_VGA_FASTMEM].size = VGA_FastmemSize();
+		out[REGION_VGA_FASTMEM].dirty = vga.mem.dirty_fastmem;
+		for (Bitu r = 0, first_page = 0; r != REGION_COUNT; first_page += (out[r++].size + PAGE_SIZE - 1) / PAGE_SIZE)
+			out[r].first_page = first_page;
+	}
+
+	bool IsCurrent()
+	{
+		if (!shadow) return false;
+		Region cur[REGION_COUNT];
+		GetRegions(cur);
+		for (Bitu r = 0; r != REGION_COUNT; r++)
+			if (!cur[r].dirty || cur[r].ptr != regions[r].ptr || cur[r].size != regions[r].size || cur[r].dirty != regions[r].dirty)
+				return false;
+		return true;
+	}
+
+	bool Init()
+	{
+		Flush();
+		history.clear();
+		history_bytes = 0;
+		MEM_TrackDirtyPages(true);
+		VGA_TrackDirtyPages(true);
+		GetRegions(regions);
+		const Region& last = regions[REGION_COUNT - 1];
+		Bitu new_pages = last.first_page + (last.size + PAGE_SIZE - 1) / PAGE_SIZE;
+		if (!shadow || pages != new_pages)
+		{
+			delete [] shadow;
+			pages = new_pages;
+			shadow = new (std::nothrow) Bit8u[pages * PAGE_SIZE];
+			if (!shadow) { LOG_MSG("[DOSBOX] Unable to allocate %d MB for the rewind buffer", (int)(pages * PAGE_SIZE / (1024*1024))); return false; }
+		}
+		memset(shadow, 0, pages * PAGE_SIZE);
+		for (const Region& r : regions)
+			memcpy(shadow + r.first_page * PAGE_SIZE, r.ptr, r.size);
+		static Bit32u init_count;
+		session = (Bit32u)time(NULL) ^ (++init_count << 24);
+		return true;
+	}
+
+	void ResetDirtyPages()
+	{
+		MEM_ResetDirtyPages();
+		VGA_ResetDirtyPages();
+	}
+
+	void MarkUntrackedPages()
+	{
+		// Tandy and PCjr video memory and the Hercules page get written directly by their video page handlers
+		if (IS_TANDY_ARCH)
+		{
+			for (const Region& r : regions)
+			{
+				if (vga.tandy.mem_base < r.ptr || vga.tandy.mem_base >= r.ptr + r.size) continue;
+				Bitu from = (Bitu)(vga.tandy.mem_base - r.ptr) / PAGE_SIZE, to = from + (32*1024 / PAGE_SIZE), num = (r.size + PAGE_SIZE - 1) / PAGE_SIZE;
+				memset(r.dirty + from, 1, (to < num ? to : num) - from);
+			}
+		}
+		else if (machine == MCH_HERC) regions[REGION_VGA_LINEAR].dirty[0] = 1;
+	}
+
+	Region& GetPageRegion(Bit32u page)
+	{
+		Bitu r = REGION_COUNT - 1;
+		while (r && page < regions[r].first_page) r--;
+		return regions[r];
+	}
+
+	static INLINE Bitu PageLength(const Region& r, Bitu i)
+	{
+		Bitu ofs = i * PAGE_SIZE;
+		return (r.size - ofs < PAGE_SIZE ? r.size - ofs : PAGE_SIZE);
+	}
+
+	bool Capture(Bit32u& out_session, Bit32u& out_id)
+	{
+		if (!IsCurrent() && !Init()) return false;
+		MarkUntrackedPages();
+
+		lock.Lock();
+		Job* job = NULL;
+		if (!free_jobs.empty()) { job = free_jobs.back(); free_jobs.pop_back(); }
+		lock.Unlock();
+		if (!job) job = new Job;
+
+		job->pages.clear();
+		for (const Region& r : regions)
+			for (Bitu i = 0, num = (r.size + PAGE_SIZE - 1) / PAGE_SIZE; i != num; i++)
+				if (r.dirty[i])
+					job->pages.push_back((Bit32u)(r.first_page + i));
+		job->data.resize(job->pages.size() * PAGE_SIZE);
+		for (size_t i = 0; i != job->pages.size(); i++)
+		{
+			const Region& r = GetPageRegion(job->pages[i]);
+			Bitu page = job->pages[i] - r.first_page, len = PageLength(r, page);
+			memcpy(&job->data[i * PAGE_SIZE], r.ptr + page * PAGE_SIZE, len);
+			if (len != PAGE_SIZE) memset(&job->data[i * PAGE_SIZE + len], 0, PAGE_SIZE - len);
+		}
+		ResetDirtyPages();
+		job->id = ++last_id;
+
+		lock.Lock();
+		queue.push_back(job);
+		if (worker_idle) { worker_idle = false; work.Post(); }
+		lock.Unlock();
+		if (!worker_started) { worker_started = true; Thread::StartDetached(CompressThread, this); }
+
+		out_session = session;
+		out_id = job->id;
+		return true;
+	}
+
+	bool Restore(Bit32u in_session, Bit32u in_id)
+	{
+		if (in_session != session || !IsCurrent()) return false;
+		Flush();
+		size_t n = history.size();
+		while (n && history[n - 1].id != in_id) n--;
+		if (!n) return false;
+
+		// First bring memory back to the latest snapshot, then undo the deltas of all snapshots newer than the requested one
+		MarkUntrackedPages();
+		for (const Region& r : regions)
+			for (Bitu i = 0, num = (r.size + PAGE_SIZE - 1) / PAGE_SIZE; i != num; i++)
+				if (r.dirty[i])
+					memcpy(r.ptr + i * PAGE_SIZE, shadow + (r.first_page + i) * PAGE_SIZE, PageLength(r, i));
+		Bit8u delta[PAGE_SIZE];
+		for (; history.size() > n; history.pop_back())
+		{
+			const std::vector<Bit8u>& d = history.back().deltas;
+			for (const Bit8u *p = (d.empty() ? NULL : &d[0]), *pEnd = p + d.size(); p != pEnd;)
+			{
+				Bit32u page; Bit16u len;
+				memcpy(&page, p, 4);
+				memcpy(&len, p + 4, 2);
+				p += 6;
+				if (!len) { memcpy(delta, p, PAGE_SIZE); p += PAGE_SIZE; }
+				else if (!Decompress(p, len, delta)) { DBP_ASSERT(false); return false; }
+				else p += len;
+				const Region& r = GetPageRegion(page);
+				XorInto(r.ptr + (page - r.first_page) * PAGE_SIZE, delta, PageLength(r, page - r.first_page));
+				XorInto(shadow + page * PAGE_SIZE, delta, PAGE_SIZE);
+			}
+			history_bytes -= d.size();
+		}
+		ResetDirtyPages();
+		return true;
+	}
+
+	void Process(Job& job)
+	{
+		Snapshot snap;
+		snap.id = job.id;
+		Bit8u delta[PAGE_SIZE], comp[PAGE_SIZE];
+		for (size_t i = 0; i != job.pages.size(); i++)
+		{
+			Bit32u page = job.pages[i];
+			Bit64u *old = (Bit64u*)(shadow + page * PAGE_SIZE), *cur = (Bit64u*)&job.data[i * PAGE_SIZE], *out = (Bit64u*)delta, any = 0;
+			for (Bitu j = 0; j != PAGE_SIZE / 8; j++) any |= (out[j] = old[j] ^ cur[j]);
+			if (!any) continue; // page was written with unchanged values
+			memcpy(old, cur, PAGE_SIZE);
+			Bitu complen = Compress(delta, comp);
+			Bit16u len = (Bit16u)(complen < PAGE_SIZE ? complen : 0); // 0 marks an uncompressed page
+			size_t ofs = snap.deltas.size();
+			snap.deltas.resize(ofs + 6 + (len ? len : PAGE_SIZE));
+			memcpy(&snap.deltas[ofs], &page, 4);
+			memcpy(&snap.deltas[ofs + 4], &len, 2);
+			memcpy(&snap.deltas[ofs + 6], (len ? comp : delta), (len ? len : PAGE_SIZE));
+		}
+
+		lock.Lock();
+		history_bytes += snap.deltas.size();
+		history.push_back(Snapshot());
+		history.back().id = snap.id;
+		history.back().deltas.swap(snap.deltas);
+		while (history_bytes > MAX_HISTORY_BYTES && history.size() > 1)
+		{
+			history_bytes -= history.front().deltas.size();
+			history.pop_front();
+		}
+		lock.Unlock();
+	}
+
+	static Thread::RET_t THREAD_CC CompressThread(void* p)
+	{
+		DBP_RewindBuffer* rb = (DBP_RewindBuffer*)p;
+		for (rb->lock.Lock(); !rb->worker_quit;)
+		{
+			if (rb->queue.empty()) { rb->worker_idle = true; rb->lock.Unlock(); rb->work.Wait(); rb->lock.Lock(); continue; }
+			Job* job = rb->queue.front();
+			rb->queue.erase(rb->queue.begin());
+			rb->worker_busy = true;
+			rb->lock.Unlock();
+			rb->Process(*job);
+			rb->lock.Lock();
+			rb->free_jobs.push_back(job);
+			rb->worker_busy = false;
+			if (rb->waiting) { rb->waiting = false; rb->done.Post(); }
+		}
+		rb->lock.Unlock();
+		rb->done.Post();
+		return 0;
+	}
+
+	static INLINE void XorInto(Bit8u* dst, const Bit8u* delta, Bitu len)
+	{
+		DBP_ASSERT((len & 7) == 0);
+		Bit64u *d = (Bit64u*)dst; const Bit64u* s = (const Bit64u*)delta;
+		for (Bitu j = 0; j != len / 8; j++) d[j] ^= s[j];
+	}
+
+	// Simple LZ77 compression of a single page with a format similar to LZ4 (token, literals, 16-bit offset, match length)
+	// XOR deltas consist mostly of long runs of zeros which become overlapping matches with an offset of 1
+	enum { LZ_MINMATCH = 4, LZ_HASHBITS = 12 };
+
+	static INLINE Bit32u Read32(const Bit8u* p) { Bit32u v; memcpy(&v, p, 4); return v; }
+
+	static Bit8u* WriteLength(Bit8u* op, Bitu len) { for (; len >= 255; len -= 255) *(op++) = 255; *(op++) = (Bit8u)len; return op; }
+
+	static Bitu Compress(const Bit8u* in, Bit8u* out)
+	{
+		Bit16u table[1<<LZ_HASHBITS];
+		memset(table, 0, sizeof(table));
+		const Bit8u *ip = in + 1, *anchor = in, *end = in + PAGE_SIZE, *mflimit = end - LZ_MINMATCH;
+		Bit8u *op = out, *oend = out + PAGE_SIZE;
+		while (ip < mflimit)
+		{
+			Bit32u seq = Read32(ip), h = (seq * 2654435761U) >> (32 - LZ_HASHBITS);
+			const Bit8u* ref = in + table[h];
+			table[h] = (Bit16u)(ip - in);
+			if (Read32(ref) != seq) { ip++; continue; }
+			const Bit8u *m = ip + LZ_MINMATCH, *r = ref + LZ_MINMATCH;
+			while (m != end && *m == *r) { m++; r++; }
+			Bitu lit = (Bitu)(ip - anchor), mlen = (Bitu)(m - ip) - LZ_MINMATCH, off = (Bitu)(ip - ref);
+			if (op + 1 + lit + (lit / 255) + 1 + 2 + (mlen / 255) + 1 > oend) return 0;
+			Bit8u* token = op++;
+			*token = (Bit8u)(((lit < 15 ? lit : 15) << 4) | (mlen < 15 ? mlen : 15));
+			if (lit >= 15) op = WriteLength(op, lit - 15);
+			memcpy(op, anchor, lit);
+			op += lit;
+			*(op++) = (Bit8u)off;
+			*(op++) = (Bit8u)(off >> 8);
+			if (mlen >= 15) op = WriteLength(op, mlen - 15);
+			ip = anchor = m;
+		}
+		if (anchor != end)
+		{
+			Bitu lit = (Bitu)(end - anchor);
+			if (op + 1 + lit + (lit / 255) + 1 > oend) return 0;
+			*(op++) = (Bit8u)((lit < 15 ? lit : 15) << 4);
+			if (lit >= 15) op = WriteLength(op, lit - 15);
+			memcpy(op, anchor, lit);
+			op += lit;
+		}
+		return (Bitu)(op - out);
+	}
+
+	static bool Decompress(const Bit8u* in, Bitu in_len, Bit8u* out)
+	{
+		const Bit8u *ip = in, *iend = in + in_len;
+		Bit8u *op = out, *oend = out + PAGE_SIZE;
+		while (ip != iend)
+		{
+			Bit8u token = *(ip++);
+			Bitu lit = (token >> 4), mlen = (token & 15);
+			if (lit == 15) for (Bit8u b = 255; b == 255 && ip != iend; lit += (b = *(ip++))) {}
+			if (lit > (Bitu)(iend - ip) || lit > (Bitu)(oend - op)) return false;
+			memcpy(op, ip, lit);
+			op += lit;
+			ip += lit;
+			if (ip == iend) break;
+			if (iend - ip < 2) return false;
+			Bitu off = ip[0] | (ip[1] << 8);
+			ip += 2;
+			if (mlen == 15) for (Bit8u b = 255; b == 255 && ip != iend; mlen += (b = *(ip++))) {}
+			mlen += LZ_MINMATCH;
+			if (!off || off > (Bitu)(op - out) || mlen > (Bitu)(oend - op)) return false;
+			for (const Bit8u* ref = op - off; mlen; mlen--) *(op++) = *(ref++);
+		}
+		return (op == oend);
+	}
+};
+
+static DBP_RewindBuffer dbp_rewind;
+
+bool DBPRewind_Capture(Bit32u& session, Bit32u& snapshot)
+{
+	return dbp_rewind.Capture(session, snapshot);
+}
+
+bool DBPRewind_Restore(Bit32u session, Bit32u snapshot)
+{
+	return dbp_rewind.Restore(session, snapshot);
+}
+
+void DBPRewind_Reset()
+{
+	if (!dbp_rewind.shadow) return;
+	dbp_rewind.Flush();
+	dbp_rewind.history.clear();
+	dbp_rewind.history_bytes = 0;
+	dbp_rewind.regions[0].ptr = NULL; // initialize again with the next capture
+}
+
+void DBPRewind_Shutdown()
+{
+	dbp_rewind.Shutdown();
+	MEM_TrackDirtyPages(false);
+	VGA_TrackDirtyPages(false);
+}
@@ -274,7 +274,7 @@ void DBPSerialize_All(DBPArchive& ar, bool dos_running, bool game_running)
 	if (ar.mode != DBPArchive::MODE_ZERO)
 	{
 		Bit32u magic = 0xD05B5747;
-		Bit8u invalid_state = (dos_running ? 0 : 1) | (game_running ? 0 : 2);
+		Bit8u invalid_state = (dos_running ? 0 : 1) | (game_running ? 0 : 2) | ((ar.flags & DBPArchive::FLAG_REWINDBUFFER) ? 4 : 0);
 		ar << magic << ar.version << invalid_state;
 		if (magic != 0xD05B5747) { ar.had_error = DBPArchive::ERR_LAYOUT; return; }
 		if (ar.version < 1 || ar.version > 8) { DBP_ASSERT(false); ar.had_error = DBPArchive::ERR_VERSION; return; }
@@ -283,6 +283,12 @@ void DBPSerialize_All(DBPArchive& ar, bool dos_running, bool game_running)
 			if (!dos_running  || (invalid_state & 1)) { ar.had_error = DBPArchive::ERR_DOSNOTRUNNING; return; }
 			if (!game_running || (invalid_state & 2)) { ar.had_error = DBPArchive::ERR_GAMENOTRUNNING; return; }
 		}
+		if (ar.mode == DBPArchive::MODE_LOAD)
+		{
+			// Only states referencing the rewind buffer keep its history, after any other state was loaded it needs to start over
+			if (invalid_state & 4) ar.flags |= DBPArchive::FLAG_REWINDBUFFER;
+			else { ar.flags &= ~DBPArchive::FLAG_REWINDBUFFER; DBPRewind_Reset(); }
+		}
 	}
 
 	Bitu memory_mb = MEM_TotalPages() / ((1024*1024)/MEM_PAGE_SIZE);
@@ -299,6 +305,14 @@ void DBPSerialize_All(DBPArchive& ar, bool dos_running, bool game_running)
 		if (serialized_vgamem  != current_vgamem)  { ar.had_error = DBPArchive::ERR_WRONGVGAMEMCONFIG;  ar.error_info = serialized_vgamem;  return; }
 	}
 
+	if (ar.flags & DBPArchive::FLAG_REWINDBUFFER)
+	{
+		Bit32u rewind_session = 0, rewind_snapshot = 0;
+		if (ar.mode == DBPArchive::MODE_SAVE && !DBPRewind_Capture(rewind_session, rewind_snapshot)) { ar.had_error = DBPArchive::ERR_REWINDBUFFER; return; }
+		ar << rewind_session << rewind_snapshot;
+		if (ar.mode == DBPArchive::MODE_LOAD && !DBPRewind_Restore(rewind_session, rewind_snapshot)) { ar.had_error = DBPArchive::ERR_REWINDBUFFER; return; }
+	}
+
 	// The switch with __LINE__ cases is a fun way to have all the serialize functions in a list that can easily be reordered in code
 	// Small things that have an easily varying size should be put at the end to simplify a delta encoded rewind buffer
 	void (*func)(DBPArchive& ar); //const char* func_name;
@@ -31,6 +31,7 @@
 #include "drives.h"
 #include "support.h"
 #include "setup.h"
+#include "dbp_threads.h"
 
 #if !defined(WIN32)
 #include <libgen.h>
@@ -1129,31 +1130,604 @@ void CDROM_Interface_Image::ClearTracks()
 	tracks.clear();
 }
 
+#ifdef C_DBP_SUPPORT_CDROM_CHD_IMAGE
+// Decoders for compressed CHD v5 CD images (hunk map, zlib, cdzl, cdlz and cdfl codecs)
+struct Chd_BitReader
+{
+	const Bit8u *start, *p, *end;
+	Bit64u buf;
+	Bit32u avail;
+	bool overflow;
+
+	Chd_BitReader(const Bit8u* ptr, size_t len) : start(ptr), p(ptr), end(ptr + len), buf(0), avail(0), overflow(false) { }
+	INLINE void Fill(Bit32u n) { for (; avail < n; avail += 8) { if (p != end) buf |= (Bit64u)*(p++) << (56 - avail); else overflow = true; } }
+	INLINE Bit32u Peek(Bit32u n) { Fill(n); return (Bit32u)(buf >> (64 - n)); }
+	INLINE void Remove(Bit32u n) { buf <<= n; avail -= n; }
+	INLINE Bit32u Read(Bit32u n) { if (!n) return 0; Bit32u res = Peek(n); Remove(n); return res; }
+	INLINE Bit32s ReadSigned(Bit32u n) { return (n ? ((Bit32s)(Read(n) << (32 - n)) >> (32 - n)) : 0); }
+	INLINE Bit32u ReadUnary() { Bit32u n = 0; while (!Read(1) && !overflow) n++; return n; }
+	INLINE void AlignToByte() { Remove(avail & 7); }
+	INLINE Bit32u BytePos() { return (Bit32u)(p - start) - (avail >> 3); }
+};
+
+struct Chd_Lzma
+{
+	// Raw LZMA stream without header or end marker, CHD always uses lc=3, lp=0, pb=2
+	enum { LC = 3, PB = 2, NUM_STATES = 12, POS_STATES = (1 << PB), PROB_INIT = 1024, LEN_PROBS = 2 + POS_STATES * 8 * 2 + 256 };
+	Bit16u isMatch[NUM_STATES << PB], isRep[NUM_STATES], isRepG0[NUM_STATES], isRepG1[NUM_STATES], isRepG2[NUM_STATES], isRep0Long[NUM_STATES << PB];
+	Bit16u literal[0x300 << LC], posSlot[4][1 << 6], posDecoders[1 + 128 - 14], align[1 << 4], lenDecoder[LEN_PROBS], repLenDecoder[LEN_PROBS];
+	const Bit8u *in, *in_end;
+	Bit32u range, code;
+
+	INLINE Bit8u NextByte() { return (in != in_end ? *(in++) : 0); }
+	INLINE void Normalize() { if (range < (1u << 24)) { range <<= 8; code = (code << 8) | NextByte(); } }
+	INLINE Bit32u Bit(Bit16u* prob)
+	{
+		Bit32u bound = (range >> 11) * *prob;
+		if (code < bound) { *prob += ((2048 - *prob) >> 5); range = bound; Normalize(); return 0; }
+		*prob -= (*prob >> 5); code -= bound; range -= bound; Normalize(); return 1;
+	}
+	INLINE Bit32u DirectBits(Bit32u num)
+	{
+		Bit32u res = 0;
+		do { range >>= 1; code -= range; Bit32u t = 0 - (code >> 31); code += (range & t); Normalize(); res = (res << 1) + (t + 1); } while (--num);
+		return res;
+	}
+	INLINE Bit32u BitTree(Bit16u* probs, Bit32u num) { Bit32u m = 1; for (Bit32u i = 0; i != num; i++) m = (m << 1) + Bit(&probs[m]); return m - (1u << num); }
+	INLINE Bit32u BitTreeReverse(Bit16u* probs, Bit32u num) { Bit32u m = 1, sym = 0; for (Bit32u i = 0, b; i != num; i++) { b = Bit(&probs[m]); m = (m << 1) + b; sym |= (b << i); } return sym; }
+	INLINE Bit32u Len(Bit16u* probs, Bit32u posState)
+	{
+		if (!Bit(&probs[0])) return BitTree(&probs[2 + posState * 8], 3);
+		if (!Bit(&probs[1])) return 8 + BitTree(&probs[2 + POS_STATES * 8 + posState * 8], 3);
+		return 16 + BitTree(&probs[2 + POS_STATES * 8 * 2], 8);
+	}
+
+	bool Decode(const Bit8u* src, Bit32u src_len, Bit8u* out, Bit32u out_len)
+	{
+		for (Bit16u *p = isMatch, *pEnd = (Bit16u*)(&repLenDecoder + 1); p != pEnd; p++) *p = PROB_INIT;
+		in = src; in_end = src + src_len; range = 0xFFFFFFFF; code = 0;
+		if (NextByte() != 0) return false;
+		for (int i = 0; i != 4; i++) code = (code << 8) | NextByte();
+
+		Bit32u state = 0, rep0 = 0, rep1 = 0, rep2 = 0, rep3 = 0, pos = 0;
+		while (pos != out_len)
+		{
+			Bit32u posState = (pos & (POS_STATES - 1)), len;
+			if (!Bit(&isMatch[(state << PB) + posState]))
+			{
+				Bit16u* probs = &literal[0x300 * ((pos ? out[pos - 1] : 0) >> (8 - LC))];
+				Bit32u symbol = 1;
+				if (state >= 7)
+				{
+					if (rep0 >= pos) return false;
+					for (Bit32u matchByte = out[pos - rep0 - 1], matchBit, bit; symbol < 0x100;)
+					{
+						matchBit = ((matchByte >> 7) & 1); matchByte <<= 1;
+						bit = Bit(&probs[((1 + matchBit) << 8) + symbol]);
+						symbol = (symbol << 1) | bit;
+						if (matchBit != bit) break;
+					}
+				}
+				while (symbol < 0x100) symbol = (symbol << 1) | Bit(&probs[symbol]);
+				out[pos++] = (Bit8u)symbol;
+				state = (state < 4 ? 0 : (state < 10 ? state - 3 : state - 6));
+				continue;
+			}
+			if (Bit(&isRep[state]))
+			{
+				if (!pos) return false;
+				if (!Bit(&isRepG0[state]))
+				{
+					if (!Bit(&isRep0Long[(state << PB) + posState]))
+					{
+						state = (state < 7 ? 9 : 11);
+						out[pos] = out[pos - rep0 - 1];
+						pos++;
+						continue;
+					}
+				}
+				else
+				{
+					Bit32u dist;
+					if (!Bit(&isRepG1[state])) dist = rep1;
+					else
+					{
+						if (!Bit(&isRepG2[state])) dist = rep2;
+						else { dist = rep3; rep3 = rep2; }
+						rep2 = rep1;
+					}
+					rep1 = rep0;
+					rep0 = dist;
+				}
+				len = Len(repLenDecoder, posState);
+				state = (state < 7 ? 8 : 11);
+			}
+			else
+			{
+				rep3 = rep2; rep2 = rep1; rep1 = rep0;
+				len = Len(lenDecoder, posState);
+				state = (state < 7 ? 7 : 10);
+				Bit32u slot = BitTree(posSlot[len < 3 ? len : 3], 6);
+				if (slot < 4) rep0 = slot;
+				else
+				{
+					Bit32u numDirectBits = ((slot >> 1) - 1);
+					rep0 = ((2 | (slot & 1)) << numDirectBits);
+					if (slot < 14) rep0 += BitTreeReverse(&posDecoders[rep0 - slot], numDirectBits);
+					else rep0 += (DirectBits(numDirectBits - 4) << 4) + BitTreeReverse(align, 4);
+				}
+				if (rep0 == 0xFFFFFFFF) break; // end marker
+			}
+			if (rep0 >= pos) return false;
+			for (len += 2; len-- && pos != out_len; pos++) out[pos] = out[pos - rep0 - 1];
+		}
+		return (pos == out_len);
+	}
+};
+
+struct Chd_Flac
+{
+	// Raw FLAC frames without stream header, CHD always stores 16-bit stereo (written as big endian samples)
+	std::vector<Bit32s> samples[2];
+	Bit32u consumed;
+
+	static bool Residual(Chd_BitReader& bits, Bit32s* out, Bit32u blocksize, Bit32u order)
+	{
+		Bit32u method = bits.Read(2), parambits = (method ? 5 : 4), escape = (method ? 31 : 15), partorder = bits.Read(4), partitions = (1u << partorder);
+		if (method > 1 || (blocksize >> partorder) < order || (blocksize & (partitions - 1))) return false;
+		Bit32s* p = out + order;
+		for (Bit32u part = 0; part != partitions; part++)
+		{
+			Bit32u param = bits.Read(parambits), n = (blocksize >> partorder) - (part ? 0 : order);
+			if (param == escape)
+				for (Bit32u rawbits = bits.Read(5); n--;) *(p++) = bits.ReadSigned(rawbits);
+			else
+				for (; n--;) { Bit32u v = (bits.ReadUnary() << param) | bits.Read(param); *(p++) = (Bit32s)(v >> 1) ^ -(Bit32s)(v & 1); }
+			if (bits.overflow) return false;
+		}
+		return true;
+	}
+
+	static bool Subframe(Chd_BitReader& bits, Bit32s* out, Bit32u blocksize, Bit32u bps)
+	{
+		if (bits.Read(1)) return false;
+		Bit32u type = bits.Read(6), wasted = 0;
+		if (bits.Read(1)) { wasted = bits.ReadUnary() + 1; if (wasted >= bps) return false; bps -= wasted; }
+		if (type == 0)
+		{
+			Bit32s v = bits.ReadSigned(bps);
+			for (Bit32u i = 0; i != blocksize; i++) out[i] = v;
+		}
+		else if (type == 1)
+		{
+			for (Bit32u i = 0; i != blocksize; i++) out[i] = bits.ReadSigned(bps);
+		}
+		else if (type >= 8 && type <= 12)
+		{
+			Bit32u order = type - 8;
+			if (order > blocksize) return false;
+			for (Bit32u i = 0; i != order; i++) out[i] = bits.ReadSigned(bps);
+			if (!Residual(bits, out, blocksize, order)) return false;
+			switch (order)
+			{
+				case 1: for (Bit32u i = 1; i < blocksize; i++) out[i] += out[i-1]; break;
+				case 2: for (Bit32u i = 2; i < blocksize; i++) out[i] += 2*out[i-1] - out[i-2]; break;
+				case 3: for (Bit32u i = 3; i < blocksize; i++) out[i] += 3*out[i-1] - 3*out[i-2] + out[i-3]; break;
+				case 4: for (Bit32u i = 4; i < blocksize; i++) out[i] += 4*out[i-1] - 6*out[i-2] + 4*out[i-3] - out[i-4]; break;
+			}
+		}
+		else if (type >= 32)
+		{
+			Bit32u order = type - 31, precision;
+			if (order > blocksize) return false;
+			for (Bit32u i = 0; i != order; i++) out[i] = bits.ReadSigned(bps);
+			if ((precision = bits.Read(4) + 1) == 16) return false;
+			Bit32s shift = bits.ReadSigned(5), coefs[32];
+			if (shift < 0) return false;
+			for (Bit32u i = 0; i != order; i++) coefs[i] = bits.ReadSigned(precision);
+			if (!Residual(bits, out, blocksize, order)) return false;
+			for (Bit32u i = order; i < blocksize; i++)
+			{
+				Bit64s sum = 0;
+				for (Bit32u j = 0; j != order; j++) sum += (Bit64s)coefs[j] * out[i - 1 - j];
+				out[i] += (Bit32s)(sum >> shift);
+			}
+		}
+		else return false;
+		if (wasted) for (Bit32u i = 0; i != blocksize; i++) out[i] = (Bit32s)((Bit32u)out[i] << wasted);
+		return !bits.overflow;
+	}
+
+	bool Decode(const Bit8u* src, Bit32u src_len, Bit8u* out, Bit32u out_len)
+	{
+		static const Bit32u sample_sizes[8] = { 16, 8, 12, 0, 16, 20, 24, 32 };
+		Chd_BitReader bits(src, src_len);
+		for (Bit8u* out_end = out + out_len; out != out_end;)
+		{
+			if (bits.Read(15) != (0x3FFE << 1)) return false; // sync code and reserved bit
+			bits.Read(1); // blocking strategy
+			Bit32u bs_code = bits.Read(4), sr_code = bits.Read(4), chan = bits.Read(4), bps = sample_sizes[bits.Read(3)], blocksize;
+			if (bits.Read(1) || !bs_code || chan > 10 || !bps || bps > 24) return false;
+			for (Bit32u utf8 = bits.Read(8); utf8 & 0x80; utf8 <<= 1) if ((utf8 & 0x40)) bits.Read(8); // frame/sample number
+			if (bs_code == 1) blocksize = 192;
+			else if (bs_code <= 5) blocksize = 576u << (bs_code - 2);
+			else if (bs_code == 6) blocksize = bits.Read(8) + 1;
+			else if (bs_code == 7) blocksize = bits.Read(16) + 1;
+			else blocksize = 256u << (bs_code - 8);
+			if (sr_code == 12) bits.Read(8); else if (sr_code == 13 || sr_code == 14) bits.Read(16);
+			bits.Read(8); // CRC-8
+			if (samples[0].size() < blocksize) { samples[0].resize(blocksize); samples[1].resize(blocksize); }
+			Bit32s *left = &samples[0][0], *right = &samples[1][0];
+			if (chan == 0 || (chan > 1 && chan < 8)) return false; // CHD audio is always stereo
+			if (!Subframe(bits, left, blocksize, bps + (chan == 9 ? 1 : 0)) || !Subframe(bits, right, blocksize, bps + (chan == 8 || chan == 10 ? 1 : 0))) return false;
+			if (chan == 8) for (Bit32u i = 0; i != blocksize; i++) right[i] = left[i] - right[i]; // left/side
+			else if (chan == 9) for (Bit32u i = 0; i != blocksize; i++) left[i] += right[i]; // side/right
+			else if (chan == 10) for (Bit32u i = 0; i != blocksize; i++) { Bit32s mid = (Bit32s)((Bit32u)left[i] << 1) | (right[i] & 1), side = right[i]; left[i] = (mid + side) >> 1; right[i] = (mid - side) >> 1; } // mid/side
+			bits.AlignToByte();
+			bits.Read(16); // CRC-16
+			if (bits.overflow) return false;
+			for (Bit32u i = 0; i != blocksize && out != out_end; i++, out += 4)
+			{
+				out[0] = (Bit8u)(left[i] >> 8); out[1] = (Bit8u)left[i];
+				out[2] = (Bit8u)(right[i] >> 8); out[3] = (Bit8u)right[i];
+			}
+		}
+		consumed = bits.BytePos();
+		return true;
+	}
+};
+
+struct Chd_Decompressor
+{
+	enum { CD_MAX_SECTOR_DATA = 2352, CD_MAX_SUBCODE_DATA = 96, CD_FRAME_SIZE = CD_MAX_SECTOR_DATA + CD_MAX_SUBCODE_DATA };
+	enum { TAG_ZLIB = 0x7a6c6962, TAG_CDZL = 0x63647a6c, TAG_CDLZ = 0x63646c7a, TAG_CDFL = 0x6364666c };
+	enum { TYPE_NONE = 4, TYPE_SELF, TYPE_PARENT, TYPE_RLE_SMALL, TYPE_RLE_LARGE, TYPE_SELF_0, TYPE_SELF_1, TYPE_PARENT_SELF, TYPE_PARENT_0, TYPE_PARENT_1 };
+	struct Entry { Bit32u offset, length; Bit16u crc; Bit8u type; };
+	struct Scratch { std::vector<Bit8u> buf; Chd_Lzma lzma; Chd_Flac flac; };
+
+	std::vector<Entry> map;
+	Bit32u compressors[4], hunkbytes;
+
+	static Bit16u crc16_lut[256];
+	static Bit8u ecc_f_lut[256], ecc_b_lut[256];
+
+	static void InitTables()
+	{
+		// Needs to be called before any decoding, decoders can run on multiple threads
+		if (crc16_lut[1]) return;
+		for (Bit32u i = 0, c, j; i != 256; crc16_lut[i++] = (Bit16u)c) for (c = (i << 8), j = 0; j != 8; j++) c = ((c & 0x8000) ? ((c << 1) ^ 0x1021) : (c << 1));
+		for (Bit32u i = 0; i != 256; i++) { Bit32u j = ((i << 1) ^ ((i & 0x80) ? 0x11D : 0)); ecc_f_lut[i] = (Bit8u)j; ecc_b_lut[i ^ j] = (Bit8u)i; }
+	}
+
+	static Bit16u CRC16(const Bit8u* p, size_t len, Bit16u crc = 0xFFFF)
+	{
+		// CRC-16-CCITT as used by the CHD format
+		while (len--) crc = (Bit16u)((crc << 8) ^ crc16_lut[(crc >> 8) ^ *(p++)]);
+		return crc;
+	}
+
+	static void GenerateECC(Bit8u* sector)
+	{
+		// Reed-Solomon P and Q parity of a mode 1 or mode 2 form 1 sector (the address is treated as zero in mode 2)
+		Bit8u address[4];
+		const bool mode2 = (sector[15] == 2);
+		if (mode2) { memcpy(address, sector + 12, 4); memset(sector + 12, 0, 4); }
+		for (int pq = 0; pq != 2; pq++)
+		{
+			const Bit32u major_count = (pq ? 52 : 86), minor_count = (pq ? 43 : 24), major_mult = (pq ? 86 : 2), minor_inc = (pq ? 88 : 86), size = major_count * minor_count;
+			const Bit8u* src = sector + 0xC;
+			Bit8u* dest = sector + (pq ? 0x8C8 : 0x81C);
+			for (Bit32u major = 0; major != major_count; major++)
+			{
+				Bit8u ecc_a = 0, ecc_b = 0;
+				for (Bit32u minor = 0, index = (major >> 1) * major_mult + (major & 1); minor != minor_count; minor++)
+				{
+					Bit8u temp = src[index];
+					if ((index += minor_inc) >= size) index -= size;
+					ecc_a = ecc_f_lut[ecc_a ^ temp];
+					ecc_b ^= temp;
+				}
+				ecc_a = ecc_b_lut[ecc_f_lut[ecc_a] ^ ecc_b];
+				dest[major] = ecc_a;
+				dest[major + major_count] = (ecc_a ^ ecc_b);
+			}
+		}
+		if (mode2) memcpy(sector + 12, address, 4);
+	}
+
+	static bool IsSupported(Bit32u tag) { return (!tag || tag == TAG_ZLIB || tag == TAG_CDZL || tag == TAG_CDLZ || tag == TAG_CDFL); }
+
+	static Bit8u ReadHuffman(Chd_BitReader& bits, const Bit8u (*lookup)[2]) { const Bit8u* l = lookup[bits.Peek(8)]; bits.Remove(l[1]); return l[0]; }
+
+	bool ParseMap(const Bit8u* hdr, const Bit8u* data, Bit32u data_len, Bit32u hunkcount)
+	{
+		// The map header contains map size (4 bytes), offset of first hunk (6), CRC16 of the uncompressed map (2), bits for lengths, self and parent references
+		if (hdr[4] || hdr[5]) return false; // offsets above 4GB
+		Bit32u curoffset = (hdr[6] << 24) | (hdr[7] << 16) | (hdr[8] << 8) | hdr[9], last_self = 0;
+		Bit16u mapcrc = (Bit16u)((hdr[10] << 8) | hdr[11]), crc = 0xFFFF;
+		Bit8u lengthbits = hdr[12], selfbits = hdr[13];
+		if (lengthbits > 32 || selfbits > 32) return false;
+		Chd_BitReader bits(data, data_len);
+
+		// Compression types are encoded with a Huffman tree of 16 codes with up to 8 bits, the tree itself is stored with RLE encoded code lengths
+		Bit8u codelens[16], lookup[256][2] = {{0}};
+		for (Bit32u curnode = 0; curnode != 16;)
+		{
+			Bit32u nodebits = bits.Read(4);
+			if (nodebits != 1) { codelens[curnode++] = (Bit8u)nodebits; continue; }
+			if ((nodebits = bits.Read(4)) == 1) { codelens[curnode++] = (Bit8u)nodebits; continue; }
+			Bit32u repcount = bits.Read(4) + 3;
+			if (curnode + repcount > 16) return false;
+			while (repcount--) codelens[curnode++] = (Bit8u)nodebits;
+		}
+		Bit32u bithisto[9] = {0}, curstart = 0;
+		for (Bit32u i = 0; i != 16; i++) { if (codelens[i] > 8) return false; bithisto[codelens[i]]++; }
+		for (Bit32u codelen = 8; codelen; codelen--)
+		{
+			Bit32u nextstart = ((curstart + bithisto[codelen]) >> 1);
+			if (codelen != 1 && nextstart * 2 != (curstart + bithisto[codelen])) return false;
+			bithisto[codelen] = curstart;
+			curstart = nextstart;
+		}
+		for (Bit32u i = 0; i != 16; i++)
+		{
+			if (!codelens[i]) continue;
+			Bit32u code = bithisto[codelens[i]]++, shift = 8 - codelens[i];
+			for (Bit32u j = (code << shift), jEnd = ((code + 1) << shift); j != jEnd; j++) { lookup[j][0] = (Bit8u)i; lookup[j][1] = codelens[i]; }
+		}
+
+		map.resize(hunkcount);
+		Bit8u lastcomp = 0;
+		for (Bit32u hunknum = 0, repcount = 0; hunknum != hunkcount; hunknum++)
+		{
+			if (repcount) { map[hunknum].type = lastcomp; repcount--; continue; }
+			Bit8u val = ReadHuffman(bits, lookup);
+			if (val == TYPE_RLE_SMALL) repcount = 2 + ReadHuffman(bits, lookup);
+			else if (val == TYPE_RLE_LARGE) { repcount = 2 + 16 + (ReadHuffman(bits, lookup) << 4); repcount += ReadHuffman(bits, lookup); }
+			else lastcomp = val;
+			map[hunknum].type = lastcomp;
+		}
+
+		for (Bit32u hunknum = 0; hunknum != hunkcount; hunknum++)
+		{
+			Entry& e = map[hunknum];
+			Bit32u offset = curoffset, length = 0;
+			Bit16u hunkcrc = 0;
+			switch (e.type)
+			{
+				case 0: case 1: case 2: case 3:
+					if (!compressors[e.type]) return false;
+					curoffset += (length = bits.Read(lengthbits));
+					hunkcrc = (Bit16u)bits.Read(16);
+					if (curoffset < offset) return false; // offsets above 4GB
+					break;
+				case TYPE_NONE:
+					curoffset += (length = hunkbytes);
+					hunkcrc = (Bit16u)bits.Read(16);
+					if (curoffset < offset) return false; // offsets above 4GB
+					break;
+				case TYPE_SELF:
+					last_self = offset = bits.Read(selfbits);
+					break;
+				case TYPE_SELF_1:
+					last_self++;
+					/* fall through */
+				case TYPE_SELF_0:
+					e.type = TYPE_SELF;
+					offset = last_self;
+					break;
+				default: return false; // parent references are not supported
+			}
+
+			// Verify map CRC over the same raw 12 byte entries the CHD writer used
+			const Bit8u raw[12] = { e.type, (Bit8u)(length >> 16), (Bit8u)(length >> 8), (Bit8u)length, 0, 0, (Bit8u)(offset >> 24), (Bit8u)(offset >> 16), (Bit8u)(offset >> 8), (Bit8u)offset, (Bit8u)(hunkcrc >> 8), (Bit8u)hunkcrc };
+			crc = CRC16(raw, sizeof(raw), crc);
+
+			if (e.type == TYPE_SELF)
+			{
+				if (offset >= hunknum) return false;
+				e = map[offset]; // resolved already, refers to the stored copy
+				continue;
+			}
+			e.offset = offset;
+			e.length = length;
+			e.crc = hunkcrc;
+		}
+		return (crc == mapcrc);
+	}
+
+	bool Decode(const Entry& e, const Bit8u* src, Bit8u* dst, Scratch& s)
+	{
+		if (e.type == TYPE_NONE) memcpy(dst, src, hunkbytes);
+		else if (compressors[e.type] == TAG_ZLIB) { if (!zipDrive::Uncompress(src, e.length, dst, hunkbytes)) return false; }
+		else
+		{
+			// CD codecs store sector data and subcode data separately, cdzl and cdlz also strip sync header and ECC where they can be regenerated
+			const Bit32u tag = compressors[e.type], frames = hunkbytes / CD_FRAME_SIZE, ecc_bytes = (tag == TAG_CDFL ? 0 : (frames + 7) / 8);
+			const Bit32u sector_bytes = frames * CD_MAX_SECTOR_DATA, subcode_bytes = frames * CD_MAX_SUBCODE_DATA;
+			if (s.buf.size() < hunkbytes) s.buf.resize(hunkbytes);
+			Bit8u *sectors = &s.buf[0], *subcode = sectors + sector_bytes;
+			Bit32u subcode_start;
+			if (tag == TAG_CDFL)
+			{
+				if (!s.flac.Decode(src, e.length, sectors, sector_bytes) || s.flac.consumed > e.length) return false;
+				subcode_start = s.flac.consumed;
+			}
+			else
+			{
+				const Bit32u complen_bytes = (hunkbytes < 65536 ? 2 : 3), header_bytes = ecc_bytes + complen_bytes;
+				if (e.length < header_bytes) return false;
+				Bit32u complen_base = (src[ecc_bytes] << 8) | src[ecc_bytes + 1];
+				if (complen_bytes > 2) complen_base = (complen_base << 8) | src[ecc_bytes + 2];
+				if (complen_base > e.length - header_bytes) return false;
+				if (tag == TAG_CDZL ? !zipDrive::Uncompress(src + header_bytes, complen_base, sectors, sector_bytes) : !s.lzma.Decode(src + header_bytes, complen_base, sectors, sector_bytes)) return false;
+				subcode_start = header_bytes + complen_base;
+			}
+			if (!zipDrive::Uncompress(src + subcode_start, e.length - subcode_start, subcode, subcode_bytes)) return false;
+
+			static const Bit8u sync_header[12] = { 0x00, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x00 };
+			for (Bit32u framenum = 0; framenum != frames; framenum++)
+			{
+				Bit8u* sector = dst + framenum * CD_FRAME_SIZE;
+				memcpy(sector, sectors + framenum * CD_MAX_SECTOR_DATA, CD_MAX_SECTOR_DATA);
+				memcpy(sector + CD_MAX_SECTOR_DATA, subcode + framenum * CD_MAX_SUBCODE_DATA, CD_MAX_SUBCODE_DATA);
+				if (ecc_bytes && (src[framenum / 8] & (1 << (framenum % 8))))
+				{
+					memcpy(sector, sync_header, sizeof(sync_header));
+					GenerateECC(sector);
+				}
+			}
+		}
+		return (CRC16(dst, hunkbytes) == e.crc);
+	}
+};
+Bit16u Chd_Decompressor::crc16_lut[256];
+Bit8u Chd_Decompressor::ecc_f_lut[256], Chd_Decompressor::ecc_b_lut[256];
+#endif
+
 #ifdef C_DBP_SUPPORT_CDROM_CHD_IMAGE
 bool CDROM_Interface_Image::LoadChdFile(char* filename)
 {
 	//DBP: Call ClearTracks here which actually clears the tracks correctly (the call to LoadCueSheet can actually leave tracks that need clearing after an error)
 	ClearTracks(); //tracks.clear();
 
-	enum { CHD_V5_HEADER_SIZE = 124, CHD_V5_UNCOMPMAPENTRYBYTES = 4, CD_MAX_SECTOR_DATA = 2352, CD_MAX_SUBCODE_DATA = 96, CD_FRAME_SIZE = CD_MAX_SECTOR_DATA + CD_MAX_SUBCODE_DATA };
+	enum { CHD_V5_HEADER_SIZE = 124, CHD_V5_UNCOMPMAPENTRYBYTES = 4, CHD_V5_COMPMAPHEADERBYTES = 16, CD_MAX_SECTOR_DATA = 2352, CD_MAX_SUBCODE_DATA = 96, CD_FRAME_SIZE = CD_MAX_SECTOR_DATA + CD_MAX_SUBCODE_DATA };
 	enum { METADATA_HEADER_SIZE = 16, CDROM_TRACK_METADATA_TAG = 1128813650, CDROM_TRACK_METADATA2_TAG = 1128813618, CD_TRACK_PADDING = 4 };
 
 	struct ChdFile : public BinaryFile
 	{
-		ChdFile(const char *filename, bool &error) : BinaryFile(filename, error), hunkmap(NULL), cooked_sector_shift(0) { }
-		virtual ~ChdFile() { free(hunkmap); }
+		ChdFile(const char *filename, bool &error) : BinaryFile(filename, error), hunkmap(NULL), cooked_sector_shift(0), cache_used(0), last_hunk((Bit32u)-1), worker_started(false), worker_idle(false), worker_quit(false), waiting(false) { }
+		virtual ~ChdFile()
+		{
+			if (worker_started)
+			{
+				lock.Lock();
+				worker_quit = true;
+				if (worker_idle) { worker_idle = false; work.Post(); }
+				lock.Unlock();
+				done.Wait(); // wait for decode thread to exit
+			}
+			free(hunkmap);
+		}
 		Bit32u *hunkmap;
 		int hunkbytes, cooked_sector_shift, audio_start;
 
+		// Compressed CHD files (without hunkmap) keep decompressed hunks in a small LRU cache.
+		// When reading sequentially, the following hunks are decompressed ahead of time by a worker thread.
+		// File access stays on the emulation thread because the CHD file can be inside a mounted ZIP or other DOS drive.
+		enum { CACHE_HUNKS = 16, READAHEAD_HUNKS = 4 };
+		enum { SLOT_FREE, SLOT_QUEUED, SLOT_DECODING, SLOT_READY };
+		struct Slot { Bit32u hunk, last_used; Bit8u state; bool valid; std::vector<Bit8u> comp, data; Slot() : state(SLOT_FREE) { } } slots[CACHE_HUNKS];
+		Chd_Decompressor codec;
+		Chd_Decompressor::Scratch scratch, worker_scratch;
+		Bit32u cache_used, last_hunk;
+		bool worker_started, worker_idle, worker_quit, waiting;
+		Mutex lock;
+		Semaphore work, done;
+
+		Slot* FindSlot(Bit32u hunk, Slot*& evict)
+		{
+			Slot* found = NULL;
+			evict = NULL;
+			for (Slot *s = slots, *sEnd = s + CACHE_HUNKS; s != sEnd; s++)
+			{
+				if (s->state != SLOT_FREE && s->hunk == hunk) found = s;
+				else if ((s->state == SLOT_FREE || s->state == SLOT_READY) && (!evict || s->state < evict->state || (s->state == evict->state && s->last_used < evict->last_used))) evict = s;
+			}
+			return found;
+		}
+
+		bool LoadHunk(Slot& s, Bit32u hunk)
+		{
+			const Chd_Decompressor::Entry& e = codec.map[hunk];
+			s.hunk = hunk;
+			s.comp.resize(e.length ? e.length : 1);
+			if (s.data.empty()) s.data.resize(hunkbytes);
+			if (BinaryFile::read(&s.comp[0], (int)e.offset, (int)e.length)) return true;
+			lock.Lock();
+			s.state = SLOT_FREE; // a READY slot is now tagged with the new hunk but still holds old data
+			lock.Unlock();
+			return false;
+		}
+
+		Slot* GetHunk(Bit32u hunk)
+		{
+			if (hunk >= codec.map.size()) return NULL;
+			Slot *evict, *s;
+			lock.Lock();
+			while ((s = FindSlot(hunk, evict)) != NULL ? s->state != SLOT_READY : !evict)
+				{ waiting = true; lock.Unlock(); done.Wait(); lock.Lock(); } // decoding ahead didn't finish yet or all slots are busy
+			lock.Unlock();
+			if (!s)
+			{
+				s = evict; // FREE or READY slots are never accessed by the worker thread
+				s->valid = (LoadHunk(*s, hunk) && codec.Decode(codec.map[hunk], &s->comp[0], &s->data[0], scratch));
+				lock.Lock();
+				s->state = SLOT_READY;
+				lock.Unlock();
+			}
+			s->last_used = ++cache_used;
+			if (!s->valid) { lock.Lock(); s->state = SLOT_FREE; lock.Unlock(); return NULL; }
+			return s;
+		}
+
+		void ReadAhead(Bit32u hunk)
+		{
+			for (Bit32u ahead = hunk + 1; ahead <= hunk + READAHEAD_HUNKS && ahead < codec.map.size(); ahead++)
+			{
+				Slot *evict, *s;
+				lock.Lock();
+				s = FindSlot(ahead, evict);
+				lock.Unlock();
+				if (s) continue;
+				if (!evict || !LoadHunk(*evict, ahead)) break; // skip reading ahead while all slots are busy
+				evict->last_used = ++cache_used;
+				lock.Lock();
+				evict->state = SLOT_QUEUED;
+				if (worker_idle) { worker_idle = false; work.Post(); }
+				lock.Unlock();
+				if (!worker_started) { worker_started = true; Thread::StartDetached(DecodeThread, this); }
+			}
+		}
+
+		static Thread::RET_t THREAD_CC DecodeThread(void* p)
+		{
+			ChdFile* chd = (ChdFile*)p;
+			for (chd->lock.Lock(); !chd->worker_quit;)
+			{
+				Slot* job = NULL;
+				for (Slot *s = chd->slots, *sEnd = s + CACHE_HUNKS; s != sEnd; s++)
+					if (s->state == SLOT_QUEUED && (!job || s->last_used < job->last_used))
+						job = s;
+				if (!job) { chd->worker_idle = true; chd->lock.Unlock(); chd->work.Wait(); chd->lock.Lock(); continue; }
+				job->state = SLOT_DECODING;
+				chd->lock.Unlock();
+				job->valid = chd->codec.Decode(chd->codec.map[job->hunk], &job->comp[0], &job->data[0], chd->worker_scratch);
+				chd->lock.Lock();
+				job->state = SLOT_READY;
+				if (chd->waiting) { chd->waiting = false; chd->done.Post(); }
+			}
+			chd->lock.Unlock();
+			chd->done.Post();
+			return 0;
+		}
+
 		static Bit32u get_bigendian_uint32(const Bit8u *base) { return (base[0] << 24) | (base[1] << 16) | (base[2] << 8) | base[3]; }
 		static Bit64u get_bigendian_uint64(const Bit8u *base) { return ((Bit64u)base[0] << 56) | ((Bit64u)base[1] << 48) | ((Bit64u)base[2] << 40) | ((Bit64u)base[3] << 32) | ((Bit64u)base[4] << 24) | ((Bit64u)base[5] << 16) | ((Bit64u)base[6] << 8) | (Bit64u)base[7]; }
 
 		virtual bool read(Bit8u *buffer, int seek, int count)
 		{
 			DBP_ASSERT((seek / CD_FRAME_SIZE) == ((seek + count) / CD_FRAME_SIZE)); // read only inside one sector
-			const int hunk = (seek / hunkbytes), hunk_ofs = (seek % hunkbytes), hunk_pos = (int)hunkmap[hunk];
-			if (!hunk_pos) { memset(buffer, 0, count); return true; }
-			if (!BinaryFile::read(buffer, hunk_pos + hunk_ofs + (count == COOKED_SECTOR_SIZE ? cooked_sector_shift : 0), count)) return false;
+			const int hunk = (seek / hunkbytes), hunk_ofs = (seek % hunkbytes) + (count == COOKED_SECTOR_SIZE ? cooked_sector_shift : 0);
+			if (!hunkmap)
+			{
+				Slot* s = GetHunk((Bit32u)hunk);
+				if (!s) return false;
+				memcpy(buffer, &s->data[hunk_ofs], count);
+				if ((Bit32u)hunk != last_hunk) { if ((Bit32u)hunk == last_hunk + 1) ReadAhead((Bit32u)hunk); last_hunk = (Bit32u)hunk; }
+			}
+			else if (!hunkmap[hunk]) { memset(buffer, 0, count); return true; }
+			else if (!BinaryFile::read(buffer, (int)hunkmap[hunk] + hunk_ofs, count)) return false;
 			if (seek >= audio_start) // CHD audio endian swap
 				for (Bit8u *p = buffer + (seek & 1), *pEnd = buffer + count, tmp; p < pEnd; p += 2)
 					{ tmp = p[0]; p[0] = p[1]; p[1] = tmp; }
@@ -1168,7 +1742,7 @@ bool CDROM_Interface_Image::LoadChdFile(char* filename)
 		err:
 		tracks.clear();
 		delete chd;
-		if (!not_chd) GFX_ShowMsg("Invalid or unsupported CHD file, must be an uncompressed version 5 CD image");
+		if (!not_chd) GFX_ShowMsg("Invalid or unsupported CHD file, must be a version 5 CD image without parent");
 		return false;
 	}
 
@@ -1180,7 +1754,8 @@ bool CDROM_Interface_Image::LoadChdFile(char* filename)
 	Bit32u hdr_length = ChdFile::get_bigendian_uint32(&rawheader[8]);
 	Bit32u hdr_version = ChdFile::get_bigendian_uint32(&rawheader[12]);
 	if (hdr_version != 5 || hdr_length != CHD_V5_HEADER_SIZE) goto err; // only ver 5 is supported
-	if (ChdFile::get_bigendian_uint32(&rawheader[16])) goto err; // compression is not supported
+	for (int i = 0; i != 4; i++) if (!Chd_Decompressor::IsSupported(chd->codec.compressors[i] = ChdFile::get_bigendian_uint32(&rawheader[16 + i * 4]))) goto err;
+	const bool compressed = (chd->codec.compressors[0] != 0);
 
 	// Make sure it's a CD image
 	DBP_STATIC_ASSERT(CD_MAX_SECTOR_DATA == RAW_SECTOR_SIZE);
@@ -1240,11 +1815,27 @@ bool CDROM_Interface_Image::LoadChdFile(char* filename)
 
 	DBP_STATIC_ASSERT(CHD_V5_UNCOMPMAPENTRYBYTES == sizeof(Bit32u));
 	Bit32u hunkcount = ((logicalbytes + chd->hunkbytes - 1) / chd->hunkbytes), sectorcount = (logicalbytes / CD_FRAME_SIZE);
-	chd->hunkmap = (Bit32u*)malloc(hunkcount * CHD_V5_UNCOMPMAPENTRYBYTES);
+	if (compressed)
+	{
+		// Read and decode the compressed hunk map
+		Bit8u mapheader[CHD_V5_COMPMAPHEADERBYTES];
+		if (!chd->BinaryFile::read(mapheader, (int)mapoffset, CHD_V5_COMPMAPHEADERBYTES)) goto err;
+		Bit32u mapbytes = ChdFile::get_bigendian_uint32(mapheader);
+		if (mapbytes > filelen - mapoffset - CHD_V5_COMPMAPHEADERBYTES) goto err;
+		std::vector<Bit8u> compmap(mapbytes + 1);
+		if (!chd->BinaryFile::read(&compmap[0], (int)mapoffset + CHD_V5_COMPMAPHEADERBYTES, (int)mapbytes)) goto err;
+		Chd_Decompressor::InitTables();
+		chd->codec.hunkbytes = (Bit32u)chd->hunkbytes;
+		if (!chd->codec.ParseMap(mapheader, &compmap[0], mapbytes, hunkcount)) goto err;
+	}
+	else
+	{
+		chd->hunkmap = (Bit32u*)malloc(hunkcount * CHD_V5_UNCOMPMAPENTRYBYTES);
 
-	// Read hunk mapping and convert to file offsets
-	if (!chd->BinaryFile::read((Bit8u*)chd->hunkmap, (int)mapoffset, hunkcount * CHD_V5_UNCOMPMAPENTRYBYTES)) goto err;
-	for (Bit32u i = 0; i != hunkcount; i++) chd->hunkmap[i] = ChdFile::get_bigendian_uint32((Bit8u*)&chd->hunkmap[i]) * chd->hunkbytes;
+		// Read hunk mapping and convert to file offsets
+		if (!chd->BinaryFile::read((Bit8u*)chd->hunkmap, (int)mapoffset, hunkcount * CHD_V5_UNCOMPMAPENTRYBYTES)) goto err;
+		for (Bit32u i = 0; i != hunkcount; i++) chd->hunkmap[i] = ChdFile::get_bigendian_uint32((Bit8u*)&chd->hunkmap[i]) * chd->hunkbytes;
+	}
 
 	// Now set physical start offsets for tracks and calculate CHD paddings. In CHD files tracks are padded to a to a 4-sector boundary.
 	// Thus we need to give ChdFile::read a means to figure out the padding that applies to the physical sector number it is reading.
@@ -84,6 +84,14 @@ static Bit16u DOS_GetAmount(void) {
 	return amount;
 }
 
+/* File reads and writes can use guest memory directly if it is plain RAM.
+   Devices run guest code while transferring and always go through dos_copybuf. */
+static HostPt DOS_GetDirectBuffer(Bit16u entry,PhysPt pt,Bit16u amount,bool write) {
+	Bit8u handle=RealHandle(entry);
+	if (handle>=DOS_FILES || !Files[handle] || (Files[handle]->GetInformation() & 0x80)) return NULL;
+	return MEM_GetBlockHostPt(pt,amount,write);
+}
+
 #define DATA_TRANSFERS_TAKE_CYCLES 1
 #ifdef DATA_TRANSFERS_TAKE_CYCLES
 
@@ -672,8 +680,9 @@ static Bitu DOS_21Handler(void) {
 		{ 
 			Bit16u toread=DOS_GetAmount();
 			dos.echo=true;
-			if (DOS_ReadFile(reg_bx,dos_copybuf,&toread)) {
-				MEM_BlockWrite(SegPhys(ds)+reg_dx,dos_copybuf,toread);
+			HostPt direct=DOS_GetDirectBuffer(reg_bx,SegPhys(ds)+reg_dx,toread,true);
+			if (DOS_ReadFile(reg_bx,(direct ? direct : dos_copybuf),&toread)) {
+				if (!direct) MEM_BlockWrite(SegPhys(ds)+reg_dx,dos_copybuf,toread);
 				reg_ax=toread;
 				CALLBACK_SCF(false);
 			} else {
@@ -687,8 +696,9 @@ static Bitu DOS_21Handler(void) {
 	case 0x40:					/* WRITE Write to file or device */
 		{
 			Bit16u towrite=DOS_GetAmount();
-			MEM_BlockRead(SegPhys(ds)+reg_dx,dos_copybuf,towrite);
-			if (DOS_WriteFile(reg_bx,dos_copybuf,&towrite)) {
+			HostPt direct=DOS_GetDirectBuffer(reg_bx,SegPhys(ds)+reg_dx,towrite,false);
+			if (!direct) MEM_BlockRead(SegPhys(ds)+reg_dx,dos_copybuf,towrite);
+			if (DOS_WriteFile(reg_bx,(direct ? direct : dos_copybuf),&towrite)) {
 				reg_ax=towrite;
 	   			CALLBACK_SCF(false);
 			} else {
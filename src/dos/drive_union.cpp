@@ -20,10 +20,12 @@
 #include "dos_inc.h"
 #include "drives.h"
 #include "pic.h"
+#include "dbp_threads.h"
 
 #include <time.h>
 #include <vector>
 #include <climits>
+#include <algorithm>
 
 #define TRUE_RESET_DOSERR (dos.errorcode = save_errorcode, true)
 
@@ -142,6 +144,243 @@ public:
 	}
 };
 
+#define ZIP_WRITE_LE16(b,v) { (b)[0] = (Bit8u)((Bit16u)(v) & 0xFF); (b)[1] = (Bit8u)((Bit16u)(v) >> 8); }
+#define ZIP_WRITE_LE32(b,v) { (b)[0] = (Bit8u)((Bit32u)(v) & 0xFF); (b)[1] = (Bit8u)(((Bit32u)(v) >> 8) & 0xFF); (b)[2] = (Bit8u)(((Bit32u)(v) >> 16) & 0xFF); (b)[3] = (Bit8u)((Bit32u)(v) >> 24); }
+
+struct Union_SaveWriter
+{
+	struct Entry
+	{
+		Bit32u size, datetime, crc32, offset, data_ofs;
+		bool is_dir, is_mods, stored, reuse;
+		char path[DOS_PATHLENGTH+3];
+		INLINE Bit16u PathLen() const { return (Bit16u)(strlen(path) + (is_dir ? 1 : 0)); }
+		INLINE Bit32u Length() const { return 30 + PathLen() + size; }
+	};
+
+	// The layout of the save file is only accessed by the writer thread while it is active
+	std::vector<Entry> layout, entries;
+	std::string save_file, data, mods;
+	Bit32u save_size, data_end, file_size;
+	bool valid, full, failed, active, finished;
+	Mutex lock;
+	Semaphore done;
+
+	Union_SaveWriter() : save_size(0), data_end(0), file_size(0), valid(false), full(false), failed(false), active(false), finished(false) {}
+
+	static bool SortByAge(const Entry& a, const Entry& b)
+	{
+		if (a.datetime != b.datetime) return (a.datetime < b.datetime); // later date goes later in the save
+		if (a.size     != b.size    ) return (a.size     < b.size    ); // bigger size goes later in the save
+		return (strcmp(a.path, b.path) < 0); // finally sort by path
+	}
+
+	static Thread::RET_t THREAD_CC Run(void* p)
+	{
+		Union_SaveWriter& w = *(Union_SaveWriter*)p;
+		w.failed = !(w.full ? w.WriteFull() : w.WriteIncremental());
+		if (!w.failed) w.layout.swap(w.entries);
+		w.valid = !w.failed;
+		w.entries.clear();
+		std::string().swap(w.data);
+		w.lock.Lock();
+		w.finished = true;
+		w.lock.Unlock();
+		w.done.Post();
+		return 0;
+	}
+
+	static Bit16u MakeLocalFileHeader(const Entry& e, Bit8u* lfh)
+	{
+		const Bit16u pathLen = e.PathLen(), date = (Bit16u)(e.datetime >> 16), time = (Bit16u)e.datetime;
+		ZIP_WRITE_LE32(lfh+ 0, 0x04034b50); // Local file header signature
+		ZIP_WRITE_LE16(lfh+ 4, 0);          // Version needed to extract (minimum)
+		ZIP_WRITE_LE16(lfh+ 6, 0);          // General purpose bit flag 
+		ZIP_WRITE_LE16(lfh+ 8, 0);          // Compression method
+		ZIP_WRITE_LE16(lfh+10, time);       // File last modification time
+		ZIP_WRITE_LE16(lfh+12, date);       // File last modification date
+		ZIP_WRITE_LE32(lfh+14, e.crc32);    // CRC-32 of uncompressed data
+		ZIP_WRITE_LE32(lfh+18, e.size);     // Compressed size
+		ZIP_WRITE_LE32(lfh+22, e.size);     // Uncompressed size
+		ZIP_WRITE_LE16(lfh+26, pathLen);    // File name length
+		ZIP_WRITE_LE16(lfh+28, 0);          // Extra field length
+
+		// File name (with \ changed to /)
+		const Bit16u lfhlen = 30 + pathLen;
+		Bit8u* pOut = lfh + 30;
+		for (const char* pIn = e.path; *pIn; pIn++, pOut++)
+			*pOut = (*pIn == '\\' ? '/' : *pIn);
+		if (e.is_dir)
+			*pOut = '/';
+		return lfhlen;
+	}
+
+	bool WriteEntry(FILE* fsave, Entry& e, Bit32u offset)
+	{
+		const Bit8u* filedata = (const Bit8u*)data.c_str() + e.data_ofs;
+		e.crc32 = (e.size ? DriveCalculateCRC32(filedata, e.size) : 0);
+		e.offset = offset;
+		Bit8u lfh[30 + DOS_PATHLENGTH + 8];
+		const Bit16u lfhlen = MakeLocalFileHeader(e, lfh);
+		return (fwrite(lfh, lfhlen, 1, fsave) && (!e.size || fwrite(filedata, e.size, 1, fsave)));
+	}
+
+	// Write the central directory at the current file position which must be at cd_offset
+	bool WriteCentralDirectory(FILE* fsave, Bit32u cd_offset, bool matches_existing, bool need_truncate)
+	{
+		std::vector<Bit8u> central_dir;
+		Bit16u file_count = 0;
+		for (const Entry& e : entries)
+		{
+			if (!e.stored) continue;
+			Bit8u lfh[30 + DOS_PATHLENGTH + 8];
+			MakeLocalFileHeader(e, lfh);
+			const Bit16u pathLen = e.PathLen();
+			const size_t centralDirPos = central_dir.size();
+			central_dir.resize(centralDirPos + 46 + pathLen);
+			Bit8u* cd = &central_dir[centralDirPos];
+			ZIP_WRITE_LE32(cd+0, 0x02014b50);             // Central directory file header signature 
+			ZIP_WRITE_LE16(cd+4, 0);                      // Version made by (0 = DOS)
+			memcpy(cd+6, lfh+4, 26);                      // Copy middle section shared with local file header
+			ZIP_WRITE_LE16(cd+32, 0);                     // File comment length
+			ZIP_WRITE_LE16(cd+34, 0);                     // Disk number where file starts
+			ZIP_WRITE_LE16(cd+36, 0);                     // Internal file attributes
+			ZIP_WRITE_LE32(cd+38, (e.is_dir ? 0x10 : 0)); // External file attributes
+			ZIP_WRITE_LE32(cd+42, e.offset);              // Relative offset of local file header
+			memcpy(cd + 46, lfh + 30, pathLen);           // File name
+			file_count++;
+		}
+
+		// Generate end of central directory
+		Bit8u eocd[22];
+		ZIP_WRITE_LE32(eocd+ 0, 0x06054b50);                 // End of central directory signature
+		ZIP_WRITE_LE16(eocd+ 4, 0);                          // Number of this disk
+		ZIP_WRITE_LE16(eocd+ 6, 0);                          // Disk where central directory starts
+		ZIP_WRITE_LE16(eocd+ 8, file_count);                 // Number of central directory records on this disk
+		ZIP_WRITE_LE16(eocd+10, file_count);                 // Total number of central directory records
+		ZIP_WRITE_LE32(eocd+12, (Bit32u)central_dir.size()); // Size of central directory (bytes)
+		ZIP_WRITE_LE32(eocd+16, cd_offset);                  // Offset of start of central directory, relative to start of archive
+		ZIP_WRITE_LE16(eocd+20, 0);                          // Comment length (n)
+
+		// Check if all that remains is the central directory in the existing save file
+		if (matches_existing)
+		{
+			Bit32u match_len = (file_count ? 46 : 22); //either compare CD or end of CD
+			Bit8u matchbuf[46];
+			matches_existing = fread(matchbuf, match_len, 1, fsave) && !memcmp((file_count ? &central_dir[0] : eocd), matchbuf, match_len);
+			if (!matches_existing) fseek(fsave, cd_offset, SEEK_SET);
+		}
+
+		bool failed = false;
+		if (!matches_existing)
+		{
+			failed |= !((!file_count || fwrite(&central_dir[0], central_dir.size(), 1, fsave)) && fwrite(eocd, 22, 1, fsave));
+			if (need_truncate)
+				failed |= !!ftruncate(fileno(fsave), (cd_offset + (Bit32u)central_dir.size() + 22));
+		}
+		data_end = cd_offset;
+		file_size = cd_offset + (Bit32u)central_dir.size() + 22;
+		return !failed;
+	}
+
+	// Write all files, keeping the parts of an existing save file which are still the same
+	bool WriteFull()
+	{
+		FILE* fsave = fopen_wrap(save_file.c_str(), "rb+");
+		bool matches_existing = !!fsave, need_truncate = matches_existing;
+		if (!fsave) fsave = fopen_wrap(save_file.c_str(), "wb");
+		if (!fsave) return false;
+
+		Bit32u local_file_offset = 0;
+		bool failed = false;
+		for (Entry& e : entries)
+		{
+			if (!e.stored) continue;
+			const Bit8u* filedata = (const Bit8u*)data.c_str() + e.data_ofs;
+			const Bit32u size = e.size;
+
+			// Check if the file already exists at this position, and skip writing it if so
+			if (matches_existing)
+			{
+				e.crc32 = (size ? DriveCalculateCRC32(filedata, size) : 0);
+				Bit8u lfh[30 + DOS_PATHLENGTH + 8];
+				const Bit16u lfhlen = MakeLocalFileHeader(e, lfh);
+				Bit32u match_len = (size > 16 ? 16 : size);
+				Bit8u matchbuf[30 + DOS_PATHLENGTH + 8 + 16];
+				matches_existing = fread(matchbuf, lfhlen + match_len, 1, fsave) && !memcmp(lfh, matchbuf, lfhlen)
+					&& (!size || (!memcmp(filedata, matchbuf + lfhlen, match_len)
+						&& (size == match_len || (!fseek(fsave, (int)(size - match_len - match_len), SEEK_CUR)
+							&& fread(matchbuf, match_len, 1, fsave)
+							&& !memcmp(filedata + size - match_len, matchbuf, match_len)))));
+				if (!matches_existing) fseek(fsave, local_file_offset, SEEK_SET);
+			}
+
+			if (matches_existing)
+				e.offset = local_file_offset;
+			else
+				failed |= !WriteEntry(fsave, e, local_file_offset); // Write local file header followed by file data
+			local_file_offset += e.Length();
+		}
+
+		failed |= !WriteCentralDirectory(fsave, local_file_offset, matches_existing, need_truncate);
+		fclose(fsave);
+		return !failed;
+	}
+
+	// Append only changed files to the end of the file data and rewrite the central directory after it
+	bool WriteIncremental()
+	{
+		FILE* fsave = fopen_wrap(save_file.c_str(), "rb+");
+		if (!fsave) return false;
+
+		// Make sure the file is still as we left it
+		bool failed = (fseek(fsave, 0, SEEK_END) || ftell(fsave) != (long)file_size);
+
+		Bit32u offset = data_end, live = 0;
+		for (const Entry& e : entries)
+			if (e.reuse && e.stored)
+				live += e.Length();
+
+		// Once more than a fifth of the file data is taken up by replaced or deleted files, move the used file data to the front
+		if (!failed && data_end - live > live / 4 + 1024 * 1024)
+		{
+			std::vector<Entry*> moves;
+			for (Entry& e : entries)
+				if (e.reuse && e.stored)
+					moves.push_back(&e);
+			std::sort(moves.begin(), moves.end(), [](const Entry* a, const Entry* b) { return a->offset < b->offset; });
+
+			// Data only ever moves towards the start of the file so it can be copied front to back
+			Bit8u buf[64 * 1024];
+			offset = 0;
+			for (Entry* e : moves)
+			{
+				const Bit32u len = e->Length();
+				for (Bit32u done = 0, n; e->offset != offset && done != len && !failed; done += n)
+				{
+					n = (len - done > sizeof(buf) ? (Bit32u)sizeof(buf) : len - done);
+					failed |= (fseek(fsave, (long)(e->offset + done), SEEK_SET) || !fread(buf, n, 1, fsave)
+						|| fseek(fsave, (long)(offset + done), SEEK_SET) || !fwrite(buf, n, 1, fsave));
+				}
+				e->offset = offset;
+				offset += len;
+			}
+		}
+
+		failed |= !!fseek(fsave, (long)offset, SEEK_SET);
+		for (Entry& e : entries)
+		{
+			if (failed || e.reuse || !e.stored) continue;
+			failed |= !WriteEntry(fsave, e, offset);
+			offset += e.Length();
+		}
+
+		failed = (failed || !WriteCentralDirectory(fsave, offset, false, true));
+		fclose(fsave);
+		return !failed;
+	}
+};
+
 struct unionDriveImpl
 {
 	memoryDrive* save_mem;
@@ -151,12 +390,14 @@ struct unionDriveImpl
 	std::vector<Bit16u> free_search_ids;
 	std::string save_file;
 	Bit32u save_size, free_bytes;
-	bool writable, autodelete_under, autodelete_over, dirty;
+	bool writable, autodelete_under, autodelete_over, dirty, changed_all;
 	Bit16u modification_date, modification_time;
+	StringToPointerHashMap<void> changed_paths;
+	Union_SaveWriter writer;
 
 	unionDriveImpl(DOS_Drive* _under, DOS_Drive* _over, const char* _save_file, bool _autodelete_under, bool _autodelete_over = false, bool strict_mode = false)
 		: save_mem(_over ? NULL : new memoryDrive()), under(_under), over(_over ? _over : save_mem), save_size(0), free_bytes(0),
-		  autodelete_under(_autodelete_under), autodelete_over(_autodelete_over || save_mem), dirty(false)
+		  autodelete_under(_autodelete_under), autodelete_over(_autodelete_over || save_mem), dirty(false), changed_all(false)
 	{
 		Bit16u bytes_sector; Bit8u sectors_cluster; Bit16u total_clusters; Bit16u free_clusters;
 		over->AllocationInfo(&bytes_sector, &sectors_cluster, &total_clusters, &free_clusters);
@@ -173,16 +414,20 @@ struct unionDriveImpl
 		if (_save_file)
 		{
 			DBP_ASSERT(!_over && writable);
-			save_file = _save_file;
+			save_file = writer.save_file = _save_file;
 			ReadSaveFile(strict_mode);
 		}
 	}
 
 	~unionDriveImpl()
 	{
+		if (writer.active)
+			FinishSaveFile();
 		if (dirty)
 			WriteSaveFile((Bitu)this);
-		if (dirty)
+		if (writer.active)
+			FinishSaveFile();
+		if (!save_file.empty())
 			PIC_RemoveSpecificEvents(WriteSaveFile, (Bitu)this);
 		for (Union_Modification* m : modifications)
 			delete m;
@@ -332,203 +577,169 @@ struct unionDriveImpl
 
 	static void WriteSaveFile(Bitu implPtr)
 	{
-		#define ZIP_WRITE_LE16(b,v) { (b)[0] = (Bit8u)((Bit16u)(v) & 0xFF); (b)[1] = (Bit8u)((Bit16u)(v) >> 8); }
-		#define ZIP_WRITE_LE32(b,v) { (b)[0] = (Bit8u)((Bit32u)(v) & 0xFF); (b)[1] = (Bit8u)(((Bit32u)(v) >> 8) & 0xFF); (b)[2] = (Bit8u)(((Bit32u)(v) >> 16) & 0xFF); (b)[3] = (Bit8u)((Bit32u)(v) >> 24); }
+		unionDriveImpl* impl = (unionDriveImpl*)implPtr;
+		Union_SaveWriter& w = impl->writer;
+		if (w.active)
+		{
+			// Check again later if the previous snapshot is still being written
+			w.lock.Lock();
+			const bool finished = w.finished;
+			w.lock.Unlock();
+			if (!finished) { PIC_AddEvent(WriteSaveFile, 100.f, implPtr); return; }
+			impl->FinishSaveFile();
+		}
+		if (!impl->dirty) return;
 
-		struct SaveFile { Bit32u size, datetime; bool is_dir; char path[DOS_PATHLENGTH+3]; };
+		LOG_MSG("[DOSBOX] Saving filesystem modifications to %s", impl->save_file.c_str());
+		impl->SnapshotSaveFile();
+		w.finished = false;
+		w.active = true;
+		Thread::StartDetached(Union_SaveWriter::Run, &w);
+		PIC_AddEvent(WriteSaveFile, 100.f, implPtr); // pick up the result
+	}
+
+	void SnapshotSaveFile()
+	{
+		typedef Union_SaveWriter::Entry Entry;
 		struct Local { static void QueueFile(const char* path, bool is_dir, Bit32u size, Bit16u date, Bit16u time, Bit8u attr, Bitu data)
 		{
-			std::vector<SaveFile>& sfs = *(std::vector<SaveFile>*)data;
-			SaveFile sf;
-			sf.size = size;
-			sf.datetime = (((Bit32u)date) << 16) | time;
-			sf.is_dir = is_dir;
-			strcpy(sf.path, path);
-			size_t pos = 0;
-			for (size_t num = sfs.size(); pos != num; pos++)
-			{
-				SaveFile& sfb = sfs[pos];
-				if (sf.datetime > sfb.datetime) continue; if (sf.datetime < sfb.datetime) break; // later date goes later in the save
-				if (sf.size     > sfb.size    ) continue; if (sf.size     < sfb.size    ) break; // bigger size goes later in the save
-				if (strcmp(sf.path, sfb.path) < 0) break; // finally sort by path
-			}
-			sfs.insert(sfs.begin() + pos, sf);
+			std::vector<Entry>& entries = *(std::vector<Entry>*)data;
+			entries.emplace_back();
+			Entry& e = entries.back();
+			e.size = size;
+			e.datetime = (((Bit32u)date) << 16) | time;
+			e.crc32 = e.offset = e.data_ofs = 0;
+			e.is_dir = is_dir;
+			e.is_mods = false;
+			e.stored = true;
+			e.reuse = false;
+			strcpy(e.path, path);
 		}};
 
-		unionDriveImpl* impl = (unionDriveImpl*)implPtr;
-		LOG_MSG("[DOSBOX] Saving filesystem modifications to %s", impl->save_file.c_str());
-		FILE* fsave = fopen_wrap(impl->save_file.c_str(), "rb+");
-		bool matches_existing = !!fsave, need_truncate = matches_existing;
-		if (!fsave) fsave = fopen_wrap(impl->save_file.c_str(), "wb");
-		if (!fsave)
+		Union_SaveWriter& w = writer;
+		std::vector<Entry>& entries = w.entries;
+		std::string& data = w.data;
+		entries.clear();
+		data.clear();
+		DriveFileIterator(over, Local::QueueFile, (Bitu)&entries);
+
+		// Also add FILEMODS.DBP which lists the modifications to files of the underlying drive
+		std::string mods;
+		for (Union_Modification* m : modifications) m->Serialize(mods);
+		if (mods.size())
 		{
-			LOG_MSG("[DOSBOX] Opening file %s for writing failed", impl->save_file.c_str());
-			reporterror:
-			static int reportcount;
-			if (reportcount++ < 3 || !(reportcount % 6))
-			{
-				extern void emuthread_notify(int duration, LOG_SEVERITIES lvl, char const* format,...);
-				emuthread_notify(2000, LOG_ERROR, "Error while writing game save file '%s'!", impl->save_file.c_str());
-			}
-			impl->ScheduleSave(5000.f);
-			return;
+			Local::QueueFile("FILEMODS.DBP", false, (Bit32u)mods.size(), modification_date, modification_time, 0, (Bitu)&entries);
+			entries.back().is_mods = true;
 		}
 
 		// Sort files by age so oldest files (which don't change anymore) are at the front of the save file.
 		// This is so most of the save file can be kept as is when updating a (potentially large) existing save.
-		std::vector<SaveFile> save_files;
-		DOS_Drive *over = impl->over, *under = impl->under;
-		DriveFileIterator(over, Local::QueueFile, (Bitu)&save_files);
+		std::sort(entries.begin(), entries.end(), Union_SaveWriter::SortByAge);
 
-		// Also insert FILEMODS.DBP into list sorted by age
-		if (impl->modifications.Len())
-			Local::QueueFile("FILEMODS.DBP", false, (Bit32u)-1, impl->modification_date, impl->modification_time, 0, (Bitu)&save_files);
+		// Files that are unchanged since the last write are referenced as is, only changed files are copied into the snapshot
+		StringToPointerHashMap<Entry> written;
+		w.full = (!w.valid || changed_all);
+		if (!w.full)
+			for (Entry& e : w.layout)
+				written.Put(e.path, &e);
 
-		std::string sbuf;
-		std::vector<Bit8u> central_dir;
-		Bit32u local_file_offset = 0, save_size = 0;
-		Bit16u file_count = 0;
-		bool failed = false;
-		for (SaveFile& sf : save_files)
+		Bit32u save_size = 0;
+		for (Entry& e : entries)
 		{
-			Bit32u size = sf.size;
-			char* path = sf.path;
-			sbuf.clear();
-			Bit8u* filedata = NULL;
-			Bit16u pathLen = (Bit16u)(strlen(path) + (sf.is_dir ? 1 : 0));
-			if (size == (Bit32u)-1) // generate file modifications meta file
+			Entry* old = (w.full ? NULL : written.Get(e.path));
+			if (old && old->is_dir == e.is_dir && old->size == e.size && old->datetime == e.datetime
+				&& (e.is_mods ? mods == w.mods : !changed_paths.Get(e.path)))
 			{
-				for (Union_Modification* m : impl->modifications) m->Serialize(sbuf);
-				size = (Bit32u)sbuf.size();
-				filedata = (Bit8u*)&sbuf[0];
+				e.reuse = true;
+				e.stored = old->stored;
+				e.offset = old->offset;
+				e.crc32 = old->crc32;
+				if (e.stored) save_size += e.size;
+				continue;
 			}
-			else if (!sf.is_dir)
+
+			const Bit32u size = e.size, ofs = (Bit32u)data.size();
+			e.data_ofs = ofs;
+			if (e.is_mods)
+			{
+				data += mods;
+			}
+			else if (!e.is_dir)
 			{
 				// Read file data in both over and under drive to compare
 				DOS_File* df;
 				bool under_match_size = false;
-				if (under->FileOpen(&df, path, 0))
+				if (under->FileOpen(&df, e.path, 0))
 				{
 					Bit32u under_size = 0;
 					df->AddRef();
 					df->Seek(&under_size, DOS_SEEK_END);
 					under_match_size = (under_size == size);
-					ReadAndClose(df, sbuf, (under_match_size ? size : 0));
+					ReadAndClose(df, data, (under_match_size ? size : 0));
 				}
 
-				bool opened = over->FileOpen(&df, (char*)path, 0);
-				bool fullyread = ReadAndClose(df, sbuf, size);
+				bool opened = over->FileOpen(&df, e.path, 0);
+				bool fullyread = ReadAndClose(df, data, size);
 				DBP_ASSERT(opened && fullyread);
-				filedata = (Bit8u*)&sbuf[under_match_size ? size : 0];
+				Bit8u* filedata = (Bit8u*)&data[ofs + (under_match_size ? size : 0)];
 
 				// If content matches, don't store in save file
-				if (under_match_size && (!size || !memcmp(filedata, &sbuf[0], size))) continue;
+				if (under_match_size && (!size || !memcmp(filedata, &data[ofs], size))) { data.resize(ofs); e.stored = false; continue; }
 
 				// Don't write files with .SWP ending that are either empty or filled with zero bytes (temporary swap files)
-				if (pathLen > 4 && !memcmp(path + pathLen - 4, ".SWP", 4))
+				const size_t pathLen = strlen(e.path);
+				if (pathLen > 4 && !memcmp(e.path + pathLen - 4, ".SWP", 4))
 				{
 					bool allzeros = true;
-					for (Bit8u *p = (Bit8u*)&sbuf[0], *pEnd = p + size; p != pEnd; p++) { if (*p) { allzeros = false; break; } }
-					if (allzeros) continue;
+					for (Bit8u *p = filedata, *pEnd = p + size; p != pEnd; p++) { if (*p) { allzeros = false; break; } }
+					if (allzeros) { data.resize(ofs); e.stored = false; continue; }
 					#if !defined(NDEBUG) && defined(_MSC_VER)
 					extern void emuthread_notify(int duration, LOG_SEVERITIES lvl, char const* format,...);
-					emuthread_notify(2000, LOG_NORMAL, "Game is writing %d MB swap file '%s'", size / 1024 / 1024, path);
+					emuthread_notify(2000, LOG_NORMAL, "Game is writing %d MB swap file '%s'", size / 1024 / 1024, e.path);
 					#endif
 				}
-			}
-
-			// Generate local file header
-			Bit8u lfh[30 + DOS_PATHLENGTH + 8];
-			const Bit16u date = (Bit16u)(sf.datetime >> 16), time = (Bit16u)sf.datetime;
-			const Bit32u crc32 = (size ? DriveCalculateCRC32(filedata, size) : 0);
-			ZIP_WRITE_LE32(lfh+ 0, 0x04034b50); // Local file header signature
-			ZIP_WRITE_LE16(lfh+ 4, 0);          // Version needed to extract (minimum)
-			ZIP_WRITE_LE16(lfh+ 6, 0);          // General purpose bit flag 
-			ZIP_WRITE_LE16(lfh+ 8, 0);          // Compression method
-			ZIP_WRITE_LE16(lfh+10, time);       // File last modification time
-			ZIP_WRITE_LE16(lfh+12, date);       // File last modification date
-			ZIP_WRITE_LE32(lfh+14, crc32);      // CRC-32 of uncompressed data
-			ZIP_WRITE_LE32(lfh+18, size);       // Compressed size
-			ZIP_WRITE_LE32(lfh+22, size);       // Uncompressed size
-			ZIP_WRITE_LE16(lfh+26, pathLen);    // File name length
-			ZIP_WRITE_LE16(lfh+28, 0);          // Extra field length
-
-			// File name (with \ changed to /)
-			const Bit16u lfhlen = 30 + pathLen;
-			for (char* pIn = (char*)path, *pOut = (char*)(lfh+30); *pIn; pIn++, pOut++)
-				*pOut = (*pIn == '\\' ? '/' : *pIn);
-			if (sf.is_dir)
-				lfh[lfhlen - 1] = '/';
-
-			// Generate central directory file header
-			const size_t centralDirPos = central_dir.size();
-			central_dir.resize(centralDirPos + 46 + pathLen);
-			Bit8u* cd = &central_dir[centralDirPos];
-			ZIP_WRITE_LE32(cd+0, 0x02014b50);              // Central directory file header signature 
-			ZIP_WRITE_LE16(cd+4, 0);                       // Version made by (0 = DOS)
-			memcpy(cd+6, lfh+4, 26);                       // Copy middle section shared with local file header
-			ZIP_WRITE_LE16(cd+32, 0);                      // File comment length
-			ZIP_WRITE_LE16(cd+34, 0);                      // Disk number where file starts
-			ZIP_WRITE_LE16(cd+36, 0);                      // Internal file attributes
-			ZIP_WRITE_LE32(cd+38, (sf.is_dir ? 0x10 : 0)); // External file attributes
-			ZIP_WRITE_LE32(cd+42, local_file_offset);      // Relative offset of local file header
-			memcpy(cd + 46, lfh + 30, pathLen);            // File name
 
-			// Check if the file already exists at this position, and skip writing it if so
-			if (matches_existing)
-			{
-				Bit32u match_len = (size > 16 ? 16 : size);
-				Bit8u matchbuf[30 + DOS_PATHLENGTH + 8 + 16];
-				matches_existing = fread(matchbuf, lfhlen + match_len, 1, fsave) && !memcmp(lfh, matchbuf, lfhlen)
-					&& (!size || (!memcmp(filedata, matchbuf + lfhlen, match_len)
-						&& (size == match_len || (!fseek(fsave, (int)(size - match_len - match_len), SEEK_CUR)
-							&& fread(matchbuf, match_len, 1, fsave)
-							&& !memcmp(filedata + size - match_len, matchbuf, match_len)))));
-				if (!matches_existing) fseek(fsave, local_file_offset, SEEK_SET);
-			}
-
-			if (!matches_existing)
-			{
-				// Write local file header followed by file data
-				failed |= !(fwrite(lfh, lfhlen, 1, fsave) && (!size || fwrite(filedata, size, 1, fsave)));
+				if (under_match_size)
+				{
+					memmove(&data[ofs], filedata, size);
+					data.resize(ofs + size);
+				}
 			}
-
-			local_file_offset += (lfhlen + size);
 			save_size += size;
-			file_count++;
 		}
 
-		// Generate end of central directory
-		Bit8u eocd[22];
-		ZIP_WRITE_LE32(eocd+ 0, 0x06054b50);                 // End of central directory signature
-		ZIP_WRITE_LE16(eocd+ 4, 0);                          // Number of this disk
-		ZIP_WRITE_LE16(eocd+ 6, 0);                          // Disk where central directory starts
-		ZIP_WRITE_LE16(eocd+ 8, file_count);                 // Number of central directory records on this disk
-		ZIP_WRITE_LE16(eocd+10, file_count);                 // Total number of central directory records
-		ZIP_WRITE_LE32(eocd+12, (Bit32u)central_dir.size()); // Size of central directory (bytes)
-		ZIP_WRITE_LE32(eocd+16, local_file_offset);          // Offset of start of central directory, relative to start of archive
-		ZIP_WRITE_LE16(eocd+20, 0);                          // Comment length (n)
+		w.mods.swap(mods);
+		w.save_size = save_size;
+		changed_paths.Clear();
+		changed_all = false;
+		dirty = false;
+	}
 
-		// Check if all that remains is the central directory in the existing save file
-		if (matches_existing)
+	void FinishSaveFile()
+	{
+		writer.done.Wait();
+		writer.active = false;
+		if (!writer.failed)
 		{
-			Bit32u match_len = (file_count ? 46 : 22); //either compare CD or end of CD
-			Bit8u matchbuf[46];
-			matches_existing = fread(matchbuf, match_len, 1, fsave) && !memcmp((file_count ? &central_dir[0] : eocd), matchbuf, match_len);
-			if (!matches_existing) fseek(fsave, local_file_offset, SEEK_SET);
+			save_size = writer.save_size;
+			return;
 		}
-
-		if (!matches_existing)
+		LOG_MSG("[DOSBOX] Error while writing file %s", save_file.c_str());
+		static int reportcount;
+		if (reportcount++ < 3 || !(reportcount % 6))
 		{
-			failed |= !((!file_count || fwrite(&central_dir[0], central_dir.size(), 1, fsave)) && fwrite(eocd, 22, 1, fsave));
-			if (need_truncate)
-				failed |= !!ftruncate(fileno(fsave), (local_file_offset + (Bit32u)central_dir.size() + 22));
+			extern void emuthread_notify(int duration, LOG_SEVERITIES lvl, char const* format,...);
+			emuthread_notify(2000, LOG_ERROR, "Error while writing game save file '%s'!", save_file.c_str());
 		}
-		fclose(fsave);
+		ScheduleSave(5000.f);
+	}
 
-		if (failed) { LOG_MSG("[DOSBOX] Error while writing file %s", impl->save_file.c_str()); goto reporterror; }
-		impl->save_size = save_size;
-		impl->dirty = false;
+	void MarkChanged(const char* path, bool is_dir = false)
+	{
+		if (save_file.empty()) return;
+		DOSPATH_REMOVE_ENDINGDOTS(path);
+		changed_paths.Put(path, this);
+		if (is_dir) changed_all = true; // paths of all contained files changed
 	}
 
 	void ScheduleSave(float delay_ms = 0)
@@ -590,6 +801,7 @@ struct Union_WriteHandle : public DOS_File
 		}
 		if (dirty)
 		{
+			impl->MarkChanged(name);
 			impl->ScheduleSave();
 			dirty = false;
 		}
@@ -824,6 +1036,7 @@ bool unionDrive::Rename(char * oldpath, char * newpath)
 		if ((oldlastslash || newlastslash) && (oldlastslash - oldpath) != (newlastslash - newpath) && memcmp(oldpath, newpath, (newlastslash - newpath))) return FALSE_SET_DOSERR(ACCESS_DENIED);
 	}
 	impl->ForceCloseFileAndScheduleSave(this, oldpath, true);
+	impl->MarkChanged(newpath, (old_m ? old_m->RedirectType() == Union_Modification::TDIR : !is_file));
 	if (new_m) //means (new_m->IsDelete())
 	{
 		delete new_m;
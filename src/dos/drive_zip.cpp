@@ -21,6 +21,7 @@
 #include "drives.h"
 #include "inout.h"
 #include "pic.h"
+#include "dbp_threads.h"
 
 #include <vector>
 
@@ -1051,12 +1052,174 @@ struct unz_explode
 	}
 };
 
+static Bit32u zip_cache_max_blocks = (8*1024*1024) / miniz::TINFL_LZ_DICT_SIZE;
+
+// LRU cache of decompressed 32 KB blocks of deflated files, shared by all files of a ZIP drive.
+// This avoids decompressing the same data again when a file is read through multiple handles, re-opened or seeked backwards.
+struct Zip_BlockCache
+{
+	enum { BLOCK = miniz::TINFL_LZ_DICT_SIZE, HASH_SIZE = 1024, NIL = 0xFFFFFFFF };
+	struct Block { const void* owner; Bit32u idx, len, last_used, next; Bit8u* data; };
+	std::vector<Block> blocks;
+	Bit32u hash[HASH_SIZE], used_counter;
+	Mutex lock;
+
+	Zip_BlockCache() : used_counter(0) { memset(hash, 0xFF, sizeof(hash)); }
+	~Zip_BlockCache() { for (Block& b : blocks) free(b.data); }
+
+	static INLINE Bit32u Hash(const void* owner, Bit32u idx) { return (Bit32u)(((size_t)owner >> 4) * 31 + idx) & (HASH_SIZE - 1); }
+
+	Bit32u Find(const void* owner, Bit32u idx)
+	{
+		for (Bit32u i = hash[Hash(owner, idx)]; i != NIL; i = blocks[i].next)
+			if (blocks[i].owner == owner && blocks[i].idx == idx) return i;
+		return NIL;
+	}
+
+	void Unlink(Bit32u i)
+	{
+		for (Bit32u* p = &hash[Hash(blocks[i].owner, blocks[i].idx)]; *p != NIL; p = &blocks[*p].next)
+			if (*p == i) { *p = blocks[i].next; break; }
+		blocks[i].owner = NULL;
+		blocks[i].last_used = 0;
+	}
+
+	// Copies data starting at ofs up to the end of the cached block, returns 0 if the block is not in the cache
+	Bit32u Read(const void* owner, Bit32u ofs, Bit8u* out, Bit32u n)
+	{
+		Bit32u res = 0, i;
+		lock.Lock();
+		if ((i = Find(owner, ofs / BLOCK)) != NIL && (ofs & (BLOCK - 1)) < blocks[i].len)
+		{
+			res = blocks[i].len - (ofs & (BLOCK - 1));
+			if (res > n) res = n;
+			memcpy(out, blocks[i].data + (ofs & (BLOCK - 1)), res);
+			blocks[i].last_used = ++used_counter;
+		}
+		lock.Unlock();
+		return res;
+	}
+
+	void Store(const void* owner, Bit32u idx, const Bit8u* data, Bit32u len)
+	{
+		const Bit32u max_blocks = zip_cache_max_blocks;
+		if (!max_blocks && blocks.empty()) return;
+		lock.Lock();
+		while (blocks.size() > max_blocks) // cache size option was lowered
+		{
+			if (blocks.back().owner) Unlink((Bit32u)blocks.size() - 1);
+			free(blocks.back().data);
+			blocks.pop_back();
+		}
+		if (max_blocks && Find(owner, idx) == NIL)
+		{
+			Bit32u i = 0;
+			if (blocks.size() < max_blocks)
+			{
+				i = (Bit32u)blocks.size();
+				blocks.resize(i + 1);
+				blocks[i].data = (Bit8u*)malloc(BLOCK);
+			}
+			else
+			{
+				for (Bit32u j = 1, jEnd = (Bit32u)blocks.size(); j != jEnd; j++)
+					if (blocks[j].last_used < blocks[i].last_used) i = j;
+				if (blocks[i].owner) Unlink(i);
+			}
+			Block& b = blocks[i];
+			Bit32u& head = hash[Hash(owner, idx)];
+			b.owner = owner;
+			b.idx = idx;
+			b.len = len;
+			b.last_used = ++used_counter;
+			b.next = head;
+			head = i;
+			memcpy(b.data, data, len);
+		}
+		lock.Unlock();
+	}
+
+	void Remove(const void* owner)
+	{
+		lock.Lock();
+		for (Bit32u i = 0, iEnd = (Bit32u)blocks.size(); i != iEnd; i++)
+			if (blocks[i].owner == owner)
+				Unlink(i);
+		lock.Unlock();
+	}
+};
+
+// Worker thread that continues decompressing a file which is being read sequentially.
+// File access stays on the emulation thread, the compressed data is read before the job gets started.
+struct Zip_InflateAhead
+{
+	Mutex lock;
+	Semaphore work, done;
+	struct Zip_DeflateUnpacker* job;
+	bool started, idle, waiting, quit, cancel;
+
+	Zip_InflateAhead() : job(NULL), started(false), idle(false), waiting(false), quit(false), cancel(false) {}
+
+	~Zip_InflateAhead()
+	{
+		if (!started) return;
+		lock.Lock();
+		quit = true;
+		if (idle) { idle = false; work.Post(); }
+		lock.Unlock();
+		done.Wait(); // wait for worker thread to exit
+	}
+
+	bool Start(Zip_DeflateUnpacker* unpacker)
+	{
+		lock.Lock();
+		const bool start = (job == NULL);
+		if (start)
+		{
+			job = unpacker;
+			cancel = false;
+			if (idle) { idle = false; work.Post(); }
+		}
+		lock.Unlock();
+		if (start && !started) { started = true; Thread::StartDetached(Run, this); }
+		return start;
+	}
+
+	bool IsRunning(Zip_DeflateUnpacker* unpacker)
+	{
+		lock.Lock();
+		const bool res = (job == unpacker);
+		lock.Unlock();
+		return res;
+	}
+
+	bool IsCanceled()
+	{
+		lock.Lock();
+		const bool res = cancel;
+		lock.Unlock();
+		return res;
+	}
+
+	void Finish(Zip_DeflateUnpacker* unpacker)
+	{
+		lock.Lock();
+		if (job == unpacker) cancel = true;
+		while (job == unpacker) { waiting = true; lock.Unlock(); done.Wait(); lock.Lock(); }
+		lock.Unlock();
+	}
+
+	static Thread::RET_t THREAD_CC Run(void* p);
+};
+
 struct Zip_Archive
 {
 	DOS_File* zip;
 	Bit64u ofs;
 	Bit64u size;
 	bool enable_crc_check;
+	Zip_BlockCache cache;
+	Zip_InflateAhead ahead;
 
 	Zip_Archive(DOS_File* _zip, bool _enable_crc_check) : zip(_zip), enable_crc_check(_enable_crc_check)
 	{
@@ -1280,8 +1443,13 @@ struct Zip_DeflateUnpacker : ZIP_Unpacker
 	Bit32u read_buf_ofs;
 	Bit32u comp_remaining;
 	Bit32u crc_run, crc_ofs, crc_failed;
+	Bit32u last_read_end;
+	bool ahead_queued;
+	std::vector<Bit8u> ahead_in;
+	Bit64u ahead_in_ofs;
+	const Zip_File* ahead_file;
 
-	enum { READ_BLOCK = miniz::MZ_ZIP_MAX_IO_BUF_SIZE, WRITE_BLOCK = miniz::TINFL_LZ_DICT_SIZE };
+	enum { READ_BLOCK = miniz::MZ_ZIP_MAX_IO_BUF_SIZE, WRITE_BLOCK = miniz::TINFL_LZ_DICT_SIZE, AHEAD_READ_BLOCKS = 4, AHEAD_TRIGGER = WRITE_BLOCK * 2 };
 	struct SeekCursor
 	{
 		Bit64u cursor_in;
@@ -1304,7 +1472,7 @@ struct Zip_DeflateUnpacker : ZIP_Unpacker
 	enum { SEEK_CURSOR_MAX_DEFL = 128 + (sizeof(SeekCursor) + 9) / 10 * 11, SEEK_CACHE_CURSOR_NEED = 50, SEEK_CACHE_CURSOR_STEPS = 20 };
 	struct SeekCache { zipDrive* drv; std::string path; Bit32u count; } * seek_cache;
 
-	Zip_DeflateUnpacker(Zip_Archive& _archive, const Zip_File& f, zipDrive* drv, const char* path) : archive(_archive), crc_run(0), crc_ofs((Bit32u)-1), crc_failed(0), seek_cache(NULL)
+	Zip_DeflateUnpacker(Zip_Archive& _archive, const Zip_File& f, zipDrive* drv, const char* path) : archive(_archive), crc_run(0), crc_ofs((Bit32u)-1), crc_failed(0), last_read_end(0), ahead_queued(false), seek_cache(NULL)
 	{
 		//printf("[%s] OPENED FILE!\n", f.name);
 		DBP_ASSERT(f.ofs_past_header);
@@ -1362,6 +1530,8 @@ struct Zip_DeflateUnpacker : ZIP_Unpacker
 
 	~Zip_DeflateUnpacker()
 	{
+		if (ahead_queued) archive.ahead.Finish(this);
+		archive.cache.Remove(this);
 		if (seek_cache) delete seek_cache;
 		free(cursors);
 	}
@@ -1376,12 +1546,39 @@ struct Zip_DeflateUnpacker : ZIP_Unpacker
 
 	Bit32u Read(const Zip_File& f, Bit32u seek_ofs, void *res_buf, Bit32u res_n)
 	{
-		if (crc_failed) return 0;
 		Bit32u want_from = seek_ofs, want_to = seek_ofs + res_n, last_idx = (Bit32u)-1, slowload_num, slowload_tick;
 		DBP_ASSERT(want_to <= f.decomp_size);
+		const bool sequential = (seek_ofs == last_read_end);
+		last_read_end = want_to;
+		Bit8u* p_res = (Bit8u*)res_buf;
+
+		if (ahead_queued)
+		{
+			// While the worker thread owns the decompressor, only the block cache can be used
+			for (Bit32u got; (got = archive.cache.Read(this, want_from, p_res, want_to - want_from)) != 0;)
+			{
+				p_res += got;
+				if ((want_from += got) != want_to) continue;
+				if (!archive.ahead.IsRunning(this)) { ahead_queued = false; if (sequential) StartAhead(f, want_to); }
+				return res_n;
+			}
+			archive.ahead.Finish(this);
+			ahead_queued = false;
+		}
+		if (crc_failed) return 0;
 
 		Bit32u have_from = ((out_buf_ofs ? out_buf_ofs - 1 : 0) & ~(WRITE_BLOCK-1));
 		if (want_from < have_from || want_from > out_buf_ofs)
+		{
+			for (Bit32u got; (want_from < have_from || want_from > out_buf_ofs) && (got = archive.cache.Read(this, want_from, p_res, want_to - want_from)) != 0;)
+			{
+				p_res += got;
+				if ((want_from += got) != want_to) continue;
+				if (sequential) StartAhead(f, want_to);
+				return res_n;
+			}
+		}
+		if (want_from < have_from || want_from > out_buf_ofs)
 		{
 			for (Bit32u idx = (want_from / cursor_block);; idx--)
 			{
@@ -1410,7 +1607,6 @@ struct Zip_DeflateUnpacker : ZIP_Unpacker
 			}
 		}
 
-		Bit8u* p_res = (Bit8u*)res_buf;
 		for (miniz::tinfl_status status = miniz::TINFL_STATUS_NEEDS_MORE_INPUT; status == miniz::TINFL_STATUS_NEEDS_MORE_INPUT || status == miniz::TINFL_STATUS_HAS_MORE_OUTPUT || status == miniz::TINFL_STATUS_DONE;)
 		{
 			if (out_buf_ofs > want_from)
@@ -1420,98 +1616,58 @@ struct Zip_DeflateUnpacker : ZIP_Unpacker
 				Bit32u have_size = have_to - want_from;
 				memcpy(p_res, write_buf + (want_from & (WRITE_BLOCK-1)), have_size);
 				if (have_to == want_to)
+				{
+					if (sequential && status != miniz::TINFL_STATUS_DONE) StartAhead(f, want_to);
 					return res_n;
+				}
 				p_res += have_size;
 				want_from = have_to;
 			}
 			DBP_ASSERT(out_buf_ofs != want_to && status != miniz::TINFL_STATUS_DONE);
 
-			if (!read_buf_avail)
+			Bit32u idx;
+			if (!Inflate(f, status, idx))
 			{
-				read_buf_avail = (comp_remaining < READ_BLOCK ? comp_remaining : READ_BLOCK);
-				if (archive.Read(ofs, read_buf, read_buf_avail) != read_buf_avail)
-					break;
-				ofs_last_read = ofs;
-				ofs += read_buf_avail;
-				comp_remaining -= read_buf_avail;
-				read_buf_ofs = 0;
-			}
-
-			Bit32u out_buf_size = WRITE_BLOCK - (out_buf_ofs & (WRITE_BLOCK-1));
-			Bit8u *pWrite_buf_cur = write_buf + (out_buf_ofs & (WRITE_BLOCK-1));
-			Bit32u in_buf_size = read_buf_avail;
-
-			status = miniz::tinfl_decompress(&inflator, read_buf + read_buf_ofs, &in_buf_size, write_buf, pWrite_buf_cur, &out_buf_size, (comp_remaining ? miniz::TINFL_FLAG_HAS_MORE_INPUT : 0));
-
-			if (crc_ofs == out_buf_ofs && out_buf_size)
-			{
-				crc_run = DriveCalculateCRC32(pWrite_buf_cur, out_buf_size, crc_run);
-				crc_ofs += out_buf_size;
-				if (crc_ofs == f.decomp_size && crc_run != f.crc)
-				{
-					DBP_ASSERT(false);
-					crc_failed = 1;
-					return 0;
-				}
+				if (crc_failed) return 0;
+				break;
 			}
 
-			read_buf_avail -= in_buf_size;
-			read_buf_ofs += in_buf_size;
-			out_buf_ofs += out_buf_size;
-			if (out_buf_ofs > f.decomp_size) { DBP_ASSERT(0); break; }
-
-			if (inflator.m_state == miniz::TINFL_STATE_INDEX_BLOCK_BOUNDRY)
+			if (idx != (Bit32u)-1)
 			{
-				// Gear cursors toward the middle of the block to accommodate forward and backward seeking as well as possible
-				Bit32u idx = (out_buf_ofs / cursor_block);
-				if (!cursors[idx].cursor_out || (out_buf_ofs > cursors[idx].cursor_out + 120*1024 && out_buf_ofs < idx*cursor_block + cursor_block/2 + 70*1024))
+				// Write a seek cache next to the compressed file for larger files
+				if (seek_cache && idx > SEEK_CACHE_CURSOR_NEED)
 				{
-					//printf("[%s] STORE SEEK CURSOR #%u AT %u\n", f.name, idx, out_buf_ofs);
-					cursors[idx].cursor_in = ofs_last_read + read_buf_ofs;
-					cursors[idx].cursor_out = out_buf_ofs;
-					cursors[idx].m_num_bits                = inflator.m_num_bits;
-					cursors[idx].m_bit_buf                 = inflator.m_bit_buf;
-					cursors[idx].m_dist                    = inflator.m_dist;
-					cursors[idx].m_counter                 = inflator.m_counter;
-					cursors[idx].m_num_extra               = inflator.m_num_extra;
-					cursors[idx].m_dist_from_out_buf_start = inflator.m_dist_from_out_buf_start;
-					memcpy(cursors[idx].write_buf, write_buf, sizeof(write_buf));
-
-					// Write a seek cache next to the compressed file for larger files
-					if (seek_cache && idx > SEEK_CACHE_CURSOR_NEED)
+					Bit32u cursor_count = (Bit16u)((f.decomp_size + (cursor_block - 1)) / cursor_block), cursor_got = 0;
+					for (Bit32u ii = (SEEK_CACHE_CURSOR_STEPS / 2); ii < cursor_count; ii++)
 					{
-						Bit32u cursor_count = (Bit16u)((f.decomp_size + (cursor_block - 1)) / cursor_block), cursor_got = 0;
-						for (Bit32u ii = (SEEK_CACHE_CURSOR_STEPS / 2); ii < cursor_count; ii++)
-						{
-							if (!cursors[ii].cursor_out) continue;
-							cursor_got++;
-							ii = (SEEK_CACHE_CURSOR_STEPS / 2 - 1) + ((ii + (SEEK_CACHE_CURSOR_STEPS-1)) / SEEK_CACHE_CURSOR_STEPS * SEEK_CACHE_CURSOR_STEPS);
-						}
-						//printf("[%s] CURSORS FOR SEEK CACHE: %d / %d\n", f.name, cursor_got, (cursor_count+(SEEK_CACHE_CURSOR_STEPS-1))/SEEK_CACHE_CURSOR_STEPS);
-						if (cursor_got > cursor_count / (SEEK_CACHE_CURSOR_STEPS*2) && cursor_got > seek_cache->count && cursor_count <= 0xFFFF)
-						{
-							seek_cache->count = cursor_got;
-							const_cast<Zip_File&>(f).have_pic = 1;
-							PIC_RemoveSpecificEvents(Zip_File::PICHandler, (Bitu)&f);
-							PIC_AddEvent(Zip_File::PICHandler, 5.0f, (Bitu)&f);
-						}
+						if (!cursors[ii].cursor_out) continue;
+						cursor_got++;
+						ii = (SEEK_CACHE_CURSOR_STEPS / 2 - 1) + ((ii + (SEEK_CACHE_CURSOR_STEPS-1)) / SEEK_CACHE_CURSOR_STEPS * SEEK_CACHE_CURSOR_STEPS);
+					}
+					//printf("[%s] CURSORS FOR SEEK CACHE: %d / %d\n", f.name, cursor_got, (cursor_count+(SEEK_CACHE_CURSOR_STEPS-1))/SEEK_CACHE_CURSOR_STEPS);
+					if (cursor_got > cursor_count / (SEEK_CACHE_CURSOR_STEPS*2) && cursor_got > seek_cache->count && cursor_count <= 0xFFFF)
+					{
+						seek_cache->count = cursor_got;
+						const_cast<Zip_File&>(f).have_pic = 1;
+						PIC_RemoveSpecificEvents(Zip_File::PICHandler, (Bitu)&f);
+						PIC_AddEvent(Zip_File::PICHandler, 5.0f, (Bitu)&f);
+					}
 
-						if (last_idx != idx)
+					if (last_idx != idx)
+					{
+						extern Bit32u DBP_GetTicks();
+						Bit32u tick = DBP_GetTicks();
+						if (last_idx == (Bit32u)-1) { slowload_num = 0; slowload_tick = tick + 77; }
+						else if (slowload_num++ >= SEEK_CACHE_CURSOR_STEPS*2 && (Bit32s)(tick - slowload_tick) >= 33 && f.have_pic)
 						{
-							extern Bit32u DBP_GetTicks();
-							Bit32u tick = DBP_GetTicks();
-							if (last_idx == (Bit32u)-1) { slowload_num = 0; slowload_tick = tick + 77; }
-							else if (slowload_num++ >= SEEK_CACHE_CURSOR_STEPS*2 && (Bit32s)(tick - slowload_tick) >= 33 && f.have_pic)
-							{
-								slowload_tick = tick;
-								extern void DBP_ShowSlowLoading();
-								DBP_ShowSlowLoading();
-								extern bool DBP_IsShuttingDown();
-								if (DBP_IsShuttingDown())
-									return (Bit32u)(p_res - (Bit8u*)res_buf); // abort slow file loading if shut down was initiated
-							}
-							last_idx = idx;
+							slowload_tick = tick;
+							extern void DBP_ShowSlowLoading();
+							DBP_ShowSlowLoading();
+							extern bool DBP_IsShuttingDown();
+							if (DBP_IsShuttingDown())
+								return (Bit32u)(p_res - (Bit8u*)res_buf); // abort slow file loading if shut down was initiated
 						}
+						last_idx = idx;
 					}
 				}
 			}
@@ -1520,6 +1676,98 @@ struct Zip_DeflateUnpacker : ZIP_Unpacker
 		return (Bit32u)(p_res - (Bit8u*)res_buf);
 	}
 
+	// Decompresses the next chunk into write_buf, sets out_cursor_idx if a new seek cursor was stored
+	bool Inflate(const Zip_File& f, miniz::tinfl_status& status, Bit32u& out_cursor_idx)
+	{
+		out_cursor_idx = (Bit32u)-1;
+		if (!read_buf_avail)
+		{
+			read_buf_avail = (comp_remaining < READ_BLOCK ? comp_remaining : READ_BLOCK);
+			if (ahead_queued)
+			{
+				// On the worker thread, only use what was read by the emulation thread in StartAhead
+				if (ofs + read_buf_avail > ahead_in_ofs + ahead_in.size()) { read_buf_avail = 0; return false; }
+				memcpy(read_buf, &ahead_in[0] + (ofs - ahead_in_ofs), read_buf_avail);
+			}
+			else if (archive.Read(ofs, read_buf, read_buf_avail) != read_buf_avail)
+				return false;
+			ofs_last_read = ofs;
+			ofs += read_buf_avail;
+			comp_remaining -= read_buf_avail;
+			read_buf_ofs = 0;
+		}
+
+		Bit32u out_buf_size = WRITE_BLOCK - (out_buf_ofs & (WRITE_BLOCK-1));
+		Bit8u *pWrite_buf_cur = write_buf + (out_buf_ofs & (WRITE_BLOCK-1));
+		Bit32u in_buf_size = read_buf_avail;
+
+		status = miniz::tinfl_decompress(&inflator, read_buf + read_buf_ofs, &in_buf_size, write_buf, pWrite_buf_cur, &out_buf_size, (comp_remaining ? miniz::TINFL_FLAG_HAS_MORE_INPUT : 0));
+
+		if (crc_ofs == out_buf_ofs && out_buf_size)
+		{
+			crc_run = DriveCalculateCRC32(pWrite_buf_cur, out_buf_size, crc_run);
+			crc_ofs += out_buf_size;
+			if (crc_ofs == f.decomp_size && crc_run != f.crc)
+			{
+				DBP_ASSERT(false);
+				crc_failed = 1;
+				return false;
+			}
+		}
+
+		read_buf_avail -= in_buf_size;
+		read_buf_ofs += in_buf_size;
+		out_buf_ofs += out_buf_size;
+		if (out_buf_ofs > f.decomp_size) { DBP_ASSERT(0); return false; }
+
+		if (out_buf_size && (!(out_buf_ofs & (WRITE_BLOCK-1)) || out_buf_ofs == f.decomp_size))
+			archive.cache.Store(this, (out_buf_ofs - 1) / WRITE_BLOCK, write_buf, ((out_buf_ofs - 1) & (WRITE_BLOCK-1)) + 1);
+
+		if (inflator.m_state == miniz::TINFL_STATE_INDEX_BLOCK_BOUNDRY)
+		{
+			// Gear cursors toward the middle of the block to accommodate forward and backward seeking as well as possible
+			Bit32u idx = (out_buf_ofs / cursor_block);
+			if (!cursors[idx].cursor_out || (out_buf_ofs > cursors[idx].cursor_out + 120*1024 && out_buf_ofs < idx*cursor_block + cursor_block/2 + 70*1024))
+			{
+				//printf("[%s] STORE SEEK CURSOR #%u AT %u\n", f.name, idx, out_buf_ofs);
+				cursors[idx].cursor_in = ofs_last_read + read_buf_ofs;
+				cursors[idx].cursor_out = out_buf_ofs;
+				cursors[idx].m_num_bits                = inflator.m_num_bits;
+				cursors[idx].m_bit_buf                 = inflator.m_bit_buf;
+				cursors[idx].m_dist                    = inflator.m_dist;
+				cursors[idx].m_counter                 = inflator.m_counter;
+				cursors[idx].m_num_extra               = inflator.m_num_extra;
+				cursors[idx].m_dist_from_out_buf_start = inflator.m_dist_from_out_buf_start;
+				memcpy(cursors[idx].write_buf, write_buf, sizeof(write_buf));
+				out_cursor_idx = idx;
+			}
+		}
+		return true;
+	}
+
+	void StartAhead(const Zip_File& f, Bit32u read_pos)
+	{
+		// Only worth it while the reader is close to what has been decompressed so far
+		if (!zip_cache_max_blocks || out_buf_ofs >= f.decomp_size || read_pos > out_buf_ofs || read_pos + AHEAD_TRIGGER < out_buf_ofs || (!comp_remaining && !read_buf_avail)) return;
+		Bit32u n = (comp_remaining < READ_BLOCK * AHEAD_READ_BLOCKS ? comp_remaining : READ_BLOCK * AHEAD_READ_BLOCKS);
+		ahead_in.resize(n ? n : 1);
+		if (archive.Read(ofs, &ahead_in[0], n) != n) return;
+		ahead_in.resize(n);
+		ahead_in_ofs = ofs;
+		ahead_file = &f;
+		ahead_queued = true; // must be set before the worker thread can see the job
+		if (!archive.ahead.Start(this)) ahead_queued = false;
+	}
+
+	void InflateAhead()
+	{
+		// Runs on the worker thread, ahead_queued stays set until the emulation thread takes back the decompressor
+		miniz::tinfl_status status = miniz::TINFL_STATUS_HAS_MORE_OUTPUT;
+		for (Bit32u idx; (status == miniz::TINFL_STATUS_NEEDS_MORE_INPUT || status == miniz::TINFL_STATUS_HAS_MORE_OUTPUT) && out_buf_ofs < ahead_file->decomp_size && !archive.ahead.IsCanceled();)
+			if (!Inflate(*ahead_file, status, idx))
+				break;
+	}
+
 	bool CheckCRC(const Zip_File& f)
 	{
 		crc_ofs = 0; // this enables CRC checking during decompression in Read
@@ -1528,6 +1776,7 @@ struct Zip_DeflateUnpacker : ZIP_Unpacker
 
 	void WriteSeekCache(const Zip_File& f)
 	{
+		if (ahead_queued) { archive.ahead.Finish(this); ahead_queued = false; }
 		DOS_File *df;
 		Bit8u drive_idx = DriveGetIndex(seek_cache->drv);
 		if (drive_idx == DOS_DRIVES || !Drives[drive_idx]->FileCreate(&df, (char*)seek_cache->path.c_str(), DOS_ATTR_ARCHIVE)) return;
@@ -1553,6 +1802,24 @@ struct Zip_DeflateUnpacker : ZIP_Unpacker
 	}
 };
 
+Thread::RET_t THREAD_CC Zip_InflateAhead::Run(void* p)
+{
+	Zip_InflateAhead* ahead = (Zip_InflateAhead*)p;
+	for (ahead->lock.Lock(); !ahead->quit;)
+	{
+		if (!ahead->job) { ahead->idle = true; ahead->lock.Unlock(); ahead->work.Wait(); ahead->lock.Lock(); continue; }
+		Zip_DeflateUnpacker* job = ahead->job;
+		ahead->lock.Unlock();
+		job->InflateAhead();
+		ahead->lock.Lock();
+		ahead->job = NULL;
+		if (ahead->waiting) { ahead->waiting = false; ahead->done.Post(); }
+	}
+	ahead->lock.Unlock();
+	ahead->done.Post();
+	return 0;
+}
+
 void Zip_File::PICHandler(Bitu implPtr)
 {
 	Zip_File& f = *(Zip_File*)implPtr;
@@ -2202,19 +2469,25 @@ bool zipDrive::isRemote(void) { return false; }
 bool zipDrive::isRemovable(void) { return false; }
 Bits zipDrive::UnMount(void) { delete this; return 0;  }
 
-void zipDrive::Uncompress(const Bit8u* src, Bit32u src_len, Bit8u* trg, Bit32u trg_len)
+bool zipDrive::Uncompress(const Bit8u* src, Bit32u src_len, Bit8u* trg, Bit32u trg_len)
 {
 	miniz::tinfl_decompressor inflator;
 	miniz::tinfl_init(&inflator);
 	const Bit8u *src_end = src + src_len, *trg_start = trg, *trg_end = trg + trg_len;
-	for (miniz::tinfl_status status = miniz::TINFL_STATUS_HAS_MORE_OUTPUT; status == miniz::TINFL_STATUS_HAS_MORE_OUTPUT;)
+	miniz::tinfl_status status = miniz::TINFL_STATUS_HAS_MORE_OUTPUT;
+	while (status == miniz::TINFL_STATUS_HAS_MORE_OUTPUT && trg != trg_end) // stop when the output is full, a corrupt stream could otherwise loop forever
 	{
 		Bit32u in_size = (Bit32u)(src_end - src), out_size = (Bit32u)(trg_end - trg);
 		status = miniz::tinfl_decompress(&inflator, src, &in_size, (Bit8u*)trg_start, trg, &out_size, miniz::TINFL_FLAG_USING_NON_WRAPPING_OUTPUT_BUF);
 		src += in_size;
 		trg += out_size;
-		DBP_ASSERT(status == miniz::TINFL_STATUS_HAS_MORE_OUTPUT || status == miniz::TINFL_STATUS_DONE);
 	}
+	return (status == miniz::TINFL_STATUS_HAS_MORE_OUTPUT || status == miniz::TINFL_STATUS_DONE) && trg == trg_end;
+}
+
+void zipDrive::SetCacheSize(Bit32u bytes)
+{
+	zip_cache_max_blocks = bytes / Zip_BlockCache::BLOCK;
 }
 
 #include <dbp_serialize.h>
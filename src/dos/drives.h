@@ -775,7 +775,8 @@ public:
 	virtual bool isRemote(void);
 	virtual bool isRemovable(void);
 	virtual Bits UnMount(void);
-	static void Uncompress(const Bit8u* src, Bit32u src_len, Bit8u* trg, Bit32u trg_len);
+	static bool Uncompress(const Bit8u* src, Bit32u src_len, Bit8u* trg, Bit32u trg_len); // raw deflate stream, returns false if the output could not be filled
+	static void SetCacheSize(Bit32u bytes); // memory limit for decompressed blocks cached per mounted ZIP drive
 private:
 	struct zipDriveImpl* impl;
 	INLINE zipDrive() {}
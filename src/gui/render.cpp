@@ -37,6 +37,7 @@
 
 #include "render_scalers.h"
 #include "render_glsl.h"
+#include "dbp_threads.h"
 
 Render_t render;
 ScalerLineHandler_t RENDER_DrawLine;
@@ -151,6 +152,154 @@ static void RENDER_ClearCacheHandler(const void * src) {
 }
 #endif
 
+#ifndef C_DBP_ENABLE_SCALERCACHE
+// DBP: Lines the VGA reports as unchanged (NULL source) are taken from the previous output frame. They only get
+// copied once the first changed line shows up, a frame without any changes is passed on to GFX as unchanged.
+static struct RENDER_Unchanged { Bitu line; bool active, changed, last_complete; } render_unchanged;
+
+static void RENDER_UnchangedLineHandler(const void * src) {
+	RENDER_Unchanged& u = render_unchanged;
+	if (src) {
+		if (GCC_UNLIKELY(!u.changed)) { u.changed = true; GFX_CopyPreviousLines(0, u.line); }
+		render.scale.lineHandler(src);
+	} else {
+		if (u.changed) GFX_CopyPreviousLines(u.line, 1);
+		render.scale.outWrite += render.scale.outPitch;
+	}
+	u.line++;
+}
+
+// Worker thread that converts the scanlines of a frame into the output buffer while emulation continues.
+// The VGA decoders keep running on the emulation thread, each decoded line is only copied into a frame
+// store and handed over in batches. The palette lookup table is updated in RENDER_StartUpdate and stays
+// unchanged until the worker is joined at the end of the frame.
+// Copying a line costs about as much as converting it for 32-bit sources and for small frames, so only
+// 8/15/16-bit frames of at least 640x480 are handed over (these save 0.1 to 0.6 ms per frame).
+struct RENDER_Worker
+{
+	enum { BATCH_LINES = 32, MIN_PIXELS = 640*480 };
+	Mutex lock;
+	Semaphore work, done;
+	Bit8u *lines, *unchanged;
+	Bitu line_bytes, capacity, max_lines, captured, posted, converted;
+	bool enabled, capturing, started, idle, waiting, quit;
+
+	RENDER_Worker() : lines(NULL), unchanged(NULL), line_bytes(0), capacity(0), max_lines(0), captured(0), posted(0), converted(0), enabled(false), capturing(false), started(false), idle(false), waiting(false), quit(false) {}
+
+	~RENDER_Worker()
+	{
+		if (started)
+		{
+			lock.Lock();
+			quit = true;
+			if (idle) { idle = false; work.Post(); }
+			lock.Unlock();
+			done.Wait(); // wait for worker thread to exit
+		}
+		free(lines);
+		free(unchanged);
+	}
+
+	bool Begin()
+	{
+		if (render.src.bpp == 32 || render.src.width * render.src.height < MIN_PIXELS) return false;
+		Bitu bytes = render.src.width * (render.src.bpp == 8 ? 1 : render.src.bpp == 32 ? 4 : 2);
+		if (bytes * render.src.height > capacity)
+		{
+			Bit8u* newlines = (Bit8u*)realloc(lines, bytes * render.src.height);
+			if (!newlines) return false;
+			lines = newlines;
+			capacity = bytes * render.src.height;
+		}
+		if (render.src.height > max_lines)
+		{
+			Bit8u* newunchanged = (Bit8u*)realloc(unchanged, render.src.height);
+			if (!newunchanged) return false;
+			unchanged = newunchanged;
+			max_lines = render.src.height;
+		}
+		line_bytes = bytes;
+		captured = posted = converted = 0;
+		capturing = true;
+		return true;
+	}
+
+	void Post()
+	{
+		lock.Lock();
+		posted = captured;
+		if (idle) { idle = false; work.Post(); }
+		lock.Unlock();
+		if (!started) { started = true; Thread::StartDetached(Run, this); }
+	}
+
+	void Finish()
+	{
+		if (!capturing) return;
+		if (posted != captured) Post();
+		lock.Lock();
+		while (converted != posted) { waiting = true; lock.Unlock(); done.Wait(); lock.Lock(); }
+		lock.Unlock();
+	}
+
+	static void CaptureLine(const void * src);
+	static Thread::RET_t THREAD_CC Run(void* p);
+};
+static RENDER_Worker render_worker;
+
+void RENDER_Worker::CaptureLine(const void * src)
+{
+	RENDER_Worker& w = render_worker;
+	if (GCC_UNLIKELY(w.captured == w.max_lines || w.captured == w.capacity / w.line_bytes)) return;
+	if (src) memcpy(w.lines + w.captured * w.line_bytes, src, w.line_bytes);
+	w.unchanged[w.captured] = !src;
+	if (++w.captured - w.posted == BATCH_LINES) w.Post();
+}
+
+Thread::RET_t THREAD_CC RENDER_Worker::Run(void* p)
+{
+	RENDER_Worker* w = (RENDER_Worker*)p;
+	for (w->lock.Lock(); !w->quit;)
+	{
+		if (w->converted == w->posted)
+		{
+			if (w->waiting) { w->waiting = false; w->done.Post(); }
+			w->idle = true; w->lock.Unlock(); w->work.Wait(); w->lock.Lock(); continue;
+		}
+		Bitu from = w->converted, to = w->posted;
+		w->lock.Unlock();
+		ScalerLineHandler_t handler = (render_unchanged.active ? RENDER_UnchangedLineHandler : render.scale.lineHandler);
+		for (Bit8u* line = w->lines + from * w->line_bytes; from != to; from++, line += w->line_bytes)
+			handler(w->unchanged[from] ? NULL : line);
+		w->lock.Lock();
+		w->converted = to;
+	}
+	w->lock.Unlock();
+	w->done.Post();
+	return 0;
+}
+
+void RENDER_SetWorker(bool enable) {
+	render_worker.enabled = enable;
+}
+
+void RENDER_FinishWorker(void) {
+	render_worker.Finish();
+}
+
+bool RENDER_SkipUnchangedLines(void) {
+	RENDER_Unchanged& u = render_unchanged;
+	if (!render.updating || !u.last_complete || render.pal.changed || !GFX_CanCopyPreviousLines())
+		return false;
+	u.active = true;
+	u.changed = false;
+	u.line = 0;
+	if (RENDER_DrawLine == render.scale.lineHandler)
+		RENDER_DrawLine = RENDER_UnchangedLineHandler;
+	return true;
+}
+#endif
+
 bool RENDER_StartUpdate(void) {
 	if (GCC_UNLIKELY(render.updating))
 		return false;
@@ -174,7 +323,11 @@ bool RENDER_StartUpdate(void) {
 #ifndef C_DBP_ENABLE_SCALERCACHE
 	if (GCC_UNLIKELY(!GFX_StartUpdate( render.scale.outWrite, render.scale.outPitch )))
 		return false;
-	RENDER_DrawLine = render.scale.lineHandler;
+	render_unchanged.active = false;
+	if (render_worker.enabled && render_worker.Begin())
+		RENDER_DrawLine = RENDER_Worker::CaptureLine;
+	else
+		RENDER_DrawLine = render.scale.lineHandler;
 #else
 	Scaler_ChangedLines[0] = 0;
 	Scaler_ChangedLineIndex = 0;
@@ -219,6 +372,11 @@ bool RENDER_StartUpdate(void) {
 
 static void RENDER_Halt( void ) {
 	RENDER_DrawLine = RENDER_EmptyLineHandler;
+#ifndef C_DBP_ENABLE_SCALERCACHE
+	render_worker.Finish();
+	render_worker.capturing = false;
+	render_unchanged.last_complete = false;
+#endif
 	GFX_EndUpdate( 0 );
 	render.updating=false;
 	render.active=false;
@@ -229,6 +387,10 @@ void RENDER_EndUpdate( bool abort ) {
 	if (GCC_UNLIKELY(!render.updating))
 		return;
 	RENDER_DrawLine = RENDER_EmptyLineHandler;
+#ifndef C_DBP_ENABLE_SCALERCACHE
+	render_worker.Finish();
+	render_worker.capturing = false;
+#endif
 #ifdef C_DBP_ENABLE_CAPTURE
 	if (GCC_UNLIKELY(CaptureState & (CAPTURE_IMAGE|CAPTURE_VIDEO))) {
 		Bitu pitch, flags;
@@ -248,7 +410,13 @@ void RENDER_EndUpdate( bool abort ) {
 #endif
 	if ( render.scale.outWrite ) {
 #ifndef C_DBP_ENABLE_SCALERCACHE
-		GFX_EndUpdate( abort? NULL : (const Bit16u*)(size_t)1 );
+		// Runs of unchanged and changed lines like Scaler_ChangedLines, either all lines changed or none
+		static Bit16u changedLines[2];
+		const RENDER_Unchanged& u = render_unchanged;
+		changedLines[0] = (Bit16u)(u.active && !u.changed && u.line >= render.src.height ? render.src.height : 0);
+		changedLines[1] = (Bit16u)(render.src.height - changedLines[0]);
+		GFX_EndUpdate( abort? NULL : changedLines );
+		render_unchanged.last_complete = !abort;
 #else
 		GFX_EndUpdate( abort? NULL : Scaler_ChangedLines );
 #endif
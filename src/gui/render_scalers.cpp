@@ -25,6 +25,8 @@
 #include "render.h"
 #include <string.h>
 
+#include "dbp_simd.h"
+
 Bit8u Scaler_Aspect[SCALER_MAXHEIGHT];
 #ifdef C_DBP_ENABLE_SCALERCACHE
 Bit16u Scaler_ChangedLines[SCALER_MAXHEIGHT];
@@ -121,6 +123,92 @@ static INLINE void ScalerAddLines( Bitu changed, Bitu count ) {
 	while (bsize--) *bdst++=*bsrc++;		\
 }
 
+// DBP: Whole line conversions for the unscaled 32-bit output used by the linear Normal1x line handlers.
+// The 15/16 bit expansions match PMAKE of render_templates.h bit by bit. They read the source pixels in the
+// little endian layout of the emulated video memory, big endian hosts use the per pixel templates instead.
+#ifndef WORDS_BIGENDIAN
+static void Scaler_Convert_8_32(Bit32u * dst, const Bit8u * src, Bitu count) {
+	// There is no gather instruction that would beat plain table loads here, read 4 indexes at once instead
+	const Bit32u * lut = render.pal.lut.b32;
+	for (; count >= 4; count -= 4, src += 4, dst += 4) {
+		dst[0] = lut[src[0]]; dst[1] = lut[src[1]];
+		dst[2] = lut[src[2]]; dst[3] = lut[src[3]];
+	}
+	while (count--) *(dst++) = lut[*(src++)];
+}
+
+static void Scaler_Convert_15_32(Bit32u * dst, const Bit16u * src, Bitu count) {
+	Bitu i = 0;
+#if defined(__SSE2__) && __SSE2__
+	const __m128i zero = _mm_setzero_si128(), r = _mm_set1_epi32(31<<10), g = _mm_set1_epi32(31<<5), b = _mm_set1_epi32(31);
+	const __m128i rl = _mm_set1_epi32(7<<12), gl = _mm_set1_epi32(7<<7), bl = _mm_set1_epi32(7<<2);
+	for (; i + 8 <= count; i += 8) {
+		__m128i s = _mm_loadu_si128((const __m128i*)(src + i));
+		for (int h = 0; h != 2; h++) {
+			__m128i v = (h ? _mm_unpackhi_epi16(s, zero) : _mm_unpacklo_epi16(s, zero));
+			__m128i p = _mm_or_si128(_mm_or_si128(_mm_slli_epi32(_mm_and_si128(v, r), 9), _mm_slli_epi32(_mm_and_si128(v, g), 6)), _mm_slli_epi32(_mm_and_si128(v, b), 3));
+			p = _mm_or_si128(p, _mm_or_si128(_mm_or_si128(_mm_slli_epi32(_mm_and_si128(v, rl), 4), _mm_slli_epi32(_mm_and_si128(v, gl), 1)), _mm_srli_epi32(_mm_and_si128(v, bl), 2)));
+			_mm_storeu_si128((__m128i*)(dst + i + h*4), p);
+		}
+	}
+#elif defined(DBP_NEON)
+	const uint32x4_t r = vdupq_n_u32(31<<10), g = vdupq_n_u32(31<<5), b = vdupq_n_u32(31);
+	const uint32x4_t rl = vdupq_n_u32(7<<12), gl = vdupq_n_u32(7<<7), bl = vdupq_n_u32(7<<2);
+	for (; i + 8 <= count; i += 8) {
+		uint16x8_t s = vld1q_u16(src + i);
+		for (int h = 0; h != 2; h++) {
+			uint32x4_t v = vmovl_u16(h ? vget_high_u16(s) : vget_low_u16(s));
+			uint32x4_t p = vorrq_u32(vorrq_u32(vshlq_n_u32(vandq_u32(v, r), 9), vshlq_n_u32(vandq_u32(v, g), 6)), vshlq_n_u32(vandq_u32(v, b), 3));
+			p = vorrq_u32(p, vorrq_u32(vorrq_u32(vshlq_n_u32(vandq_u32(v, rl), 4), vshlq_n_u32(vandq_u32(v, gl), 1)), vshrq_n_u32(vandq_u32(v, bl), 2)));
+			vst1q_u32(dst + i + h*4, p);
+		}
+	}
+#endif
+	for (; i < count; i++) {
+		const Bit32u v = src[i];
+		dst[i] = ((v&(31<<10))<<9)|((v&(31<<5))<<6)|((v&31)<<3)|((v&(7<<12))<<4)|((v&(7<<7))<<1)|((v&(7<<2))>>2);
+	}
+}
+
+static void Scaler_Convert_16_32(Bit32u * dst, const Bit16u * src, Bitu count) {
+	Bitu i = 0;
+#if defined(__SSE2__) && __SSE2__
+	const __m128i zero = _mm_setzero_si128(), r = _mm_set1_epi32(31<<11), g = _mm_set1_epi32(63<<5), rbl = _mm_set1_epi32(0xE01F);
+	const __m128i gl = _mm_set1_epi32(3<<9), bl = _mm_set1_epi32(7<<2);
+	for (; i + 8 <= count; i += 8) {
+		__m128i s = _mm_loadu_si128((const __m128i*)(src + i));
+		for (int h = 0; h != 2; h++) {
+			__m128i v = (h ? _mm_unpackhi_epi16(s, zero) : _mm_unpacklo_epi16(s, zero));
+			__m128i p = _mm_or_si128(_mm_or_si128(_mm_slli_epi32(_mm_and_si128(v, r), 8), _mm_slli_epi32(_mm_and_si128(v, g), 5)), _mm_slli_epi32(_mm_and_si128(v, rbl), 3));
+			p = _mm_or_si128(p, _mm_or_si128(_mm_srli_epi32(_mm_and_si128(v, gl), 1), _mm_srli_epi32(_mm_and_si128(v, bl), 2)));
+			_mm_storeu_si128((__m128i*)(dst + i + h*4), p);
+		}
+	}
+#elif defined(DBP_NEON)
+	const uint32x4_t r = vdupq_n_u32(31<<11), g = vdupq_n_u32(63<<5), rbl = vdupq_n_u32(0xE01F);
+	const uint32x4_t gl = vdupq_n_u32(3<<9), bl = vdupq_n_u32(7<<2);
+	for (; i + 8 <= count; i += 8) {
+		uint16x8_t s = vld1q_u16(src + i);
+		for (int h = 0; h != 2; h++) {
+			uint32x4_t v = vmovl_u16(h ? vget_high_u16(s) : vget_low_u16(s));
+			uint32x4_t p = vorrq_u32(vorrq_u32(vshlq_n_u32(vandq_u32(v, r), 8), vshlq_n_u32(vandq_u32(v, g), 5)), vshlq_n_u32(vandq_u32(v, rbl), 3));
+			p = vorrq_u32(p, vorrq_u32(vshrq_n_u32(vandq_u32(v, gl), 1), vshrq_n_u32(vandq_u32(v, bl), 2)));
+			vst1q_u32(dst + i + h*4, p);
+		}
+	}
+#endif
+	for (; i < count; i++) {
+		const Bit32u v = src[i];
+		dst[i] = ((v&(31<<11))<<8)|((v&(63<<5))<<5)|((v&0xE01F)<<3)|((v&(3<<9))>>1)|((v&(7<<2))>>2);
+	}
+}
+
+static void Scaler_Convert_32_32(Bit32u * dst, const Bit32u * src, Bitu count) {
+	memcpy(dst, src, count * 4);
+}
+#define Scaler_Convert_9_32 Scaler_Convert_8_32
+#endif
+
 #define interp_w2(P0,P1,W0,W1)															\
 	((((P0&redblueMask)*W0+(P1&redblueMask)*W1)/(W0+W1)) & redblueMask) |	\
 	((((P0&  greenMask)*W0+(P1&  greenMask)*W1)/(W0+W1)) & greenMask)
@@ -41,6 +41,11 @@ static void conc4d(SCALERNAME,SBPP,DBPP,R)(const void *s) {
 		return;
 	}
 #endif
+	// DBP: Unscaled 32-bit output converts the entire line at once
+#if defined(SCALERLINEAR) && !defined(C_DBP_ENABLE_SCALERCACHE) && !defined(WORDS_BIGENDIAN) && (SCALERWIDTH == 1) && (SCALERHEIGHT == 1) && (DBPP == 32)
+	conc3d(Scaler_Convert,SBPP,DBPP)((PTYPE *)render.scale.outWrite, (const SRCTYPE*)s, render.src.width);
+	ScalerAddLines( 1, 1 );
+#else
 	/* Clear the complete line marker */
 	Bitu hadChange = 0;
 	const SRCTYPE *src = (SRCTYPE*)s;
@@ -152,6 +157,7 @@ static void conc4d(SCALERNAME,SBPP,DBPP,R)(const void *s) {
 	}
 #endif
 	ScalerAddLines( hadChange, scaleLines );
+#endif
 }
 
 #if !defined(SCALERLINEAR) 
@@ -41,6 +41,28 @@ static void UpdateEMSMapping(void) {
 	}
 }
 
+/* physical memory page of a DMA address, cares for EMS pageframe etc. */
+static INLINE Bitu DMA_GetPhysPage(Bitu highpart_addr_page,PhysPt offset) {
+	Bitu page = highpart_addr_page+(offset >> 12);
+	if (page < EMM_PAGEFRAME4K) page = paging.firstmb[page];
+	else if (page < EMM_PAGEFRAME4K+0x10) page = ems_board_mapping[page];
+	else if (page < LINK_START) page = paging.firstmb[page];
+	return page;
+}
+
+/* host memory of a DMA address */
+static INLINE HostPt DMA_GetHostPt(Bitu highpart_addr_page,PhysPt offset) {
+	return MemBase + DMA_GetPhysPage(highpart_addr_page,offset)*4096 + (offset & 4095);
+}
+
+/* length of the span starting at offset that stays within one page and before the wrap limit */
+static INLINE Bitu DMA_SpanSize(PhysPt offset,Bitu size,Bit32u wrap_limit) {
+	Bitu run = 4096 - (offset & 4095);
+	if (run > size) run = size;
+	if (offset <= wrap_limit && wrap_limit - offset < run - 1) run = wrap_limit - offset + 1;
+	return run;
+}
+
 /* read a block from physical memory */
 static void DMA_BlockRead(PhysPt spage,PhysPt offset,void * data,Bitu size,Bit8u dma16) {
 	Bit8u * write=(Bit8u *) data;
@@ -48,17 +70,17 @@ static void DMA_BlockRead(PhysPt spage,PhysPt offset,void * data,Bitu size,Bit8u
 	size <<= dma16;
 	offset <<= dma16;
 	Bit32u dma_wrap = ((0xffff<<dma16)+dma16) | dma_wrapping;
-	for ( ; size ; size--, offset++) {
-		if (offset>(dma_wrapping<<dma16)) {
+	Bit32u wrap_limit = (dma_wrapping<<dma16);
+	while (size) {
+		if (offset>wrap_limit) {
 			LOG_MSG("DMA segbound wrapping (read): %x:%x size %" sBitfs(x) " [%x] wrap %x",spage,offset,size,dma16,dma_wrapping);
 		}
 		offset &= dma_wrap;
-		Bitu page = highpart_addr_page+(offset >> 12);
-		/* care for EMS pageframe etc. */
-		if (page < EMM_PAGEFRAME4K) page = paging.firstmb[page];
-		else if (page < EMM_PAGEFRAME4K+0x10) page = ems_board_mapping[page];
-		else if (page < LINK_START) page = paging.firstmb[page];
-		*write++=phys_readb(page*4096 + (offset & 4095));
+		Bitu run = DMA_SpanSize(offset,size,wrap_limit);
+		memcpy(write,DMA_GetHostPt(highpart_addr_page,offset),run);
+		write+=run;
+		offset+=(PhysPt)run;
+		size-=run;
 	}
 }
 
@@ -69,17 +91,19 @@ static void DMA_BlockWrite(PhysPt spage,PhysPt offset,void * data,Bitu size,Bit8
 	size <<= dma16;
 	offset <<= dma16;
 	Bit32u dma_wrap = ((0xffff<<dma16)+dma16) | dma_wrapping;
-	for ( ; size ; size--, offset++) {
-		if (offset>(dma_wrapping<<dma16)) {
+	Bit32u wrap_limit = (dma_wrapping<<dma16);
+	while (size) {
+		if (offset>wrap_limit) {
 			LOG_MSG("DMA segbound wrapping (write): %x:%x size %" sBitfs(x) " [%x] wrap %x",spage,offset,size,dma16,dma_wrapping);
 		}
 		offset &= dma_wrap;
-		Bitu page = highpart_addr_page+(offset >> 12);
-		/* care for EMS pageframe etc. */
-		if (page < EMM_PAGEFRAME4K) page = paging.firstmb[page];
-		else if (page < EMM_PAGEFRAME4K+0x10) page = ems_board_mapping[page];
-		else if (page < LINK_START) page = paging.firstmb[page];
-		phys_writeb(page*4096 + (offset & 4095), *read++);
+		Bitu run = DMA_SpanSize(offset,size,wrap_limit);
+		Bitu page = DMA_GetPhysPage(highpart_addr_page,offset);
+		if (GCC_UNLIKELY(MemDirty!=0)) MEM_MarkPageDirty(page); // a span never crosses a page
+		memcpy(MemBase + page*4096 + (offset & 4095),read,run);
+		read+=run;
+		offset+=(PhysPt)run;
+		size-=run;
 	}
 }
 
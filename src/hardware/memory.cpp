@@ -63,6 +63,7 @@ static struct MemoryBlock {
 } memory;
 
 HostPt MemBase;
+Bit8u* MemDirty;
 
 class IllegalPageHandler : public PageHandler {
 public:
@@ -137,9 +138,41 @@ public:
 
 
 
+// DBP: While dirty page tracking is enabled, RAM pages that have not been written to since the last reset are
+// mapped through this handler. The first write marks the page dirty and switches the TLB entry to direct writes.
+class DirtyTrackPageHandler : public RAMPageHandler {
+public:
+	DirtyTrackPageHandler() {
+		flags=PFLAG_READABLE;
+	}
+	INLINE HostPt MarkDirty(PhysPt addr) {
+		Bitu lin_page=addr>>12, phys_page=PAGING_GetPhysicalPage(addr)>>12;
+		if (MemDirty) MemDirty[phys_page]=1;
+#if defined(USE_FULL_TLB)
+		if (paging.tlb.writehandler[lin_page]==this) {
+			paging.tlb.write[lin_page]=MemBase+phys_page*MEM_PAGESIZE-(lin_page<<12);
+			paging.tlb.writehandler[lin_page]=MEM_GetPageHandler(phys_page);
+		}
+#else
+		PAGING_UnlinkPages(lin_page,1);
+#endif
+		return MemBase+phys_page*MEM_PAGESIZE+(addr&4095);
+	}
+	void writeb(PhysPt addr,Bitu val) {
+		host_writeb(MarkDirty(addr),(Bit8u)val);
+	}
+	void writew(PhysPt addr,Bitu val) {
+		host_writew(MarkDirty(addr),(Bit16u)val);
+	}
+	void writed(PhysPt addr,Bitu val) {
+		host_writed(MarkDirty(addr),(Bit32u)val);
+	}
+};
+
 static IllegalPageHandler illegal_page_handler;
 static RAMPageHandler ram_page_handler;
 static ROMPageHandler rom_page_handler;
+static DirtyTrackPageHandler dirty_track_page_handler;
 
 void MEM_SetLFB(Bitu page, Bitu pages, PageHandler *handler, PageHandler *mmiohandler) {
 	memory.lfb.handler=handler;
@@ -152,7 +185,9 @@ void MEM_SetLFB(Bitu page, Bitu pages, PageHandler *handler, PageHandler *mmioha
 
 PageHandler * MEM_GetPageHandler(Bitu phys_page) {
 	if (phys_page<memory.pages) {
-		return memory.phandlers[phys_page];
+		PageHandler * handler=memory.phandlers[phys_page];
+		if (GCC_UNLIKELY(MemDirty!=NULL) && handler==&ram_page_handler && !MemDirty[phys_page]) return &dirty_track_page_handler;
+		return handler;
 	} else if ((phys_page>=memory.lfb.start_page) && (phys_page<memory.lfb.end_page)) {
 		return memory.lfb.handler;
 	} else if ((phys_page>=memory.lfb.start_page+0x01000000/4096) &&
@@ -170,6 +205,8 @@ PageHandler * MEM_GetPageHandler(Bitu phys_page) {
 }
 
 void MEM_SetPageHandler(Bitu phys_page,Bitu pages,PageHandler * handler) {
+	// code page handlers restore what MEM_GetPageHandler returned when they were set up
+	if (handler==&dirty_track_page_handler) handler=&ram_page_handler;
 	for (;pages>0;pages--) {
 		memory.phandlers[phys_page]=handler;
 		phys_page++;
@@ -199,23 +236,56 @@ void mem_strcpy(PhysPt dest,PhysPt src) {
 }
 
 void mem_memcpy(PhysPt dest,PhysPt src,Bitu size) {
-	while (size--) mem_writeb_inline(dest++,mem_readb_inline(src++));
+	while (size) {
+		//Copy up to the next page boundary of either side at once
+		Bitu run=4096-((src&4095)>(dest&4095)?(src&4095):(dest&4095));
+		if (run>size) run=size;
+		HostPt tlb_read=get_tlb_read(src), tlb_write=get_tlb_write(dest);
+		//Forward overlapping copies repeat the pattern like the byte loop does
+		if (tlb_read && tlb_write && !(tlb_write+dest>tlb_read+src && tlb_write+dest<tlb_read+src+run)) memmove(tlb_write+dest,tlb_read+src,run);
+		else for (Bitu i=0;i<run;i++) mem_writeb_inline(dest+i,mem_readb_inline(src+i));
+		dest+=run;src+=run;size-=run;
+	}
 }
 
 void MEM_BlockRead(PhysPt pt,void * data,Bitu size) {
 	Bit8u * write=reinterpret_cast<Bit8u *>(data);
-	while (size--) {
-		*write++=mem_readb_inline(pt++);
+	while (size) {
+		Bitu run=4096-(pt&4095);
+		if (run>size) run=size;
+		HostPt tlb_addr=get_tlb_read(pt);
+		if (tlb_addr) memcpy(write,tlb_addr+pt,run);
+		else for (Bitu i=0;i<run;i++) write[i]=mem_readb_inline(pt+i);
+		pt+=run;write+=run;size-=run;
 	}
 }
 
 void MEM_BlockWrite(PhysPt pt,void const * const data,Bitu size) {
 	Bit8u const * read = reinterpret_cast<Bit8u const * const>(data);
-	while (size--) {
-		mem_writeb_inline(pt++,*read++);
+	while (size) {
+		Bitu run=4096-(pt&4095);
+		if (run>size) run=size;
+		HostPt tlb_addr=get_tlb_write(pt);
+		if (tlb_addr) memcpy(tlb_addr+pt,read,run);
+		else for (Bitu i=0;i<run;i++) mem_writeb_inline(pt+i,read[i]);
+		pt+=run;read+=run;size-=run;
 	}
 }
 
+/* Returns the host memory behind a block if all of its pages are mapped directly and contiguously */
+HostPt MEM_GetBlockHostPt(PhysPt pt,Bitu size,bool write) {
+	if (!size) return NULL;
+	HostPt tlb_addr=(write ? get_tlb_write(pt) : get_tlb_read(pt));
+	if (!tlb_addr) return NULL;
+	PhysPt page=(pt&~4095), last=((pt+(PhysPt)(size-1))&~4095);
+	if (last<page) return NULL; //wraps around
+	while (page!=last) {
+		page+=4096;
+		if ((write ? get_tlb_write(page) : get_tlb_read(page))!=tlb_addr) return NULL;
+	}
+	return tlb_addr+pt;
+}
+
 void MEM_BlockCopy(PhysPt dest,PhysPt src,Bitu size) {
 	mem_memcpy(dest,src,size);
 }
@@ -562,6 +632,34 @@ void PreparePCJRCartRom(void) {
 
 HostPt GetMemBase(void) { return MemBase; }
 
+void MEM_TrackDirtyPages(bool enable) {
+	if (enable) {
+		if (!MemDirty) MemDirty=new Bit8u[memory.pages];
+		MEM_ResetDirtyPages();
+	} else if (MemDirty) {
+		delete [] MemDirty;
+		MemDirty=NULL;
+		PAGING_ClearTLB();
+	}
+}
+
+void MEM_ResetDirtyPages(void) {
+	memset(MemDirty,0,memory.pages);
+#if defined(USE_FULL_TLB)
+	// Unlink all pages that currently allow direct writes to RAM so the next write to them gets tracked again
+	for (Bitu i=0;i<paging.links.used;i++) {
+		Bitu lin_page=paging.links.entries[i];
+		if (paging.tlb.writehandler[lin_page]==&ram_page_handler) PAGING_UnlinkPages(lin_page,1);
+	}
+#else
+	PAGING_ClearTLB();
+#endif
+}
+
+void MEM_MarkPageDirty(Bitu phys_page) {
+	if (MemDirty && phys_page<memory.pages) MemDirty[phys_page]=1;
+}
+
 class MEMORY:public Module_base{
 private:
 	IO_ReadHandleObject ReadHandler;
@@ -622,6 +720,8 @@ public:
 		MEM_A20_Enable(false);
 	}
 	~MEMORY(){
+		delete [] MemDirty;
+		MemDirty=NULL;
 		delete [] MemBase;
 		delete [] memory.phandlers;
 		delete [] memory.mhandles;
@@ -660,7 +760,7 @@ void DBPSerialize_Memory(DBPArchive& ar)
 	ar.Serialize(memory.lfb.end_page);
 	ar.Serialize(memory.lfb.pages);
 	ar.Serialize(memory.a20);
-	ar.SerializeSparse(MemBase, (pages * MEM_PAGE_SIZE));
+	if (!(ar.flags & DBPArchive::FLAG_REWINDBUFFER)) ar.SerializeSparse(MemBase, (pages * MEM_PAGE_SIZE));
 	ar.SerializeBytes(memory.mhandles, (pages * sizeof(MemHandle)));
 
 	//if (ar.mode == DBPArchive::MODE_LOAD) memcpy(MemBase + CALLBACK_PhysPointer(0), cbBuf, sizeof(cbBuf));
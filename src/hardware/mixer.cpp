@@ -69,6 +69,8 @@
 #define TICK_NEXT ( 1 << TICK_SHIFT)
 #define TICK_MASK (TICK_NEXT -1)
 
+#include "dbp_simd.h"
+
 #ifdef DBP_STANDALONE
 #include "dbp_threads.h"
 static Mutex DBP_AudioMutex;
@@ -117,6 +119,72 @@ static struct {
 
 Bit8u MixTemp[MIXER_BUFSIZE];
 
+//Add a span of interleaved stereo samples scaled by the channel volume into the work buffer
+static void MIXER_AccumulateSpan(Bitu mixpos, const Bit32s * span, Bitu frames, const Bit32s * volmul) {
+	while (frames) {
+		mixpos &= MIXER_BUFMASK;
+		Bitu run = MIXER_BUFSIZE - mixpos;
+		if (run > frames) run = frames;
+		Bit32s* work = mixer.work[mixpos];
+		Bitu i = 0;
+#if defined(__SSE2__) && __SSE2__
+		//SSE2 has no 32 bit multiply, combine the low halves of two 32x32->64 multiplies
+		const __m128i vol = _mm_set_epi32(volmul[1], volmul[0], volmul[1], volmul[0]), volodd = _mm_srli_epi64(vol, 32);
+		for (; i + 2 <= run; i += 2) {
+			__m128i s = _mm_loadu_si128((const __m128i*)(span + i*2));
+			__m128i even = _mm_mul_epu32(s, vol), odd = _mm_mul_epu32(_mm_srli_epi64(s, 32), volodd);
+			__m128i mul = _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0,0,2,0)), _mm_shuffle_epi32(odd, _MM_SHUFFLE(0,0,2,0)));
+			_mm_storeu_si128((__m128i*)(work + i*2), _mm_add_epi32(_mm_loadu_si128((const __m128i*)(work + i*2)), mul));
+		}
+#elif defined(DBP_NEON)
+		const int32x2_t vol2 = vld1_s32(volmul);
+		const int32x4_t vol = vcombine_s32(vol2, vol2);
+		for (; i + 2 <= run; i += 2)
+			vst1q_s32(work + i*2, vmlaq_s32(vld1q_s32(work + i*2), vld1q_s32(span + i*2), vol));
+#endif
+		for (; i < run; i++) {
+			work[i*2+0] += (Bits)span[i*2+0] * volmul[0];
+			work[i*2+1] += (Bits)span[i*2+1] * volmul[1];
+		}
+		span += run * 2;
+		mixpos += run;
+		frames -= run;
+	}
+}
+
+//Scale down, clip and store frames from the work buffer and clear them for the next round
+static void MIXER_OutputSpan(Bit16s * output, Bitu pos, Bitu frames) {
+	while (frames) {
+		pos &= MIXER_BUFMASK;
+		Bitu run = MIXER_BUFSIZE - pos;
+		if (run > frames) run = frames;
+		Bit32s* work = mixer.work[pos];
+		Bitu i = 0;
+#if defined(__SSE2__) && __SSE2__
+		//Saturating pack matches MIXER_CLIP
+		for (; i + 4 <= run; i += 4) {
+			__m128i a = _mm_srai_epi32(_mm_loadu_si128((const __m128i*)(work + i*2 + 0)), MIXER_VOLSHIFT);
+			__m128i b = _mm_srai_epi32(_mm_loadu_si128((const __m128i*)(work + i*2 + 4)), MIXER_VOLSHIFT);
+			_mm_storeu_si128((__m128i*)(output + i*2), _mm_packs_epi32(a, b));
+		}
+#elif defined(DBP_NEON)
+		for (; i + 4 <= run; i += 4) {
+			int16x4_t a = vqmovn_s32(vshrq_n_s32(vld1q_s32(work + i*2 + 0), MIXER_VOLSHIFT));
+			int16x4_t b = vqmovn_s32(vshrq_n_s32(vld1q_s32(work + i*2 + 4), MIXER_VOLSHIFT));
+			vst1q_s16(output + i*2, vcombine_s16(a, b));
+		}
+#endif
+		for (; i < run; i++) {
+			output[i*2+0] = MIXER_CLIP(work[i*2+0] >> MIXER_VOLSHIFT);
+			output[i*2+1] = MIXER_CLIP(work[i*2+1] >> MIXER_VOLSHIFT);
+		}
+		memset(work, 0, run * sizeof(mixer.work[0]));
+		output += run * 2;
+		pos += run;
+		frames -= run;
+	}
+}
+
 MixerChannel * MIXER_AddChannel(MIXER_Handler handler,Bitu freq,const char * name) {
 	MixerChannel * chan=new MixerChannel();
 	chan->scale = 1.0;
@@ -248,149 +316,156 @@ void MixerChannel::AddSilence(void) {
 	offset[0] = offset[1] = 0;
 }
 
-//4 seems to work . Disabled for now
-#define MIXER_UPRAMP_STEPS 0
-#define MIXER_UPRAMP_SAVE 512
+//Frames converted and resampled in one go before being added to the work buffer
+#define MIXER_SPAN 256
 
 template<class Type,bool stereo,bool signeddata,bool nativeorder>
-inline void MixerChannel::AddSamples(Bitu len, const Type* data) {
-	last_samples_were_stereo = stereo;
-
-	//Position where to write the data
-	Bitu mixpos = mixer.pos + done;
-	//Position in the incoming data
-	Bitu pos = 0;
-	//Mix and data for the full length
-	while (1) {
-		//Does new data need to get read?
-		while (freq_counter >= FREQ_NEXT) {
-			//Would this overflow the source data, then it's time to leave
-			if (pos >= len) {
-				last_samples_were_silence = false;
-#if MIXER_UPRAMP_STEPS > 0
-				if (offset[0] || offset[1]) {
-					//Should be safe to do, as the value inside offset is 16 bit while offset itself is at least 32 bit
-					offset[0] = (offset[0]*(MIXER_UPRAMP_STEPS-1))/MIXER_UPRAMP_STEPS;
-					offset[1] = (offset[1]*(MIXER_UPRAMP_STEPS-1))/MIXER_UPRAMP_STEPS;
-					if (offset[0] < MIXER_UPRAMP_SAVE && offset[0] > -MIXER_UPRAMP_SAVE) offset[0] = 0;
-					if (offset[1] < MIXER_UPRAMP_SAVE && offset[1] > -MIXER_UPRAMP_SAVE) offset[1] = 0;
+static void MIXER_ConvertSamples(Bit32s * dst,const Type * data,Bitu count) {
+	//Output is always interleaved stereo, mono data gets written to both sides
+	for (Bitu pos = 0; pos < count; pos++, dst += 2) {
+		if ( sizeof( Type) == 1) {
+			if (!signeddata) {
+				if (stereo) {
+					dst[0]=(((Bit8s)(data[pos*2+0] ^ 0x80)) << 8);
+					dst[1]=(((Bit8s)(data[pos*2+1] ^ 0x80)) << 8);
+				} else {
+					dst[0]=dst[1]=(((Bit8s)(data[pos] ^ 0x80)) << 8);
+				}
+			} else {
+				if (stereo) {
+					dst[0]=(data[pos*2+0] << 8);
+					dst[1]=(data[pos*2+1] << 8);
+				} else {
+					dst[0]=dst[1]=(data[pos] << 8);
 				}
-#endif
-				return;
-			}
-			freq_counter -= FREQ_NEXT;
-			prevSample[0] = nextSample[0];
-			if (stereo) {
-				prevSample[1] = nextSample[1];
 			}
-			if ( sizeof( Type) == 1) {
-				if (!signeddata) {
-					if (stereo) {
-						nextSample[0]=(((Bit8s)(data[pos*2+0] ^ 0x80)) << 8);
-						nextSample[1]=(((Bit8s)(data[pos*2+1] ^ 0x80)) << 8);
+		//16bit and 32bit both contain 16bit data internally
+		} else  {
+			if (signeddata) {
+				if (stereo) {
+					if (nativeorder) {
+						dst[0]=data[pos*2+0];
+						dst[1]=data[pos*2+1];
 					} else {
-						nextSample[0]=(((Bit8s)(data[pos] ^ 0x80)) << 8);
+						if ( sizeof( Type) == 2) {
+							dst[0]=(Bit16s)host_readw((HostPt)&data[pos*2+0]);
+							dst[1]=(Bit16s)host_readw((HostPt)&data[pos*2+1]);
+						} else {
+							dst[0]=(Bit32s)host_readd((HostPt)&data[pos*2+0]);
+							dst[1]=(Bit32s)host_readd((HostPt)&data[pos*2+1]);
+						}
 					}
 				} else {
-					if (stereo) {
-						nextSample[0]=(data[pos*2+0] << 8);
-						nextSample[1]=(data[pos*2+1] << 8);
+					if (nativeorder) {
+						dst[0]=dst[1]=data[pos];
 					} else {
-						nextSample[0]=(data[pos] << 8);
-					}
-				}
-			//16bit and 32bit both contain 16bit data internally
-			} else  {
-				if (signeddata) {
-					if (stereo) {
-						if (nativeorder) {
-							nextSample[0]=data[pos*2+0];
-							nextSample[1]=data[pos*2+1];
+						if ( sizeof( Type) == 2) {
+							dst[0]=dst[1]=(Bit16s)host_readw((HostPt)&data[pos]);
 						} else {
-							if ( sizeof( Type) == 2) {
-								nextSample[0]=(Bit16s)host_readw((HostPt)&data[pos*2+0]);
-								nextSample[1]=(Bit16s)host_readw((HostPt)&data[pos*2+1]);
-							} else {
-								nextSample[0]=(Bit32s)host_readd((HostPt)&data[pos*2+0]);
-								nextSample[1]=(Bit32s)host_readd((HostPt)&data[pos*2+1]);
-							}
+							dst[0]=dst[1]=(Bit32s)host_readd((HostPt)&data[pos]);
 						}
+					}
+				}
+			} else {
+				if (stereo) {
+					if (nativeorder) {
+						dst[0]=(Bit32s)((Bits)data[pos*2+0]-32768);
+						dst[1]=(Bit32s)((Bits)data[pos*2+1]-32768);
 					} else {
-						if (nativeorder) {
-							nextSample[0] = data[pos];
+						if ( sizeof( Type) == 2) {
+							dst[0]=(Bit32s)((Bits)host_readw((HostPt)&data[pos*2+0])-32768);
+							dst[1]=(Bit32s)((Bits)host_readw((HostPt)&data[pos*2+1])-32768);
 						} else {
-							if ( sizeof( Type) == 2) {
-								nextSample[0]=(Bit16s)host_readw((HostPt)&data[pos]);
-							} else {
-								nextSample[0]=(Bit32s)host_readd((HostPt)&data[pos]);
-							}
+							dst[0]=(Bit32s)((Bits)host_readd((HostPt)&data[pos*2+0])-32768);
+							dst[1]=(Bit32s)((Bits)host_readd((HostPt)&data[pos*2+1])-32768);
 						}
 					}
 				} else {
-					if (stereo) {
-						if (nativeorder) {
-							nextSample[0]=(Bits)data[pos*2+0]-32768;
-							nextSample[1]=(Bits)data[pos*2+1]-32768;
-						} else {
-							if ( sizeof( Type) == 2) {
-								nextSample[0]=(Bits)host_readw((HostPt)&data[pos*2+0])-32768;
-								nextSample[1]=(Bits)host_readw((HostPt)&data[pos*2+1])-32768;
-							} else {
-								nextSample[0]=(Bits)host_readd((HostPt)&data[pos*2+0])-32768;
-								nextSample[1]=(Bits)host_readd((HostPt)&data[pos*2+1])-32768;
-							}
-						}
+					if (nativeorder) {
+						dst[0]=dst[1]=(Bit32s)((Bits)data[pos]-32768);
 					} else {
-						if (nativeorder) {
-							nextSample[0]=(Bits)data[pos]-32768;
+						if ( sizeof( Type) == 2) {
+							dst[0]=dst[1]=(Bit32s)((Bits)host_readw((HostPt)&data[pos])-32768);
 						} else {
-							if ( sizeof( Type) == 2) {
-								nextSample[0]=(Bits)host_readw((HostPt)&data[pos])-32768;
-							} else {
-								nextSample[0]=(Bits)host_readd((HostPt)&data[pos])-32768;
-							}
+							dst[0]=dst[1]=(Bit32s)((Bits)host_readd((HostPt)&data[pos])-32768);
 						}
 					}
 				}
 			}
-			//This sample has been handled now, increase position
-			pos++;
-#if MIXER_UPRAMP_STEPS > 0
-			if (last_samples_were_silence && pos == 1) {
-				offset[0] = nextSample[0] - prevSample[0];
-				if (stereo) offset[1] = nextSample[1] - prevSample[1];
-				//Don't bother with small steps.
-				if (offset[0] < (MIXER_UPRAMP_SAVE*4) && offset[0] > (-MIXER_UPRAMP_SAVE*4)) offset[0] = 0;
-				if (offset[1] < (MIXER_UPRAMP_SAVE*4) && offset[1] > (-MIXER_UPRAMP_SAVE*4)) offset[1] = 0;
-			}
+		}
+	}
+}
+
+template<class Type,bool stereo,bool signeddata,bool nativeorder>
+inline void MixerChannel::AddSamples(Bitu len, const Type* data) {
+	last_samples_were_stereo = stereo;
 
-			if (offset[0] || offset[1]) {
-				nextSample[0] = nextSample[0] - (offset[0]*(MIXER_UPRAMP_STEPS*static_cast<Bits>(len)-static_cast<Bits>(pos))) /( MIXER_UPRAMP_STEPS*static_cast<Bits>(len) );
-				nextSample[1] = nextSample[1] - (offset[1]*(MIXER_UPRAMP_STEPS*static_cast<Bits>(len)-static_cast<Bits>(pos))) /( MIXER_UPRAMP_STEPS*static_cast<Bits>(len) );
+	//Converted input and resampled output, both interleaved stereo
+	Bit32s in[MIXER_SPAN*2], out[MIXER_SPAN*2];
+	Bitu inpos = 0, incount = 0, outcount = 0;
+	//Keep the resampler state in locals, the right side is only tracked for stereo data
+	Bits prev0 = prevSample[0], prev1 = prevSample[1], next0 = nextSample[0], next1 = nextSample[1];
+	Bitu counter = freq_counter;
+	//Position where to write the data
+	Bitu mixpos = mixer.pos + done;
+	//Mix and data for the full length
+	while (1) {
+		//Does new data need to get read?
+		while (counter >= FREQ_NEXT) {
+			if (inpos == incount) {
+				//Would this overflow the source data, then it's time to leave
+				if (!len) goto finish;
+				incount = (len < MIXER_SPAN ? len : MIXER_SPAN);
+				MIXER_ConvertSamples<Type,stereo,signeddata,nativeorder>(in, data, incount);
+				data += incount * (stereo ? 2 : 1);
+				len -= incount;
+				inpos = 0;
 			}
-#endif
+			counter -= FREQ_NEXT;
+			prev0 = next0;
+			next0 = in[inpos*2+0];
+			if (stereo) {
+				prev1 = next1;
+				next1 = in[inpos*2+1];
+			}
+			inpos++;
 		}
-		//Where to write
-		mixpos &= MIXER_BUFMASK;
-		Bit32s* write = mixer.work[mixpos];
+		Bit32s* o = &out[outcount*2];
 		if (!interpolate) {
-			write[0] += prevSample[0] * volmul[0];
-			write[1] += (stereo ? prevSample[1] : prevSample[0]) * volmul[1];
+			o[0] = (Bit32s)prev0;
+			o[1] = (Bit32s)(stereo ? prev1 : prev0);
 		}
 		else {
-			Bits diff_mul = freq_counter & FREQ_MASK;
-			Bits sample = prevSample[0] + (((nextSample[0] - prevSample[0]) * diff_mul) >> FREQ_SHIFT);
-			write[0] += sample*volmul[0];
+			Bits diff_mul = counter & FREQ_MASK;
+			Bits sample = prev0 + (((next0 - prev0) * diff_mul) >> FREQ_SHIFT);
+			o[0] = (Bit32s)sample;
 			if (stereo) {
-				sample = prevSample[1] + (((nextSample[1] - prevSample[1]) * diff_mul) >> FREQ_SHIFT);
+				sample = prev1 + (((next1 - prev1) * diff_mul) >> FREQ_SHIFT);
 			}
-			write[1] += sample*volmul[1];
+			o[1] = (Bit32s)sample;
 		}
 		//Prepare for next sample
-		freq_counter += freq_add;
-		mixpos++;
-		done++;
+		counter += freq_add;
+		if (++outcount == MIXER_SPAN) {
+			MIXER_AccumulateSpan(mixpos, out, outcount, volmul);
+			mixpos += outcount;
+			done += outcount;
+			outcount = 0;
+		}
+	}
+finish:
+	if (outcount) {
+		MIXER_AccumulateSpan(mixpos, out, outcount, volmul);
+		done += outcount;
+	}
+	prevSample[0] = prev0;
+	nextSample[0] = next0;
+	if (stereo) {
+		prevSample[1] = prev1;
+		nextSample[1] = next1;
 	}
+	freq_counter = counter;
+	last_samples_were_silence = false;
 }
 
 void MixerChannel::AddStretched(Bitu len,Bit16s * data) {
@@ -674,16 +749,7 @@ MIXER_CallBack(void * /*userdata*/, uint8_t *stream, int len) {
 			pos++;
 		}
 	} else {
-		while (reduce--) {
-			pos &= MIXER_BUFMASK;
-			sample=mixer.work[pos][0]>>MIXER_VOLSHIFT;
-			*output++=MIXER_CLIP(sample);
-			sample=mixer.work[pos][1]>>MIXER_VOLSHIFT;
-			*output++=MIXER_CLIP(sample);
-			mixer.work[pos][0]=0;
-			mixer.work[pos][1]=0;
-			pos++;
-		}
+		MIXER_OutputSpan(output, pos, reduce);
 	}
 	Callback_UnlockAudio();
 
@@ -23,6 +23,7 @@
 #include "pic.h"
 #include "timer.h"
 #include "setup.h"
+#include <algorithm>
 
 #define PIC_QUEUESIZE 512
 
@@ -168,15 +169,76 @@ struct PICEntry {
 	float index;
 	Bitu value;
 	PIC_EventHandler pic_event;
-	PICEntry * next;
+	Bit32u order; // events with the same index run in the order they were added
+	PICEntry * next; // only used in free list
 };
 
+//DBP: Scheduled events are kept in a binary min-heap sorted by index and order (heap[0] is the next event)
 static struct {
 	PICEntry entries[PIC_QUEUESIZE];
+	PICEntry * heap[PIC_QUEUESIZE];
+	Bitu count;
+	Bit32u order;
 	PICEntry * free_entry;
-	PICEntry * next_entry;
 } pic_queue;
 
+static INLINE bool PIC_EntryBefore(const PICEntry* a, const PICEntry* b) {
+	return (a->index < b->index || (a->index == b->index && a->order < b->order));
+}
+
+static void PIC_HeapSiftUp(Bitu pos) {
+	PICEntry * entry=pic_queue.heap[pos];
+	while (pos) {
+		Bitu parent=(pos-1)>>1;
+		if (!PIC_EntryBefore(entry,pic_queue.heap[parent])) break;
+		pic_queue.heap[pos]=pic_queue.heap[parent];
+		pos=parent;
+	}
+	pic_queue.heap[pos]=entry;
+}
+
+static void PIC_HeapSiftDown(Bitu pos) {
+	PICEntry * entry=pic_queue.heap[pos];
+	for (Bitu child;(child=pos*2+1)<pic_queue.count;pos=child) {
+		if (child+1<pic_queue.count && PIC_EntryBefore(pic_queue.heap[child+1],pic_queue.heap[child])) child++;
+		if (!PIC_EntryBefore(pic_queue.heap[child],entry)) break;
+		pic_queue.heap[pos]=pic_queue.heap[child];
+	}
+	pic_queue.heap[pos]=entry;
+}
+
+static void PIC_HeapRemoveFirst() {
+	PICEntry * entry=pic_queue.heap[0];
+	entry->next=pic_queue.free_entry;
+	pic_queue.free_entry=entry;
+	if (!--pic_queue.count) return;
+	pic_queue.heap[0]=pic_queue.heap[pic_queue.count];
+	PIC_HeapSiftDown(0);
+}
+
+static void PIC_HeapRemoveEvents(PIC_EventHandler handler, bool check_val, Bitu val) {
+	// Compact the array without the removed events, then restore the heap from the bottom up
+	Bitu count=0;
+	for (Bitu i=0;i!=pic_queue.count;i++) {
+		PICEntry * entry=pic_queue.heap[i];
+		if (GCC_UNLIKELY(entry->pic_event==handler) && (!check_val || entry->value==val)) {
+			entry->next=pic_queue.free_entry;
+			pic_queue.free_entry=entry;
+		} else pic_queue.heap[count++]=entry;
+	}
+	if (count==pic_queue.count) return;
+	pic_queue.count=count;
+	for (Bitu i=count/2;i--;) PIC_HeapSiftDown(i);
+}
+
+static void PIC_HeapSort() {
+	// A sorted array is a valid heap. Renumbering the order keeps the sequence stable
+	// when TIMER_AddTick makes two close indices equal, just like the former sorted list.
+	std::sort(pic_queue.heap,pic_queue.heap+pic_queue.count,PIC_EntryBefore);
+	for (Bitu i=0;i!=pic_queue.count;i++) pic_queue.heap[i]->order=(Bit32u)i;
+	pic_queue.order=(Bit32u)pic_queue.count;
+}
+
 static void write_command(Bitu port,Bitu val,Bitu /*iolen*/) {
 	PIC_Controller * pic = &pics[port==0x20 ? 0 : 1];
 
@@ -371,30 +433,10 @@ void PIC_SetIRQMask(Bitu irq, bool masked) {
 }
 
 static void AddEntry(PICEntry * entry) {
-	PICEntry * find_entry=pic_queue.next_entry;
-	if (GCC_UNLIKELY(find_entry ==0)) {
-		entry->next=0;
-		pic_queue.next_entry=entry;
-	} else if (find_entry->index>entry->index) {
-		pic_queue.next_entry=entry;
-		entry->next=find_entry;
-	} else while (find_entry) {
-		if (find_entry->next) {
-			/* See if the next index comes later than this one */
-			if (find_entry->next->index > entry->index) {
-				entry->next=find_entry->next;
-				find_entry->next=entry;
-				break;
-			} else {
-				find_entry=find_entry->next;
-			}
-		} else {
-			entry->next=find_entry->next;
-			find_entry->next=entry;
-			break;
-		}
-	}
-	Bits cycles=PIC_MakeCycles(pic_queue.next_entry->index-PIC_TickIndex());
+	entry->order=pic_queue.order++;
+	pic_queue.heap[pic_queue.count]=entry;
+	PIC_HeapSiftUp(pic_queue.count++);
+	Bits cycles=PIC_MakeCycles(pic_queue.heap[0]->index-PIC_TickIndex());
 	if (cycles<CPU_Cycles) {
 		CPU_CycleLeft+=CPU_Cycles;
 		CPU_Cycles=0;
@@ -420,53 +462,11 @@ void PIC_AddEvent(PIC_EventHandler handler,float delay,Bitu val) {
 }
 
 void PIC_RemoveSpecificEvents(PIC_EventHandler handler, Bitu val) {
-	PICEntry * entry=pic_queue.next_entry;
-	PICEntry * prev_entry;
-	prev_entry = 0;
-	while (entry) {
-		if (GCC_UNLIKELY((entry->pic_event == handler)) && (entry->value == val)) {
-			if (prev_entry) {
-				prev_entry->next=entry->next;
-				entry->next=pic_queue.free_entry;
-				pic_queue.free_entry=entry;
-				entry=prev_entry->next;
-				continue;
-			} else {
-				pic_queue.next_entry=entry->next;
-				entry->next=pic_queue.free_entry;
-				pic_queue.free_entry=entry;
-				entry=pic_queue.next_entry;
-				continue;
-			}
-		}
-		prev_entry=entry;
-		entry=entry->next;
-	}
+	PIC_HeapRemoveEvents(handler,true,val);
 }
 
 void PIC_RemoveEvents(PIC_EventHandler handler) {
-	PICEntry * entry=pic_queue.next_entry;
-	PICEntry * prev_entry;
-	prev_entry=0;
-	while (entry) {
-		if (GCC_UNLIKELY(entry->pic_event==handler)) {
-			if (prev_entry) {
-				prev_entry->next=entry->next;
-				entry->next=pic_queue.free_entry;
-				pic_queue.free_entry=entry;
-				entry=prev_entry->next;
-				continue;
-			} else {
-				pic_queue.next_entry=entry->next;
-				entry->next=pic_queue.free_entry;
-				pic_queue.free_entry=entry;
-				entry=pic_queue.next_entry;
-				continue;
-			}
-		}
-		prev_entry=entry;
-		entry=entry->next;
-	}
+	PIC_HeapRemoveEvents(handler,false,0);
 }
 
 
@@ -480,22 +480,21 @@ bool PIC_RunQueue(void) {
 	/* Check the queue for an entry */
 	Bits index_nd=PIC_TickIndexND();
 	InEventService = true;
-	while (pic_queue.next_entry && (pic_queue.next_entry->index*CPU_CycleMax<=index_nd)) {
-		PICEntry * entry=pic_queue.next_entry;
-		pic_queue.next_entry=entry->next;
+	while (pic_queue.count && (pic_queue.heap[0]->index*CPU_CycleMax<=index_nd)) {
+		PICEntry * entry=pic_queue.heap[0];
+		PIC_EventHandler pic_event=entry->pic_event;
+		Bitu value=entry->value;
 
+		/* Put the entry in the free list before calling the handler which can add new events */
 		srv_lag = entry->index;
-		(entry->pic_event)(entry->value); // call the event handler
-
-		/* Put the entry in the free list */
-		entry->next=pic_queue.free_entry;
-		pic_queue.free_entry=entry;
+		PIC_HeapRemoveFirst();
+		pic_event(value); // call the event handler
 	}
 	InEventService = false;
 
 	/* Check when to set the new cycle end */
-	if (pic_queue.next_entry) {
-		Bits cycles=(Bits)(pic_queue.next_entry->index*CPU_CycleMax-index_nd);
+	if (pic_queue.count) {
+		Bits cycles=(Bits)(pic_queue.heap[0]->index*CPU_CycleMax-index_nd);
 		if (GCC_UNLIKELY(!cycles)) cycles=1;
 		if (cycles<CPU_CycleLeft) {
 			CPU_Cycles=cycles;
@@ -544,10 +543,17 @@ void TIMER_AddTick(void) {
 	CPU_Cycles=0;
 	PIC_Ticks++;
 	/* Go through the list of scheduled events and lower their index with 1000 */
-	PICEntry * entry=pic_queue.next_entry;
-	while (entry) {
-		entry->index -= 1.0;
-		entry=entry->next;
+	//DBP: Lowering every index by the same amount keeps the heap valid as long as no two indices become equal.
+	//     Subtracting 1.0 is exact for indices from 0.5 up to 2^24 (events are scheduled only a few ms ahead), so
+	//     only sort (and renumber) when an index outside that range could round into its neighbor or when the
+	//     order counter is running out.
+	bool sort=(pic_queue.order>=0x80000000);
+	for (Bitu i=0;i!=pic_queue.count && !sort;i++) {
+		sort=(pic_queue.heap[i]->index<0.5f || pic_queue.heap[i]->index>=16777216.0f);
+	}
+	if (sort) PIC_HeapSort();
+	for (Bitu i=0;i!=pic_queue.count;i++) {
+		pic_queue.heap[i]->index -= 1.0;
 	}
 	/* Call our list of ticker handlers */
 	TickerBlock * ticker=firstticker;
@@ -607,7 +613,8 @@ public:
 		}
 		pic_queue.entries[PIC_QUEUESIZE-1].next=0;
 		pic_queue.free_entry=&pic_queue.entries[0];
-		pic_queue.next_entry=0;
+		pic_queue.count=0;
+		pic_queue.order=0;
 	}
 
 	~PIC_8259A(){
@@ -660,8 +667,10 @@ void DBPSerialize_PIC(DBPArchive& ar)
 	}
 	else if (ar.mode != DBPArchive::MODE_LOAD)
 	{
-		for (PICEntry* it = pic_queue.next_entry; it; it = it->next)
+		PIC_HeapSort(); // store in order of execution
+		for (Bitu i = 0; i != pic_queue.count; i++)
 		{
+			PICEntry* it = pic_queue.heap[i];
 			// skip storing state irrelevant union and zip drive events which keep a pointer in the value
 			if (it->pic_event == DBPSerializePIC_EventHandlerunionDrivePtrs[0]) continue;
 			if (it->pic_event == DBPSerializePIC_EventHandlerzipDrivePtrs[0]) continue;
@@ -714,17 +723,17 @@ void DBPSerialize_PIC(DBPArchive& ar)
 		}
 		pic_queue.entries[PIC_QUEUESIZE-1].next = NULL;
 		pic_queue.free_entry = (pic_count != PIC_QUEUESIZE ? &pic_queue.entries[pic_count] : NULL);
-		pic_queue.next_entry = (pic_count ? &pic_queue.entries[0] : NULL);
-		if (pic_count) pic_queue.entries[pic_count-1].next = NULL;
+		for (Bit16u i = 0; i != pic_count; i++) { pic_queue.heap[i] = &pic_queue.entries[i]; pic_queue.entries[i].order = i; } // stored sorted which is a valid heap
+		pic_queue.count = pic_count;
+		pic_queue.order = pic_count;
 	}
 }
 
 //void PIC_VALIDATE()
 //{
-//	int i, total = 0;
-//	PICEntry *last_entry = NULL, *last_free = NULL, *it;
-//	for (i = 0, it = pic_queue.next_entry; it; it = it->next, total++) { last_entry = it; DBP_ASSERT(i++ <= PIC_QUEUESIZE); }
-//	for (i = 0, it = pic_queue.free_entry; it; it = it->next, total++) { last_free = it; DBP_ASSERT(i++ <= PIC_QUEUESIZE); }
-//	DBP_ASSERT(total == PIC_QUEUESIZE || InEventService);
-//	DBP_ASSERT(!last_entry || !last_free || last_entry != last_free);
+//	int i, total = (int)pic_queue.count;
+//	PICEntry *it;
+//	for (Bitu j = 1; j < pic_queue.count; j++) DBP_ASSERT(!PIC_EntryBefore(pic_queue.heap[j], pic_queue.heap[(j-1)>>1]));
+//	for (i = 0, it = pic_queue.free_entry; it; it = it->next, total++) { DBP_ASSERT(i++ <= PIC_QUEUESIZE); }
+//	DBP_ASSERT(total == PIC_QUEUESIZE);
 //}
@@ -615,6 +615,55 @@ static void VGA_ProcessSplit() {
 	vga.draw.address_line=0;
 }
 
+// DBP: Scanlines of the linear modes are only decoded when the video memory they show was written since the previous drawn frame.
+// The display offset of each line is remembered so scrolling, panning and split screens still redraw the affected lines.
+static struct VGA_Unchanged {
+	bool wanted, record, skip;
+	Bitu dirty_ofs;
+	Bit8u* last_base;
+	Bit32u addr[SCALER_MAXHEIGHT];
+} vga_unchanged;
+
+static void VGA_UnchangedForget(void) {
+	memset(vga_unchanged.addr, 0xFF, sizeof(vga_unchanged.addr));
+}
+
+void VGA_SkipUnchangedLines(bool enable) {
+	vga_unchanged.wanted = enable;
+}
+
+static void VGA_UnchangedFrameStart(void) {
+	VGA_Unchanged& u = vga_unchanged;
+	if (u.wanted != (vga.mem.dirty_display != NULL)) {
+		VGA_TrackDisplayPages(u.wanted);
+		VGA_UnchangedForget();
+	}
+	u.skip = false;
+	bool record = (vga.mem.dirty_display && VGA_DrawLine == VGA_Draw_Linear_Line && (vga.draw.linear_base == vga.mem.linear || vga.draw.linear_base == vga.fastmem));
+	if (!record || vga.draw.linear_base != u.last_base) {
+		if (u.record) VGA_UnchangedForget();
+		u.last_base = (record ? vga.draw.linear_base : NULL);
+	}
+	u.record = record;
+	if (!record) return;
+	VGA_ResetDisplayPages();
+	u.dirty_ofs = (vga.draw.linear_base == vga.fastmem ? (Bitu)(vga.mem.dirty_display_fastmem - vga.mem.dirty_display) : 0);
+	u.skip = RENDER_SkipUnchangedLines();
+}
+
+static bool VGA_LineUnchanged(Bitu vidstart) {
+	VGA_Unchanged& u = vga_unchanged;
+	if (!u.record || vga.draw.lines_done >= SCALER_MAXHEIGHT) return false;
+	Bitu offset = vidstart & vga.draw.linear_mask;
+	Bit32u& last = u.addr[vga.draw.lines_done];
+	if (last != (Bit32u)offset) { last = (Bit32u)offset; return false; }
+	if (!u.skip || ((vga.draw.line_length + offset) & ~vga.draw.linear_mask)) return false;
+	const Bit8u *cur = vga.mem.dirty_display + u.dirty_ofs, *prev = vga.mem.dirty_display_last + u.dirty_ofs;
+	for (Bitu p = (offset >> 12), pEnd = ((offset + vga.draw.line_length - 1) >> 12); p <= pEnd; p++)
+		if (cur[p] | prev[p]) return false;
+	return true;
+}
+
 static Bit8u bg_color_index = 0; // screen-off black index
 static void VGA_DrawSingleLine(Bitu /*blah*/) {
 	if (GCC_UNLIKELY(vga.attr.disabled)) {
@@ -670,6 +719,9 @@ static void VGA_DrawSingleLine(Bitu /*blah*/) {
 			}
 		}
 		RENDER_DrawLine(TempLine);
+		if (vga_unchanged.record && vga.draw.lines_done < SCALER_MAXHEIGHT) vga_unchanged.addr[vga.draw.lines_done] = ~(Bit32u)0;
+	} else if (VGA_LineUnchanged(vga.draw.address)) {
+		RENDER_DrawLine(NULL);
 	} else {
 		Bit8u * data=VGA_DrawLine( vga.draw.address, vga.draw.address_line );	
 		RENDER_DrawLine(data);
@@ -712,8 +764,8 @@ static void VGA_DrawEGASingleLine(Bitu /*blah*/) {
 
 static void VGA_DrawPart(Bitu lines) {
 	while (lines--) {
-		Bit8u * data=VGA_DrawLine( vga.draw.address, vga.draw.address_line );
-		RENDER_DrawLine(data);
+		if (VGA_LineUnchanged(vga.draw.address)) RENDER_DrawLine(NULL);
+		else RENDER_DrawLine(VGA_DrawLine( vga.draw.address, vga.draw.address_line ));
 		vga.draw.address_line++;
 		if (vga.draw.address_line>=vga.draw.address_line_total) {
 			vga.draw.address_line=0;
@@ -937,6 +989,8 @@ static void VGA_VerticalTimer(Bitu /*val*/) {
 		vga.draw.address += vga.draw.address_add * (vga.draw.vblank_skip/(vga.draw.address_line_total));
 	}
 
+	VGA_UnchangedFrameStart();
+
 	// add the draw event
 	switch (vga.draw.mode) {
 	case PART:
@@ -1034,6 +1088,7 @@ void VGA_ActivateHardwareCursor(void) {
 }
 
 void VGA_SetupDrawing(Bitu /*val*/) {
+	VGA_UnchangedForget();
 	if (vga.mode==M_ERROR) {
 		PIC_RemoveEvents(VGA_VerticalTimer);
 		PIC_RemoveEvents(VGA_PanningLatch);
@@ -1706,4 +1761,6 @@ void DBPSerialize_VGA_Draw(DBPArchive& ar)
 	
 	if (ar.mode == DBPArchive::MODE_ZERO)
 		vga.draw.linear_base = NULL;
+	else if (ar.mode == DBPArchive::MODE_LOAD)
+		VGA_UnchangedForget(); // video memory was replaced without passing the page handlers
 }
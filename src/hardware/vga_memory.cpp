@@ -65,6 +65,13 @@ static INLINE void hostWrite(HostPt off, Bitu val) {
 		host_writed( off, (Bit32u)val );
 }
 
+template <class Size>
+static INLINE void linearWrite(PhysPt addr, Bitu val) {
+	hostWrite<Size>( &vga.mem.linear[addr], val );
+	VGA_MARK_DIRTY(addr);
+	VGA_MARK_DIRTY(addr+sizeof(Size)-1);
+}
+
 template <class Size>
 static INLINE Bitu  hostRead(HostPt off ) {
 	if ( sizeof( Size ) == 1)
@@ -186,10 +193,12 @@ public:
 		/* Update video memory and the pixel buffer */
 		VGA_Latch pixels;
 		vga.mem.linear[start] = val;
+		VGA_MARK_DIRTY(start);
 		start >>= 2;
 		pixels.d=((Bit32u*)vga.mem.linear)[start];
 
 		Bit8u * write_pixels=&vga.fastmem[start<<3];
+		VGA_MARK_DIRTY_FASTMEM(start<<3);
 
 		Bit32u colors0_3, colors4_7;
 		VGA_Latch temp;temp.d=(pixels.d>>4) & 0x0f0f0f0f;
@@ -272,7 +281,9 @@ public:
 		pixels.d&=vga.config.full_not_map_mask;
 		pixels.d|=(data & vga.config.full_map_mask);
 		((Bit32u*)vga.mem.linear)[start]=pixels.d;
+		VGA_MARK_DIRTY(start<<2);
 		Bit8u * write_pixels=&vga.fastmem[start<<3];
+		VGA_MARK_DIRTY_FASTMEM(start<<3);
 
 		Bit32u colors0_3, colors4_7;
 		VGA_Latch temp;temp.d=(pixels.d>>4) & 0x0f0f0f0f;
@@ -334,15 +345,19 @@ public:
 	template <class Size>
 	static INLINE void writeCache(PhysPt addr, Bitu val) {
 		hostWrite<Size>( &vga.fastmem[addr], val );
+		VGA_MARK_DIRTY_FASTMEM(addr);
+		VGA_MARK_DIRTY_FASTMEM(addr+sizeof(Size)-1);
 		if (GCC_UNLIKELY(addr < 320)) {
 			// And replicate the first line
 			hostWrite<Size>( &vga.fastmem[addr+64*1024], val );
+			VGA_MARK_DIRTY_FASTMEM(addr+64*1024);
 		}
 	}
 	template <class Size>
 	static INLINE void writeHandler(PhysPt addr, Bitu val) {
 		// No need to check for compatible chains here, this one is only enabled if that bit is set
 		hostWrite<Size>( &vga.mem.linear[((addr&~3)<<2)+(addr&3)], val );
+		VGA_MARK_DIRTY((addr&~3)<<2);
 	}
 	Bitu readb(PhysPt addr ) {
 		addr = PAGING_GetPhysicalAddress(addr) & vgapages.mask;
@@ -423,6 +438,7 @@ public:
 		pixels.d&=vga.config.full_not_map_mask;
 		pixels.d|=(data & vga.config.full_map_mask);
 		((Bit32u*)vga.mem.linear)[addr]=pixels.d;
+		VGA_MARK_DIRTY(addr<<2);
 //		if(vga.config.compatible_chain4)
 //			((Bit32u*)vga.mem.linear)[CHECKED2(addr+64*1024)]=pixels.d; 
 	}
@@ -483,15 +499,48 @@ public:
 		} else {
 			if (vga.seq.map_mask & 0x4) // font map
 				vga.draw.font[addr]=(Bit8u)val;
-			if (vga.seq.map_mask & 0x2) // character attribute
+			if (vga.seq.map_mask & 0x2) { // character attribute
 				vga.mem.linear[CHECKED3(vga.svga.bank_read_full+addr+1)]=(Bit8u)val;
-			if (vga.seq.map_mask & 0x1) // character index
+				VGA_MARK_DIRTY(CHECKED3(vga.svga.bank_read_full+addr+1));
+			}
+			if (vga.seq.map_mask & 0x1) { // character index
 				vga.mem.linear[CHECKED3(vga.svga.bank_read_full+addr)]=(Bit8u)val;
+				VGA_MARK_DIRTY(CHECKED3(vga.svga.bank_read_full+addr));
+			}
 		}
 	}
 };
 
-class VGA_Map_Handler : public PageHandler {
+// DBP: While dirty page tracking is enabled, the direct mapped handlers are not PFLAG_WRITEABLE so writes reach them.
+// The first write to a page marks it dirty and switches the TLB entry to direct writes.
+class VGA_DirtyTrack_Handler : public PageHandler {
+public:
+	INLINE HostPt MarkDirty(PhysPt addr) {
+		Bitu lin_page=addr>>12, phys_page=PAGING_GetPhysicalPage(addr)>>12;
+		HostPt page=GetHostWritePt(phys_page);
+		VGA_MARK_DIRTY(page-vga.mem.linear);
+		VGA_MARK_DIRTY(page-vga.mem.linear+4095);
+#if defined(USE_FULL_TLB)
+		if (paging.tlb.writehandler[lin_page]==this) paging.tlb.write[lin_page]=page-(lin_page<<12);
+#endif
+		return page+(addr&4095);
+	}
+	void writeb(PhysPt addr,Bitu val) {
+		host_writeb(MarkDirty(addr),(Bit8u)val);
+	}
+	void writew(PhysPt addr,Bitu val) {
+		host_writew(MarkDirty(addr),(Bit16u)val);
+	}
+	void writed(PhysPt addr,Bitu val) {
+		host_writed(MarkDirty(addr),(Bit32u)val);
+	}
+	void TrackDirtyPages(bool enable) {
+		if (enable) flags&=~PFLAG_WRITEABLE;
+		else flags|=PFLAG_WRITEABLE;
+	}
+};
+
+class VGA_Map_Handler : public VGA_DirtyTrack_Handler {
 public:
 	VGA_Map_Handler() {
 		flags=PFLAG_READABLE|PFLAG_WRITEABLE|PFLAG_NOCODE;
@@ -534,21 +583,21 @@ public:
 		addr += vga.svga.bank_write_full;
 		addr = CHECKED(addr);
 		MEM_CHANGED( addr );
-		hostWrite<Bit8u>( &vga.mem.linear[addr], val );
+		linearWrite<Bit8u>( addr, val );
 	}
 	void writew(PhysPt addr,Bitu val) {
 		addr = PAGING_GetPhysicalAddress(addr) & vgapages.mask;
 		addr += vga.svga.bank_write_full;
 		addr = CHECKED(addr);
 		MEM_CHANGED( addr );
-		hostWrite<Bit16u>( &vga.mem.linear[addr], val );
+		linearWrite<Bit16u>( addr, val );
 	}
 	void writed(PhysPt addr,Bitu val) {
 		addr = PAGING_GetPhysicalAddress(addr) & vgapages.mask;
 		addr += vga.svga.bank_write_full;
 		addr = CHECKED(addr);
 		MEM_CHANGED( addr );	
-		hostWrite<Bit32u>( &vga.mem.linear[addr], val );
+		linearWrite<Bit32u>( addr, val );
 	}
 };
 
@@ -626,24 +675,24 @@ public:
 	void writeb(PhysPt addr,Bitu val) {
 		addr = PAGING_GetPhysicalAddress(addr) - vga.lfb.addr;
 		addr = CHECKED(addr);
-		hostWrite<Bit8u>( &vga.mem.linear[addr], val );
+		linearWrite<Bit8u>( addr, val );
 		MEM_CHANGED( addr );
 	}
 	void writew(PhysPt addr,Bitu val) {
 		addr = PAGING_GetPhysicalAddress(addr) - vga.lfb.addr;
 		addr = CHECKED(addr);
-		hostWrite<Bit16u>( &vga.mem.linear[addr], val );
+		linearWrite<Bit16u>( addr, val );
 		MEM_CHANGED( addr );
 	}
 	void writed(PhysPt addr,Bitu val) {
 		addr = PAGING_GetPhysicalAddress(addr) - vga.lfb.addr;
 		addr = CHECKED(addr);
-		hostWrite<Bit32u>( &vga.mem.linear[addr], val );
+		linearWrite<Bit32u>( addr, val );
 		MEM_CHANGED( addr );
 	}
 };
 
-class VGA_LFB_Handler : public PageHandler {
+class VGA_LFB_Handler : public VGA_DirtyTrack_Handler {
 public:
 	VGA_LFB_Handler() {
 		flags=PFLAG_READABLE|PFLAG_WRITEABLE|PFLAG_NOCODE;
@@ -939,7 +988,86 @@ void VGA_StartUpdateLFB(void) {
 	MEM_SetLFB(vga.s3.la_window << 4 ,vga.vmemsize/4096, vga.lfb.handler, &vgaph.mmio);
 }
 
+Bit32u VGA_LinearSize(void) {
+	// Same as the allocation in VGA_SetupMemory without the alignment padding
+	return (vga.vmemsize < 512*1024 ? 512*1024 : vga.vmemsize) + 2048;
+}
+
+Bit32u VGA_FastmemSize(void) {
+	return (vga.vmemsize<<1)+4096;
+}
+
+// DBP: Dirty page tracking has two users, the rewind buffer and the display which skips unchanged scanlines
+enum { VGA_DIRTY_REWIND = 1, VGA_DIRTY_DISPLAY = 2 };
+static Bit8u vga_dirty_users;
+
+static Bitu VGA_DirtyPageCount(void) {
+	return ((VGA_LinearSize()+4095)>>12)+(VGA_FastmemSize()>>12);
+}
+
+static void VGA_UnlinkWritablePages(void) {
+#if defined(USE_FULL_TLB)
+	for (Bitu i=0;i<paging.links.used;i++) {
+		Bitu lin_page=paging.links.entries[i];
+		if (paging.tlb.write[lin_page] && (paging.tlb.writehandler[lin_page]==&vgaph.map || paging.tlb.writehandler[lin_page]==&vgaph.lfb))
+			PAGING_UnlinkPages(lin_page,1);
+	}
+#else
+	PAGING_ClearTLB();
+#endif
+}
+
+static void VGA_SetDirtyPageUser(Bit8u user, bool enable) {
+	Bit8u users=(enable ? (vga_dirty_users|user) : (vga_dirty_users&~user));
+	if (users && !vga.mem.dirty) {
+		// Flags of the rewind buffer followed by the current and the previous flags of the display
+		Bitu count=VGA_DirtyPageCount();
+		vga.mem.dirty=new Bit8u[count*3];
+		vga.mem.dirty_fastmem=vga.mem.dirty+((VGA_LinearSize()+4095)>>12);
+		vga.mem.dirty_display=vga.mem.dirty+count;
+		vga.mem.dirty_display_fastmem=vga.mem.dirty_fastmem+count;
+		vga.mem.dirty_display_last=vga.mem.dirty_display+count;
+		memset(vga.mem.dirty,1,count*3);
+		vgaph.map.TrackDirtyPages(true);
+		vgaph.lfb.TrackDirtyPages(true);
+		VGA_UnlinkWritablePages();
+	} else if (!users && vga.mem.dirty) {
+		delete [] vga.mem.dirty;
+		vga.mem.dirty=vga.mem.dirty_fastmem=vga.mem.dirty_display=vga.mem.dirty_display_fastmem=vga.mem.dirty_display_last=NULL;
+		vgaph.map.TrackDirtyPages(false);
+		vgaph.lfb.TrackDirtyPages(false);
+		PAGING_ClearTLB();
+	}
+	vga_dirty_users=users;
+}
+
+void VGA_TrackDirtyPages(bool enable) {
+	VGA_SetDirtyPageUser(VGA_DIRTY_REWIND,enable);
+	if (enable) VGA_ResetDirtyPages();
+}
+
+void VGA_ResetDirtyPages(void) {
+	memset(vga.mem.dirty,0,VGA_DirtyPageCount());
+	VGA_UnlinkWritablePages();
+}
+
+void VGA_TrackDisplayPages(bool enable) {
+	VGA_SetDirtyPageUser(VGA_DIRTY_DISPLAY,enable);
+}
+
+void VGA_ResetDisplayPages(void) {
+	Bitu count=VGA_DirtyPageCount();
+	memcpy(vga.mem.dirty_display_last,vga.mem.dirty_display,count);
+	memset(vga.mem.dirty_display,0,count);
+	VGA_UnlinkWritablePages();
+}
+
+void VGA_MarkAllPagesDirty(void) {
+	if (vga.mem.dirty) memset(vga.mem.dirty,1,VGA_DirtyPageCount()*2);
+}
+
 static void VGA_Memory_ShutDown(Section * /*sec*/) {
+	if (vga.mem.dirty) VGA_SetDirtyPageUser(VGA_DIRTY_REWIND|VGA_DIRTY_DISPLAY,false);
 #ifndef C_DBP_LIBRETRO
 	delete[] vga.mem.linear_orgptr;
 	delete[] vga.fastmem_orgptr;
@@ -1026,12 +1154,10 @@ void DBPSerialize_VGA_Memory(DBPArchive& ar)
 	}
 
 	// vga.vmemsize is serialized in DBPSerialize_All and validated to be unchanged during load
-	Bit32u vga_allocsize = vga.vmemsize;
-	if (vga_allocsize < 512*1024) vga_allocsize = 512*1024;
-	vga_allocsize += 2048;
-	ar.SerializeSparse(vga.mem.linear, vga_allocsize);
+	// With FLAG_REWINDBUFFER the contents of video memory are stored in the in-core rewind buffer
+	if (!(ar.flags & DBPArchive::FLAG_REWINDBUFFER)) ar.SerializeSparse(vga.mem.linear, VGA_LinearSize());
 	ar.Serialize(vga.vmemwrap);
-	ar.SerializeSparse(vga.fastmem, (vga.vmemsize<<1)+4096);
+	if (!(ar.flags & DBPArchive::FLAG_REWINDBUFFER)) ar.SerializeSparse(vga.fastmem, VGA_FastmemSize());
 	ar.Serialize(vgapages);
 
 	#ifdef VGA_KEEP_CHANGES
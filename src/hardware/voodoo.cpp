@@ -222,11 +222,8 @@ static INLINE INT32 mul_32x32_shift(INT32 a, INT32 b, INT8 shift)
 	return (INT32)(((INT64)a * (INT64)b) >> shift);
 }
 
-#if !defined(__SSE2__) && (_M_IX86_FP == 2 || (defined(_M_AMD64) || defined(_M_X64)))
-#define __SSE2__ 1
-#endif
+#include "dbp_simd.h"
 #if defined(__SSE2__) && __SSE2__
-#include <emmintrin.h>
 static INT16 sse2_scale_table[256][8];
 #endif
 
@@ -238,6 +235,15 @@ static INLINE rgb_t rgba_bilinear_filter(rgb_t rgb00, rgb_t rgb01, rgb_t rgb10,
 		_mm_slli_epi32(_mm_madd_epi16(_mm_unpacklo_epi8(_mm_unpacklo_epi8(_mm_cvtsi32_si128(rgb01), _mm_cvtsi32_si128(rgb00)), _mm_setzero_si128()), scale_u), 15),
 		_mm_srli_epi32(_mm_madd_epi16(_mm_unpacklo_epi8(_mm_unpacklo_epi8(_mm_cvtsi32_si128(rgb11), _mm_cvtsi32_si128(rgb10)), _mm_setzero_si128()), scale_u), 1)),
 		scale_v), 15), _mm_setzero_si128()), _mm_setzero_si128()));
+#elif defined(DBP_NEON)
+	/* same math as the SSE2 path: rows are weighted with 256-u/u, then halved and weighted with 256-v/v */
+	uint16x8_t c0 = vmovl_u8(vreinterpret_u8_u32(vset_lane_u32(rgb01, vdup_n_u32(rgb00), 1)));
+	uint16x8_t c1 = vmovl_u8(vreinterpret_u8_u32(vset_lane_u32(rgb11, vdup_n_u32(rgb10), 1)));
+	uint16x4_t wu = vdup_n_u16(u), wiu = vdup_n_u16(256 - u);
+	uint16x4_t row0 = vshr_n_u16(vmla_u16(vmul_u16(vget_low_u16(c0), wiu), vget_high_u16(c0), wu), 1);
+	uint16x4_t row1 = vshr_n_u16(vmla_u16(vmul_u16(vget_low_u16(c1), wiu), vget_high_u16(c1), wu), 1);
+	uint32x4_t res = vmlal_u16(vmull_u16(row1, vdup_n_u16(v)), row0, vdup_n_u16(256 - v));
+	return vget_lane_u32(vreinterpret_u32_u8(vmovn_u16(vcombine_u16(vmovn_u32(vshrq_n_u32(res, 15)), vdup_n_u16(0)))), 0);
 #else
 	UINT32 ag0, ag1, rb0, rb1;
 	rb0 = (rgb00 & 0x00ff00ff) + ((((rgb01 & 0x00ff00ff) - (rgb00 & 0x00ff00ff)) * u) >> 8);
@@ -254,6 +260,99 @@ static INLINE rgb_t rgba_bilinear_filter(rgb_t rgb00, rgb_t rgb01, rgb_t rgb10,
 #endif
 }
 
+/* bilinear filter 4 pixels at once, results are identical to calling rgba_bilinear_filter on each */
+static INLINE void rgba_bilinear_filter4(rgb_t *res, const rgb_t *rgb00, const rgb_t *rgb01, const rgb_t *rgb10, const rgb_t *rgb11, const UINT8 *u, const UINT8 *v)
+{
+#if defined(__SSE2__) && __SSE2__
+	const __m128i zero = _mm_setzero_si128(), c256 = _mm_set1_epi16(256);
+	const __m128i c00 = _mm_loadu_si128((const __m128i *)rgb00), c01 = _mm_loadu_si128((const __m128i *)rgb01);
+	const __m128i c10 = _mm_loadu_si128((const __m128i *)rgb10), c11 = _mm_loadu_si128((const __m128i *)rgb11);
+
+	/* expand the per pixel weights to 16-bit lanes, 4 lanes per pixel */
+	__m128i wu = _mm_unpacklo_epi8(_mm_cvtsi32_si128(*(const int *)u), zero);
+	__m128i wv = _mm_unpacklo_epi8(_mm_cvtsi32_si128(*(const int *)v), zero);
+	wu = _mm_unpacklo_epi16(wu, wu);
+	wv = _mm_unpacklo_epi16(wv, wv);
+	const __m128i wu01 = _mm_unpacklo_epi32(wu, wu), wu23 = _mm_unpackhi_epi32(wu, wu);
+	const __m128i wv01 = _mm_unpacklo_epi32(wv, wv), wv23 = _mm_unpackhi_epi32(wv, wv);
+
+	/* rows are at most 255*256 so 16-bit multiplies are exact, halve them for the signed multiply-add below */
+	#define VOODOO_SSE2_ROW(A, B, HALF, W) \
+		_mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_unpack##HALF##_epi8(A, zero), _mm_sub_epi16(c256, W)), _mm_mullo_epi16(_mm_unpack##HALF##_epi8(B, zero), W)), 1)
+	const __m128i row0_01 = VOODOO_SSE2_ROW(c00, c01, lo, wu01), row1_01 = VOODOO_SSE2_ROW(c10, c11, lo, wu01);
+	const __m128i row0_23 = VOODOO_SSE2_ROW(c00, c01, hi, wu23), row1_23 = VOODOO_SSE2_ROW(c10, c11, hi, wu23);
+	#undef VOODOO_SSE2_ROW
+
+	/* pair up (row1, row0) with (v, 256-v) and blend the rows */
+	const __m128i sv01 = _mm_unpacklo_epi16(wv01, _mm_sub_epi16(c256, wv01)), sv23 = _mm_unpacklo_epi16(wv23, _mm_sub_epi16(c256, wv23));
+	const __m128i sv1 = _mm_unpackhi_epi16(wv01, _mm_sub_epi16(c256, wv01)), sv3 = _mm_unpackhi_epi16(wv23, _mm_sub_epi16(c256, wv23));
+	const __m128i p0 = _mm_srli_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(row1_01, row0_01), sv01), 15);
+	const __m128i p1 = _mm_srli_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(row1_01, row0_01), sv1), 15);
+	const __m128i p2 = _mm_srli_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(row1_23, row0_23), sv23), 15);
+	const __m128i p3 = _mm_srli_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(row1_23, row0_23), sv3), 15);
+	_mm_storeu_si128((__m128i *)res, _mm_packus_epi16(_mm_packs_epi32(p0, p1), _mm_packs_epi32(p2, p3)));
+#elif defined(DBP_NEON)
+	const uint8x16_t c00 = vld1q_u8((const uint8_t *)rgb00), c01 = vld1q_u8((const uint8_t *)rgb01);
+	const uint8x16_t c10 = vld1q_u8((const uint8_t *)rgb10), c11 = vld1q_u8((const uint8_t *)rgb11);
+	const uint16x8_t c256 = vdupq_n_u16(256);
+	const uint16x8_t wu01 = vcombine_u16(vdup_n_u16(u[0]), vdup_n_u16(u[1])), wu23 = vcombine_u16(vdup_n_u16(u[2]), vdup_n_u16(u[3]));
+	const uint16x8_t wv01 = vcombine_u16(vdup_n_u16(v[0]), vdup_n_u16(v[1])), wv23 = vcombine_u16(vdup_n_u16(v[2]), vdup_n_u16(v[3]));
+	const uint16x8_t wiv01 = vsubq_u16(c256, wv01), wiv23 = vsubq_u16(c256, wv23);
+
+	#define DBP_NEON_ROW(A, B, HALF, W) \
+		vshrq_n_u16(vmlaq_u16(vmulq_u16(vmovl_u8(vget_##HALF##_u8(A)), vsubq_u16(c256, W)), vmovl_u8(vget_##HALF##_u8(B)), W), 1)
+	const uint16x8_t row0_01 = DBP_NEON_ROW(c00, c01, low, wu01), row1_01 = DBP_NEON_ROW(c10, c11, low, wu01);
+	const uint16x8_t row0_23 = DBP_NEON_ROW(c00, c01, high, wu23), row1_23 = DBP_NEON_ROW(c10, c11, high, wu23);
+	#undef DBP_NEON_ROW
+
+	#define DBP_NEON_COL(R0, R1, WV, WIV, HALF) \
+		vmovn_u32(vshrq_n_u32(vmlal_u16(vmull_u16(vget_##HALF##_u16(R1), vget_##HALF##_u16(WV)), vget_##HALF##_u16(R0), vget_##HALF##_u16(WIV)), 15))
+	const uint16x8_t p01 = vcombine_u16(DBP_NEON_COL(row0_01, row1_01, wv01, wiv01, low), DBP_NEON_COL(row0_01, row1_01, wv01, wiv01, high));
+	const uint16x8_t p23 = vcombine_u16(DBP_NEON_COL(row0_23, row1_23, wv23, wiv23, low), DBP_NEON_COL(row0_23, row1_23, wv23, wiv23, high));
+	#undef DBP_NEON_COL
+	vst1q_u8((uint8_t *)res, vcombine_u8(vmovn_u16(p01), vmovn_u16(p23)));
+#else
+	for (int i = 0; i != 4; i++)
+		res[i] = rgba_bilinear_filter(rgb00[i], rgb01[i], rgb10[i], rgb11[i], u[i], v[i]);
+#endif
+}
+
+/* set once check_bilinear_filter verified the 4 pixel filter, otherwise pixels are filtered one by one */
+static bool bilinear_filter4_verified;
+
+/* verify that the 4 pixel filter matches the single pixel filter and that SIMD builds match a per channel reference of their math */
+static bool check_bilinear_filter()
+{
+	UINT32 seed = 0x1234567;
+	for (int n = 0; n != 4096; n++)
+	{
+		rgb_t texels[4][4], res[4];
+		UINT8 u[4], v[4];
+		for (int i = 0; i != 4; i++)
+		{
+			for (int j = 0; j != 4; j++) { seed ^= seed << 13; seed ^= seed >> 17; seed ^= seed << 5; texels[j][i] = seed; }
+			u[i] = (n < 256 ? (UINT8)n : (UINT8)(seed >> 8));
+			v[i] = (n < 256 ? (UINT8)(255 - n) : (UINT8)(seed >> 16));
+		}
+		rgba_bilinear_filter4(res, texels[0], texels[1], texels[2], texels[3], u, v);
+		for (int i = 0; i != 4; i++)
+		{
+			if (res[i] != rgba_bilinear_filter(texels[0][i], texels[1][i], texels[2][i], texels[3][i], u[i], v[i])) return false;
+			#if (defined(__SSE2__) && __SSE2__) || defined(DBP_NEON)
+			rgb_t ref = 0;
+			for (int shift = 0; shift != 32; shift += 8)
+			{
+				UINT32 row0 = ((texels[0][i] >> shift) & 0xff) * (256 - u[i]) + ((texels[1][i] >> shift) & 0xff) * u[i];
+				UINT32 row1 = ((texels[2][i] >> shift) & 0xff) * (256 - u[i]) + ((texels[3][i] >> shift) & 0xff) * u[i];
+				ref |= ((((row1 >> 1) * v[i]) + ((row0 >> 1) * (256 - v[i]))) >> 15) << shift;
+			}
+			if (res[i] != ref) return false;
+			#endif
+		}
+	}
+	return true;
+}
+
 struct poly_vertex
 {
 	float		x;							/* X coordinate */
@@ -284,6 +383,9 @@ enum
 
 enum { MAX_TRIANGLE_THREADS = 7, MAX_TRIANGLE_WORKERS = MAX_TRIANGLE_THREADS + 1 };
 
+/* deferred triangle queue (must be power of two), number of queued triangles per worker wake-up, scanlines per tile band and render state snapshots (must be power of two) */
+enum { TRIANGLE_QUEUE_SIZE = 1024, TRIANGLE_QUEUE_KICK = 32, TRIANGLE_TILE_SHIFT = 3, TRIANGLE_STATE_COUNT = 64 };
+
 /* maximum number of TMUs */
 #define MAX_TMU					2
 
@@ -951,15 +1053,118 @@ struct draw_state
 	bool screen_update_pending;
 };
 
+/* iterated parameters of a triangle, copied so a queued triangle doesn't depend on later register writes */
+struct triangle_iter
+{
+	INT16				ax, ay;					/* vertex A x,y (12.4) */
+	INT32				startr, startg, startb, starta; /* starting R,G,B,A (12.12) */
+	INT32				startz;					/* starting Z (20.12) */
+	INT64				startw;					/* starting W (16.32) */
+	INT32				drdx, dgdx, dbdx, dadx;	/* delta R,G,B,A per X */
+	INT32				dzdx;					/* delta Z per X */
+	INT64				dwdx;					/* delta W per X */
+	INT32				drdy, dgdy, dbdy, dady;	/* delta R,G,B,A per Y */
+	INT32				dzdy;					/* delta Z per Y */
+	INT64				dwdy;					/* delta W per Y */
+	struct tmu_iter
+	{
+		INT64			starts, startt, startw;	/* starting S,T,W */
+		INT64			dsdx, dtdx, dwdx;		/* delta S,T,W per X */
+		INT64			dsdy, dtdy, dwdy;		/* delta S,T,W per Y */
+		INT32			lodbasetemp;			/* lodbase calculated by prepare_tmu */
+	} tmu[MAX_TMU];
+};
+
+/* render state read by the rasterizer, snapshotted so queued triangles don't depend on later register writes */
+/* member names match voodoo_state/fbi_state/tmu_state so the rasterizers can be instantiated for both */
+struct triangle_state
+{
+	voodoo_reg			reg[0x100];				/* FBI registers */
+	struct
+	{
+		UINT8 *			ram;					/* pointer to frame buffer RAM */
+		UINT32			auxoffs;				/* word offset to 1 aux buffer */
+		UINT32			yorigin;				/* Y origin subtract value */
+		UINT32			rowpixels;				/* pixels per row */
+		UINT8			fogblend[64];			/* 64-entry fog table */
+		UINT8			fogdelta[64];			/* 64-entry fog table */
+		UINT8			fogdelta_mask;			/* mask for for delta (0xff for V1, 0xfc for V2) */
+	} fbi;
+	struct tmu_snapshot
+	{
+		UINT8 *			ram;					/* pointer to our RAM */
+		UINT32			mask;					/* mask to apply to pointers */
+		INT32			lodmin, lodmax;			/* min, max LOD values */
+		INT32			lodbias;				/* LOD bias */
+		UINT32			lodmask;				/* mask of available LODs */
+		UINT32			lodoffset[9];			/* offset of texture base for each LOD */
+		INT32			detailmax;				/* detail clamp */
+		INT32			detailbias;				/* detail bias */
+		UINT8			detailscale;			/* detail scale */
+		UINT8			bilinear_mask;			/* mask for bilinear resolution (0xf0 for V1, 0xff for V2) */
+		UINT32			wmask;					/* mask for the current texture width */
+		UINT32			hmask;					/* mask for the current texture height */
+		const rgb_t *	lookup;					/* selected lookup, points to lookup_copy if it can be modified by register writes */
+		rgb_t			lookup_copy[256];		/* copy of a palette or NCC lookup table */
+	} tmu[MAX_TMU];
+	typedef tmu_snapshot tmu_type;
+	UINT32				tmu_config;
+	bool				send_config;
+	UINT32				queue_end;				/* queue position after the last triangle using this state */
+};
+
+struct voodoo_state;
+struct triangle_cmd;
+typedef void (*raster_func)(const triangle_state *v, const triangle_cmd& cmd, INT32 y, const poly_extent *extent, stats_block& stats);
+typedef void (*raster_direct_func)(const voodoo_state *v, const triangle_cmd& cmd, INT32 y, const poly_extent *extent, stats_block& stats);
+
+/* rasterizer for one pipeline configuration */
+struct raster_info
+{
+	raster_func			callback;				/* callback pointer for queued triangles */
+	raster_direct_func	callback_direct;		/* callback pointer for triangles drawn right away from the live state */
+	raster_info *		next;					/* pointer to next entry with the same hash */
+	UINT32				hits;					/* how many triangles used this configuration */
+	UINT32				tmus;					/* number of active TMUs */
+	UINT32				eff_color_path;			/* fbzColorPath value */
+	UINT32				eff_alpha_mode;			/* alphaMode value */
+	UINT32				eff_fog_mode;			/* fogMode value */
+	UINT32				eff_fbz_mode;			/* fbzMode value */
+	UINT32				eff_tex_mode_0;			/* textureMode value for TMU #0 */
+	UINT32				eff_tex_mode_1;			/* textureMode value for TMU #1 */
+};
+
+struct triangle_cmd
+{
+	poly_vertex v1, v2, v3;
+	INT32 v1y, v3y;
+	UINT16 *drawbuf;
+	raster_func raster;
+	UINT32 tmus, texmode0, texmode1;
+	UINT32 workermask;						/* bit set for each worker owning a tile band touched by the triangle */
+	const triangle_state *state;
+	triangle_iter iter;
+};
+
 struct triangle_worker
 {
 	bool threads_active;
 	UINT8 triangle_threads;
-	UINT16 *drawbuf;
-	poly_vertex v1, v2, v3;
-	INT32 v1y, v3y, totalpix;
+	UINT8 threads_running;
+	UINT8 bands;							/* number of tile band owners, with a single worker the emulation thread draws every other band */
+	bool waiting;							/* emulation thread is blocked in triangle_worker_sync, cleared by the thread posting semdone */
+	bool idle[MAX_TRIANGLE_THREADS];		/* worker is blocked on its sembegin, cleared by the thread posting it */
+	UINT32 queue_head;						/* next slot written by the emulation thread */
+	UINT32 queue_published;					/* slots up to here are visible to the workers */
+	UINT32 queue_synced;					/* all slots up to here have been drawn */
+	UINT32 done[MAX_TRIANGLE_THREADS];		/* slots up to here have been drawn by each worker */
+	UINT32 state_head;						/* next render state snapshot slot */
+	triangle_state* state;					/* snapshot of the current render state, NULL after a register write changed it */
+	triangle_state* states;
+	triangle_cmd* queue;
 	Semaphore* sembegin;
-	volatile bool done[MAX_TRIANGLE_THREADS];
+	Semaphore* semdone;
+	Mutex* lock;
 };
 
 struct voodoo_state
@@ -976,6 +1181,7 @@ struct voodoo_state
 
 	fbi_state			fbi;					/* FBI states */
 	tmu_state			tmu[MAX_TMU];			/* TMU states */
+	typedef tmu_state	tmu_type;
 	tmu_shared_state	tmushare;				/* TMU shared state */
 	UINT32				tmu_config;
 
@@ -1850,20 +2056,18 @@ while (0)
 
 /*************************************
  *
- *  Texture pipeline macro
+ *  Texture pipeline macros
  *
  *************************************/
 
-#define TEXTURE_PIPELINE(TT, XX, DITHER4, TEXMODE, COTHER, LOOKUP, LODBASE, ITERS, ITERT, ITERW, RESULT) \
+/* determine S/T/LOD and fetch the texel(s), handing the result to POINT_SAMPLED(texel) or BILINEAR(texel0..3, sfrac, tfrac) */
+#define TEXTURE_FETCH(TT, XX, DITHER4, TEXMODE, LOOKUP, LODBASE, ITERS, ITERT, ITERW, LOD, POINT_SAMPLED, BILINEAR) \
 do																				\
 {																				\
-	INT32 blendr, blendg, blendb, blenda;										\
-	INT32 tr, tg, tb, ta;														\
 	INT32 s, t, lod, ilod;														\
 	INT64 oow;																	\
 	INT32 smax, tmax;															\
 	UINT32 texbase;																\
-	rgb_union c_local;															\
 																				\
 	/* determine the S/T/LOD values for this texture */							\
 	if (TEXMODE_ENABLE_PERSPECTIVE(TEXMODE))									\
@@ -1931,16 +2135,16 @@ do																				\
 		if (TEXMODE_FORMAT(TEXMODE) < 8)										\
 		{																		\
 			texel0 = *(UINT8 *)&(TT)->ram[(texbase + t + s) & (TT)->mask];		\
-			c_local.u = (LOOKUP)[texel0];										\
+			POINT_SAMPLED((LOOKUP)[texel0]);									\
 		}																		\
 		else																	\
 		{																		\
 			texel0 = *(UINT16 *)&(TT)->ram[(texbase + 2*(t + s)) & (TT)->mask];	\
 			if (TEXMODE_FORMAT(TEXMODE) >= 10 && TEXMODE_FORMAT(TEXMODE) <= 12)	\
-				c_local.u = (LOOKUP)[texel0];									\
+				POINT_SAMPLED((LOOKUP)[texel0]);								\
 			else																\
-				c_local.u = ((LOOKUP)[texel0 & 0xff] & 0xffffff) |				\
-							((texel0 & 0xff00) << 16);							\
+				POINT_SAMPLED(((LOOKUP)[texel0 & 0xff] & 0xffffff) |			\
+							((texel0 & 0xff00) << 16));							\
 		}																		\
 	}																			\
 	else																		\
@@ -2027,9 +2231,23 @@ do																				\
 		}																		\
 																				\
 		/* weigh in each texel */												\
-		c_local.u = rgba_bilinear_filter(texel0, texel1, texel2, texel3, sfrac, tfrac);\
+		BILINEAR(texel0, texel1, texel2, texel3, sfrac, tfrac);					\
 	}																			\
 																				\
+	(LOD) = lod;																\
+}																				\
+while (0)
+
+/* combine a fetched texel with the output of the upstream TMU */
+#define TEXTURE_COMBINE(TT, TEXMODE, COTHER, CLOCAL, LOD, RESULT)				\
+do																				\
+{																				\
+	INT32 blendr, blendg, blendb, blenda;										\
+	INT32 tr, tg, tb, ta;														\
+	const INT32 lod = (LOD);													\
+	rgb_union c_local;														\
+	c_local.u = (CLOCAL);													\
+																				\
 	/* select zero/other for RGB */												\
 	if (!TEXMODE_TC_ZERO_OTHER(TEXMODE))										\
 	{																			\
@@ -2187,6 +2405,20 @@ do																				\
 }																				\
 while (0)
 
+/* texture lookup and combine of a single pixel */
+#define TEXTURE_PIPELINE(TT, XX, DITHER4, TEXMODE, COTHER, LOOKUP, LODBASE, ITERS, ITERT, ITERW, RESULT) \
+do																				\
+{																				\
+	rgb_t tex_local;															\
+	INT32 tex_lod;																\
+	TEXTURE_FETCH(TT, XX, DITHER4, TEXMODE, LOOKUP, LODBASE, ITERS, ITERT, ITERW,\
+		tex_lod, TEXTURE_POINT_SAMPLED, TEXTURE_BILINEAR);						\
+	TEXTURE_COMBINE(TT, TEXMODE, COTHER, tex_local, tex_lod, RESULT);			\
+}																				\
+while (0)
+#define TEXTURE_POINT_SAMPLED(TEXEL) tex_local = (TEXEL)
+#define TEXTURE_BILINEAR(TEXEL0, TEXEL1, TEXEL2, TEXEL3, SFRAC, TFRAC) tex_local = rgba_bilinear_filter(TEXEL0, TEXEL1, TEXEL2, TEXEL3, SFRAC, TFRAC)
+
 
 
 /*************************************
@@ -2195,13 +2427,8 @@ while (0)
  *
  *************************************/
 
-#define PIXEL_PIPELINE_BEGIN(VV, STATS, XX, YY, FBZCOLORPATH, FBZMODE, ITERZ, ITERW, ZACOLOR, STIPPLE)	\
-do																				\
-{																				\
-	INT32 depthval, wfloat;														\
-	INT32 prefogr, prefogg, prefogb;											\
-	INT32 r, g, b, a;															\
-																				\
+/* stippling and depth test, jumps to SKIP if the pixel gets rejected */
+#define PIXEL_PIPELINE_DEPTH(STATS, XX, YY, FBZCOLORPATH, FBZMODE, ITERZ, ITERW, ZACOLOR, STIPPLE, DEPTHVAL, WFLOAT, SKIP)	\
 	/* apply clipping */														\
 	/* note that for perf reasons, we assume the caller has done clipping */	\
 																				\
@@ -2214,7 +2441,7 @@ do																				\
 			(STIPPLE) = ((STIPPLE) << 1) | ((STIPPLE) >> 31);					\
 			if (((STIPPLE) & 0x80000000) == 0)									\
 			{																	\
-				goto skipdrawdepth;												\
+				goto SKIP;														\
 			}																	\
 		}																		\
 																				\
@@ -2224,46 +2451,46 @@ do																				\
 			int stipple_index = (((YY) & 3) << 3) | (~(XX) & 7);				\
 			if ((((STIPPLE) >> stipple_index) & 1) == 0)						\
 			{																	\
-				goto skipdrawdepth;												\
+				goto SKIP;														\
 			}																	\
 		}																		\
 	}																			\
 																				\
 	/* compute "floating point" W value (used for depth and fog) */				\
 	if ((ITERW) & LONGTYPE(0xffff00000000))										\
-		wfloat = 0x0000;														\
+		(WFLOAT) = 0x0000;														\
 	else																		\
 	{																			\
 		UINT32 temp = (UINT32)(ITERW);											\
 		if ((temp & 0xffff0000) == 0)											\
-			wfloat = 0xffff;													\
+			(WFLOAT) = 0xffff;													\
 		else																	\
 		{																		\
 			int exp = count_leading_zeros(temp);								\
-			wfloat = ((exp << 12) | ((~temp >> (19 - exp)) & 0xfff));			\
-			if (wfloat < 0xffff) wfloat++;										\
+			(WFLOAT) = ((exp << 12) | ((~temp >> (19 - exp)) & 0xfff));			\
+			if ((WFLOAT) < 0xffff) (WFLOAT)++;									\
 		}																		\
 	}																			\
 																				\
 	/* compute depth value (W or Z) for this pixel */							\
 	if (FBZMODE_WBUFFER_SELECT(FBZMODE) == 0)									\
-		CLAMPED_Z(ITERZ, FBZCOLORPATH, depthval);								\
+		CLAMPED_Z(ITERZ, FBZCOLORPATH, (DEPTHVAL));								\
 	else if (FBZMODE_DEPTH_FLOAT_SELECT(FBZMODE) == 0)							\
-		depthval = wfloat;														\
+		(DEPTHVAL) = (WFLOAT);													\
 	else																		\
 	{																			\
 		if ((ITERZ) & 0xf0000000)												\
-			depthval = 0x0000;													\
+			(DEPTHVAL) = 0x0000;												\
 		else																	\
 		{																		\
 			UINT32 temp = (ITERZ) << 4;											\
 			if ((temp & 0xffff0000) == 0)										\
-				depthval = 0xffff;												\
+				(DEPTHVAL) = 0xffff;											\
 			else																\
 			{																	\
 				int exp = count_leading_zeros(temp);							\
-				depthval = ((exp << 12) | ((~temp >> (19 - exp)) & 0xfff));		\
-				if (depthval < 0xffff) depthval++;								\
+				(DEPTHVAL) = ((exp << 12) | ((~temp >> (19 - exp)) & 0xfff));	\
+				if ((DEPTHVAL) < 0xffff) (DEPTHVAL)++;							\
 			}																	\
 		}																		\
 	}																			\
@@ -2271,8 +2498,8 @@ do																				\
 	/* add the bias */															\
 	if (FBZMODE_ENABLE_DEPTH_BIAS(FBZMODE))										\
 	{																			\
-		depthval += (INT16)(ZACOLOR);											\
-		CLAMP(depthval, 0, 0xffff);												\
+		(DEPTHVAL) += (INT16)(ZACOLOR);											\
+		CLAMP((DEPTHVAL), 0, 0xffff);											\
 	}																			\
 																				\
 	/* handle depth buffer testing */											\
@@ -2283,7 +2510,7 @@ do																				\
 		/* the source depth is either the iterated W/Z+bias or a */				\
 		/* constant value */													\
 		if (FBZMODE_DEPTH_SOURCE_COMPARE(FBZMODE) == 0)							\
-			depthsource = depthval;												\
+			depthsource = (DEPTHVAL);											\
 		else																	\
 			depthsource = (UINT16)(ZACOLOR);									\
 																				\
@@ -2292,14 +2519,14 @@ do																				\
 		{																		\
 			case 0:		/* depthOP = never */									\
 				ADD_STAT_COUNT(STATS, zfunc_fail)								\
-				goto skipdrawdepth;												\
+				goto SKIP;														\
 																				\
 			case 1:		/* depthOP = less than */								\
 				if (depth)														\
 					if (depthsource >= depth[XX])								\
 					{															\
 						ADD_STAT_COUNT(STATS, zfunc_fail)						\
-						goto skipdrawdepth;										\
+						goto SKIP;												\
 					}															\
 				break;															\
 																				\
@@ -2308,7 +2535,7 @@ do																				\
 					if (depthsource != depth[XX])								\
 					{															\
 						ADD_STAT_COUNT(STATS, zfunc_fail)						\
-						goto skipdrawdepth;										\
+						goto SKIP;												\
 					}															\
 				break;															\
 																				\
@@ -2317,7 +2544,7 @@ do																				\
 					if (depthsource > depth[XX])								\
 					{															\
 						ADD_STAT_COUNT(STATS, zfunc_fail)						\
-						goto skipdrawdepth;										\
+						goto SKIP;												\
 					}															\
 				break;															\
 																				\
@@ -2326,7 +2553,7 @@ do																				\
 					if (depthsource <= depth[XX])								\
 					{															\
 						ADD_STAT_COUNT(STATS, zfunc_fail)						\
-						goto skipdrawdepth;										\
+						goto SKIP;												\
 					}															\
 				break;															\
 																				\
@@ -2335,7 +2562,7 @@ do																				\
 					if (depthsource == depth[XX])								\
 					{															\
 						ADD_STAT_COUNT(STATS, zfunc_fail)						\
-						goto skipdrawdepth;										\
+						goto SKIP;												\
 					}															\
 				break;															\
 																				\
@@ -2344,7 +2571,7 @@ do																				\
 					if (depthsource < depth[XX])								\
 					{															\
 						ADD_STAT_COUNT(STATS, zfunc_fail)						\
-						goto skipdrawdepth;										\
+						goto SKIP;												\
 					}															\
 				break;															\
 																				\
@@ -2354,6 +2581,26 @@ do																				\
 	}
 
 
+#define PIXEL_PIPELINE_BEGIN(VV, STATS, XX, YY, FBZCOLORPATH, FBZMODE, ITERZ, ITERW, ZACOLOR, STIPPLE)	\
+do																				\
+{																				\
+	INT32 depthval, wfloat;														\
+	INT32 prefogr, prefogg, prefogb;											\
+	INT32 r, g, b, a;															\
+																				\
+	PIXEL_PIPELINE_DEPTH(STATS, XX, YY, FBZCOLORPATH, FBZMODE, ITERZ, ITERW,	\
+						ZACOLOR, STIPPLE, depthval, wfloat, skipdrawdepth);
+
+
+/* same as PIXEL_PIPELINE_BEGIN for a pixel that already passed PIXEL_PIPELINE_DEPTH */
+#define PIXEL_PIPELINE_BEGIN_TESTED(DEPTHVAL, WFLOAT)							\
+do																				\
+{																				\
+	INT32 depthval = (DEPTHVAL), wfloat = (WFLOAT);								\
+	INT32 prefogr, prefogg, prefogb;											\
+	INT32 r, g, b, a;
+
+
 #define PIXEL_PIPELINE_MODIFY(VV, DITHER, DITHER4, XX, FBZMODE, FBZCOLORPATH, ALPHAMODE, FOGMODE, ITERZ, ITERW, ITERAXXX) \
 																				\
 	/* perform fogging */														\
@@ -5021,7 +5268,41 @@ static double Voodoo_GetHRetracePosition();
     RASTERIZER MANAGEMENT
 ***************************************************************************/
 
-static INLINE void raster_generic(const voodoo_state *v, UINT32 TMUS, UINT32 TEXMODE0, UINT32 TEXMODE1, void *destbase, INT32 y, const poly_extent *extent, stats_block& stats)
+/* texture lookups of the pixels in a block of up to 4 that passed the depth test with the bilinear filter running on all of them at once */
+/* point sampled and rejected pixels are passed through the filter as 4 equal texels which results in the texel itself */
+template <class TMU>
+static INLINE void texture_fetch_block(const TMU *tt, INT32 x, INT32 count, UINT32 passmask, const UINT8 *dither4, UINT32 TEXMODE, INT32 lodbase,
+	INT64 iters, INT64 itert, INT64 iterw, INT64 dsdx, INT64 dtdx, INT64 dwdx, rgb_t *result, INT32 *resultlod)
+{
+	rgb_t texels[4][4];
+	UINT8 sfracs[4], tfracs[4];
+	const rgb_t* const lookup = tt->lookup;
+	INT32 i = 0;
+	#define TEXTURE_POINT_SAMPLED_BLOCK(TEXEL) (texels[0][i] = texels[1][i] = texels[2][i] = texels[3][i] = (TEXEL), sfracs[i] = tfracs[i] = 0)
+	#define TEXTURE_BILINEAR_BLOCK(TEXEL0, TEXEL1, TEXEL2, TEXEL3, SFRAC, TFRAC) (texels[0][i] = (TEXEL0), texels[1][i] = (TEXEL1), \
+		texels[2][i] = (TEXEL2), texels[3][i] = (TEXEL3), sfracs[i] = (SFRAC), tfracs[i] = (TFRAC))
+	for (; i != count; i++, iters += dsdx, itert += dtdx, iterw += dwdx)
+	{
+		if (!(passmask & (1 << i)))
+		{
+			TEXTURE_POINT_SAMPLED_BLOCK(0);
+			continue;
+		}
+		TEXTURE_FETCH(tt, x + i, dither4, TEXMODE, lookup, lodbase, iters, itert, iterw,
+			resultlod[i], TEXTURE_POINT_SAMPLED_BLOCK, TEXTURE_BILINEAR_BLOCK);
+	}
+	for (; i != 4; i++)
+		TEXTURE_POINT_SAMPLED_BLOCK(0);
+	#undef TEXTURE_POINT_SAMPLED_BLOCK
+	#undef TEXTURE_BILINEAR_BLOCK
+	if (GCC_LIKELY(bilinear_filter4_verified))
+		rgba_bilinear_filter4(result, texels[0], texels[1], texels[2], texels[3], sfracs, tfracs);
+	else for (i = 0; i != 4; i++)
+		result[i] = rgba_bilinear_filter(texels[0][i], texels[1][i], texels[2][i], texels[3][i], sfracs[i], tfracs[i]);
+}
+
+template <class STATE>
+static INLINE void raster_pipeline(const STATE *v, const triangle_iter& iter, UINT32 TMUS, UINT32 TEXMODE0, UINT32 TEXMODE1, UINT32 r_fbzColorPath, UINT32 r_alphaMode, UINT32 r_fogMode, UINT32 r_fbzMode, void *destbase, INT32 y, const poly_extent *extent, stats_block& stats)
 {
 	DECLARE_DITHER_POINTERS;
 
@@ -5029,13 +5310,9 @@ static INLINE void raster_generic(const voodoo_state *v, UINT32 TMUS, UINT32 TEX
 	INT32 startx = extent->startx;
 	INT32 stopx = extent->stopx;
 
-	const fbi_state& fbi = v->fbi;
-	const tmu_state& tmu0 = v->tmu[0];
-	const tmu_state& tmu1 = v->tmu[1];
-	UINT32 r_fbzColorPath = v->reg[fbzColorPath].u;
-	UINT32 r_fbzMode = v->reg[fbzMode].u;
-	UINT32 r_alphaMode = v->reg[alphaMode].u;
-	UINT32 r_fogMode = v->reg[fogMode].u;
+	const triangle_iter& fbi = iter;
+	const triangle_iter::tmu_iter& tmu0 = iter.tmu[0];
+	const triangle_iter::tmu_iter& tmu1 = iter.tmu[1];
 	UINT32 r_zaColor = v->reg[zaColor].u;
 	UINT32 r_stipple = v->reg[stipple].u;
 
@@ -5113,35 +5390,77 @@ static INLINE void raster_generic(const voodoo_state *v, UINT32 TMUS, UINT32 TEX
 		itert1 = tmu1.startt + dy * tmu1.dtdy + dx * tmu1.dtdx;
 	}
 
+	/* pixels are depth tested in blocks of 4 ahead of the rest of the pixel pipeline */
+	/* a pixel only ever tests its own depth buffer entry so this gives the same result as testing one by one */
+	/* TMUs with bilinear filtering then fetch the texels of the pixels that passed with one filter call per block */
+	const bool block_tmu1 = (TMUS >= 2 && v->tmu[1].lodmin < (8 << 8) && (TEXMODE_MINIFICATION_FILTER(TEXMODE1) || TEXMODE_MAGNIFICATION_FILTER(TEXMODE1)));
+	const bool block_tmu0 = (TMUS >= 1 && v->tmu[0].lodmin < (8 << 8) && !v->send_config && (TEXMODE_MINIFICATION_FILTER(TEXMODE0) || TEXMODE_MAGNIFICATION_FILTER(TEXMODE0)));
+	rgb_t block_texel[MAX_TMU][4];
+	INT32 block_lod[MAX_TMU][4];
+	INT32 block_depthval[4] = { 0 }, block_wfloat[4] = { 0 };
+	UINT32 block_pass = 0;
+
 	/* loop in X */
 	for (INT32 x = startx; x < stopx; x++)
 	{
 		rgb_union iterargb = { 0 };
 		rgb_union texel = { 0 };
 
-		/* pixel pipeline part 1 handles depth testing and stippling */
-		PIXEL_PIPELINE_BEGIN(v, stats, x, y, r_fbzColorPath, r_fbzMode, iterz, iterw, r_zaColor, r_stipple);
+		const INT32 blockpos = (x - startx) & 3;
+		if (!blockpos)
+		{
+			const INT32 count = (stopx - x < 4 ? stopx - x : 4);
+			INT32 blockz = iterz;
+			INT64 blockw = iterw;
+			block_pass = 0;
+			for (INT32 i = 0; i != count; i++, blockz += fbi.dzdx, blockw += fbi.dwdx)
+			{
+				/* pixel pipeline part 1 handles depth testing and stippling */
+				PIXEL_PIPELINE_DEPTH(stats, x + i, y, r_fbzColorPath, r_fbzMode, blockz, blockw, r_zaColor, r_stipple,
+									block_depthval[i], block_wfloat[i], skipblockdepth);
+				block_pass |= (1 << i);
+				skipblockdepth:;
+			}
+			if (block_pass && block_tmu1)
+				texture_fetch_block(&v->tmu[1], x, count, block_pass, dither4, TEXMODE1, tmu1.lodbasetemp, iters1, itert1, iterw1,
+									tmu1.dsdx, tmu1.dtdx, tmu1.dwdx, block_texel[1], block_lod[1]);
+			if (block_pass && block_tmu0)
+				texture_fetch_block(&v->tmu[0], x, count, block_pass, dither4, TEXMODE0, tmu0.lodbasetemp, iters0, itert0, iterw0,
+									tmu0.dsdx, tmu0.dtdx, tmu0.dwdx, block_texel[0], block_lod[0]);
+		}
+
+		PIXEL_PIPELINE_BEGIN_TESTED(block_depthval[blockpos], block_wfloat[blockpos]);
+		if (!(block_pass & (1 << blockpos)))
+			goto skipdrawdepth;
 
 		/* run the texture pipeline on TMU1 to produce a value in texel */
 		/* note that they set LOD min to 8 to "disable" a TMU */
 
 		if (TMUS >= 2 && v->tmu[1].lodmin < (8 << 8)) {
-			const tmu_state* const tmus = &v->tmu[1];
-			const rgb_t* const lookup = tmus->lookup;
-			TEXTURE_PIPELINE(tmus, x, dither4, TEXMODE1, texel,
-								lookup, tmus->lodbasetemp,
-								iters1, itert1, iterw1, texel);
+			const typename STATE::tmu_type* const tmus = &v->tmu[1];
+			if (block_tmu1)
+				TEXTURE_COMBINE(tmus, TEXMODE1, texel, block_texel[1][blockpos], block_lod[1][blockpos], texel);
+			else
+			{
+				const rgb_t* const lookup = tmus->lookup;
+				TEXTURE_PIPELINE(tmus, x, dither4, TEXMODE1, texel,
+									lookup, tmu1.lodbasetemp,
+									iters1, itert1, iterw1, texel);
+			}
 		}
 
 		/* run the texture pipeline on TMU0 to produce a final */
 		/* result in texel */
 		/* note that they set LOD min to 8 to "disable" a TMU */
 		if (TMUS >= 1 && v->tmu[0].lodmin < (8 << 8)) {
-			if (!v->send_config) {
-				const tmu_state* const tmus = &v->tmu[0];
+			if (block_tmu0) {
+				const typename STATE::tmu_type* const tmus = &v->tmu[0];
+				TEXTURE_COMBINE(tmus, TEXMODE0, texel, block_texel[0][blockpos], block_lod[0][blockpos], texel);
+			} else if (!v->send_config) {
+				const typename STATE::tmu_type* const tmus = &v->tmu[0];
 				const rgb_t* const lookup = tmus->lookup;
 				TEXTURE_PIPELINE(tmus, x, dither4, TEXMODE0, texel,
-								lookup, tmus->lodbasetemp,
+								lookup, tmu0.lodbasetemp,
 								iters0, itert0, iterw0, texel);
 			} else {	/* send config data to the frame buffer */
 				texel.u=v->tmu_config;
@@ -5403,6 +5722,158 @@ static INLINE void raster_generic(const voodoo_state *v, UINT32 TMUS, UINT32 TEX
 	}
 }
 
+/*-------------------------------------------------
+    raster_generic - rasterizer reading the
+    pipeline configuration from the registers
+-------------------------------------------------*/
+template <class STATE>
+static void raster_generic(const STATE *v, const triangle_cmd& cmd, INT32 y, const poly_extent *extent, stats_block& stats)
+{
+	raster_pipeline(v, cmd.iter, cmd.tmus, cmd.texmode0, cmd.texmode1,
+		v->reg[fbzColorPath].u, v->reg[alphaMode].u, v->reg[fogMode].u, v->reg[fbzMode].u, cmd.drawbuf, y, extent, stats);
+}
+
+/*-------------------------------------------------
+    raster_specialized - rasterizer with the
+    pipeline configuration known at compile time
+    so the per-pixel mode branches fold away
+-------------------------------------------------*/
+template <class STATE, UINT32 TMUS, UINT32 FBZCOLORPATH, UINT32 ALPHAMODE, UINT32 FOGMODE, UINT32 FBZMODE, UINT32 TEXMODE0, UINT32 TEXMODE1>
+static void raster_specialized(const STATE *v, const triangle_cmd& cmd, INT32 y, const poly_extent *extent, stats_block& stats)
+{
+	raster_pipeline(v, cmd.iter, TMUS, TEXMODE0, TEXMODE1, FBZCOLORPATH, ALPHAMODE, FOGMODE, FBZMODE, cmd.drawbuf, y, extent, stats);
+}
+
+/*-------------------------------------------------
+    Rasterizer table, one entry per pipeline
+    configuration (texmode 0 for unused TMUs).
+    Configurations seen at runtime are counted in
+    raster_info::hits, enable LOG_RASTERIZERS to
+    dump the most used ones in this format.
+-------------------------------------------------*/
+#define RASTERIZER_ENTRY(TMUS, FBZCP, ALPHAMODE, FOGMODE, FBZMODE, TEXMODE0, TEXMODE1) \
+	{ raster_specialized<triangle_state, TMUS, FBZCP, ALPHAMODE, FOGMODE, FBZMODE, TEXMODE0, TEXMODE1>,	\
+	  raster_specialized<voodoo_state, TMUS, FBZCP, ALPHAMODE, FOGMODE, FBZMODE, TEXMODE0, TEXMODE1>, NULL, 0, TMUS, FBZCP, ALPHAMODE, FOGMODE, FBZMODE, TEXMODE0, TEXMODE1 },
+
+static raster_info raster_table[] =
+{
+	/*               tmus fbzColorPath alphaMode   fogMode     fbzMode     texMode0    texMode1 */
+	/* gouraud shaded, depth buffered, dithered */
+	RASTERIZER_ENTRY( 0, 0x00C26100, 0x00000000, 0x00000000, 0x00004731, 0x00000000, 0x00000000 )
+	RASTERIZER_ENTRY( 0, 0x00C26100, 0x00000000, 0x00000000, 0x00004739, 0x00000000, 0x00000000 )
+	/* texture modulated by iterated RGB, point sampled and bilinear, RGB565, Z and W buffered */
+	RASTERIZER_ENTRY( 1, 0x08C22401, 0x00000000, 0x00000000, 0x00004731, 0x0C261A01, 0x00000000 )
+	RASTERIZER_ENTRY( 1, 0x08C22401, 0x00000000, 0x00000000, 0x00004731, 0x0C261A07, 0x00000000 )
+	RASTERIZER_ENTRY( 1, 0x08C22401, 0x00000000, 0x00000000, 0x00004739, 0x0C261A01, 0x00000000 )
+	RASTERIZER_ENTRY( 1, 0x08C22401, 0x00000000, 0x00000000, 0x00004739, 0x0C261A07, 0x00000000 )
+	/* same with fog table enabled */
+	RASTERIZER_ENTRY( 1, 0x08C22401, 0x00000000, 0x00000001, 0x00004739, 0x0C261A01, 0x00000000 )
+	RASTERIZER_ENTRY( 1, 0x08C22401, 0x00000000, 0x00000001, 0x00004739, 0x0C261A07, 0x00000000 )
+	/* alpha blended texture (src alpha, one minus src alpha), no depth write */
+	RASTERIZER_ENTRY( 1, 0x08C22401, 0x00005110, 0x00000000, 0x00004331, 0x0C261A07, 0x00000000 )
+	/* 8-bit palettized texture modulated by iterated RGB, W buffered */
+	RASTERIZER_ENTRY( 1, 0x08C22401, 0x00000000, 0x00000000, 0x00004739, 0x0C261501, 0x00000000 )
+	RASTERIZER_ENTRY( 1, 0x08C22401, 0x00000000, 0x00000000, 0x00004739, 0x0C261507, 0x00000000 )
+};
+#undef RASTERIZER_ENTRY
+
+enum { RASTER_HASH_SIZE = 97, RASTER_PROFILE_MAX = 1024 };
+static raster_info* raster_hash[RASTER_HASH_SIZE];
+static raster_info raster_profile[RASTER_PROFILE_MAX];
+static raster_info raster_fallback = { raster_generic<triangle_state>, raster_generic<voodoo_state> };
+static raster_info* raster_last;
+static UINT32 raster_profile_count;
+
+static INLINE UINT32 compute_raster_hash(UINT32 tmus, UINT32 fbzcp, UINT32 alphamode, UINT32 fogmode, UINT32 fbzmode, UINT32 texmode0, UINT32 texmode1)
+{
+	UINT32 hash = tmus;
+	hash = (hash << 1) ^ fbzcp;
+	hash = (hash << 1) ^ alphamode;
+	hash = (hash << 1) ^ fogmode;
+	hash = (hash << 1) ^ fbzmode;
+	hash = (hash << 1) ^ texmode0;
+	hash = (hash << 1) ^ texmode1;
+	return hash % RASTER_HASH_SIZE;
+}
+
+static void init_rasterizers()
+{
+	if (raster_last) return;
+	for (raster_info *info = raster_table; info != raster_table + ARRAY_LENGTH(raster_table); info++)
+	{
+		UINT32 hash = compute_raster_hash(info->tmus, info->eff_color_path, info->eff_alpha_mode, info->eff_fog_mode, info->eff_fbz_mode, info->eff_tex_mode_0, info->eff_tex_mode_1);
+		info->next = raster_hash[hash];
+		raster_hash[hash] = info;
+	}
+	raster_last = &raster_fallback;
+}
+
+/*-------------------------------------------------
+    find_rasterizer - find a specialized rasterizer
+    for the configuration, unknown configurations
+    get a generic entry so their hits are counted
+-------------------------------------------------*/
+static raster_info *find_rasterizer(UINT32 tmus, UINT32 fbzcp, UINT32 alphamode, UINT32 fogmode, UINT32 fbzmode, UINT32 texmode0, UINT32 texmode1)
+{
+	#define RASTER_MATCHES(info) (info->eff_fbz_mode == fbzmode && info->eff_color_path == fbzcp && info->eff_tex_mode_0 == texmode0 && info->tmus == tmus \
+		&& info->eff_alpha_mode == alphamode && info->eff_fog_mode == fogmode && info->eff_tex_mode_1 == texmode1)
+
+	/* consecutive triangles usually share the same configuration */
+	raster_info *info = raster_last;
+	if (RASTER_MATCHES(info) && info != &raster_fallback)
+		return info;
+
+	UINT32 hash = compute_raster_hash(tmus, fbzcp, alphamode, fogmode, fbzmode, texmode0, texmode1);
+	for (info = raster_hash[hash]; info; info = info->next)
+		if (RASTER_MATCHES(info))
+			return (raster_last = info);
+	#undef RASTER_MATCHES
+
+	if (raster_profile_count == RASTER_PROFILE_MAX)
+		return &raster_fallback;
+
+	info = &raster_profile[raster_profile_count++];
+	info->callback = raster_generic<triangle_state>;
+	info->callback_direct = raster_generic<voodoo_state>;
+	info->hits = 0;
+	info->tmus = tmus;
+	info->eff_color_path = fbzcp;
+	info->eff_alpha_mode = alphamode;
+	info->eff_fog_mode = fogmode;
+	info->eff_fbz_mode = fbzmode;
+	info->eff_tex_mode_0 = texmode0;
+	info->eff_tex_mode_1 = texmode1;
+	info->next = raster_hash[hash];
+	raster_hash[hash] = info;
+	return (raster_last = info);
+}
+
+static int compare_raster_hits(const void *a, const void *b)
+{
+	UINT32 ha = (*(const raster_info* const*)a)->hits, hb = (*(const raster_info* const*)b)->hits;
+	return (ha < hb ? 1 : (ha > hb ? -1 : 0));
+}
+
+static void dump_rasterizer_stats()
+{
+	raster_info* sorted[ARRAY_LENGTH(raster_table) + RASTER_PROFILE_MAX];
+	UINT32 count = 0;
+	for (UINT32 i = 0; i != RASTER_HASH_SIZE; i++)
+		for (raster_info *info = raster_hash[i]; info; info = info->next)
+			if (info->hits)
+				sorted[count++] = info;
+	qsort(sorted, count, sizeof(sorted[0]), compare_raster_hits);
+
+	LOG_MSG("VOODOO: Rasterizer usage (%u configurations, %u untracked triangles)", count, raster_fallback.hits);
+	for (UINT32 i = 0; i != count && i != 64; i++)
+	{
+		const raster_info *info = sorted[i];
+		LOG_MSG("	RASTERIZER_ENTRY( %u, 0x%08X, 0x%08X, 0x%08X, 0x%08X, 0x%08X, 0x%08X ) /* %10u %s */",
+			info->tmus, info->eff_color_path, info->eff_alpha_mode, info->eff_fog_mode, info->eff_fbz_mode, info->eff_tex_mode_0, info->eff_tex_mode_1,
+			info->hits, (info->callback == raster_generic<triangle_state> ? "generic" : "specialized"));
+	}
+}
+
 /***************************************************************************
     GENERIC RASTERIZERS
 ***************************************************************************/
@@ -6015,7 +6486,7 @@ static void accumulate_statistics(voodoo_state *v, const stats_block *stats)
 static void update_statistics(voodoo_state *v, bool accumulate)
 {
 	/* accumulate/reset statistics from all units */
-	for (size_t i = 0; i != v->tworker.triangle_threads; i++)
+	for (size_t i = 0; i != MAX_TRIANGLE_WORKERS; i++)
 	{
 		if (accumulate)
 			accumulate_statistics(v, &v->thread_stats[i]);
@@ -6033,37 +6504,25 @@ static void update_statistics(voodoo_state *v, bool accumulate)
     COMMAND HANDLERS
 ***************************************************************************/
 
-static void triangle_worker_work(triangle_worker& tworker, INT32 worktstart, INT32 worktend)
+template <class STATE>
+static void triangle_worker_draw(const STATE *state, void (*raster)(const STATE*, const triangle_cmd&, INT32, const poly_extent*, stats_block&),
+	const triangle_cmd& cmd, UINT32 worker, UINT32 workers, stats_block& stats)
 {
-	/* determine the number of TMUs involved */
-	UINT32 tmus = 0, texmode0 = 0, texmode1 = 0;
-	if (!FBIINIT3_DISABLE_TMUS(v->reg[fbiInit3].u) && FBZCP_TEXTURE_ENABLE(v->reg[fbzColorPath].u))
-	{
-		tmus = 1;
-		texmode0 = v->tmu[0].reg[textureMode].u;
-		if (v->chipmask & 0x04)
-		{
-			tmus = 2;
-			texmode1 = v->tmu[1].reg[textureMode].u;
-		}
-		if (v_perf & V_PERFFLAG_LOWQUALITY) //force disable bilinear filter
-		{
-			texmode0 &= ~6;
-			texmode1 &= ~6;
-		}
-	}
-
 	/* compute the slopes for each portion of the triangle */
-	poly_vertex v1 = tworker.v1, v2 = tworker.v2, v3 = tworker.v3;
+	const poly_vertex &v1 = cmd.v1, &v2 = cmd.v2, &v3 = cmd.v3;
 	float dxdy_v1v2 = (v2.y == v1.y) ? 0.0f : (v2.x - v1.x) / (v2.y - v1.y);
 	float dxdy_v1v3 = (v3.y == v1.y) ? 0.0f : (v3.x - v1.x) / (v3.y - v1.y);
 	float dxdy_v2v3 = (v3.y == v2.y) ? 0.0f : (v3.x - v2.x) / (v3.y - v2.y);
 
-	stats_block my_stats = {0};
-	INT32 from = tworker.totalpix * worktstart / (tworker.triangle_threads + 1);
-	INT32 to   = tworker.totalpix * worktend   / (tworker.triangle_threads + 1);
-	for (INT32 curscan = tworker.v1y, scanend = tworker.v3y, sumpix = 0, lastsum = 0; curscan != scanend && lastsum < to; lastsum = sumpix, curscan++)
+	for (INT32 curscan = cmd.v1y, scanend = cmd.v3y; curscan < scanend; curscan++)
 	{
+		/* tile bands of scanlines are distributed round-robin over the workers */
+		if (workers > 1 && (UINT32)(curscan >> TRIANGLE_TILE_SHIFT) % workers != worker)
+		{
+			curscan |= (1 << TRIANGLE_TILE_SHIFT) - 1;
+			continue;
+		}
+
 		float fully = (float)(curscan) + 0.5f;
 		float startx = v1.x + (fully - v1.y) * dxdy_v1v3;
 
@@ -6082,96 +6541,173 @@ static void triangle_worker_work(triangle_worker& tworker, INT32 worktstart, INT
 			std::swap(extent.startx, extent.stopx);
 		}
 
-		sumpix += (extent.stopx - extent.startx);
-
-		if (sumpix <= from)
-			continue;
-		if (lastsum < from)
-			extent.startx += (from - lastsum);
-		if (sumpix > to)
-			extent.stopx -= (sumpix - to);
-
-		raster_generic(v, tmus, texmode0, texmode1, tworker.drawbuf, curscan, &extent, my_stats);
+		raster(state, cmd, curscan, &extent, stats);
 	}
-	sum_statistics(&v->thread_stats[worktstart], &my_stats);
 }
 
 static Thread::RET_t THREAD_CC triangle_worker_thread_func(void* p)
 {
 	triangle_worker& tworker = v->tworker;
-	for (INT32 tnum = (INT32)(size_t)p; tworker.threads_active;)
+	const UINT32 tnum = (UINT32)(size_t)p, bands = tworker.bands;
+	for (UINT32 tail = 0;;)
 	{
-		tworker.sembegin[tnum].Wait();
-		if (tworker.threads_active)
-			triangle_worker_work(tworker, tnum, tnum + 1);
-		tworker.done[tnum] = true;
+		tworker.lock->Lock();
+		const UINT32 head = tworker.queue_published;
+		if (tail == head)
+		{
+			if (!tworker.threads_active) { tworker.lock->Unlock(); break; }
+			tworker.idle[tnum] = true;
+			tworker.lock->Unlock();
+			tworker.sembegin[tnum].Wait();
+			continue;
+		}
+		tworker.lock->Unlock();
+
+		stats_block my_stats = {0};
+		for (; tail != head; tail++)
+		{
+			const triangle_cmd& cmd = tworker.queue[tail & (TRIANGLE_QUEUE_SIZE - 1)];
+			if (cmd.workermask & (1 << tnum))
+				triangle_worker_draw(cmd.state, cmd.raster, cmd, tnum, bands, my_stats);
+		}
+		sum_statistics(&v->thread_stats[tnum], &my_stats);
+
+		tworker.lock->Lock();
+		tworker.done[tnum] = tail;
+		if (tworker.waiting) { tworker.waiting = false; tworker.semdone->Post(); }
+		tworker.lock->Unlock();
 	}
+	tworker.lock->Lock();
+	tworker.threads_running--;
+	if (tworker.waiting) { tworker.waiting = false; tworker.semdone->Post(); }
+	tworker.lock->Unlock();
 	return 0;
 }
 
-static void triangle_worker_shutdown(triangle_worker& tworker)
+static void triangle_worker_start(triangle_worker& tworker)
 {
-	if (!tworker.threads_active) return;
-	tworker.threads_active = false;
-	for (size_t i = 0; i != tworker.triangle_threads; i++) tworker.done[i] = false;
-	for (size_t i = 0; i != tworker.triangle_threads; i++) tworker.sembegin[i].Post();
-	recheckdone:
-	for (size_t i = 0; i != tworker.triangle_threads; i++) if (!tworker.done[i]) goto recheckdone;
-	delete [] tworker.sembegin;
+	tworker.threads_active = true;
+	tworker.threads_running = tworker.triangle_threads;
+	tworker.bands = (tworker.triangle_threads == 1 ? 2 : tworker.triangle_threads);
+	tworker.waiting = false;
+	tworker.queue_head = tworker.queue_published = tworker.queue_synced = 0;
+	memset(tworker.done, 0, sizeof(tworker.done));
+	memset(tworker.idle, 0, sizeof(tworker.idle));
+	if (tworker.states) for (UINT32 i = 0; i != TRIANGLE_STATE_COUNT; i++) tworker.states[i].queue_end = 0;
+	tworker.queue = new triangle_cmd[TRIANGLE_QUEUE_SIZE];
+	tworker.sembegin = new Semaphore[tworker.triangle_threads];
+	tworker.semdone = new Semaphore;
+	tworker.lock = new Mutex;
+	for (size_t i = 0; i != tworker.triangle_threads; i++) Thread::StartDetached(triangle_worker_thread_func, (void*)i);
 }
 
-static void triangle_worker_run(triangle_worker& tworker)
+// Wake up idle workers, each sembegin is posted only by the thread clearing the idle flag so it never gets posted twice
+static void triangle_worker_wake(triangle_worker& tworker)
 {
-	if (!(v_perf & V_PERFFLAG_MULTITHREAD))
-	{
-		// do not use threaded calculation
-		tworker.totalpix = 0xFFFFFFF;
-		triangle_worker_work(tworker, 0, 1);
-		return;
-	}
+	for (size_t i = 0; i != tworker.triangle_threads; i++)
+		if (tworker.idle[i]) { tworker.idle[i] = false; tworker.sembegin[i].Post(); }
+}
 
-	/* compute the slopes for each portion of the triangle */
-	poly_vertex v1 = tworker.v1, v2 = tworker.v2, v3 = tworker.v3;
-	float dxdy_v1v2 = (v2.y == v1.y) ? 0.0f : (v2.x - v1.x) / (v2.y - v1.y);
-	float dxdy_v1v3 = (v3.y == v1.y) ? 0.0f : (v3.x - v1.x) / (v3.y - v1.y);
-	float dxdy_v2v3 = (v3.y == v2.y) ? 0.0f : (v3.x - v2.x) / (v3.y - v2.y);
+// Make queued triangles visible to the workers without waiting for them
+static void triangle_worker_kick(triangle_worker& tworker)
+{
+	if (tworker.queue_published == tworker.queue_head) return;
+	tworker.lock->Lock();
+	tworker.queue_published = tworker.queue_head;
+	triangle_worker_wake(tworker);
+	tworker.lock->Unlock();
+}
 
-	INT32 pixsum = 0;
-	for (INT32 curscan = tworker.v1y, scanend = tworker.v3y; curscan != scanend; curscan++)
-	{
-		float fully = (float)(curscan) + 0.5f;
-		float startx = v1.x + (fully - v1.y) * dxdy_v1v3;
+// Block until all triangles queued before queue position upto have been drawn
+static void triangle_worker_sync(triangle_worker& tworker, UINT32 upto)
+{
+	if ((INT32)(upto - tworker.queue_synced) <= 0) return;
+	triangle_worker_kick(tworker);
 
-		/* compute the ending X based on which part of the triangle we're in */
-		float stopx = (fully < v2.y ? (v1.x + (fully - v1.y) * dxdy_v1v2) : (v2.x + (fully - v2.y) * dxdy_v2v3));
+	tworker.lock->Lock();
+	for (size_t i = 0; i != tworker.triangle_threads; i++)
+	{
+		while ((INT32)(upto - tworker.done[i]) > 0)
+		{
+			tworker.waiting = true;
+			tworker.lock->Unlock();
+			tworker.semdone->Wait();
+			tworker.lock->Lock();
+		}
+	}
+	tworker.lock->Unlock();
+	tworker.queue_synced = upto;
+}
 
-		/* clamp to full pixels */
-		INT32 istartx = round_coordinate(startx), istopx = round_coordinate(stopx);
+// Block until all queued triangles have been drawn, needs to be called before the frame buffer or the statistics get accessed
+static void triangle_worker_flush(triangle_worker& tworker)
+{
+	triangle_worker_sync(tworker, tworker.queue_head);
+}
 
-		/* force start < stop */
-		pixsum += (istartx > istopx ? istartx - istopx : istopx - istartx);
-	}
-	tworker.totalpix = pixsum;
+static void triangle_worker_shutdown(triangle_worker& tworker)
+{
+	if (!tworker.threads_active) return;
+	triangle_worker_flush(tworker);
 
-	// Don't wake up threads for just a few pixels
-	if (tworker.totalpix <= 350)
+	tworker.lock->Lock();
+	tworker.threads_active = false;
+	triangle_worker_wake(tworker);
+	while (tworker.threads_running)
 	{
-		triangle_worker_work(tworker, 0, tworker.triangle_threads + 1);
-		return;
+		tworker.waiting = true;
+		tworker.lock->Unlock();
+		tworker.semdone->Wait();
+		tworker.lock->Lock();
 	}
+	tworker.lock->Unlock();
+
+	delete [] tworker.queue;
+	delete [] tworker.sembegin;
+	delete tworker.semdone;
+	delete tworker.lock;
+}
 
-	if (!tworker.threads_active)
+// Get a snapshot of the render state for the triangle about to be queued, a new one is only taken after a register write changed the state
+static triangle_state* triangle_worker_state(voodoo_state *v, int texcount)
+{
+	triangle_worker& tworker = v->tworker;
+	if (tworker.state) return tworker.state;
+	if (!tworker.states) tworker.states = new triangle_state[TRIANGLE_STATE_COUNT]();
+
+	/* the slot gets reused once the workers are done with the last triangle that used it */
+	triangle_state& s = tworker.states[tworker.state_head++ & (TRIANGLE_STATE_COUNT - 1)];
+	triangle_worker_sync(tworker, s.queue_end);
+
+	memcpy(s.reg, v->reg, sizeof(s.reg));
+	s.fbi.ram = v->fbi.ram;
+	s.fbi.auxoffs = v->fbi.auxoffs;
+	s.fbi.yorigin = v->fbi.yorigin;
+	s.fbi.rowpixels = v->fbi.rowpixels;
+	memcpy(s.fbi.fogblend, v->fbi.fogblend, sizeof(s.fbi.fogblend));
+	memcpy(s.fbi.fogdelta, v->fbi.fogdelta, sizeof(s.fbi.fogdelta));
+	s.fbi.fogdelta_mask = v->fbi.fogdelta_mask;
+	for (int t = 0; t != MAX_TMU; t++)
 	{
-		tworker.threads_active = true;
-		tworker.sembegin = new Semaphore[tworker.triangle_threads];
-		for (size_t i = 0; i != tworker.triangle_threads; i++) Thread::StartDetached(triangle_worker_thread_func, (void*)i);
+		const tmu_state& tmu = v->tmu[t];
+		triangle_state::tmu_snapshot& st = s.tmu[t];
+		st.ram = tmu.ram; st.mask = tmu.mask;
+		st.lodmin = tmu.lodmin; st.lodmax = tmu.lodmax; st.lodbias = tmu.lodbias; st.lodmask = tmu.lodmask;
+		memcpy(st.lodoffset, tmu.lodoffset, sizeof(st.lodoffset));
+		st.detailmax = tmu.detailmax; st.detailbias = tmu.detailbias; st.detailscale = tmu.detailscale;
+		st.bilinear_mask = tmu.bilinear_mask; st.wmask = tmu.wmask; st.hmask = tmu.hmask;
+
+		/* palette and NCC tables get modified by register writes, the other lookup tables are constant */
+		st.lookup = tmu.lookup;
+		if (t < texcount && (tmu.lookup == tmu.palette || tmu.lookup == tmu.palettea || tmu.lookup == tmu.ncc[0].texel || tmu.lookup == tmu.ncc[1].texel))
+		{
+			memcpy(st.lookup_copy, tmu.lookup, sizeof(st.lookup_copy));
+			st.lookup = st.lookup_copy;
+		}
 	}
-
-	for (size_t i = 0; i != tworker.triangle_threads; i++) tworker.done[i] = false;
-	for (size_t i = 0; i != tworker.triangle_threads; i++) tworker.sembegin[i].Post();
-	triangle_worker_work(tworker, tworker.triangle_threads, tworker.triangle_threads + 1);
-	recheckdone:
-	for (size_t i = 0; i != tworker.triangle_threads; i++) if (!tworker.done[i]) goto recheckdone;
+	s.tmu_config = v->tmu_config;
+	s.send_config = v->send_config;
+	return (tworker.state = &s);
 }
 
 /*-------------------------------------------------
@@ -6280,12 +6816,79 @@ static void triangle(voodoo_state *v)
 			prepare_tmu(&v->tmu[1]);
 	}
 
+	/* in multi threaded mode the triangle is queued and drawn by the worker threads owning the touched tile bands */
 	triangle_worker& tworker = v->tworker;
-	tworker.v1 = *v1, tworker.v2 = *v2, tworker.v3 = *v3;
-	tworker.drawbuf = drawbuf;
-	tworker.v1y = v1y;
-	tworker.v3y = v3y;
-	triangle_worker_run(tworker);
+	const bool deferred = ((v_perf & V_PERFFLAG_MULTITHREAD) && tworker.triangle_threads);
+	if (!deferred)
+		triangle_worker_flush(tworker);
+	else if (!tworker.threads_active)
+		triangle_worker_start(tworker);
+	else if (tworker.queue_head - tworker.queue_synced == TRIANGLE_QUEUE_SIZE)
+		triangle_worker_sync(tworker, tworker.queue_head - TRIANGLE_QUEUE_SIZE / 2);
+
+	triangle_cmd direct_cmd, &cmd = (deferred ? tworker.queue[tworker.queue_head & (TRIANGLE_QUEUE_SIZE - 1)] : direct_cmd);
+	if (deferred)
+	{
+		/* bin the triangle into the tile bands it covers */
+		const UINT32 bands = tworker.bands;
+		const INT32 band_first = (v1y >> TRIANGLE_TILE_SHIFT), band_last = ((v3y - 1) >> TRIANGLE_TILE_SHIFT);
+		cmd.workermask = 0;
+		if ((UINT32)(band_last - band_first) >= bands - 1)
+			cmd.workermask = (1 << bands) - 1;
+		else for (INT32 band = band_first; band <= band_last; band++)
+			cmd.workermask |= 1 << ((UINT32)band % bands);
+	}
+
+	cmd.v1 = *v1, cmd.v2 = *v2, cmd.v3 = *v3;
+	cmd.v1y = v1y;
+	cmd.v3y = v3y;
+	cmd.drawbuf = drawbuf;
+	cmd.tmus = texcount;
+	cmd.texmode0 = (texcount >= 1 ? v->tmu[0].reg[textureMode].u : 0);
+	cmd.texmode1 = (texcount >= 2 ? v->tmu[1].reg[textureMode].u : 0);
+	if (v_perf & V_PERFFLAG_LOWQUALITY) //force disable bilinear filter
+	{
+		cmd.texmode0 &= ~6;
+		cmd.texmode1 &= ~6;
+	}
+
+	/* pick the rasterizer for the current pipeline configuration */
+	raster_info *info = find_rasterizer(cmd.tmus, v->reg[fbzColorPath].u, v->reg[alphaMode].u, v->reg[fogMode].u, v->reg[fbzMode].u, cmd.texmode0, cmd.texmode1);
+	cmd.raster = info->callback;
+	info->hits++;
+
+	/* queued triangles reference a snapshot of the render state, drawing right away reads the live state */
+	/* then copy the iterated parameters */
+	triangle_state* state = (deferred ? triangle_worker_state(v, texcount) : NULL);
+	cmd.state = state;
+	triangle_iter& it = cmd.iter;
+	const fbi_state& fbi = v->fbi;
+	it.ax = fbi.ax; it.ay = fbi.ay;
+	it.startr = fbi.startr; it.startg = fbi.startg; it.startb = fbi.startb; it.starta = fbi.starta; it.startz = fbi.startz; it.startw = fbi.startw;
+	it.drdx = fbi.drdx; it.dgdx = fbi.dgdx; it.dbdx = fbi.dbdx; it.dadx = fbi.dadx; it.dzdx = fbi.dzdx; it.dwdx = fbi.dwdx;
+	it.drdy = fbi.drdy; it.dgdy = fbi.dgdy; it.dbdy = fbi.dbdy; it.dady = fbi.dady; it.dzdy = fbi.dzdy; it.dwdy = fbi.dwdy;
+	for (int t = 0; t != texcount; t++)
+	{
+		const tmu_state& tmu = v->tmu[t];
+		triangle_iter::tmu_iter& tit = it.tmu[t];
+		tit.starts = tmu.starts; tit.startt = tmu.startt; tit.startw = tmu.startw;
+		tit.dsdx = tmu.dsdx; tit.dtdx = tmu.dtdx; tit.dwdx = tmu.dwdx;
+		tit.dsdy = tmu.dsdy; tit.dtdy = tmu.dtdy; tit.dwdy = tmu.dwdy;
+		tit.lodbasetemp = tmu.lodbasetemp;
+	}
+
+	if (!deferred)
+		triangle_worker_draw(v, info->callback_direct, cmd, 0, 1, v->thread_stats[0]);
+	else
+	{
+		/* with a single worker the emulation thread draws its own share of the tile bands right away */
+		const UINT32 self = tworker.triangle_threads;
+		if (self < tworker.bands && (cmd.workermask & (1 << self)))
+			triangle_worker_draw(cmd.state, cmd.raster, cmd, self, tworker.bands, v->thread_stats[self]);
+		state->queue_end = ++tworker.queue_head;
+		if (tworker.queue_head - tworker.queue_published >= TRIANGLE_QUEUE_KICK)
+			triangle_worker_kick(tworker);
+	}
 
 	/* update stats */
 	v->reg[fbiTrianglesOut].u++;
@@ -6673,6 +7276,10 @@ static void register_w(UINT32 offset, UINT32 data) {
 		return;
 	}
 
+	/* queued triangles copy their iterated parameters, anything else used by the rasterizer is in the render state snapshot */
+	if ((regnum < vertexAx || regnum > ftriangleCMD) && (regnum < sSetupMode || regnum > sBeginTriCMD))
+		v->tworker.state = NULL;
+
 	/* switch off the register */
 	switch (regnum)
 	{
@@ -6955,16 +7562,21 @@ static void register_w(UINT32 offset, UINT32 data) {
 		/* other commands */
 		case nopCMD:
 			if (data & 1)
+			{
+				triangle_worker_flush(v->tworker);
 				reset_counters(v);
+			}
 			if (data & 2)
 				v->reg[fbiTrianglesOut].u = 0;
 			break;
 
 		case fastfillCMD:
+			triangle_worker_flush(v->tworker);
 			fastfill(v);
 			break;
 
 		case swapbufferCMD:
+			triangle_worker_flush(v->tworker);
 			swapbuffer(v, data);
 			break;
 
@@ -7109,7 +7721,10 @@ static void register_w(UINT32 offset, UINT32 data) {
 
 				v->reg[fbiInit0].u = data;
 				if (FBIINIT0_GRAPHICS_RESET(data))
+				{
+					triangle_worker_flush(v->tworker);
 					soft_reset(v);
+				}
 				recompute_video_memory(v);
 			}
 			break;
@@ -8115,6 +8730,7 @@ static UINT32 register_r(UINT32 offset)
 		case fbiZfuncFail:
 		case fbiAfuncFail:
 		case fbiPixelsOut:
+			triangle_worker_flush(v->tworker);
 			update_statistics(v, true);
 		case fbiTrianglesOut:
 			result = v->reg[regnum].u & 0xffffff;
@@ -8205,16 +8821,16 @@ static void voodoo_w(UINT32 offset, UINT32 data, UINT32 mask) {
 	if ((offset & (0xc00000/4)) == 0)
 		register_w(offset, data);
 	else if ((offset & (0x800000/4)) == 0)
-		lfb_w(offset, data, mask);
+		{ triangle_worker_flush(v->tworker); lfb_w(offset, data, mask); }
 	else
-		texture_w(offset, data);
+		{ triangle_worker_flush(v->tworker); texture_w(offset, data); }
 }
 
 static UINT32 voodoo_r(UINT32 offset) {
 	if ((offset & (0xc00000/4)) == 0)
 		return register_r(offset);
 	else if ((offset & (0x800000/4)) == 0)
-		return lfb_r(offset);
+		{ triangle_worker_flush(v->tworker); return lfb_r(offset); }
 
 	return 0xffffffff;
 }
@@ -8231,6 +8847,7 @@ static UINT32 voodoo_r(UINT32 offset) {
 static void voodoo_init(UINT8 type) {
 	DBP_ASSERT(!v);
 	v = new voodoo_state;
+	init_rasterizers();
 
 	v->active = false;
 
@@ -8300,6 +8917,10 @@ static void voodoo_init(UINT8 type) {
 			sse2_scale_table[i][1] = sse2_scale_table[i][3] = sse2_scale_table[i][5] = sse2_scale_table[i][7] = 256-i;
 		}
 		#endif
+
+		bilinear_filter4_verified = check_bilinear_filter();
+		DBP_ASSERT(bilinear_filter4_verified);
+		if (!bilinear_filter4_verified) LOG(LOG_VOODOO,LOG_WARN)("VOODOO: 4 pixel bilinear filter mismatch, filtering pixels one by one\n");
 	}
 
 	v->tmu_config = 0x11;	// revision 1
@@ -8410,6 +9031,9 @@ static void voodoo_init(UINT8 type) {
 
 static void voodoo_shutdown() {
 	if (v!=NULL) {
+		triangle_worker_shutdown(v->tworker);
+		delete [] v->tworker.states;
+		if (LOG_RASTERIZERS) dump_rasterizer_stats();
 		free(v->fbi.ram);
 		if (v->tmu[0].ram != NULL) {
 			free(v->tmu[0].ram);
@@ -8420,7 +9044,6 @@ static void voodoo_shutdown() {
 			v->tmu[1].ram = NULL;
 		}
 		v->active = false;
-		triangle_worker_shutdown(v->tworker);
 		delete v;
 		v = NULL;
 	}
@@ -8452,6 +9075,7 @@ static void voodoo_activate(void) {
 static void Voodoo_VerticalTimer(Bitu /*val*/) {
 	v->draw.frame_start = PIC_FullIndex();
 	PIC_AddEvent( Voodoo_VerticalTimer, v->draw.vfreq );
+	triangle_worker_kick(v->tworker);
 
 	if (v->resolution_dirty)
 	{
@@ -8487,6 +9111,10 @@ static void Voodoo_VerticalTimer(Bitu /*val*/) {
 			v->clutDirty = false;
 		}
 
+		// queued triangles only need to be finished first when they are drawn directly into the front buffer
+		if (FBZMODE_DRAW_BUFFER(v->reg[fbzMode].u) == 0)
+			triangle_worker_flush(v->tworker);
+
 		// draw all lines with clut lookups
 		const Bit16u *viewbuf = (Bit16u *)(v->fbi.ram + v->fbi.rgboffs[v->fbi.frontbuf]);
 		for (Bitu i = 0, w = v->fbi.width; i < v->fbi.height; i++)
@@ -8550,6 +9178,7 @@ static double Voodoo_GetHRetracePosition() {
 static void Voodoo_UpdateScreen(void) {
 	// abort drawing
 	RENDER_EndUpdate(true);
+	triangle_worker_flush(v->tworker);
 
 	if ((!v->clock_enabled || !v->output_on) && v->draw.override_on) {
 		// switching off
@@ -8919,6 +9548,7 @@ void DBPSerialize_Voodoo(DBPArchive& ar)
 {
 	UINT8 myvtype = (v ? v->type : (UINT8)-1), vtype = myvtype;
 	ar.Serialize(vtype).Serialize(voodoo_current_lfb);
+	if (v) { triangle_worker_flush(v->tworker); v->tworker.state = NULL; }
 
 	if (ar.mode == DBPArchive::MODE_LOAD && vtype != myvtype)
 	{
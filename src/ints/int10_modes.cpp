@@ -476,6 +476,7 @@ static void FinishSetMode(bool clearmem) {
 			/* Hack we just access the memory directly */
 			memset(vga.mem.linear,0,vga.vmemsize);
 			memset(vga.fastmem, 0, vga.vmemsize<<1);
+			VGA_MarkAllPagesDirty();
 		}
 	}
 	/* Setup the BIOS */
@@ -0,0 +1,208 @@
+/*
+ *  Copyright (C) 2002-2021  The DOSBox Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+/*
+	Standalone microbenchmark for DMA_BlockRead/DMA_BlockWrite in src/hardware/dma.cpp.
+	It is not part of the core build, compile and run it with:
+		g++ -O2 -o dma_span_bench tools/dma_span_bench.cpp && ./dma_span_bench
+
+	The byte functions are the ones from before the span change (a page remap and a
+	phys_readb/phys_writeb per byte), the span functions are the current ones. Both
+	are first compared over random transfers (8 and 16 bit, wrap limit hits, the EMS
+	page frame), then the read side is timed with the pattern of a SB16 playing
+	10 minutes of 44.1kHz stereo 16-bit audio through a 4096 word auto-init buffer
+	that the mixer reads in 256 word chunks.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+typedef uint8_t Bit8u;
+typedef uint32_t Bit32u;
+typedef uintptr_t Bitu;
+typedef Bit32u PhysPt;
+typedef Bit8u * HostPt;
+#define INLINE inline
+
+#define LINK_START	((1024+64)/4)
+#define EMM_PAGEFRAME4K	((0xE000*16)/4096)
+#define MEMORY_SIZE	(32*1024*1024)
+
+static struct { Bitu firstmb[LINK_START]; } paging;
+static Bit32u ems_board_mapping[LINK_START];
+static HostPt MemBase;
+static Bit32u dma_wrapping = 0xffff;
+static Bitu wrap_logs; // counts the segbound wrapping messages instead of printing them
+
+static INLINE Bit8u phys_readb(PhysPt addr) { return MemBase[addr]; }
+static INLINE void phys_writeb(PhysPt addr,Bit8u val) { MemBase[addr]=val; }
+
+/* byte by byte, as before */
+static void Byte_BlockRead(PhysPt spage,PhysPt offset,void * data,Bitu size,Bit8u dma16) {
+	Bit8u * write=(Bit8u *) data;
+	Bitu highpart_addr_page = spage>>12;
+	size <<= dma16;
+	offset <<= dma16;
+	Bit32u dma_wrap = ((0xffff<<dma16)+dma16) | dma_wrapping;
+	for ( ; size ; size--, offset++) {
+		if (offset>(dma_wrapping<<dma16)) wrap_logs++;
+		offset &= dma_wrap;
+		Bitu page = highpart_addr_page+(offset >> 12);
+		/* care for EMS pageframe etc. */
+		if (page < EMM_PAGEFRAME4K) page = paging.firstmb[page];
+		else if (page < EMM_PAGEFRAME4K+0x10) page = ems_board_mapping[page];
+		else if (page < LINK_START) page = paging.firstmb[page];
+		*write++=phys_readb(page*4096 + (offset & 4095));
+	}
+}
+
+static void Byte_BlockWrite(PhysPt spage,PhysPt offset,void * data,Bitu size,Bit8u dma16) {
+	Bit8u * read=(Bit8u *) data;
+	Bitu highpart_addr_page = spage>>12;
+	size <<= dma16;
+	offset <<= dma16;
+	Bit32u dma_wrap = ((0xffff<<dma16)+dma16) | dma_wrapping;
+	for ( ; size ; size--, offset++) {
+		if (offset>(dma_wrapping<<dma16)) wrap_logs++;
+		offset &= dma_wrap;
+		Bitu page = highpart_addr_page+(offset >> 12);
+		/* care for EMS pageframe etc. */
+		if (page < EMM_PAGEFRAME4K) page = paging.firstmb[page];
+		else if (page < EMM_PAGEFRAME4K+0x10) page = ems_board_mapping[page];
+		else if (page < LINK_START) page = paging.firstmb[page];
+		phys_writeb(page*4096 + (offset & 4095), *read++);
+	}
+}
+
+/* page spans, as in dma.cpp now (without the dirty page tracking) */
+static INLINE Bitu DMA_GetPhysPage(Bitu highpart_addr_page,PhysPt offset) {
+	Bitu page = highpart_addr_page+(offset >> 12);
+	if (page < EMM_PAGEFRAME4K) page = paging.firstmb[page];
+	else if (page < EMM_PAGEFRAME4K+0x10) page = ems_board_mapping[page];
+	else if (page < LINK_START) page = paging.firstmb[page];
+	return page;
+}
+
+static INLINE HostPt DMA_GetHostPt(Bitu highpart_addr_page,PhysPt offset) {
+	return MemBase + DMA_GetPhysPage(highpart_addr_page,offset)*4096 + (offset & 4095);
+}
+
+static INLINE Bitu DMA_SpanSize(PhysPt offset,Bitu size,Bit32u wrap_limit) {
+	Bitu run = 4096 - (offset & 4095);
+	if (run > size) run = size;
+	if (offset <= wrap_limit && wrap_limit - offset < run - 1) run = wrap_limit - offset + 1;
+	return run;
+}
+
+static void Span_BlockRead(PhysPt spage,PhysPt offset,void * data,Bitu size,Bit8u dma16) {
+	Bit8u * write=(Bit8u *) data;
+	Bitu highpart_addr_page = spage>>12;
+	size <<= dma16;
+	offset <<= dma16;
+	Bit32u dma_wrap = ((0xffff<<dma16)+dma16) | dma_wrapping;
+	Bit32u wrap_limit = (dma_wrapping<<dma16);
+	while (size) {
+		if (offset>wrap_limit) wrap_logs++;
+		offset &= dma_wrap;
+		Bitu run = DMA_SpanSize(offset,size,wrap_limit);
+		memcpy(write,DMA_GetHostPt(highpart_addr_page,offset),run);
+		write+=run;
+		offset+=(PhysPt)run;
+		size-=run;
+	}
+}
+
+static void Span_BlockWrite(PhysPt spage,PhysPt offset,void * data,Bitu size,Bit8u dma16) {
+	Bit8u * read=(Bit8u *) data;
+	Bitu highpart_addr_page = spage>>12;
+	size <<= dma16;
+	offset <<= dma16;
+	Bit32u dma_wrap = ((0xffff<<dma16)+dma16) | dma_wrapping;
+	Bit32u wrap_limit = (dma_wrapping<<dma16);
+	while (size) {
+		if (offset>wrap_limit) wrap_logs++;
+		offset &= dma_wrap;
+		Bitu run = DMA_SpanSize(offset,size,wrap_limit);
+		memcpy(DMA_GetHostPt(highpart_addr_page,offset),read,run);
+		read+=run;
+		offset+=(PhysPt)run;
+		size-=run;
+	}
+}
+
+static double Now() {
+	timespec t;
+	clock_gettime(CLOCK_MONOTONIC,&t);
+	return t.tv_sec+t.tv_nsec/1e9;
+}
+
+int main() {
+	MemBase = (HostPt)malloc(MEMORY_SIZE);
+	for (Bitu i=0;i!=LINK_START;i++) paging.firstmb[i] = ems_board_mapping[i] = i;
+	ems_board_mapping[EMM_PAGEFRAME4K+3] = 0x300; // a remapped EMS page
+
+	// same data and same number of wrap messages for random transfers
+	static Bit8u data_byte[0x40000], data_span[0x40000];
+	srand(1);
+	for (int it=0;it!=200000;it++) {
+		Bit8u dma16 = (Bit8u)(rand()&1);
+		dma_wrapping = ((rand()%8) ? 0xffff : 0xffffffff);
+		PhysPt spage = (PhysPt)(rand()%256)<<16;
+		PhysPt offset = (PhysPt)((rand()%4) ? rand() : 0xffff - rand()%8) & 0xffff;
+		Bitu size = (Bitu)(rand()%((rand()%4) ? 70000 : 40)) + 1;
+		if (spage + (70000<<2) >= MEMORY_SIZE) continue;
+		bool write = ((it&1) != 0);
+		for (Bitu i=0;i!=MEMORY_SIZE;i+=4096) MemBase[i] = (Bit8u)i; // a few bytes that change per pass
+		Bitu logs0 = wrap_logs;
+		if (write) {
+			for (Bitu i=0;i!=(size<<dma16);i++) data_byte[i] = (Bit8u)(i*7+it);
+			Byte_BlockWrite(spage,offset,data_byte,size,dma16);
+			Byte_BlockRead(spage,offset,data_byte,size,dma16);
+		} else Byte_BlockRead(spage,offset,data_byte,size,dma16);
+		Bitu logs1 = wrap_logs;
+		if (write) {
+			for (Bitu i=0;i!=(size<<dma16);i++) data_span[i] = (Bit8u)(i*7+it);
+			Span_BlockWrite(spage,offset,data_span,size,dma16);
+			Span_BlockRead(spage,offset,data_span,size,dma16);
+		} else Span_BlockRead(spage,offset,data_span,size,dma16);
+		if (memcmp(data_byte,data_span,size<<dma16) || wrap_logs-logs1 != logs1-logs0) {
+			printf("Mismatch in transfer %d\n",it);
+			return 1;
+		}
+	}
+	printf("200000 random transfers identical (%u wrap messages)\n",(unsigned)wrap_logs);
+
+	// SB16 16-bit auto-init playback
+	dma_wrapping = 0xffff;
+	for (Bitu i=0;i!=MEMORY_SIZE;i++) MemBase[i] = (Bit8u)(i*2654435761u>>13);
+	for (int pass=0;pass!=2;pass++) {
+		double start = Now();
+		Bit8u chunk[256*2];
+		Bitu addr = 0, sum = 0;
+		for (long n=0;n!=44100L*2*600/256;n++) {
+			(pass ? Span_BlockRead : Byte_BlockRead)(0x40000,(PhysPt)addr,chunk,256,1);
+			sum += chunk[17];
+			addr = (addr + 256) & 4095;
+		}
+		printf("%s: %.3fs (checksum %u)\n",(pass ? "span" : "byte"),Now()-start,(unsigned)sum);
+	}
+	return 0;
+}
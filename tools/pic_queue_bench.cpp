@@ -0,0 +1,371 @@
+/*
+ *  Copyright (C) 2002-2021  The DOSBox Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+/*
+	Standalone replay harness for the PIC event queue in src/hardware/pic.cpp.
+	It is not part of the core build, compile and run it with:
+		g++ -O2 -o pic_queue_bench tools/pic_queue_bench.cpp && ./pic_queue_bench
+
+	A trace of two million add, remove, run and tick operations is generated
+	with the sorted list the queue used before, then replayed on
+	- the sorted list (reference run order and time)
+	- the heap with TIMER_AddTick sorting only when lowering the indices could
+	  make two of them equal (as in pic.cpp now)
+	- the heap sorting on every tick (as in the first heap version)
+	Every run event is hashed in order, all three must produce the same hash.
+	Events are scheduled up to depth/8 ms ahead, some on a 0.25ms grid and some
+	up to three float steps after a 0.125ms grid point within the next ms to get
+	equal and nearly equal indices. Time advances
+	in random steps, a tick happens when it passes 1.0. In a few milliseconds
+	the queue only runs up to 0.3 so the tick finds overdue events, which is the
+	case where lowering the indices can round two of them together.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <algorithm>
+#include <vector>
+
+typedef uint32_t Bit32u;
+typedef uintptr_t Bitu;
+#define INLINE inline
+#define GCC_UNLIKELY(x) (x)
+#define PIC_QUEUESIZE 512
+
+enum { OP_ADD, OP_REMOVE_SPECIFIC, OP_REMOVE, OP_RUN, OP_TICK };
+struct Op { Bit32u type, handler, value; float time; };
+static std::vector<Op> trace;
+static Bit32u events_run;
+static Bitu run_hash;
+
+static INLINE void RunEvent(Bitu handler, Bitu value, float index) {
+	Bit32u index_bits;
+	memcpy(&index_bits,&index,4);
+	run_hash = (run_hash ^ (handler*16 + value)) * 1099511628211ULL;
+	run_hash = (run_hash ^ index_bits) * 1099511628211ULL;
+	events_run++;
+}
+
+/* the sorted list from before the heap change */
+namespace List {
+	struct PICEntry {
+		float index;
+		Bitu value;
+		Bitu pic_event;
+		PICEntry * next;
+	};
+	static struct {
+		PICEntry entries[PIC_QUEUESIZE];
+		PICEntry * free_entry;
+		PICEntry * next_entry;
+		Bitu count;
+	} pic_queue;
+
+	static void Init() {
+		for (Bitu i=0;i<PIC_QUEUESIZE-1;i++) pic_queue.entries[i].next=&pic_queue.entries[i+1];
+		pic_queue.entries[PIC_QUEUESIZE-1].next=0;
+		pic_queue.free_entry=&pic_queue.entries[0];
+		pic_queue.next_entry=0;
+		pic_queue.count=0;
+	}
+
+	static void AddEvent(Bitu handler, float index, Bitu val) {
+		PICEntry * entry=pic_queue.free_entry;
+		pic_queue.free_entry=pic_queue.free_entry->next;
+		entry->index=index;
+		entry->pic_event=handler;
+		entry->value=val;
+		pic_queue.count++;
+		PICEntry * find_entry=pic_queue.next_entry;
+		if (GCC_UNLIKELY(find_entry ==0)) {
+			entry->next=0;
+			pic_queue.next_entry=entry;
+		} else if (find_entry->index>entry->index) {
+			pic_queue.next_entry=entry;
+			entry->next=find_entry;
+		} else while (find_entry) {
+			if (find_entry->next) {
+				/* See if the next index comes later than this one */
+				if (find_entry->next->index > entry->index) {
+					entry->next=find_entry->next;
+					find_entry->next=entry;
+					break;
+				} else {
+					find_entry=find_entry->next;
+				}
+			} else {
+				entry->next=find_entry->next;
+				find_entry->next=entry;
+				break;
+			}
+		}
+	}
+
+	static void RemoveEvents(Bitu handler, bool check_val, Bitu val) {
+		PICEntry * entry=pic_queue.next_entry;
+		PICEntry * prev_entry=0;
+		while (entry) {
+			if (GCC_UNLIKELY(entry->pic_event==handler) && (!check_val || entry->value==val)) {
+				PICEntry * next=entry->next;
+				if (prev_entry) prev_entry->next=next;
+				else pic_queue.next_entry=next;
+				entry->next=pic_queue.free_entry;
+				pic_queue.free_entry=entry;
+				pic_queue.count--;
+				entry=next;
+				continue;
+			}
+			prev_entry=entry;
+			entry=entry->next;
+		}
+	}
+
+	static void RunQueue(float time) {
+		while (pic_queue.next_entry && pic_queue.next_entry->index<=time) {
+			PICEntry * entry=pic_queue.next_entry;
+			pic_queue.next_entry=entry->next;
+			RunEvent(entry->pic_event,entry->value,entry->index);
+			entry->next=pic_queue.free_entry;
+			pic_queue.free_entry=entry;
+			pic_queue.count--;
+		}
+	}
+
+	static void AddTick() {
+		for (PICEntry * entry=pic_queue.next_entry;entry;entry=entry->next) entry->index -= 1.0;
+	}
+}
+
+/* the heap as in pic.cpp */
+namespace Heap {
+	struct PICEntry {
+		float index;
+		Bitu value;
+		Bitu pic_event;
+		Bit32u order; // events with the same index run in the order they were added
+		PICEntry * next; // only used in free list
+	};
+	static struct {
+		PICEntry entries[PIC_QUEUESIZE];
+		PICEntry * heap[PIC_QUEUESIZE];
+		Bitu count;
+		Bit32u order;
+		PICEntry * free_entry;
+	} pic_queue;
+	static bool sort_every_tick;
+	static Bitu sorts;
+
+	static INLINE bool PIC_EntryBefore(const PICEntry* a, const PICEntry* b) {
+		return (a->index < b->index || (a->index == b->index && a->order < b->order));
+	}
+
+	static void PIC_HeapSiftUp(Bitu pos) {
+		PICEntry * entry=pic_queue.heap[pos];
+		while (pos) {
+			Bitu parent=(pos-1)>>1;
+			if (!PIC_EntryBefore(entry,pic_queue.heap[parent])) break;
+			pic_queue.heap[pos]=pic_queue.heap[parent];
+			pos=parent;
+		}
+		pic_queue.heap[pos]=entry;
+	}
+
+	static void PIC_HeapSiftDown(Bitu pos) {
+		PICEntry * entry=pic_queue.heap[pos];
+		for (Bitu child;(child=pos*2+1)<pic_queue.count;pos=child) {
+			if (child+1<pic_queue.count && PIC_EntryBefore(pic_queue.heap[child+1],pic_queue.heap[child])) child++;
+			if (!PIC_EntryBefore(pic_queue.heap[child],entry)) break;
+			pic_queue.heap[pos]=pic_queue.heap[child];
+		}
+		pic_queue.heap[pos]=entry;
+	}
+
+	static void PIC_HeapRemoveFirst() {
+		PICEntry * entry=pic_queue.heap[0];
+		entry->next=pic_queue.free_entry;
+		pic_queue.free_entry=entry;
+		if (!--pic_queue.count) return;
+		pic_queue.heap[0]=pic_queue.heap[pic_queue.count];
+		PIC_HeapSiftDown(0);
+	}
+
+	static void PIC_HeapRemoveEvents(Bitu handler, bool check_val, Bitu val) {
+		Bitu count=0;
+		for (Bitu i=0;i!=pic_queue.count;i++) {
+			PICEntry * entry=pic_queue.heap[i];
+			if (GCC_UNLIKELY(entry->pic_event==handler) && (!check_val || entry->value==val)) {
+				entry->next=pic_queue.free_entry;
+				pic_queue.free_entry=entry;
+			} else pic_queue.heap[count++]=entry;
+		}
+		if (count==pic_queue.count) return;
+		pic_queue.count=count;
+		for (Bitu i=count/2;i--;) PIC_HeapSiftDown(i);
+	}
+
+	static void PIC_HeapSort() {
+		std::sort(pic_queue.heap,pic_queue.heap+pic_queue.count,PIC_EntryBefore);
+		for (Bitu i=0;i!=pic_queue.count;i++) pic_queue.heap[i]->order=(Bit32u)i;
+		pic_queue.order=(Bit32u)pic_queue.count;
+		sorts++;
+	}
+
+	static void Init() {
+		for (Bitu i=0;i<PIC_QUEUESIZE-1;i++) pic_queue.entries[i].next=&pic_queue.entries[i+1];
+		pic_queue.entries[PIC_QUEUESIZE-1].next=0;
+		pic_queue.free_entry=&pic_queue.entries[0];
+		pic_queue.count=0;
+		pic_queue.order=0;
+		sorts=0;
+	}
+
+	static void AddEvent(Bitu handler, float index, Bitu val) {
+		PICEntry * entry=pic_queue.free_entry;
+		pic_queue.free_entry=pic_queue.free_entry->next;
+		entry->index=index;
+		entry->pic_event=handler;
+		entry->value=val;
+		entry->order=pic_queue.order++;
+		pic_queue.heap[pic_queue.count]=entry;
+		PIC_HeapSiftUp(pic_queue.count++);
+	}
+
+	static void RunQueue(float time) {
+		while (pic_queue.count && pic_queue.heap[0]->index<=time) {
+			PICEntry * entry=pic_queue.heap[0];
+			RunEvent(entry->pic_event,entry->value,entry->index);
+			PIC_HeapRemoveFirst();
+		}
+	}
+
+	static void AddTick() {
+		bool sort=(sort_every_tick || pic_queue.order>=0x80000000);
+		for (Bitu i=0;i!=pic_queue.count && !sort;i++) {
+			sort=(pic_queue.heap[i]->index<0.5f || pic_queue.heap[i]->index>=16777216.0f);
+		}
+		if (sort) PIC_HeapSort();
+		for (Bitu i=0;i!=pic_queue.count;i++) {
+			pic_queue.heap[i]->index -= 1.0;
+		}
+	}
+}
+
+static Bit32u rnd_state;
+static Bit32u Rnd(Bit32u range) {
+	rnd_state = rnd_state*1103515245 + 12345;
+	return (rnd_state>>8)%range;
+}
+
+static void MakeTrace(Bitu depth) {
+	// the list decides which operations are possible (queue not full, events to run)
+	trace.clear();
+	List::Init();
+	rnd_state = 1;
+	float now = 0, horizon = (float)(depth/8);
+	bool late = false;
+	while (trace.size()!=2000000) {
+		Op op = { OP_ADD, Rnd(8), Rnd(4), 0 };
+		Bit32u r = Rnd(100);
+		if (r < 45) {
+			if (List::pic_queue.count >= depth) continue;
+			Bit32u kind = Rnd(4);
+			float delay = (kind == 0 ? (float)(1+Rnd((Bit32u)horizon*4))*0.25f : (float)(1+Rnd(100000))*horizon/100000.0f);
+			op.time = now + delay;
+			if (kind == 1) { // up to three float steps after a grid point within the next millisecond
+				op.time = (float)(int)((now+(float)Rnd(1000)/1000.0f)*8+1)*0.125f;
+				for (Bit32u steps = Rnd(4); steps--;) op.time = nextafterf(op.time,2*op.time);
+			}
+			List::AddEvent(op.handler,op.time,op.value);
+		} else if (r < 50) {
+			op.type = OP_REMOVE_SPECIFIC;
+			List::RemoveEvents(op.handler,true,op.value);
+		} else if (r < 51) {
+			op.type = OP_REMOVE;
+			List::RemoveEvents(op.handler,false,0);
+		} else {
+			now += (float)(1+Rnd(1000))/10000.0f;
+			if (now >= 1.0f) {
+				// most ticks happen after all events of the millisecond ran, a few are late
+				if (!late) {
+					op.type = OP_RUN;
+					op.time = 1.0f;
+					List::RunQueue(op.time);
+					trace.push_back(op);
+				}
+				op.type = OP_TICK;
+				List::AddTick();
+				now -= 1.0f;
+				late = (Rnd(100) == 0);
+			} else {
+				op.type = OP_RUN;
+				op.time = (late && now > 0.3f ? 0.3f : now);
+				List::RunQueue(op.time);
+			}
+		}
+		trace.push_back(op);
+	}
+}
+
+template <class QUEUE_INIT, class QUEUE_ADD, class QUEUE_REMOVE, class QUEUE_RUN, class QUEUE_TICK>
+static double Replay(QUEUE_INIT init, QUEUE_ADD add, QUEUE_REMOVE remove, QUEUE_RUN run, QUEUE_TICK tick) {
+	init();
+	events_run = 0;
+	run_hash = 1469598103934665603ULL;
+	timespec t0, t1;
+	clock_gettime(CLOCK_MONOTONIC,&t0);
+	for (std::vector<Op>::const_iterator it = trace.begin(); it != trace.end(); ++it) {
+		switch (it->type) {
+			case OP_ADD: add(it->handler,it->time,it->value); break;
+			case OP_REMOVE_SPECIFIC: remove(it->handler,true,it->value); break;
+			case OP_REMOVE: remove(it->handler,false,0); break;
+			case OP_RUN: run(it->time); break;
+			case OP_TICK: tick(); break;
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC,&t1);
+	return (t1.tv_sec-t0.tv_sec)+(t1.tv_nsec-t0.tv_nsec)/1e9;
+}
+
+int main() {
+	static const Bitu depths[] = { 16, 64, 400 };
+	bool identical = true;
+	for (Bitu d=0;d!=sizeof(depths)/sizeof(depths[0]);d++) {
+		MakeTrace(depths[d]);
+		Bitu ticks = 0;
+		for (std::vector<Op>::const_iterator it = trace.begin(); it != trace.end(); ++it) ticks += (it->type == OP_TICK);
+		double time_list = Replay(List::Init,List::AddEvent,List::RemoveEvents,List::RunQueue,List::AddTick);
+		Bitu hash_list = run_hash; Bit32u run_list = events_run;
+		Heap::sort_every_tick = false;
+		double time_heap = Replay(Heap::Init,Heap::AddEvent,Heap::PIC_HeapRemoveEvents,Heap::RunQueue,Heap::AddTick);
+		Bitu hash_heap = run_hash, sorts_heap = Heap::sorts;
+		Heap::sort_every_tick = true;
+		double time_sort = Replay(Heap::Init,Heap::AddEvent,Heap::PIC_HeapRemoveEvents,Heap::RunQueue,Heap::AddTick);
+		Bitu hash_sort = run_hash;
+		bool same = (hash_list == hash_heap && hash_list == hash_sort);
+		identical &= same;
+		printf("Up to %3u events, %u operations, %u ticks, %u events run, run order %s\n",
+			(unsigned)depths[d],(unsigned)trace.size(),(unsigned)ticks,(unsigned)run_list,(same ? "identical" : "DIFFERENT"));
+		printf("    list: %.3fs, heap: %.3fs (%u sorts), heap sorting every tick: %.3fs\n",
+			time_list,time_heap,(unsigned)sorts_heap,time_sort);
+	}
+	return (identical ? 0 : 1);
+}